@@ -1,11 +1,53 @@
 #include "../../graphics/src/engine/engine.h"
 
+#include <cstdlib>
+#include <cstring>
+
 #define SDL_main main
 
 //main entry point
 int main(int argc, char* argv[]){
+    // packs the images of a directory into an atlas and exits without a window
+    if (argc == 4 && strcmp(argv[1], "--pack-atlas") == 0) {
+        return vkatlas::pack_directory(argv[2], argv[3]) ? 0 : 1;
+    }
+
     MB_Engine engine;
 
+    // optional runtime settings
+    for (int i = 1; i < argc - 1; i++) {
+        if (strcmp(argv[i], "--frames-in-flight") == 0) {
+            engine.set_frames_in_flight(static_cast<uint32_t>(std::atoi(argv[++i])));
+        }
+        else if (strcmp(argv[i], "--fps-limit") == 0) {
+            engine.set_target_fps(std::atof(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--render-scale") == 0) {
+            engine.set_render_scale(static_cast<float>(std::atof(argv[++i])));
+        }
+        else if (strcmp(argv[i], "--dynamic-resolution") == 0) {
+            engine.set_dynamic_resolution(static_cast<float>(std::atof(argv[++i])));
+        }
+        else if (strcmp(argv[i], "--frame-budget") == 0) {
+            engine.set_frame_budget(static_cast<float>(std::atof(argv[++i])));
+        }
+        else if (strcmp(argv[i], "--quality-log") == 0) {
+            engine.set_quality_log(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--present-mode") == 0) {
+            const char* mode = argv[++i];
+            if (strcmp(mode, "mailbox") == 0) {
+                engine.set_present_mode(VK_PRESENT_MODE_MAILBOX_KHR);
+            }
+            else if (strcmp(mode, "immediate") == 0) {
+                engine.set_present_mode(VK_PRESENT_MODE_IMMEDIATE_KHR);
+            }
+            else {
+                engine.set_present_mode(VK_PRESENT_MODE_FIFO_KHR);
+            }
+        }
+    }
+
     engine.init();
 
     engine.run();
@@ -1,14 +0,0 @@
-//glsl version 4.5
-#version 450
-
-//shader input
-layout (location = 0) in vec3 inColor;
-
-//output write
-layout (location = 0) out vec4 outFragColor;
-
-void main()
-{
-	//return red
-	outFragColor = vec4(inColor,1.0f);
-}
\ No newline at end of file
@@ -0,0 +1,46 @@
+//glsl version 4.5
+#version 450
+
+//shading path, every variant is specialized from this one module
+//so the unused branches are folded away by the driver
+layout (constant_id = 0) const uint SHADING_MODE = 0;
+layout (constant_id = 1) const float SOLID_R = 1.0f;
+layout (constant_id = 2) const float SOLID_G = 0.0f;
+layout (constant_id = 3) const float SOLID_B = 0.0f;
+
+const uint SHADING_VERTEX_COLOR = 0;
+const uint SHADING_SOLID        = 1;
+const uint SHADING_NORMALS      = 2;
+const uint SHADING_DEPTH        = 3;
+const uint SHADING_TEXTURED     = 4;
+
+//shader input
+layout (location = 0) in vec3 inColor;
+layout (location = 1) in vec3 inNormal;
+layout (location = 2) in vec2 inTexCoord;
+
+//textures of the material
+layout (set = 2, binding = 0) uniform sampler2D colorTexture;
+
+//output write
+layout (location = 0) out vec4 outFragColor;
+
+void main()
+{
+	if (SHADING_MODE == SHADING_SOLID) {
+		outFragColor = vec4(SOLID_R, SOLID_G, SOLID_B, 1.0f);
+	}
+	else if (SHADING_MODE == SHADING_NORMALS) {
+		//object space normals remapped to [0, 1]
+		outFragColor = vec4(normalize(inNormal) * 0.5f + 0.5f, 1.0f);
+	}
+	else if (SHADING_MODE == SHADING_DEPTH) {
+		outFragColor = vec4(vec3(gl_FragCoord.z), 1.0f);
+	}
+	else if (SHADING_MODE == SHADING_TEXTURED) {
+		outFragColor = texture(colorTexture, inTexCoord);
+	}
+	else {
+		outFragColor = vec4(inColor, 1.0f);
+	}
+}
@@ -3,18 +3,28 @@
 layout (location = 0) in vec3 vPosition;
 layout (location = 1) in vec3 vNormal;
 layout (location = 2) in vec3 vColor;
+layout (location = 3) in vec2 vTexCoord;
 
 layout (location = 0) out vec3 outColor;
+layout (location = 1) out vec3 outNormal;
+layout (location = 2) out vec2 outTexCoord;
 
-//push constants block
-layout( push_constant ) uniform constants
+//written once per frame
+layout (set = 0, binding = 0) uniform CameraBuffer
 {
-  vec4 data;
-  mat4 render_matrix;
-} PushConstants;
+  mat4 viewproj;
+} camera;
+
+//written per draw when the transform changes
+layout (set = 1, binding = 0) uniform ObjectBuffer
+{
+  mat4 model;
+} object;
 
 void main()
 {
-	gl_Position = PushConstants.render_matrix * vec4(vPosition, 1.0f);
+	gl_Position = camera.viewproj * object.model * vec4(vPosition, 1.0f);
 	outColor = vColor;
-}
\ No newline at end of file
+	outNormal = vNormal;
+	outTexCoord = vTexCoord;
+}
@@ -0,0 +1,159 @@
+#include "Frame_Pacer.h"
+
+#include <thread>
+
+// sleeping is imprecise, so the final stretch before a deadline is spun
+constexpr auto SPIN_THRESHOLD = std::chrono::milliseconds(1);
+// extra headroom added on top of the measured work time
+constexpr auto WORK_MARGIN = std::chrono::microseconds(500);
+// period the reported maximum latency is taken over
+constexpr auto LATENCY_WINDOW = std::chrono::seconds(1);
+
+static double to_ms(Frame_Pacer::clock::duration duration) {
+  return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+Frame_Pacer::Frame_Pacer(vk_interface* _vk) : vk(_vk) {
+  if (vk->_device->_present_wait) {
+    _wait_for_present = (PFN_vkWaitForPresentKHR) vkGetDeviceProcAddr(vk->_device->_logical, "vkWaitForPresentKHR");
+  }
+  _stats.present_wait = _wait_for_present != nullptr;
+  _deadline = clock::now();
+  _frame_start = _deadline;
+  _input_time = _deadline;
+  _latency_window_start = _deadline;
+}
+
+/**
+ * @brief Limits the main loop to a frame rate
+ * @param fps target frames per second, 0 disables the limiter
+ */
+void Frame_Pacer::set_target_fps(double fps) {
+  if (fps <= 0.0) {
+    _target_period = clock::duration::zero();
+    return;
+  }
+  _target_period = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1.0 / fps));
+  _deadline = clock::now();
+}
+
+/**
+ * @brief Sets how many presents may be waiting on the display before
+ *        the next frame starts, only used with present wait
+ */
+void Frame_Pacer::set_max_queued_presents(uint32_t count) {
+  _max_queued_presents = std::max(count, 1u);
+}
+
+/**
+ * @brief Blocks until the next frame should begin sampling input, so that 
+ *        recording finishes just before the frame deadline
+ */
+void Frame_Pacer::wait_for_frame_start() {
+  clock::time_point start = clock::now();
+
+  // the GPU wait is done before input is sampled so it does not add latency
+  vk->_cmd->wait_for_render();
+  wait_for_queued_presents();
+
+  if (_target_period > clock::duration::zero()) {
+    _deadline += _target_period;
+    clock::time_point wake_time = _deadline - _work_estimate;
+    clock::time_point now = clock::now();
+
+    if (wake_time > now) {
+      sleep_until(wake_time);
+    }
+    else if (_deadline < now) {
+      // running behind, restart the schedule instead of bursting to catch up
+      _deadline = now + _work_estimate;
+    }
+  }
+
+  clock::time_point frame_start = clock::now();
+  _stats.sleep_ms = to_ms(frame_start - start);
+  _stats.frame_ms = to_ms(frame_start - _frame_start);
+  _frame_start = frame_start;
+}
+
+void Frame_Pacer::mark_input_sampled() {
+  _input_time = clock::now();
+}
+
+/**
+ * @brief Updates the work estimate and latency once a frame was queued for present
+ * @param present_id id of the present that displays the frame
+ */
+void Frame_Pacer::mark_presented(uint64_t present_id) {
+  clock::time_point now = clock::now();
+  _last_present_id = present_id;
+  _input_times[present_id % LATENCY_HISTORY] = _input_time;
+
+  // exponential moving average of the work done after input is sampled
+  clock::duration work = now - _input_time + WORK_MARGIN;
+  _work_estimate = (_work_estimate * 7 + work) / 8;
+  _stats.work_ms = to_ms(_work_estimate);
+
+  // without present wait latency can only be measured up to queueing the present
+  if (_wait_for_present == nullptr) {
+    record_latency(_input_time, now);
+  }
+}
+
+/**
+ * @brief Present ids of a retired swapchain can no longer be waited on
+ */
+void Frame_Pacer::on_swapchain_recreated() {
+  _last_waited_id = _last_present_id;
+}
+
+/**
+ * @brief Waits until no more than the allowed number of presents are
+ *        still queued, and measures latency up to the displayed present
+ */
+void Frame_Pacer::wait_for_queued_presents() {
+  if (_wait_for_present == nullptr || _last_present_id < _max_queued_presents) {
+    return;
+  }
+
+  uint64_t wait_id = _last_present_id + 1 - _max_queued_presents;
+  if (wait_id <= _last_waited_id) {
+    return;
+  }
+
+  VkResult result = _wait_for_present(
+    vk->_device->_logical,
+    vk->_swapchain->_handle,
+    wait_id,
+    100000000
+  );
+  _last_waited_id = wait_id;
+
+  // out of date swapchains and timeouts only skip the measurement
+  if (result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR) {
+    record_latency(_input_times[wait_id % LATENCY_HISTORY], clock::now());
+  }
+}
+
+void Frame_Pacer::record_latency(clock::time_point input_time, clock::time_point present_time) {
+  _stats.latency_ms = to_ms(present_time - input_time);
+  _window_max_latency_ms = std::max(_window_max_latency_ms, _stats.latency_ms);
+  _stats.max_latency_ms = std::max(_stats.max_latency_ms, _stats.latency_ms);
+
+  // a window's maximum replaces the last one once it is over
+  if (present_time - _latency_window_start >= LATENCY_WINDOW) {
+    _stats.max_latency_ms = _window_max_latency_ms;
+    _window_max_latency_ms = 0.0;
+    _latency_window_start = present_time;
+  }
+}
+
+void Frame_Pacer::sleep_until(clock::time_point wake_time) {
+  clock::time_point now = clock::now();
+  if (wake_time - now > SPIN_THRESHOLD) {
+    std::this_thread::sleep_for(wake_time - now - SPIN_THRESHOLD);
+  }
+  while (clock::now() < wake_time) {
+    std::this_thread::yield();
+  }
+}
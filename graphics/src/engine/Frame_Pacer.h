@@ -0,0 +1,66 @@
+#pragma once
+
+#include "../vulkan_util/vk_types.h"
+#include "../vulkan/vk_interface.h"
+
+#include <chrono>
+
+struct Pacing_Stats {
+  double frame_ms       = 0.0; // time between the start of consecutive frames
+  double work_ms        = 0.0; // estimated time from input sampling to present
+  double sleep_ms       = 0.0; // time spent waiting before sampling input
+  double latency_ms     = 0.0; // input sampling to present (to display with present wait)
+  double max_latency_ms = 0.0; // highest latency of the last reporting window
+  bool   present_wait   = false;
+};
+
+/**
+ * @brief Paces the main loop so input is sampled as late as possible,
+ *        either against a CPU frame limit or against presentation
+ *        through VK_KHR_present_wait when the device supports it
+ */
+class Frame_Pacer
+{
+public:
+  using clock = std::chrono::steady_clock;
+
+  Frame_Pacer(vk_interface* _vk);
+  ~Frame_Pacer(){};
+
+  void set_target_fps(double fps);
+  void set_max_queued_presents(uint32_t count);
+
+  void wait_for_frame_start();
+  void mark_input_sampled();
+  void mark_presented(uint64_t present_id);
+  void on_swapchain_recreated();
+
+  const Pacing_Stats& stats() const { return _stats; }
+
+private:
+  vk_interface* vk;
+  PFN_vkWaitForPresentKHR _wait_for_present = nullptr;
+
+  clock::duration   _target_period = clock::duration::zero();
+  clock::duration   _work_estimate = clock::duration::zero();
+  clock::time_point _deadline;
+  clock::time_point _frame_start;
+  clock::time_point _input_time;
+
+  uint32_t _max_queued_presents = 1;
+  uint64_t _last_present_id = 0;
+  uint64_t _last_waited_id = 0;
+
+  // input sample times of recent presents, indexed by present id
+  static constexpr size_t LATENCY_HISTORY = 8;
+  std::array<clock::time_point, LATENCY_HISTORY> _input_times;
+  // the maximum latency is gathered per window so it falls back after a hitch
+  clock::time_point _latency_window_start;
+  double            _window_max_latency_ms = 0.0;
+
+  Pacing_Stats _stats;
+
+  void wait_for_queued_presents();
+  void record_latency(clock::time_point input_time, clock::time_point present_time);
+  static void sleep_until(clock::time_point wake_time);
+};
@@ -33,6 +33,23 @@ void GUI::init_imgui() {
   //ImGui::SetCurrentContext(ctx);
   ImGui_ImplSDL2_InitForVulkan(_window); // imgui for SDL2
 
+  init_backend();
+}
+
+/**
+ * @brief The ImGui pipeline is built against the swapchain render pass, it
+ *        is rebuilt when a new surface format replaced the pass. Format
+ *        changes are rare, so the device is idled instead of retiring the
+ *        backend's objects one by one. Textures added through the backend
+ *        keep working, the new set layout is defined the same way
+ */
+void GUI::on_render_pass_changed() {
+  vkDeviceWaitIdle(vk->_device->_logical);
+  ImGui_ImplVulkan_Shutdown();
+  init_backend();
+}
+
+void GUI::init_backend() {
   // imgui for vulkan
   ImGui_ImplVulkan_InitInfo init_info {};
   init_info.Instance = vk->_instance;
@@ -40,6 +57,7 @@ void GUI::init_imgui() {
 	init_info.Device = vk->_device->_logical;
 	init_info.Queue = vk->_device->_graphics_queue;
 	init_info.DescriptorPool = imgui_pool;
+	init_info.PipelineCache = vk->_pipeline_cache->handle();
 	init_info.MinImageCount = 3;
 	init_info.ImageCount = 3;
 	init_info.UseDynamicRendering = false;
@@ -49,9 +67,19 @@ void GUI::init_imgui() {
 
   ImGui_ImplVulkan_Init(&init_info, vk->_swapchain->_renderpass);
 
-  vk->_cmd->immediate_submit([&](VkCommandBuffer cmd) { ImGui_ImplVulkan_CreateFontsTexture(cmd); });
+  // the font upload overlaps the rest of startup, its staging 
+  // memory is released once the upload has finished
+  Submit_Token font_upload = vk->_cmd->immediate_submit_async([&](VkCommandBuffer cmd) { 
+    ImGui_ImplVulkan_CreateFontsTexture(cmd); 
+  });
+  vk->_cmd->then(font_upload, []() { ImGui_ImplVulkan_DestroyFontUploadObjects(); });
+}
 
-  ImGui_ImplVulkan_DestroyFontUploadObjects();
+/**
+ * @brief Registers a function that draws an ImGui window each frame
+ */
+void GUI::add_panel(std::function<void()>&& panel) {
+  _panels.push_back(std::move(panel));
 }
 
 void GUI::process_event(SDL_Event *event) {
@@ -67,6 +95,10 @@ void GUI::begin_drawing() {
   // some imgui UI to test
   ImGui::ShowDemoWindow();
 
+  for (auto& panel : _panels) {
+    panel();
+  }
+
   // make imgui calculate internal draw structures
   ImGui::Render();
 }
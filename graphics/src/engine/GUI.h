@@ -17,6 +17,8 @@ public:
   ~GUI();
 
   void init_imgui();
+  void on_render_pass_changed();
+  void add_panel(std::function<void()>&& panel);
   void process_event(SDL_Event *event);
   void begin_drawing();
   void draw_imgui();
@@ -26,4 +28,9 @@ private:
   SDL_Window* _window;
 
   VkDescriptorPool imgui_pool;
+
+  void init_backend();
+
+  // engine subsystems register windows that are drawn every frame
+  std::vector<std::function<void()>> _panels;
 };
\ No newline at end of file
@@ -1,5 +1,8 @@
 #include "object.h"
+#include "../vulkan/Cmd.h"
+#include "../vulkan_util/vk_atlas.h"
 
+#include <cmath>
 #include <iostream>
 
 VertexInputDescription Vertex::get_vertex_description() {
@@ -34,26 +37,93 @@ VertexInputDescription Vertex::get_vertex_description() {
 	color_attribute.format = VK_FORMAT_R32G32B32_SFLOAT;
 	color_attribute.offset = offsetof(Vertex, color);
 
+	//UV will be stored at Location 3
+	VkVertexInputAttributeDescription uv_attribute = {};
+	uv_attribute.binding = 0;
+	uv_attribute.location = 3;
+	uv_attribute.format = VK_FORMAT_R32G32_SFLOAT;
+	uv_attribute.offset = offsetof(Vertex, uv);
+
 	description.attributes.push_back(position_attribute);
 	description.attributes.push_back(normal_attribute);
 	description.attributes.push_back(color_attribute);
+	description.attributes.push_back(uv_attribute);
 	return description;
 }
 
-void Material::create_material(VkPipeline pipeline, VkPipelineLayout layout) {
+/**
+ * @brief Bounding sphere around the center of the vertex bounds, and the
+ *        square root of the UV area over the surface area of the triangles
+ */
+void Mesh::compute_bounds() {
+  if (_vertices.empty()) {
+    return;
+  }
+
+  glm::vec3 min = _vertices[0].position;
+  glm::vec3 max = _vertices[0].position;
+  for (const auto& vertex : _vertices) {
+    min = glm::min(min, vertex.position);
+    max = glm::max(max, vertex.position);
+  }
+  _center = (min + max) * 0.5f;
+  _radius = 0.f;
+  for (const auto& vertex : _vertices) {
+    _radius = std::max(_radius, glm::length(vertex.position - _center));
+  }
+
+  float surface_area = 0.f;
+  float uv_area = 0.f;
+  for (size_t i = 0; i + 2 < _vertices.size(); i += 3) {
+    const Vertex& a = _vertices[i];
+    const Vertex& b = _vertices[i + 1];
+    const Vertex& c = _vertices[i + 2];
+    surface_area += glm::length(glm::cross(b.position - a.position, c.position - a.position)) * 0.5f;
+    glm::vec2 uv_b = b.uv - a.uv;
+    glm::vec2 uv_c = c.uv - a.uv;
+    uv_area += std::abs(uv_b.x * uv_c.y - uv_b.y * uv_c.x) * 0.5f;
+  }
+  _uv_density = surface_area > 0.f ? std::sqrt(uv_area / surface_area) : 0.f;
+}
+
+/**
+ * @brief Moves the UVs into the rect of an atlas the mesh's texture was
+ *        packed into, must run before the mesh is uploaded
+ */
+void Mesh::remap_uvs(const vkatlas::Atlas_Rect& rect) {
+  for (auto& vertex : _vertices) {
+    vertex.uv = rect.remap(vertex.uv);
+  }
+}
+
+void Material::create_material(Pipeline_Handle pipeline, Pipeline_Handle fallback, const Render_State& state) {
   _pipeline = pipeline;
-  _pipelineLayout = layout;
+  _fallback = fallback;
+  _state = state;
 }
 
-Object::Object(const char* filename, VmaAllocator allocator) : _allocator(allocator) {
+/**
+ * @param atlas_rect rect of the mesh's texture in an atlas, the UVs are
+ *        moved into it as the mesh is imported
+ */
+Object::Object(const char* filename, VmaAllocator allocator, Deletion_Queue* deletion_queue, const vkatlas::Atlas_Rect* atlas_rect) 
+: _allocator(allocator), _deletion_queue(deletion_queue) {
   bool result = load_obj(filename);
+  if (atlas_rect != nullptr) {
+    mesh.remap_uvs(*atlas_rect);
+  }
+  mesh.compute_bounds();
 }
 
-Object::Object(Mesh cpy_mesh, VmaAllocator allocator) : _allocator(allocator), mesh(cpy_mesh){}
+Object::Object(Mesh cpy_mesh, VmaAllocator allocator, Deletion_Queue* deletion_queue) 
+: _allocator(allocator), _deletion_queue(deletion_queue), mesh(cpy_mesh) {
+  mesh.compute_bounds();
+}
 
 Object::~Object() {
+  // frames still in flight may reference the vertex buffer
   if (is_uploaded) {
-    vmaDestroyBuffer(_allocator, mesh._vertexBuffer._buffer, mesh._vertexBuffer._allocation);
+    _deletion_queue->retire_buffer(mesh._vertexBuffer._buffer, mesh._vertexBuffer._allocation, last_used_value);
   }
 }
 
@@ -110,6 +180,15 @@ bool Object::load_obj(const char* filename) {
         //temporarily setting vertex color as the vertex normal
         new_vert.color = new_vert.normal;
 
+        //obj puts the origin of texture coordinates at the bottom left
+        if (idx.texcoord_index >= 0) {
+          new_vert.uv.x = attrib.texcoords[2 * idx.texcoord_index + 0];
+          new_vert.uv.y = 1.f - attrib.texcoords[2 * idx.texcoord_index + 1];
+        }
+        else {
+          new_vert.uv = { 0.f, 0.f };
+        }
+
         mesh._vertices.push_back(new_vert);
       }
       index_offset += fv;
@@ -119,16 +198,45 @@ bool Object::load_obj(const char* filename) {
   return true;
 }
 
-void Object::upload_mesh() {
-  VkBufferCreateInfo buffer_info {};
-  buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+/**
+ * @brief Copies the mesh into device local memory through a staging buffer,
+ *        the copy runs asynchronously and frames submitted later wait on it
+ * @return token that completes once the vertex buffer is ready
+ */
+Submit_Token Object::upload_mesh(Cmd* cmd) {
+  const size_t buffer_size = mesh._vertices.size() * sizeof(Vertex);
+
+  // stage the vertices in host visible memory
+  VkBufferCreateInfo staging_info {};
+  staging_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  staging_info.size = buffer_size;
+  staging_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+
+  VmaAllocationCreateInfo staging_alloc_info {};
+  staging_alloc_info.usage = VMA_MEMORY_USAGE_CPU_ONLY;
+
+  AllocatedBuffer staging;
+  VK_CHECK(vmaCreateBuffer(_allocator, &staging_info, &staging_alloc_info,
+    &staging._buffer,
+    &staging._allocation,
+    nullptr
+  ));
+
+  void* data;
+  vmaMapMemory(_allocator, staging._allocation, &data);
+
+  memcpy(data, mesh._vertices.data(), buffer_size);
 
-  buffer_info.size = mesh._vertices.size() * sizeof(Vertex);
+  vmaUnmapMemory(_allocator, staging._allocation);
 
-  buffer_info.usage =  VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;;
+  // the vertex buffer itself lives in GPU memory
+  VkBufferCreateInfo buffer_info {};
+  buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  buffer_info.size = buffer_size;
+  buffer_info.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
 
   VmaAllocationCreateInfo vma_alloc_info {};
-  vma_alloc_info.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;
+  vma_alloc_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
 
   VK_CHECK(vmaCreateBuffer(_allocator, &buffer_info, &vma_alloc_info,
     &mesh._vertexBuffer._buffer,
@@ -136,12 +244,23 @@ void Object::upload_mesh() {
     nullptr
   ));
 
-  void* data;
-  vmaMapMemory(_allocator, mesh._vertexBuffer._allocation, &data);
-
-  memcpy(data, mesh._vertices.data(), mesh._vertices.size() * sizeof(Vertex));
-
-  vmaUnmapMemory(_allocator, mesh._vertexBuffer._allocation);
-
+  Submit_Token token = cmd->immediate_submit_async([&](VkCommandBuffer upload_cmd) {
+    VkBufferCopy copy {};
+    copy.srcOffset = 0;
+    copy.dstOffset = 0;
+    copy.size = buffer_size;
+    vkCmdCopyBuffer(upload_cmd, staging._buffer, mesh._vertexBuffer._buffer, 1, &copy);
+  });
+
+  // release the staging buffer once the copy is done
+  VmaAllocator allocator = _allocator;
+  cmd->then(token, [allocator, staging]() {
+    vmaDestroyBuffer(allocator, staging._buffer, staging._allocation);
+  });
+
+  // frames submitted from now on wait on the upload, so the buffer is only
+  // retired once the copy into it is done even if the object is never drawn
+  last_used_value = std::max(last_used_value, cmd->submitted_value() + 1);
   is_uploaded = true;
-}
\ No newline at end of file
+  return token;
+}
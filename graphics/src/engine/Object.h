@@ -1,9 +1,15 @@
 #pragma once 
 
 #include "../vulkan_util/vk_types.h"
+#include "../vulkan/Deletion_Queue.h"
+#include "../vulkan/pipeline.h"
 
 #include <tiny_obj_loader.h>
 
+class Cmd;
+struct Texture;
+namespace vkatlas { struct Atlas_Rect; }
+
 struct VertexInputDescription {
   std::vector<VkVertexInputBindingDescription> bindings;
 	std::vector<VkVertexInputAttributeDescription> attributes;
@@ -15,6 +21,7 @@ struct Vertex {
   glm::vec3 position;
   glm::vec3 normal;
   glm::vec3 color;
+  glm::vec2 uv;
 
   static VertexInputDescription get_vertex_description();
 };
@@ -23,13 +30,33 @@ struct Mesh {
   std::vector<Vertex> _vertices;
 
   AllocatedBuffer _vertexBuffer;
+
+  // model space bounding sphere, and UV units per model space unit
+  // averaged over the surface, culling derives texel density from both
+  glm::vec3 _center{ 0.f };
+  float     _radius = 0.f;
+  float     _uv_density = 0.f;
+
+  void compute_bounds();
+  void remap_uvs(const vkatlas::Atlas_Rect& rect);
 };
 
+/**
+ * @brief Pipelines are referenced by handle, so a material picks up its
+ *        pipeline once it compiles and any better pipeline replacing it
+ */
 struct Material {
-  VkPipeline _pipeline;
-  VkPipelineLayout _pipelineLayout;
+  Pipeline_Handle _pipeline = NULL_PIPELINE_HANDLE;
+  // drawn with while _pipeline compiles, the object is skipped without one
+  Pipeline_Handle _fallback = NULL_PIPELINE_HANDLE;
+  // applied per draw where the bound pipeline left the state dynamic
+  Render_State    _state;
+  // sampled through set 2 of the mesh shaders, the set is written for
+  // the frame being drawn since streaming replaces the texture's image
+  Texture*        _texture = nullptr;
+  VkDescriptorSet _texture_set = VK_NULL_HANDLE;
 
-  void create_material(VkPipeline pipeline, VkPipelineLayout layout);
+  void create_material(Pipeline_Handle pipeline, Pipeline_Handle fallback = NULL_PIPELINE_HANDLE, const Render_State& state = {});
 };
 
 class Object {
@@ -37,15 +64,19 @@ public:
   Mesh      mesh;
   Material  material;
   glm::mat4 transform_mtx;
+  // frame timeline value of the last frame that drew this object, or of
+  // the first frame waiting on its upload
+  uint64_t  last_used_value = 0;
 
-  Object(const char* filename, VmaAllocator allocator);
-  Object(Mesh cpy_mesh, VmaAllocator allocator);
+  Object(const char* filename, VmaAllocator allocator, Deletion_Queue* deletion_queue, const vkatlas::Atlas_Rect* atlas_rect = nullptr);
+  Object(Mesh cpy_mesh, VmaAllocator allocator, Deletion_Queue* deletion_queue);
   ~Object();
 
-  void upload_mesh();
+  Submit_Token upload_mesh(Cmd* cmd);
   bool load_obj(const char* filename);
 private:
   bool is_uploaded = false;
 
   VmaAllocator _allocator;
+  Deletion_Queue* _deletion_queue;
 };
\ No newline at end of file
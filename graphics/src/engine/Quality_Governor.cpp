@@ -0,0 +1,190 @@
+#include "Quality_Governor.h"
+
+// weight of the newest frame in the smoothed times
+constexpr double SMOOTHING = 0.1;
+// quality only rises once the slower side is under this fraction of the budget
+constexpr double RAISE_BAND = 0.75;
+// measured frames at new settings before the next decision, knobs are
+// coarse so the governor reacts slower than the resolution controller
+constexpr uint32_t SETTLE_FRAMES = 30;
+// decisions kept for the GUI, the log has all of them
+constexpr size_t DECISION_HISTORY = 16;
+
+static double smooth(double average, double value) {
+  return average == 0.0 ? value : average + (value - average) * SMOOTHING;
+}
+
+static const char* cost_name(Knob_Cost cost) {
+  switch (cost) {
+    case Knob_Cost::Cpu:  return "cpu";
+    case Knob_Cost::Gpu:  return "gpu";
+    case Knob_Cost::Both:
+    default:              return "cpu+gpu";
+  }
+}
+
+Quality_Governor::Quality_Governor() {
+  _stats.budget_ms = 1000.f / 60.f;
+}
+
+/**
+ * @brief Registers a knob, its current level is taken as it is and only
+ *        applied once the governor changes it
+ */
+void Quality_Governor::add_knob(const Quality_Knob& knob) {
+  Quality_Knob added = knob;
+  added.steps = std::max(added.steps, 1u);
+  added.level = std::min(added.level, added.steps);
+  auto position = std::upper_bound(_knobs.begin(), _knobs.end(), added, [](const Quality_Knob& a, const Quality_Knob& b) {
+    return a.priority < b.priority;
+  });
+  _knobs.insert(position, std::move(added));
+}
+
+void Quality_Governor::set_enabled(bool enabled) {
+  if (enabled && !_enabled) {
+    _stats.cpu_ms = 0.0;
+    _stats.gpu_ms = 0.0;
+    _stats.cooldown = SETTLE_FRAMES;
+  }
+  _enabled = enabled;
+}
+
+void Quality_Governor::set_budget_ms(float budget_ms) {
+  _stats.budget_ms = std::max(budget_ms, 1.f);
+}
+
+/**
+ * @brief Starts a CSV log of the decisions, one row per knob change
+ * @return false when the file cannot be opened
+ */
+bool Quality_Governor::set_log_path(const std::string& path) {
+  _log.close();
+  _log.open(path, std::ios::trunc);
+  if (!_log.is_open()) {
+    fmt::println("failed to open quality log {}", path);
+    return false;
+  }
+  _log << "frame,knob,from,to,cpu_ms,gpu_ms,budget_ms,reason\n";
+  return true;
+}
+
+/**
+ * @brief Puts every lowered knob back to full quality, the best value it
+ *        was registered with
+ */
+void Quality_Governor::restore() {
+  for (auto& knob : _knobs) {
+    if (knob.level != knob.steps) {
+      knob.level = knob.steps;
+      if (knob.apply) {
+        knob.apply(knob.value());
+      }
+    }
+  }
+}
+
+/**
+ * @brief Feeds the times of the last frame and changes at most one knob
+ * @param cpu_ms time the CPU spent on the frame, without waits on the
+ *        GPU, the swapchain or the frame limiter
+ * @param gpu_samples count of measured GPU frames, the GPU time is only
+ *        used when it belongs to a frame not seen before
+ * @param frames_in_flight frames recorded before a change shows up in the
+ *        measured times
+ * @param frame number of the frame, written to the log
+ */
+void Quality_Governor::update(double cpu_ms, double gpu_ms, uint64_t gpu_samples, uint32_t frames_in_flight, uint64_t frame) {
+  if (!_enabled) {
+    return;
+  }
+
+  // frames recorded before a change were measured with the old settings
+  if (_stale > 0) {
+    _stale--;
+    if (_stale == 0) {
+      _stats.cpu_ms = 0.0;
+      _stats.gpu_ms = 0.0;
+    }
+    return;
+  }
+
+  _stats.cpu_ms = smooth(_stats.cpu_ms, cpu_ms);
+  if (gpu_samples != _last_gpu_samples) {
+    _last_gpu_samples = gpu_samples;
+    _stats.gpu_ms = smooth(_stats.gpu_ms, gpu_ms);
+  }
+  if (_stats.cooldown > 0) {
+    _stats.cooldown--;
+    return;
+  }
+
+  double budget = _stats.budget_ms;
+  double slowest = std::max(_stats.cpu_ms, _stats.gpu_ms);
+  bool changed = false;
+  if (slowest > budget) {
+    _stats.bound = _stats.gpu_ms >= _stats.cpu_ms ? Knob_Cost::Gpu : Knob_Cost::Cpu;
+    for (auto& knob : _knobs) {
+      bool helps = knob.cost == _stats.bound || knob.cost == Knob_Cost::Both;
+      if (helps && knob.level > 0) {
+        change(knob, knob.level - 1, true, frame);
+        changed = true;
+        break;
+      }
+    }
+  }
+  else if (slowest < budget * RAISE_BAND) {
+    for (auto it = _knobs.rbegin(); it != _knobs.rend(); ++it) {
+      if (it->level < it->steps) {
+        change(*it, it->level + 1, false, frame);
+        changed = true;
+        break;
+      }
+    }
+  }
+
+  if (changed) {
+    _stale = frames_in_flight + 1;
+    _stats.cooldown = SETTLE_FRAMES;
+  }
+}
+
+void Quality_Governor::change(Quality_Knob& knob, uint32_t level, bool over, uint64_t frame) {
+  Quality_Decision decision;
+  decision.frame = frame;
+  decision.knob = knob.name;
+  decision.from = knob.value();
+  knob.level = level;
+  decision.to = knob.value();
+  decision.cpu_ms = _stats.cpu_ms;
+  decision.gpu_ms = _stats.gpu_ms;
+  decision.over = over;
+
+  if (knob.apply) {
+    knob.apply(decision.to);
+  }
+  if (over) {
+    _stats.lowered++;
+  }
+  else {
+    _stats.raised++;
+  }
+
+  const char* reason = over ? cost_name(_stats.bound) : "under";
+  fmt::println(
+    "quality: {} {:.2f} -> {:.2f} (cpu {:.2f} ms, gpu {:.2f} ms, budget {:.2f} ms, {})",
+    knob.name, decision.from, decision.to, decision.cpu_ms, decision.gpu_ms, _stats.budget_ms, reason
+  );
+  if (_log.is_open()) {
+    _log << fmt::format(
+      "{},{},{:.3f},{:.3f},{:.3f},{:.3f},{:.3f},{}\n",
+      frame, knob.name, decision.from, decision.to, decision.cpu_ms, decision.gpu_ms, _stats.budget_ms, reason
+    );
+    _log.flush();
+  }
+
+  _decisions.push_back(std::move(decision));
+  if (_decisions.size() > DECISION_HISTORY) {
+    _decisions.pop_front();
+  }
+}
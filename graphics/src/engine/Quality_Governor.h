@@ -0,0 +1,95 @@
+#pragma once
+
+#include "../vulkan_util/vk_types.h"
+
+#include <fstream>
+
+// the side of the frame a knob saves time on
+enum class Knob_Cost : uint8_t {
+  Cpu,
+  Gpu,
+  Both,
+};
+
+/**
+ * @brief A setting the governor may lower to save frame time. It moves in
+ *        whole steps between its cheapest and best value, level 0 is the
+ *        cheapest and level steps is full quality
+ */
+struct Quality_Knob {
+  std::string name;
+  // knobs of lower priority are lowered first and raised last
+  int         priority = 0;
+  Knob_Cost   cost = Knob_Cost::Gpu;
+  float       cheapest = 0.f;
+  float       best = 1.f;
+  uint32_t    steps = 4;
+  uint32_t    level = 4;
+  std::function<void(float value)> apply;
+
+  float value() const { return cheapest + (best - cheapest) * static_cast<float>(level) / static_cast<float>(steps); }
+};
+
+struct Quality_Decision {
+  uint64_t    frame;
+  std::string knob;
+  float       from;
+  float       to;
+  double      cpu_ms;
+  double      gpu_ms;
+  // the frame was over the budget, or far enough under it to raise quality
+  bool        over;
+};
+
+struct Governor_Stats {
+  double   cpu_ms = 0.0; // smoothed CPU time of a frame, without pacing sleeps
+  double   gpu_ms = 0.0; // smoothed GPU time of the graphics queue
+  float    budget_ms = 0.f;
+  uint32_t lowered = 0;
+  uint32_t raised = 0;
+  // measured frames left before the next decision
+  uint32_t cooldown = 0;
+  // the side over the budget at the last decision
+  Knob_Cost bound = Knob_Cost::Gpu;
+};
+
+/**
+ * @brief Keeps the frame inside a time budget by trading registered quality
+ *        knobs. When the slower of the CPU and GPU times goes over the
+ *        budget the lowest priority knob that saves time on that side drops
+ *        a step, once both are well under it the highest priority knob not at
+ *        full quality rises a step. Every decision is kept for the GUI and
+ *        appended to a CSV log
+ */
+class Quality_Governor
+{
+public:
+  Quality_Governor();
+  ~Quality_Governor(){};
+
+  void add_knob(const Quality_Knob& knob);
+  void update(double cpu_ms, double gpu_ms, uint64_t gpu_samples, uint32_t frames_in_flight, uint64_t frame);
+  void restore();
+
+  void set_enabled(bool enabled);
+  bool enabled() const { return _enabled; }
+  void set_budget_ms(float budget_ms);
+  bool set_log_path(const std::string& path);
+
+  std::vector<Quality_Knob>& knobs() { return _knobs; }
+  const std::deque<Quality_Decision>& decisions() const { return _decisions; }
+  const Governor_Stats& stats() const { return _stats; }
+
+private:
+  bool     _enabled = false;
+  uint64_t _last_gpu_samples = 0;
+  // measured frames still recorded with the knobs before the last change
+  uint32_t _stale = 0;
+
+  std::vector<Quality_Knob>    _knobs;
+  std::deque<Quality_Decision> _decisions;
+  std::ofstream                _log;
+  Governor_Stats               _stats;
+
+  void change(Quality_Knob& knob, uint32_t level, bool over, uint64_t frame);
+};
@@ -0,0 +1,96 @@
+#include "Resolution_Controller.h"
+
+#include <cmath>
+
+// weight of the newest frame in the smoothed GPU time
+constexpr double SMOOTHING = 0.15;
+// the scale drops above the budget and rises below this fraction of it
+constexpr double LOWER_BAND = 0.85;
+// fraction of the budget a step aims for, leaving room for spikes
+constexpr double AIM = 0.92;
+// largest change of a single step, drops are allowed to be faster
+constexpr float MAX_DROP = 0.1f;
+constexpr float MAX_RISE = 0.05f;
+// steps smaller than this are not worth the change in sharpness
+constexpr float MIN_STEP = 0.01f;
+// measured frames at a new scale before the next decision
+constexpr uint32_t SETTLE_FRAMES = 6;
+
+Resolution_Controller::Resolution_Controller(float min_scale, float max_scale) {
+  set_limits(min_scale, max_scale);
+  _stats.scale = _max_scale;
+  _stats.target_ms = 1000.f / 60.f;
+}
+
+void Resolution_Controller::set_target_ms(float target_ms) {
+  _stats.target_ms = std::max(target_ms, 1.f);
+}
+
+void Resolution_Controller::set_limits(float min_scale, float max_scale) {
+  _max_scale = std::clamp(max_scale, 0.25f, 1.f);
+  _min_scale = std::clamp(min_scale, 0.25f, _max_scale);
+  _stats.scale = std::clamp(_stats.scale, _min_scale, _max_scale);
+}
+
+/**
+ * @brief Starts the controller from a scale set by hand
+ */
+void Resolution_Controller::set_scale(float scale) {
+  _stats.scale = std::clamp(scale, _min_scale, _max_scale);
+}
+
+/**
+ * @brief Feeds the GPU time of the last measured frame and returns the
+ *        scale to draw the next frame at
+ * @param samples count of measured frames, the time is only used when
+ *        it belongs to a frame not seen before
+ * @param frames_in_flight frames recorded before a change shows up in the
+ *        measured time, no other change is made until then
+ */
+float Resolution_Controller::update(double gpu_ms, uint64_t samples, uint32_t frames_in_flight) {
+  _stats.measuring = samples != 0;
+  if (!_enabled || samples == _last_samples) {
+    return _stats.scale;
+  }
+  _last_samples = samples;
+
+  // frames recorded before a change were drawn at the old scale
+  if (_stale > 0) {
+    _stale--;
+    if (_stale == 0) {
+      _stats.gpu_ms = 0.0;
+    }
+    return _stats.scale;
+  }
+
+  _stats.gpu_ms = _stats.gpu_ms == 0.0 ? gpu_ms : _stats.gpu_ms + (gpu_ms - _stats.gpu_ms) * SMOOTHING;
+  if (_stats.cooldown > 0) {
+    _stats.cooldown--;
+    return _stats.scale;
+  }
+
+  double target = _stats.target_ms;
+  bool over = _stats.gpu_ms > target;
+  bool under = _stats.gpu_ms < target * LOWER_BAND;
+  if ((!over && !under) || _stats.gpu_ms <= 0.0) {
+    return _stats.scale;
+  }
+
+  float wanted = _stats.scale * static_cast<float>(std::sqrt(target * AIM / _stats.gpu_ms));
+  wanted = std::clamp(wanted, _stats.scale - MAX_DROP, _stats.scale + MAX_RISE);
+  wanted = std::clamp(wanted, _min_scale, _max_scale);
+  if (std::abs(wanted - _stats.scale) < MIN_STEP) {
+    return _stats.scale;
+  }
+
+  if (wanted < _stats.scale) {
+    _stats.decreases++;
+  }
+  else {
+    _stats.increases++;
+  }
+  _stats.scale = wanted;
+  _stale = frames_in_flight + 1;
+  _stats.cooldown = SETTLE_FRAMES;
+  return _stats.scale;
+}
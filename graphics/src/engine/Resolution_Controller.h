@@ -0,0 +1,52 @@
+#pragma once
+
+#include "../vulkan_util/vk_types.h"
+
+struct Resolution_Stats {
+  float    scale       = 1.f;
+  double   gpu_ms      = 0.0; // smoothed GPU time of the graphics queue
+  float    target_ms   = 0.f;
+  // changes made since the start
+  uint32_t increases   = 0;
+  uint32_t decreases   = 0;
+  // measured frames at the current scale left before the next change
+  uint32_t cooldown    = 0;
+  bool     measuring   = false; // GPU timestamps are arriving
+};
+
+/**
+ * @brief Picks the render scale from the GPU time of recent frames. The
+ *        scale drops when the time goes over the budget and only rises
+ *        once it is well under, the band in between keeps it from
+ *        oscillating. Pixel cost goes with the square of the scale, so
+ *        steps are sized from the ratio of budget to time
+ */
+class Resolution_Controller
+{
+public:
+  Resolution_Controller(float min_scale = 0.5f, float max_scale = 1.f);
+  ~Resolution_Controller(){};
+
+  float update(double gpu_ms, uint64_t samples, uint32_t frames_in_flight);
+
+  void set_enabled(bool enabled) { _enabled = enabled; }
+  bool enabled() const { return _enabled; }
+  void set_target_ms(float target_ms);
+  void set_limits(float min_scale, float max_scale);
+  void set_scale(float scale);
+
+  float scale() const { return _stats.scale; }
+  float min_scale() const { return _min_scale; }
+  float max_scale() const { return _max_scale; }
+  const Resolution_Stats& stats() const { return _stats; }
+
+private:
+  bool     _enabled = false;
+  float    _min_scale;
+  float    _max_scale;
+  uint64_t _last_samples = 0;
+  // measured frames still drawn at the scale before the last change
+  uint32_t _stale = 0;
+
+  Resolution_Stats _stats;
+};
@@ -0,0 +1,70 @@
+#include "Thread_Pool.h"
+
+Thread_Pool::Thread_Pool(uint32_t thread_count) {
+  if (thread_count == 0) {
+    uint32_t cores = std::thread::hardware_concurrency();
+    thread_count = cores > 1 ? cores - 1 : 1;
+  }
+
+  _workers.reserve(thread_count);
+  for (uint32_t i = 0; i < thread_count; i++) {
+    _workers.emplace_back(&Thread_Pool::worker_loop, this);
+  }
+}
+
+/**
+ * @brief Finishes every queued job before the workers are joined
+ */
+Thread_Pool::~Thread_Pool() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stopping = true;
+  }
+  _job_ready.notify_all();
+
+  for (auto& worker : _workers) {
+    worker.join();
+  }
+}
+
+void Thread_Pool::enqueue(std::function<void()>&& job) {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _jobs.push_back(std::move(job));
+  }
+  _job_ready.notify_one();
+}
+
+/**
+ * @brief Blocks until the queue is empty and no job is running
+ */
+void Thread_Pool::wait_idle() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  _idle.wait(lock, [&]() { return _jobs.empty() && _active == 0; });
+}
+
+void Thread_Pool::worker_loop() {
+  while (true) {
+    std::function<void()> job;
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _job_ready.wait(lock, [&]() { return _stopping || !_jobs.empty(); });
+      if (_jobs.empty()) {
+        return;
+      }
+      job = std::move(_jobs.front());
+      _jobs.pop_front();
+      _active++;
+    }
+
+    job();
+
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _active--;
+      if (_jobs.empty() && _active == 0) {
+        _idle.notify_all();
+      }
+    }
+  }
+}
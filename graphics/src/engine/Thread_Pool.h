@@ -0,0 +1,37 @@
+#pragma once
+
+#include "../vulkan_util/vk_types.h"
+
+#include <condition_variable>
+#include <thread>
+
+/**
+ * @brief Fixed set of worker threads that run queued jobs in FIFO order
+ */
+class Thread_Pool
+{
+public:
+  // zero picks one thread per core, leaving a core for the main thread
+  Thread_Pool(uint32_t thread_count = 0);
+  ~Thread_Pool();
+
+  Thread_Pool (const Thread_Pool&) = delete;
+  Thread_Pool& operator= (const Thread_Pool&) = delete;
+
+  void enqueue(std::function<void()>&& job);
+  void wait_idle();
+
+  uint32_t thread_count() const { return static_cast<uint32_t>(_workers.size()); }
+
+private:
+  std::vector<std::thread>          _workers;
+  std::deque<std::function<void()>> _jobs;
+
+  std::mutex              _mutex;
+  std::condition_variable _job_ready;
+  std::condition_variable _idle;
+  uint32_t                _active{0};
+  bool                    _stopping{false};
+
+  void worker_loop();
+};
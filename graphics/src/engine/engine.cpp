@@ -1,10 +1,17 @@
 #include "engine.h"
 
 #include <glm/gtx/transform.hpp>
+#include <filesystem>
 
 #define VMA_IMPLEMENTATION
 #include "../../external_src/vk_mem_alloc.h"
 
+// stages the graphics submission waits on the acquired image at, and
+// signals the render semaphore presentation waits on after
+constexpr VkPipelineStageFlags2 SWAPCHAIN_WAIT_STAGES = 
+  VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR | VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT_KHR;
+constexpr VkPipelineStageFlags2 RENDER_SIGNAL_STAGES = VK_PIPELINE_STAGE_2_ALL_GRAPHICS_BIT;
+
 
 MB_Engine::MB_Engine() {
 
@@ -20,15 +27,125 @@ MB_Engine::~MB_Engine() {
 void MB_Engine::init() {
   create_window();
   vk = new vk_interface(_window);
-  vk->init(_window_extent);
+  vk->init(_frames_in_flight, _present_mode);
+  workers = new Thread_Pool();
+  shader_compiler = new Shader_Compiler("shaders", "shader_cache");
+  pipeline_library = new Pipeline_Library(vk->_device, vk->_pipeline_cache, vk->_layout_cache, shader_compiler);
+  pipeline_compiler = new Pipeline_Compiler(
+    vk->_device->_logical, 
+    vk->_pipeline_cache, 
+    vk->_layout_cache, 
+    shader_compiler, 
+    pipeline_library, 
+    workers
+  );
+  init_descriptors();
   init_pipelines();
+  init_uniforms();
+  init_textures();
+  init_background();
   load_meshes();
   init_gui();
+  init_pacer();
+  init_render_graph();
+  init_resolution();
+  init_governor();
   init_camera();
   init_scene();
   _initialized = true;
 }
 
+/**
+ * @brief Sets how many frames the CPU may record ahead of the GPU,
+ *        1 gives the lowest latency and more frames give throughput
+ * @param count number of frames in flight, clamped to [1, MAX_FRAME_OVERLAP]
+ */
+void MB_Engine::set_frames_in_flight(uint32_t count) {
+  _frames_in_flight = std::clamp(count, 1u, MAX_FRAME_OVERLAP);
+  if (_initialized) {
+    vk->_cmd->set_frame_overlap(_frames_in_flight);
+  }
+}
+
+/**
+ * @brief Sets the preferred present mode, FIFO is used when the
+ *        surface does not support it
+ */
+void MB_Engine::set_present_mode(VkPresentModeKHR mode) {
+  _present_mode = mode;
+  if (_initialized) {
+    vk->_swapchain->preferred_present_mode = mode;
+    resize_requested = true;
+  }
+}
+
+/**
+ * @brief Limits the frame rate, input is sampled just before the 
+ *        deadline of each frame to keep latency low
+ * @param fps target frames per second, 0 disables the limiter
+ */
+void MB_Engine::set_target_fps(double fps) {
+  _target_fps = static_cast<float>(fps);
+  if (_initialized) {
+    pacer->set_target_fps(fps);
+  }
+}
+
+/**
+ * @brief Sets the fraction of the window size the scene is drawn at, 
+ *        smaller scales are upscaled to the window by upscale.comp
+ * @param scale clamped to [0.25, 1], 1 draws at native resolution
+ */
+void MB_Engine::set_render_scale(float scale) {
+  _render_scale = std::clamp(scale, 0.25f, 1.f);
+  if (_initialized) {
+    resolution->set_scale(_render_scale);
+  }
+}
+
+/**
+ * @brief Lets the render scale follow the GPU time of the graphics queue,
+ *        lowering it when a frame takes longer than the target
+ * @param target_ms GPU time per frame to stay under, 0 keeps the scale fixed
+ */
+void MB_Engine::set_dynamic_resolution(float target_ms) {
+  _dynamic_target_ms = std::max(target_ms, 0.f);
+  if (_initialized) {
+    resolution->set_enabled(_dynamic_target_ms > 0.f);
+    if (_dynamic_target_ms > 0.f) {
+      resolution->set_target_ms(_dynamic_target_ms);
+    }
+  }
+}
+
+/**
+ * @brief Lets the quality governor lower LOD, draw distance, instance
+ *        density and render scale whenever a frame takes longer than the budget
+ * @param budget_ms CPU and GPU time per frame to stay under, 0 disables it
+ */
+void MB_Engine::set_frame_budget(float budget_ms) {
+  _frame_budget_ms = std::max(budget_ms, 0.f);
+  if (_initialized) {
+    if (_frame_budget_ms > 0.f) {
+      governor->set_budget_ms(_frame_budget_ms);
+    }
+    governor->set_enabled(_frame_budget_ms > 0.f);
+    if (_frame_budget_ms == 0.f) {
+      governor->restore();
+    }
+  }
+}
+
+/**
+ * @brief Writes the governor's decisions to a CSV file
+ */
+void MB_Engine::set_quality_log(const std::string& path) {
+  _quality_log_path = path;
+  if (_initialized) {
+    governor->set_log_path(path);
+  }
+}
+
 /**
  * @brief main rendering loop for the MB_Engine, runs until
  *        window is closed for an error is encountered.
@@ -39,6 +156,9 @@ bool should_quit = false;
 
 // main rendering loop
 while (!should_quit) {
+  // wait for the frame deadline before input is sampled
+  pacer->wait_for_frame_start();
+
   // handle events
   while (SDL_PollEvent(&event) != 0) {
     // quit on alt-f4 or exit
@@ -46,15 +166,20 @@ while (!should_quit) {
       should_quit = true;
     }
     else if (event.type == SDL_WINDOWEVENT) {
-      switch (event.window.type) {
+      switch (event.window.event) {
         // rendering should halt while the window is minimized
         case SDL_WINDOWEVENT_MINIMIZED:
           stop_rendering = true;
           break;
-        // rendering will resume when the window is maximized
+        // rendering will resume when the window is maximized or restored
         case SDL_WINDOWEVENT_MAXIMIZED:
+        case SDL_WINDOWEVENT_RESTORED:
           stop_rendering = false;
           break;
+        // the swapchain is rebuilt before the next frame
+        case SDL_WINDOWEVENT_SIZE_CHANGED:
+          resize_requested = true;
+          break;
 
         default:
           break;
@@ -89,6 +214,7 @@ while (!should_quit) {
 
     gui->process_event(&event);
   }
+  pacer->mark_input_sampled();
 
   // slow loop iteration to save resources  
   if (stop_rendering) {
@@ -112,9 +238,37 @@ void MB_Engine::cleanup() {
   if (_initialized) {
     
     vkDeviceWaitIdle(vk->_device->_logical);
+    // continuations free staging memory and ImGui upload objects, they run 
+    // before the subsystems owning them are destroyed
+    vk->_cmd->finish_uploads();
     mb_objs.flush();
+    for (uint32_t i = 0; i < MAX_FRAME_OVERLAP; i++) {
+      delete _background_images[i];
+    }
+    delete _uniforms;
+    delete render_graph;
+    delete resolution;
+    delete governor;
+    streamer->report();
+    delete streamer;
+    delete _ui_atlas;
+    textures->report();
+    delete textures;
+    _descriptors->report("persistent");
+    vk->_sampler_cache->report();
+    delete _descriptors;
+    for (uint32_t i = 0; i < MAX_FRAME_OVERLAP; i++) {
+      delete _frame_descriptors[i];
+    }
+    delete pipeline_compiler;
+    delete workers;
     pipeline_queue.flush(vk->_device->_logical);
+    // linked pipelines, including retired ones, are destroyed before the parts they were linked from
+    vk->_deletion_queue->flush();
+    delete pipeline_library;
+    delete shader_compiler;
     delete camera;
+    delete pacer;
     delete gui;
     
     SDL_DestroyWindow(_window);
@@ -144,43 +298,626 @@ void MB_Engine::create_window() {
   );
 }
 
+/**
+ * @brief Descriptor sets come from growable pool chains, the ratios are
+ *        only a starting point and pools created later follow usage
+ */
+void MB_Engine::init_descriptors() {
+  VkDevice _logical = vk->_device->_logical;
+
+  std::vector<vkdescriptor::Pool_Ratio> ratios = {
+    { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1.f },
+    { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1.f },
+    { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1.f },
+    { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1.f },
+    { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2.f },
+  };
+
+  _descriptors = new vkdescriptor::Growable_Allocator(_logical, vk->_layout_cache, 16, ratios);
+  for (uint32_t i = 0; i < MAX_FRAME_OVERLAP; i++) {
+    _frame_descriptors[i] = new vkdescriptor::Growable_Allocator(_logical, vk->_layout_cache, 64, ratios);
+  }
+}
+
+/**
+ * @brief Pipelines are compiled concurrently on the worker threads, 
+ *        their shaders are compiled from GLSL on the same workers and
+ *        their layouts are reflected from the shaders. Only the pipelines
+ *        needed to draw anything are waited on, the rest compile on demand
+ */
 void MB_Engine::init_pipelines() {
+  auto start = std::chrono::steady_clock::now();
+
   init_mesh_pipeline();
+  init_background_pipeline();
+  init_upscale_pipeline();
+  pipeline_compiler->wait();
+
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  fmt::println(
+    "compiled {} pipelines on {} threads in {:.2f} ms ({} failed, {} deduplicated)",
+    pipeline_compiler->compiled_count(),
+    workers->thread_count(),
+    std::chrono::duration<double, std::milli>(elapsed).count(),
+    pipeline_compiler->failed_count(),
+    pipeline_queue.deduplicated_count
+  );
+  shader_compiler->report();
+  vk->_pipeline_cache->report();
+  pipeline_library->report();
+  vk->_layout_cache->report();
+
+  // set layouts come from the reflected pipeline layouts
+  required_set_layouts(_mesh_fallback, "Mesh Pipeline", 0);
+  _gradient_set_layout = required_set_layouts(_gradient_pipeline, "Gradient Pipeline", 1)[0];
+  _upscale_set_layout = required_set_layouts(_upscale_pipeline, "Upscale Pipeline", 1)[0];
+
+  // every mesh variant shares the layout of the vertex color pipeline it falls back to
+  Material mat;
+  mat.create_material(_mesh_fallback, _mesh_fallback, _mesh_state);
+  materials["mesh"] = mat;
 }
 
+/**
+ * @brief Set layouts of a pipeline nothing can be drawn without, shaders
+ *        are compiled at runtime so a failed compile ends startup here
+ * @param set_count sets the reflected layout must have at least
+ */
+std::vector<VkDescriptorSetLayout> MB_Engine::required_set_layouts(Pipeline_Handle handle, const char* name, size_t set_count) {
+  if (pipeline_queue.pipeline(handle) == VK_NULL_HANDLE) {
+    throw std::runtime_error(fmt::format("failed to compile required pipeline {}", name));
+  }
+  std::vector<VkDescriptorSetLayout> set_layouts = vk->_layout_cache->set_layouts(pipeline_queue.layout(handle));
+  if (set_layouts.size() < set_count) {
+    throw std::runtime_error(fmt::format("pipeline {} has {} descriptor sets, expected {}", name, set_layouts.size(), set_count));
+  }
+  return set_layouts;
+}
+
+/**
+ * @brief Compiles the vertex color mesh pipeline, the generic fallback
+ *        other shading modes draw with until they are compiled
+ */
 void MB_Engine::init_mesh_pipeline() {
-  VkPipelineLayout layout;
-  vklayout::Layout::mesh_layout(vk->_device->_logical, &layout);
+  _mesh_state.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+  _mesh_state.polygon_mode = VK_POLYGON_MODE_FILL;
+  _mesh_state.cull_mode = VK_CULL_MODE_NONE;
+  _mesh_state.front_face = VK_FRONT_FACE_CLOCKWISE;
+  _mesh_state.depth_test = true;
+  _mesh_state.depth_write = true;
+  _mesh_state.depth_compare = VK_COMPARE_OP_LESS_OR_EQUAL;
 
-  Pipeline pipeline_builder(vk->_device->_logical);
-  pipeline_builder.set_shaders("shaders/tri_mesh.vert.spv", "shaders/colored_triangle.frag.spv");
+  _mesh_fallback = request_mesh_pipeline(SHADING_VERTEX_COLOR);
+}
 
+/**
+ * @brief Queues a shading mode of the mesh pipeline with the current mesh
+ *        state as a variant of the same shader modules, returns without
+ *        waiting for the compile. States the device can set per draw are
+ *        left dynamic, so requests differing only in them share a pipeline
+ */
+Pipeline_Handle MB_Engine::request_mesh_pipeline(uint32_t mode) {
   VertexInputDescription vertex_description = Vertex::get_vertex_description();
-  pipeline_builder._vertex_input_info.pVertexAttributeDescriptions = vertex_description.attributes.data();
-  pipeline_builder._vertex_input_info.vertexAttributeDescriptionCount = static_cast<uint32_t>(vertex_description.attributes.size());
-  pipeline_builder._vertex_input_info.pVertexBindingDescriptions = vertex_description.bindings.data();
-  pipeline_builder._vertex_input_info.vertexBindingDescriptionCount = static_cast<uint32_t>(vertex_description.bindings.size());
-
-  pipeline_builder.set_input_topology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
-  pipeline_builder.set_polygon_mode(VK_POLYGON_MODE_FILL);
-  pipeline_builder.set_cull_mode(VK_CULL_MODE_NONE, VK_FRONT_FACE_CLOCKWISE);
-  pipeline_builder.set_multisampling_none();
-  pipeline_builder.set_pipeline_layout(layout);
-  pipeline_builder.default_depth_stencil(true, true, VK_COMPARE_OP_LESS_OR_EQUAL);
-  pipeline_builder.disable_blending();
-  VkPipeline pipeline = pipeline_builder.build_pipeline(vk->_swapchain->_renderpass);
-
-  pipeline_queue.pipeline_layouts["Mesh Layout"] = layout;
-  pipeline_queue.pipelines["Mesh Pipeline"] = pipeline;
 
-  Material mat;
-  mat.create_material(pipeline, layout);
-  materials["mesh"] = mat;
+  const char* names[SHADING_MODE_COUNT] = { "Mesh Pipeline", "Mesh Solid", "Mesh Normals", "Mesh Depth", "Mesh Textured" };
+  auto description = std::make_shared<Pipeline_Description>();
+  description->name = names[mode];
+  description->vert_filepath = "shaders/tri_mesh.vert";
+  description->frag_filepath = "shaders/mesh.frag";
+  description->vertex_bindings = vertex_description.bindings;
+  description->vertex_attributes = vertex_description.attributes;
+  description->state = _mesh_state;
+  description->dynamic_states = supported_dynamic_states(vk->_device);
+  description->render_pass = vk->_swapchain->_scene_renderpass;
+  // camera and object uniforms are written to the uniform ring
+  description->dynamic_buffers = { { 0, 0 }, { 1, 0 } };
+
+  description->variant.set(0, mode);
+  if (mode == SHADING_SOLID) {
+    // solid red, the old triangle.frag
+    description->variant.set(1, 1.f).set(2, 0.f).set(3, 0.f);
+  }
+  return pipeline_compiler->compile(description, &pipeline_queue);
+}
+
+void MB_Engine::init_background_pipeline() {
+  auto description = std::make_shared<Pipeline_Description>();
+  description->name = "Gradient Pipeline";
+  description->comp_filepath = "shaders/gradient.comp";
+
+  _gradient_pipeline = pipeline_compiler->compile(description, &pipeline_queue);
+}
+
+/**
+ * @brief Compiles the upscaler, it reads the scene with texel fetches so
+ *        its sampler only has to clamp
+ */
+void MB_Engine::init_upscale_pipeline() {
+  auto description = std::make_shared<Pipeline_Description>();
+  description->name = "Upscale Pipeline";
+  description->comp_filepath = "shaders/upscale.comp";
+
+  _upscale_pipeline = pipeline_compiler->compile(description, &pipeline_queue);
+
+  VkSamplerCreateInfo sampler_info{};
+  sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+  sampler_info.pNext = nullptr;
+  sampler_info.magFilter = VK_FILTER_LINEAR;
+  sampler_info.minFilter = VK_FILTER_LINEAR;
+  sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+  sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  sampler_info.maxAnisotropy = 1.f;
+  sampler_info.compareOp = VK_COMPARE_OP_ALWAYS;
+  sampler_info.minLod = 0.f;
+  sampler_info.maxLod = 0.f;
+  sampler_info.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+  sampler_info.unnormalizedCoordinates = VK_FALSE;
+  _upscale_sampler = vk->_sampler_cache->get_sampler(sampler_info);
+}
+
+/**
+ * @brief Creates the uniform ring and the sets of the mesh shaders, the
+ *        ring grows with the scene so this is only a starting size
+ */
+void MB_Engine::init_uniforms() {
+  _uniforms = new Uniform_Ring(vk->_device, vk->_allocator, 256 * 1024, MAX_FRAME_OVERLAP);
+  write_uniform_sets();
+}
+
+/**
+ * @brief Points new sets at the whole ring, they are only written again
+ *        when the ring grows. Sets of the old buffer may still be bound by
+ *        frames in flight, so they are left allocated rather than updated
+ */
+void MB_Engine::write_uniform_sets() {
+  std::vector<VkDescriptorSetLayout> set_layouts = required_set_layouts(_mesh_fallback, "Mesh Pipeline", 2);
+  _camera_set = _descriptors->allocate(set_layouts[0]);
+  _object_set = _descriptors->allocate(set_layouts[1]);
+
+  VkDescriptorBufferInfo camera_info = _uniforms->descriptor(sizeof(Camera_Uniforms));
+  VkDescriptorBufferInfo object_info = _uniforms->descriptor(sizeof(Object_Uniforms));
+
+  VkWriteDescriptorSet writes[2] = {};
+  writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  writes[0].dstSet = _camera_set;
+  writes[0].dstBinding = 0;
+  writes[0].descriptorCount = 1;
+  writes[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+  writes[0].pBufferInfo = &camera_info;
+
+  writes[1] = writes[0];
+  writes[1].dstSet = _object_set;
+  writes[1].pBufferInfo = &object_info;
+
+  vkUpdateDescriptorSets(vk->_device->_logical, 2, writes, 0, nullptr);
+}
+
+/**
+ * @brief Loads the textures of the mesh material, a compressed version
+ *        of the texture is used instead of the PNG when one is present.
+ *        Only the small mips are loaded up front, the rest are streamed
+ *        in as the meshes using them get close enough to need them
+ */
+void MB_Engine::init_textures() {
+  textures = new Texture_Cache(vk->_device, vk->_allocator, vk->_cmd, vk->_sampler_cache);
+  streamer = new Texture_Streamer(textures, vk->_cmd, vk->_deletion_queue, workers, 64ull * 1024 * 1024);
+
+  Texture_Options options;
+  options.stream = true;
+  Texture* color = textures->load("textures/checker.png", options);
+  streamer->add(color);
+
+  _texture_set_layout = required_set_layouts(_mesh_fallback, "Mesh Pipeline", 3)[2];
+  materials["mesh"]._texture = color;
+
+  // the small images next to the textures are packed into one atlas at runtime,
+  // vkatlas::pack_directory does the same offline for Texture_Atlas::load
+  vkatlas::Atlas_Builder builder;
+  std::error_code error;
+  for (const auto& entry : std::filesystem::directory_iterator("textures", error)) {
+    vktexture::Texture_Data image;
+    std::string ext = entry.path().extension().string();
+    if ((ext == ".png" || ext == ".jpg") &&
+        vktexture::load_image(entry.path().string(), true, &image) &&
+        std::max(image.extent.width, image.extent.height) <= 256) {
+      builder.add(entry.path().filename().string(), image);
+    }
+  }
+  _ui_atlas = new Texture_Atlas(textures);
+  if (builder.image_count() > 0 && _ui_atlas->build(builder, "ui atlas")) {
+    const Texture* atlas = _ui_atlas->texture();
+    fmt::println(
+      "packed {} images into {} {}x{} atlas layers",
+      _ui_atlas->image_count(),
+      _ui_atlas->layer_count(),
+      atlas->extent.width,
+      atlas->extent.height
+    );
+  }
+}
+
+/**
+ * @brief Creates the images the gradient compute shader writes to, they are
+ *        shared between the compute and graphics queues so no ownership 
+ *        transfers are needed
+ */
+void MB_Engine::init_background() {
+  VkDevice _logical = vk->_device->_logical;
+
+  std::vector<uint32_t> queue_families = { vk->_device->_graphics_index.value() };
+  if (vk->_device->_compute_index.value() != vk->_device->_graphics_index.value()) {
+    queue_families.push_back(vk->_device->_compute_index.value());
+  }
+
+  // the background is stretched by the blit if the window is resized
+  VkExtent2D extent = vk->_swapchain->swapchain_extent;
+  for (uint32_t i = 0; i < MAX_FRAME_OVERLAP; i++) {
+    _background_images[i] = new Image(vk->_allocator, _logical);
+    _background_images[i]->create_image(
+      { extent.width, extent.height, 1 },
+      VK_FORMAT_R16G16B16A16_SFLOAT,
+      VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+      VK_IMAGE_ASPECT_COLOR_BIT,
+      queue_families
+    );
+
+    _background_sets[i] = _descriptors->allocate(_gradient_set_layout);
+
+    VkDescriptorImageInfo image_info{};
+    image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    image_info.imageView = _background_images[i]->_image_view;
+
+    VkWriteDescriptorSet image_write{};
+    image_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    image_write.dstBinding = 0;
+    image_write.dstSet = _background_sets[i];
+    image_write.descriptorCount = 1;
+    image_write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    image_write.pImageInfo = &image_info;
+    vkUpdateDescriptorSets(_logical, 1, &image_write, 0, nullptr);
+  }
 }
 
 void MB_Engine::init_gui() {
   gui = new GUI(_window, vk);
   gui->init_imgui();
+
+  gui->add_panel([&]() {
+    ImGui::Begin("Shading");
+    const char* modes[SHADING_MODE_COUNT] = { "Vertex color", "Solid", "Normals", "Depth", "Textured" };
+    int mode = _selected_shader;
+    if (ImGui::Combo("Mode", &mode, modes, SHADING_MODE_COUNT)) {
+      set_shading_mode(mode);
+    }
+    bool wireframe = _mesh_state.polygon_mode == VK_POLYGON_MODE_LINE;
+    bool cull_back = _mesh_state.cull_mode == VK_CULL_MODE_BACK_BIT;
+    bool changed = false;
+    if (vk->_device->_fill_mode_non_solid) {
+      changed |= ImGui::Checkbox("Wireframe", &wireframe);
+    }
+    changed |= ImGui::Checkbox("Cull back faces", &cull_back);
+    changed |= ImGui::Checkbox("Depth test", &_mesh_state.depth_test);
+    if (changed) {
+      _mesh_state.polygon_mode = wireframe ? VK_POLYGON_MODE_LINE : VK_POLYGON_MODE_FILL;
+      _mesh_state.cull_mode = cull_back ? VK_CULL_MODE_BACK_BIT : VK_CULL_MODE_NONE;
+      _mesh_state.depth_write = _mesh_state.depth_test;
+      update_mesh_material();
+    }
+
+    const Dynamic_State_Stats& dynamic = vk->_cmd->dynamic_state_stats();
+    ImGui::Text("Pipelines: %u", static_cast<uint32_t>(pipeline_queue.entries.size()));
+    ImGui::Text("Dynamic state: %s", vk->_device->_extended_dynamic_state ? "enabled" : "unavailable");
+    ImGui::Text("State commands: %u (%u redundant skipped)", dynamic.commands, dynamic.redundant);
+    ImGui::Checkbox("Skip while compiling", &pipeline_queue.skip_pending);
+    const Pipeline_Swap_Stats& swaps = pipeline_queue.swap_stats;
+    ImGui::Text("Fallback draws: %u", swaps.fallback_draws);
+    ImGui::Text("Skipped draws: %u", swaps.skipped_draws);
+    ImGui::Text("Swap ins: %u (last %.2f ms, max %.2f ms)", swaps.swap_ins, swaps.last_swap_in_ms, swaps.max_swap_in_ms);
+    ImGui::End();
+  });
+
+  // ImGui samples 2D textures, an atlas that needed more layers is not shown
+  if (_ui_atlas->texture() != nullptr && _ui_atlas->layer_count() == 1) {
+    _ui_atlas_set = ImGui_ImplVulkan_AddTexture(
+      _ui_atlas->texture()->sampler,
+      _ui_atlas->texture()->image->_image_view,
+      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+    );
+  }
+
+  gui->add_panel([&]() {
+    ImGui::Begin("Atlas");
+    ImGui::Text("Images: %u in %u layers", static_cast<uint32_t>(_ui_atlas->image_count()), _ui_atlas->layer_count());
+    if (_ui_atlas_set != VK_NULL_HANDLE) {
+      for (const auto& entry : _ui_atlas->rects()) {
+        const vkatlas::Atlas_Rect& rect = entry.second;
+        glm::vec2 uv1 = rect.uv_offset + rect.uv_scale;
+        ImGui::Image(
+          (ImTextureID)_ui_atlas_set,
+          ImVec2(64.f, 64.f),
+          ImVec2(rect.uv_offset.x, rect.uv_offset.y),
+          ImVec2(uv1.x, uv1.y)
+        );
+        ImGui::SameLine();
+        ImGui::Text("%s (%ux%u)", entry.first.c_str(), rect.width, rect.height);
+      }
+    }
+    ImGui::End();
+  });
+
+  gui->add_panel([&]() {
+    const Streaming_Stats& stats = streamer->stats();
+    ImGui::Begin("Texture Streaming");
+    int budget_mib = static_cast<int>(stats.budget / (1024 * 1024));
+    if (ImGui::SliderInt("Budget (MiB)", &budget_mib, 1, 512)) {
+      streamer->set_budget(VkDeviceSize(budget_mib) * 1024 * 1024);
+    }
+    ImGui::Text("Resident: %.2f MiB", stats.committed_bytes / (1024.0 * 1024.0));
+    ImGui::Text("Visible objects: %u of %u", static_cast<uint32_t>(_visible.size()), static_cast<uint32_t>(_renderables.size()));
+    ImGui::Text("Loads pending: %u", stats.pending);
+    ImGui::Text("Levels streamed in: %u, evicted: %u", stats.streamed_in, stats.evicted);
+    ImGui::Text("Over budget: %u (%u failed)", stats.over_budget, stats.failed);
+    Texture* color = materials["mesh"]._texture;
+    ImGui::Text("Mesh texture: mip %u of %u", color->resident_mip, color->mip_levels);
+    ImGui::End();
+  });
+}
+
+/**
+ * @brief Switches every mesh to another variant of the mesh pipeline,
+ *        a variant used for the first time compiles in the background
+ *        and meshes draw with the vertex color pipeline until it is ready
+ */
+void MB_Engine::set_shading_mode(int mode) {
+  _selected_shader = std::clamp(mode, 0, static_cast<int>(SHADING_MODE_COUNT) - 1);
+  update_mesh_material();
+}
+
+/**
+ * @brief Points every mesh at the pipeline for the current shading mode
+ *        and mesh state, pipelines already requested are reused
+ */
+void MB_Engine::update_mesh_material() {
+  Pipeline_Handle pipeline = request_mesh_pipeline(_selected_shader);
+  materials["mesh"].create_material(pipeline, _mesh_fallback, _mesh_state);
+  for (auto object : _renderables) {
+    object->material = materials["mesh"];
+  }
+}
+
+void MB_Engine::init_pacer() {
+  pacer = new Frame_Pacer(vk);
+  pacer->set_target_fps(_target_fps);
+
+  gui->add_panel([&]() {
+    const Pacing_Stats& stats = pacer->stats();
+    ImGui::Begin("Frame Pacing");
+    const char* present_modes[] = { "FIFO", "MAILBOX", "IMMEDIATE" };
+    const VkPresentModeKHR present_mode_values[] = {
+      VK_PRESENT_MODE_FIFO_KHR, VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR
+    };
+    int present_mode_index = 0;
+    for (int i = 0; i < 3; i++) {
+      if (present_mode_values[i] == _present_mode) {
+        present_mode_index = i;
+      }
+    }
+    if (ImGui::Combo("Present mode", &present_mode_index, present_modes, 3)) {
+      set_present_mode(present_mode_values[present_mode_index]);
+    }
+    ImGui::Text("Active mode: %s", string_VkPresentModeKHR(vk->_swapchain->present_mode));
+    ImGui::Text("Present wait: %s", stats.present_wait ? "enabled" : "unavailable");
+    ImGui::Text("Frame: %.2f ms", stats.frame_ms);
+    ImGui::Text("Work estimate: %.2f ms", stats.work_ms);
+    ImGui::Text("Sleep: %.2f ms", stats.sleep_ms);
+    ImGui::Text("Input to present: %.2f ms (max %.2f ms)", stats.latency_ms, stats.max_latency_ms);
+    if (ImGui::SliderFloat("FPS limit", &_target_fps, 0.f, 240.f, "%.0f")) {
+      pacer->set_target_fps(_target_fps);
+    }
+    ImGui::End();
+  });
+
+  gui->add_panel([&]() {
+    const Gpu_Frame_Times& times = vk->_cmd->gpu_frame_times();
+    ImGui::Begin("Async Compute");
+    ImGui::Text("Compute queue: %s", vk->_device->_async_compute ? "dedicated" : "shared with graphics");
+    ImGui::Text("Graphics: %.3f ms", times.graphics_ms);
+    ImGui::Text("Compute: %.3f ms", times.compute_ms);
+    ImGui::Text("Overlap: %.3f ms", times.overlap_ms);
+    ImGui::End();
+  });
+
+  gui->add_panel([&]() {
+    const vkdescriptor::Allocator_Stats& frame = _frame_descriptors[vk->_cmd->get_frame_index()]->stats();
+    const vkdescriptor::Allocator_Stats& persistent = _descriptors->stats();
+    ImGui::Begin("Descriptors");
+    ImGui::Text("Frame sets: %u in %u pools", frame.sets_allocated, frame.pools_in_use);
+    ImGui::Text("Frame pools created: %u (%u overflows)", frame.pools_created, frame.pool_overflows);
+    ImGui::Text("Persistent sets: %u in %u pools", persistent.sets_allocated, persistent.pools_created);
+    const Uniform_Ring_Stats& ring = _uniforms->stats();
+    ImGui::Text("Uniform writes: %u (%u bytes, peak %u, grown %u times)", 
+      ring.writes, static_cast<uint32_t>(ring.bytes), static_cast<uint32_t>(ring.peak_bytes), ring.grows);
+    ImGui::End();
+  });
+}
+
+void MB_Engine::init_render_graph() {
+  render_graph = new Render_Graph(vk->_device, vk->_allocator, vk->_cmd, vk->_deletion_queue);
+
+  gui->add_panel([&]() {
+    const Graph_Schedule& schedule = render_graph->schedule();
+    ImGui::Begin("Render Graph");
+    ImGui::Text("Passes: %u (%u culled)", static_cast<uint32_t>(schedule.passes.size()), schedule.culled);
+    ImGui::Text("Render passes: %u", schedule.render_passes);
+    ImGui::Text("Barriers: %u in %u batches", schedule.barriers, schedule.barrier_batches);
+    for (const auto& pass : schedule.passes) {
+      if (pass.culled) {
+        ImGui::BulletText("%s (culled)", pass.name.c_str());
+      }
+      else {
+        ImGui::BulletText("%s: %u barriers%s", pass.name.c_str(), pass.barriers, pass.merged ? ", merged" : "");
+      }
+    }
+    ImGui::Text("Transients: %.2f MiB aliased into %.2f MiB", 
+      schedule.transient_bytes / (1024.0 * 1024.0), schedule.allocated_bytes / (1024.0 * 1024.0));
+    for (const auto& transient : schedule.transients) {
+      ImGui::BulletText("%s: slot %u, passes %u to %u", 
+        transient.name.c_str(), transient.slot, transient.first_pass, transient.last_pass);
+    }
+    ImGui::Text("Rebuilds: %u", schedule.rebuilds);
+    ImGui::End();
+  });
+}
+
+/**
+ * @brief The controller starts from the scale set at launch, the scene
+ *        targets are always window sized so changing it never reallocates
+ */
+void MB_Engine::init_resolution() {
+  resolution = new Resolution_Controller();
+  resolution->set_scale(_render_scale);
+  resolution->set_enabled(_dynamic_target_ms > 0.f);
+  if (_dynamic_target_ms > 0.f) {
+    resolution->set_target_ms(_dynamic_target_ms);
+  }
+
+  gui->add_panel([&]() {
+    VkExtent2D output = vk->_swapchain->swapchain_extent;
+    const Resolution_Stats& stats = resolution->stats();
+    ImGui::Begin("Resolution");
+
+    bool dynamic = resolution->enabled();
+    if (ImGui::Checkbox("Dynamic", &dynamic)) {
+      resolution->set_scale(_render_scale);
+      resolution->set_enabled(dynamic);
+    }
+    if (dynamic) {
+      float target_ms = stats.target_ms;
+      if (ImGui::SliderFloat("GPU target (ms)", &target_ms, 4.f, 33.3f, "%.1f")) {
+        resolution->set_target_ms(target_ms);
+      }
+      float limits[2] = { resolution->min_scale(), resolution->max_scale() };
+      if (ImGui::SliderFloat2("Scale limits", limits, 0.25f, 1.f, "%.2f")) {
+        resolution->set_limits(limits[0], limits[1]);
+      }
+      ImGui::Text("Render scale: %.2f", _render_scale);
+      ImGui::Text("GPU: %.3f ms smoothed", stats.gpu_ms);
+      ImGui::Text("Changes: %u up, %u down", stats.increases, stats.decreases);
+      ImGui::Text("Settling: %u frames", stats.cooldown);
+      if (!stats.measuring) {
+        ImGui::Text("No GPU timestamps, the scale is held");
+      }
+    }
+    else {
+      ImGui::SliderFloat("Render scale", &_render_scale, 0.25f, 1.f, "%.2f");
+    }
+
+    ImGui::Text("Render: %ux%u", _render_extent.width, _render_extent.height);
+    ImGui::Text("Output: %ux%u", output.width, output.height);
+    bool upscaling = _render_extent.width != output.width || _render_extent.height != output.height || dynamic;
+    ImGui::Text("Upscaler: %s", upscaling ? "edge adaptive" : "off at native scale");
+    ImGui::End();
+  });
+}
+
+/**
+ * @brief Registers the knobs the governor trades against the frame budget,
+ *        the lowest priority is given up first
+ */
+void MB_Engine::init_governor() {
+  governor = new Quality_Governor();
+  if (!_quality_log_path.empty()) {
+    governor->set_log_path(_quality_log_path);
+  }
+
+  Quality_Knob density;
+  density.name = "instance density";
+  density.priority = 0;
+  density.cost = Knob_Cost::Both;
+  density.cheapest = 0.25f;
+  density.best = 1.f;
+  density.steps = 3;
+  density.level = 3;
+  density.apply = [&](float value) { _instance_density = value; };
+  governor->add_knob(density);
+
+  Quality_Knob distance;
+  distance.name = "draw distance";
+  distance.priority = 1;
+  distance.cost = Knob_Cost::Both;
+  distance.cheapest = 50.f;
+  distance.best = _draw_distance;
+  distance.steps = 3;
+  distance.level = 3;
+  distance.apply = [&](float value) { _draw_distance = value; };
+  governor->add_knob(distance);
+
+  // positive biases stream coarser mips, the sampler's own bias stays 0
+  Quality_Knob lod;
+  lod.name = "texture lod bias";
+  lod.priority = 2;
+  lod.cost = Knob_Cost::Gpu;
+  lod.cheapest = 2.f;
+  lod.best = 0.f;
+  lod.steps = 2;
+  lod.level = 2;
+  lod.apply = [&](float value) { _lod_bias = value; };
+  governor->add_knob(lod);
+
+  // with dynamic resolution on the knob caps the controller instead, full
+  // quality is the scale or cap set at launch so restoring goes back to it
+  Quality_Knob scale;
+  scale.name = "render scale";
+  scale.priority = 3;
+  scale.cost = Knob_Cost::Gpu;
+  scale.best = resolution->enabled() ? resolution->max_scale() : _render_scale;
+  scale.cheapest = std::min(0.5f, scale.best);
+  scale.steps = 5;
+  scale.level = 5;
+  scale.apply = [&](float value) {
+    if (resolution->enabled()) {
+      resolution->set_limits(resolution->min_scale(), value);
+      _render_scale = resolution->scale();
+    }
+    else {
+      _render_scale = value;
+    }
+  };
+  governor->add_knob(scale);
+
+  if (_frame_budget_ms > 0.f) {
+    governor->set_budget_ms(_frame_budget_ms);
+  }
+  governor->set_enabled(_frame_budget_ms > 0.f);
+
+  gui->add_panel([&]() {
+    const Governor_Stats& stats = governor->stats();
+    ImGui::Begin("Quality");
+    bool enabled = governor->enabled();
+    if (ImGui::Checkbox("Governor", &enabled)) {
+      governor->set_enabled(enabled);
+      if (!enabled) {
+        governor->restore();
+      }
+    }
+    float budget_ms = stats.budget_ms;
+    if (ImGui::SliderFloat("Frame budget (ms)", &budget_ms, 4.f, 33.3f, "%.1f")) {
+      governor->set_budget_ms(budget_ms);
+    }
+    ImGui::Text("CPU: %.2f ms  GPU: %.2f ms (smoothed)", stats.cpu_ms, stats.gpu_ms);
+    ImGui::Text("Bound: %s", stats.bound == Knob_Cost::Cpu ? "CPU" : "GPU");
+    ImGui::Text("Lowered %u, raised %u, settling %u frames", stats.lowered, stats.raised, stats.cooldown);
+    for (const auto& knob : governor->knobs()) {
+      ImGui::BulletText("%s: %.2f (%u/%u)", knob.name.c_str(), knob.value(), knob.level, knob.steps);
+    }
+    for (auto it = governor->decisions().rbegin(); it != governor->decisions().rend(); ++it) {
+      ImGui::Text("%llu: %s %.2f -> %.2f", 
+        static_cast<unsigned long long>(it->frame), it->knob.c_str(), it->from, it->to);
+    }
+    ImGui::End();
+  });
 }
 
 void MB_Engine::load_meshes() {
@@ -200,15 +937,20 @@ void MB_Engine::load_meshes() {
 	_triangle_mesh._vertices[1].color = { 0.f, 1.f, 0.0f }; //pure green
 	_triangle_mesh._vertices[2].color = { 0.f, 1.f, 0.0f }; //pure green
 
+	_triangle_mesh._vertices[0].uv = { 1.f, 0.f };
+	_triangle_mesh._vertices[1].uv = { 0.f, 0.f };
+	_triangle_mesh._vertices[2].uv = { 0.5f, 1.f };
+
   // upload objects to the GPU
-  Object* triangle_obj = new Object(_triangle_mesh, vk->_allocator);
-  Object* monkey_obj = new Object("meshes/monkey_smooth.obj", vk->_allocator);
+  Object* triangle_obj = new Object(_triangle_mesh, vk->_allocator, vk->_deletion_queue);
+  Object* monkey_obj = new Object("meshes/monkey_smooth.obj", vk->_allocator, vk->_deletion_queue);
   triangle_obj->material = materials["mesh"];
   monkey_obj->material = materials["mesh"];
   mb_objs.map["Triangle"] = triangle_obj;
   mb_objs.map["Monkey"] = monkey_obj;
-  triangle_obj->upload_mesh();
-  monkey_obj->upload_mesh();
+  // uploads run asynchronously, the first frame waits on them
+  triangle_obj->upload_mesh(vk->_cmd);
+  monkey_obj->upload_mesh(vk->_cmd);
 }
 
 void MB_Engine::init_camera() {
@@ -221,40 +963,391 @@ void MB_Engine::init_scene() {
   _renderables.push_back(monkey);
 }
 
+/**
+ * @brief Rebuilds the swapchain for the current window size, the old
+ *        swapchain is retired without waiting on the device
+ */
+void MB_Engine::resize_swapchain() {
+  int width, height;
+  SDL_Vulkan_GetDrawableSize(_window, &width, &height);
+
+  // a zero sized swapchain cannot be created, wait until the window has an area
+  if (width == 0 || height == 0) {
+    return;
+  }
+
+  bool render_pass_replaced = vk->recreate_swapchain();
+  if (render_pass_replaced) {
+    gui->on_render_pass_changed();
+  }
+  pacer->on_swapchain_recreated();
+  render_graph->on_swapchain_recreated();
+  _window_extent = vk->_swapchain->swapchain_extent;
+  resize_requested = false;
+}
+
+/**
+ * @brief Drops renderables whose bounding sphere is outside the view
+ *        frustum or beyond the draw distance, thinned out by the instance
+ *        density, and requests the mip each visible texture is sampled at,
+ *        from the texels its mesh covers per pixel at the sphere's nearest
+ *        point to the camera
+ * @param fov_y vertical field of view in radians
+ * @param extent size of the image drawn to
+ */
+void MB_Engine::cull(const glm::mat4& viewproj, float fov_y, VkExtent2D extent) {
+  // frustum planes from the rows of the view projection, normals face inward
+  glm::vec4 rows[4] = {
+    { viewproj[0][0], viewproj[1][0], viewproj[2][0], viewproj[3][0] },
+    { viewproj[0][1], viewproj[1][1], viewproj[2][1], viewproj[3][1] },
+    { viewproj[0][2], viewproj[1][2], viewproj[2][2], viewproj[3][2] },
+    { viewproj[0][3], viewproj[1][3], viewproj[2][3], viewproj[3][3] },
+  };
+  glm::vec4 planes[6] = {
+    rows[3] + rows[0], rows[3] - rows[0],
+    rows[3] + rows[1], rows[3] - rows[1],
+    rows[3] + rows[2], rows[3] - rows[2],
+  };
+  for (auto& plane : planes) {
+    plane /= glm::length(glm::vec3(plane));
+  }
+
+  // the view translates the world by the camera position
+  glm::vec3 eye = -camera->pos;
+  float world_per_pixel = 2.f * std::tan(fov_y * 0.5f) / static_cast<float>(extent.height);
+  uint64_t frame = static_cast<uint64_t>(_frame_number);
+
+  _visible.clear();
+  for (size_t i = 0; i < _renderables.size(); i++) {
+    // thinning by the golden ratio keeps an even spread of objects at any
+    // density, the first object is always kept
+    if (std::fmod(static_cast<float>(i) * 0.618034f, 1.f) >= _instance_density) {
+      continue;
+    }
+    Object* object = _renderables[i];
+    const Mesh& mesh = object->mesh;
+    glm::vec3 center = glm::vec3(object->transform_mtx * glm::vec4(mesh._center, 1.f));
+    float scale = std::max({
+      glm::length(glm::vec3(object->transform_mtx[0])),
+      glm::length(glm::vec3(object->transform_mtx[1])),
+      glm::length(glm::vec3(object->transform_mtx[2])),
+    });
+    float radius = mesh._radius * scale;
+
+    bool inside = true;
+    for (const auto& plane : planes) {
+      if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) {
+        inside = false;
+        break;
+      }
+    }
+    float distance = std::max(glm::length(center - eye) - radius, 0.1f);
+    if (!inside || distance > _draw_distance) {
+      continue;
+    }
+    _visible.push_back(object);
+
+    Texture* texture = object->material._texture;
+    if (texture == nullptr || !texture->streamed || mesh._uv_density <= 0.f) {
+      continue;
+    }
+    float texels_per_world = mesh._uv_density / scale * static_cast<float>(std::max(texture->extent.width, texture->extent.height));
+    float texels_per_pixel = texels_per_world * distance * world_per_pixel;
+    streamer->request(texture, std::log2(std::max(texels_per_pixel, 1.f)) + _lod_bias, frame);
+  }
+}
+
+/**
+ * @brief Points the visible objects at texture sets written for this frame,
+ *        objects sharing a texture share its set. Every shading mode
+ *        declares the sampler, so untextured objects get the default texture
+ */
+void MB_Engine::write_texture_sets() {
+  vkdescriptor::Growable_Allocator* frame_descriptors = _frame_descriptors[vk->_cmd->get_frame_index()];
+  std::unordered_map<Texture*, VkDescriptorSet> sets;
+
+  for (auto object : _visible) {
+    Texture* texture = object->material._texture;
+    if (texture == nullptr) {
+      texture = textures->default_texture();
+    }
+
+    auto found = sets.find(texture);
+    if (found == sets.end()) {
+      VkDescriptorSet set = frame_descriptors->allocate(_texture_set_layout);
+      VkDescriptorImageInfo image_info = textures->descriptor(texture);
+      VkWriteDescriptorSet image_write{};
+      image_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+      image_write.dstSet = set;
+      image_write.dstBinding = 0;
+      image_write.descriptorCount = 1;
+      image_write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+      image_write.pImageInfo = &image_info;
+      vkUpdateDescriptorSets(vk->_device->_logical, 1, &image_write, 0, nullptr);
+      found = sets.emplace(texture, set).first;
+    }
+    object->material._texture_set = found->second;
+  }
+}
+
+/**
+ * @brief Records the gradient on the compute queue, the graphics 
+ *        submission of this frame waits on it
+ */
+void MB_Engine::draw_background() {
+  Image* background = _background_images[vk->_cmd->get_frame_index()];
+
+  vk->_cmd->begin_compute();
+  vk->_cmd->transition_compute_image(background->_image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+  vk->_cmd->bind_compute_pipeline(
+    pipeline_queue.pipeline(_gradient_pipeline),
+    pipeline_queue.layout(_gradient_pipeline),
+    _background_sets[vk->_cmd->get_frame_index()]
+  );
+  // workgroups are 16x16
+  vk->_cmd->dispatch(
+    (background->_extent.width + 15) / 16,
+    (background->_extent.height + 15) / 16,
+    1
+  );
+  vk->_cmd->transition_compute_image(background->_image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+  vk->_cmd->end_compute();
+  vk->_cmd->submit_compute();
+}
+
+/**
+ * @brief Records upscale.comp from the scene color target into an image
+ *        the size of the swapchain, the set is rebuilt every frame as
+ *        the render graph may give the images new views
+ * @param input_extent texels of the scene image holding the frame
+ */
+void MB_Engine::upscale(
+  VkCommandBuffer cmd, 
+  VkImageView scene, 
+  VkImageView upscaled, 
+  VkExtent2D input_extent, 
+  VkExtent2D output_extent
+) {
+  VkDescriptorSet set = _frame_descriptors[vk->_cmd->get_frame_index()]->allocate(_upscale_set_layout);
+
+  VkDescriptorImageInfo scene_info{};
+  scene_info.sampler = _upscale_sampler;
+  scene_info.imageView = scene;
+  scene_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+  VkDescriptorImageInfo upscaled_info{};
+  upscaled_info.imageView = upscaled;
+  upscaled_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+  VkWriteDescriptorSet writes[2] = {};
+  writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  writes[0].dstSet = set;
+  writes[0].dstBinding = 0;
+  writes[0].descriptorCount = 1;
+  writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  writes[0].pImageInfo = &scene_info;
+  writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  writes[1].dstSet = set;
+  writes[1].dstBinding = 1;
+  writes[1].descriptorCount = 1;
+  writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+  writes[1].pImageInfo = &upscaled_info;
+  vkUpdateDescriptorSets(vk->_device->_logical, 2, writes, 0, nullptr);
+
+  Upscale_Constants constants;
+  constants.input_size = glm::vec2(input_extent.width, input_extent.height);
+  constants.output_size = glm::vec2(output_extent.width, output_extent.height);
+
+  VkPipelineLayout layout = pipeline_queue.layout(_upscale_pipeline);
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_queue.pipeline(_upscale_pipeline));
+  vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, layout, 0, 1, &set, 0, nullptr);
+  vkCmdPushConstants(cmd, layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(Upscale_Constants), &constants);
+  // workgroups are 16x16
+  vkCmdDispatch(cmd, (output_extent.width + 15) / 16, (output_extent.height + 15) / 16, 1);
+}
+
 /**
  * @brief Images are retrieved from the swapchain, drawn on,
  *        and then presented to the window surface
  */
 void MB_Engine::draw() {
-  // wait for the previous frame to finish rendering
-  vk->_cmd->wait_for_render();
+  if (resize_requested) {
+    resize_swapchain();
+    if (resize_requested) {
+      return;
+    }
+  }
+
+  // the pacer already waited for the previous frame in this slot to finish
+  // rendering before input was sampled
+  Frame_Pacer::clock::time_point cpu_start = Frame_Pacer::clock::now();
+
+  // pipelines replaced by optimized links may still be bound by frames in flight
+  pipeline_compiler->retire_replaced(vk->_deletion_queue, vk->_cmd->submitted_value());
+
+  // the sets and uniforms of the last frame in this slot are no longer in use
+  _frame_descriptors[vk->_cmd->get_frame_index()]->reset();
+
+  // every renderable may write its own block, the ring grows before the frame needs it
+  VkDeviceSize uniform_bytes = _uniforms->block_size(sizeof(Camera_Uniforms)) + 
+    _renderables.size() * _uniforms->block_size(sizeof(Object_Uniforms));
+  if (_uniforms->reserve(uniform_bytes, vk->_deletion_queue, vk->_cmd->submitted_value())) {
+    write_uniform_sets();
+  }
+  _uniforms->begin_frame(vk->_cmd->get_frame_index());
+
+  // the times of the newest measured frame pick the quality of this one,
+  // the governor may cap the scale the resolution controller works within
+  const Gpu_Frame_Times& times = vk->_cmd->gpu_frame_times();
+  governor->update(_cpu_ms, times.graphics_ms, times.samples, vk->_cmd->get_frame_overlap(), static_cast<uint64_t>(_frame_number));
+  if (resolution->enabled()) {
+    _render_scale = resolution->update(times.graphics_ms, times.samples, vk->_cmd->get_frame_overlap());
+  }
+
+  // the scene is drawn offscreen at the render scale and upscaled to the swapchain
+  VkExtent2D draw_extent = vk->_swapchain->swapchain_extent;
+  VkExtent2D render_extent = {
+    std::max(1u, static_cast<uint32_t>(draw_extent.width * _render_scale + 0.5f)),
+    std::max(1u, static_cast<uint32_t>(draw_extent.height * _render_scale + 0.5f))
+  };
+  _render_extent = render_extent;
+  glm::mat4 view = glm::translate(glm::mat4(1.f), camera->pos);
+  float fov_y = glm::radians(70.f);
+  float aspect = static_cast<float>(draw_extent.width) / static_cast<float>(draw_extent.height);
+  glm::mat4 projection = glm::perspective(fov_y, aspect, 0.1f, 200.0f);
+  projection[1][1] *= -1;
+  glm::mat4 viewproj = projection * view;
+
+  // culling requests the mips streamed in, finished ones are swapped in
+  // before any set of this frame is written
+  cull(viewproj, fov_y, render_extent);
+  streamer->update(static_cast<uint64_t>(_frame_number), vk->_cmd->submitted_value());
+  write_texture_sets();
+
+  // compute work does not depend on the swapchain image and starts first
+  draw_background();
 
   // grab the next image from the swaphchain
-  uint32_t swapchain_image_index = vk->get_next_image();
+  uint32_t swapchain_image_index;
+  Frame_Pacer::clock::time_point acquire_start = Frame_Pacer::clock::now();
+  if (!vk->get_next_image(&swapchain_image_index)) {
+    resize_requested = true;
+    return;
+  }
+  Frame_Pacer::clock::duration acquire_time = Frame_Pacer::clock::now() - acquire_start;
   
   vk->_cmd->begin_recording(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
 
-  VkRenderPassBeginInfo renderpass_info {};
-  vk->draw_background(&renderpass_info, _window_extent ,swapchain_image_index);
+  // the camera is written once and shared by every draw of the frame
+  Camera_Uniforms camera_data;
+  camera_data.viewproj = viewproj;
+
+  Frame_Uniforms uniforms;
+  uniforms.ring = _uniforms;
+  uniforms.camera_set = _camera_set;
+  uniforms.camera_offset = _uniforms->write(camera_data);
+  uniforms.object_set = _object_set;
+
+  render_graph->begin_frame();
+
+  Image* background = _background_images[vk->_cmd->get_frame_index()];
+  Graph_Import background_import;
+  background_import.image = background->_image;
+  background_import.view = background->_image_view;
+  background_import.format = background->_format;
+  background_import.extent = { background->_extent.width, background->_extent.height };
+  // the compute queue leaves it ready to copy, the semaphore wait orders the rest
+  background_import.initial_layout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  Graph_Resource background_image = render_graph->import_image("background", background_import);
+
+  VkImage swapchain_image = vk->_swapchain->swapchain_images[swapchain_image_index];
+  Graph_Import swapchain_import;
+  swapchain_import.image = swapchain_image;
+  swapchain_import.view = vk->_swapchain->swapchain_image_views[swapchain_image_index];
+  swapchain_import.format = vk->_swapchain->swapchain_image_format;
+  swapchain_import.extent = draw_extent;
+  swapchain_import.initial_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+  swapchain_import.initial_stages = SWAPCHAIN_WAIT_STAGES;
+  swapchain_import.final_layout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+  swapchain_import.final_stages = RENDER_SIGNAL_STAGES;
+  swapchain_import.output = true;
+  Graph_Resource swapchain = render_graph->import_image("swapchain", swapchain_import);
+
+  // the scene targets are window sized and the frame is drawn into their
+  // top left corner, a new render scale keeps the same images
+  Graph_Resource scene_color = render_graph->create_image("scene color", { SCENE_COLOR_FORMAT, draw_extent });
+  Graph_Resource depth = render_graph->create_image("depth", { DEPTH_FORMAT, draw_extent, VK_IMAGE_ASPECT_DEPTH_BIT });
 
-  vk->_cmd->begin_renderpass(&renderpass_info, VK_SUBPASS_CONTENTS_INLINE);
+  Graph_Pass copy_pass = render_graph->add_pass("background copy", [&](VkCommandBuffer cmd) {
+    vk->_cmd->copy_image_to_image(
+      background->_image, 
+      render_graph->image(scene_color), 
+      { background->_extent.width, background->_extent.height }, 
+      render_extent
+    );
+  });
+  render_graph->read(copy_pass, background_image, Resource_Usage::Transfer_Src);
+  render_graph->write(copy_pass, scene_color, Resource_Usage::Transfer_Dst);
+
+  // the color attachment loads the background, only depth is cleared
+  std::vector<VkClearValue> clear_values(2);
+  clear_values[0].color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
+  clear_values[1].depthStencil.depth = 1.f;
+
+  Graph_Pass mesh_pass = render_graph->add_pass("meshes", [&](VkCommandBuffer cmd) {
+    vk->_cmd->set_window(render_extent);
+    vk->_cmd->draw_objects(uniforms, _visible.data(), _visible.size(), &pipeline_queue);
+  });
+  render_graph->read(mesh_pass, scene_color, Resource_Usage::Color_Attachment);
+  render_graph->write(mesh_pass, scene_color, Resource_Usage::Color_Attachment);
+  render_graph->write(mesh_pass, depth, Resource_Usage::Depth_Attachment);
+  render_graph->set_render_pass(mesh_pass, vk->_swapchain->_scene_renderpass, clear_values);
+  render_graph->set_render_area(mesh_pass, render_extent);
+
+  // at native scale the scene is copied to the swapchain as it is, the
+  // dynamic scale always upscales so reaching 1 does not change the graph
+  Graph_Resource presented = scene_color;
+  bool upscaling = render_extent.width != draw_extent.width || render_extent.height != draw_extent.height;
+  if (upscaling || resolution->enabled()) {
+    presented = render_graph->create_image("upscaled", { SCENE_COLOR_FORMAT, draw_extent });
+    Graph_Pass upscale_pass = render_graph->add_pass("upscale", [&](VkCommandBuffer cmd) {
+      upscale(cmd, render_graph->view(scene_color), render_graph->view(presented), render_extent, draw_extent);
+    });
+    render_graph->read(upscale_pass, scene_color, Resource_Usage::Sampled);
+    render_graph->write(upscale_pass, presented, Resource_Usage::Storage_Write);
+  }
+
+  // the swapchain is sRGB and cannot be stored to, the blit encodes it
+  Graph_Pass present_pass = render_graph->add_pass("present copy", [&](VkCommandBuffer cmd) {
+    vk->_cmd->copy_image_to_image(render_graph->image(presented), swapchain_image, draw_extent, draw_extent);
+  });
+  render_graph->read(present_pass, presented, Resource_Usage::Transfer_Src);
+  render_graph->write(present_pass, swapchain, Resource_Usage::Transfer_Dst);
+
+  // ImGui is drawn over the upscaled image at native resolution
+  Graph_Pass gui_pass = render_graph->add_pass("imgui", [&](VkCommandBuffer cmd) {
+    gui->draw_imgui();
+  });
+  render_graph->read(gui_pass, swapchain, Resource_Usage::Color_Attachment);
+  render_graph->write(gui_pass, swapchain, Resource_Usage::Color_Attachment);
+  render_graph->set_render_pass(gui_pass, vk->_swapchain->_renderpass);
 
   //--- RENDERING COMMANDS ---//
-  vk->_cmd->set_window(_window_extent);
-  vk->_cmd->draw_objects(camera->pos, _renderables.data(), _renderables.size());
-  gui->draw_imgui();
+  render_graph->compile();
+  render_graph->execute(vk->_cmd->current_cmd);
 
-  vk->_cmd->end_renderpass();
   vk->_cmd->end_recording();
+  _uniforms->flush();
 
   // submit the image to the graphics queue
-  vk->_cmd->submit_graphics(
-    VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR,
-    VK_PIPELINE_STAGE_2_ALL_GRAPHICS_BIT
-  );
+  vk->_cmd->submit_graphics(SWAPCHAIN_WAIT_STAGES, RENDER_SIGNAL_STAGES);
+  _cpu_ms = std::chrono::duration<double, std::milli>(Frame_Pacer::clock::now() - cpu_start - acquire_time).count();
 
   // present the graphics image to the window
-  vk->_cmd->present_graphics(vk->_swapchain->_handle, &swapchain_image_index);
+  if (!vk->_cmd->present_graphics(vk->_swapchain->_handle, &swapchain_image_index)) {
+    resize_requested = true;
+  }
+  pacer->mark_presented(vk->_cmd->last_present_id());
   _frame_number++;
 
 }
@@ -12,6 +12,15 @@
 #include "gui.h"
 #include "object.h"
 #include "camera.h"
+#include "Frame_Pacer.h"
+#include "Thread_Pool.h"
+#include "Resolution_Controller.h"
+#include "Quality_Governor.h"
+#include "../vulkan/Pipeline_Compiler.h"
+#include "../vulkan/Texture.h"
+#include "../vulkan/Texture_Streamer.h"
+#include "../vulkan/Texture_Atlas.h"
+#include "../vulkan/Render_Graph.h"
 
 struct Obj_Queue {
   std::unordered_map<std::string, Object*> map;
@@ -23,6 +32,22 @@ struct Obj_Queue {
   }
 };
 
+// values of the SHADING_MODE specialization constant in mesh.frag
+enum Shading_Mode : uint32_t {
+  SHADING_VERTEX_COLOR = 0,
+  SHADING_SOLID,
+  SHADING_NORMALS,
+  SHADING_DEPTH,
+  SHADING_TEXTURED,
+  SHADING_MODE_COUNT
+};
+
+// push constants of upscale.comp
+struct Upscale_Constants {
+  glm::vec2 input_size;
+  glm::vec2 output_size;
+};
+
 class MB_Engine
 {
 public:
@@ -33,6 +58,14 @@ public:
   void run();
   void cleanup();
 
+  void set_frames_in_flight(uint32_t count);
+  void set_present_mode(VkPresentModeKHR mode);
+  void set_target_fps(double fps);
+  void set_render_scale(float scale);
+  void set_dynamic_resolution(float target_ms);
+  void set_frame_budget(float budget_ms);
+  void set_quality_log(const std::string& path);
+
 private:
   // MB_Engine states and callbacks
   VkDebugUtilsMessengerEXT debug_messenger;
@@ -41,24 +74,81 @@ private:
   bool stop_rendering { false };
   bool resize_requested{ false };
   int _selected_shader { 0 };
+  uint32_t _frames_in_flight { 2 };
+  VkPresentModeKHR _present_mode { VK_PRESENT_MODE_FIFO_KHR };
+  float _target_fps { 0.f };
+  // fraction of the swapchain size the scene is drawn at before upscaling
+  float _render_scale { 0.75f };
+  VkExtent2D _render_extent { 1, 1 };
+  // GPU time the render scale is fitted to, 0 keeps the scale fixed
+  float _dynamic_target_ms { 0.f };
+  // frame time the quality governor keeps to, 0 leaves the knobs alone
+  float _frame_budget_ms { 0.f };
+  std::string _quality_log_path;
+  // CPU time of the last frame, without waits on the GPU and swapchain
+  double _cpu_ms { 0.0 };
+  // quality knobs, lowered by the governor to fit the frame budget
+  float _lod_bias { 0.f };
+  float _draw_distance { 200.f };
+  float _instance_density { 1.f };
 
   // MB_Engine handles
   SDL_Window* _window;
   VkExtent2D _window_extent{ 1200 , 600 };
-  DeletionQueue _main_deletion_queue;
 
   // Graphics Pipelines handles
   Pipeline_Queue pipeline_queue;
+  // shading modes are requested on first use and draw with the fallback until compiled
+  Pipeline_Handle _mesh_fallback;
+  Render_State    _mesh_state;
+  Pipeline_Handle _gradient_pipeline;
+  VkDescriptorSetLayout _gradient_set_layout;
+  Pipeline_Handle _upscale_pipeline;
+  VkDescriptorSetLayout _upscale_set_layout;
+  VkSampler _upscale_sampler;
 
   // Engine objects
   Obj_Queue mb_objs;
   std::unordered_map<std::string, Material> materials;
   std::vector<Object*> _renderables;
+  // renderables left after culling, rebuilt every frame
+  std::vector<Object*> _visible;
+
+  // background drawn on the async compute queue, one image per frame in flight
+  Image*           _background_images[MAX_FRAME_OVERLAP];
+  VkDescriptorSet  _background_sets[MAX_FRAME_OVERLAP];
+
+  // sets that live as long as the engine, and sets rebuilt every frame
+  // that are released together once the frame using them has finished
+  vkdescriptor::Growable_Allocator* _descriptors;
+  vkdescriptor::Growable_Allocator* _frame_descriptors[MAX_FRAME_OVERLAP];
+
+  // camera and per draw uniforms, bound at dynamic offsets into the ring
+  Uniform_Ring*   _uniforms;
+  VkDescriptorSet _camera_set;
+  VkDescriptorSet _object_set;
+
+  // texture sets are written per frame, streaming replaces texture images
+  VkDescriptorSetLayout _texture_set_layout;
 
   // Wrapper handles
   vk_interface* vk;
   Pipeline* pipeline;
   GUI* gui;
+  Frame_Pacer* pacer;
+  Resolution_Controller* resolution;
+  Quality_Governor* governor;
+  Thread_Pool* workers;
+  Shader_Compiler* shader_compiler;
+  Pipeline_Library* pipeline_library;
+  Pipeline_Compiler* pipeline_compiler;
+  Texture_Cache* textures;
+  Texture_Streamer* streamer;
+  // rebuilt and compiled every frame, keeps the scene targets and framebuffers
+  Render_Graph* render_graph;
+  // small GUI images packed at startup, drawn through one ImGui descriptor
+  Texture_Atlas* _ui_atlas;
+  VkDescriptorSet _ui_atlas_set { VK_NULL_HANDLE };
 
   // camera and movement states
   Camera* camera;
@@ -67,10 +157,25 @@ private:
 
   void create_window();
 
+  void init_descriptors();
   void init_pipelines();
   void init_mesh_pipeline();
+  Pipeline_Handle request_mesh_pipeline(uint32_t mode);
+  std::vector<VkDescriptorSetLayout> required_set_layouts(Pipeline_Handle handle, const char* name, size_t set_count);
+  void update_mesh_material();
+  void init_background_pipeline();
+  void init_upscale_pipeline();
+  void init_uniforms();
+  void write_uniform_sets();
+  void init_textures();
+  void init_background();
 
   void init_gui();
+  void set_shading_mode(int mode);
+  void init_pacer();
+  void init_render_graph();
+  void init_resolution();
+  void init_governor();
 
   void load_meshes();
 
@@ -78,6 +183,12 @@ private:
 
   void init_scene();
 
+  void resize_swapchain();
+
+  void cull(const glm::mat4& viewproj, float fov_y, VkExtent2D extent);
+  void write_texture_sets();
+  void draw_background();
+  void upscale(VkCommandBuffer cmd, VkImageView scene, VkImageView upscaled, VkExtent2D input_extent, VkExtent2D output_extent);
   void draw();
 
 };
@@ -1,22 +1,60 @@
 #include "Cmd.h"
 
-Cmd::Cmd(Device* _device) {
+Cmd::Cmd(Device* _device, Deletion_Queue* deletion_queue, uint32_t frame_overlap) 
+: _deletion_queue(deletion_queue) {
   _logical = _device->_logical;
   _graphics_queue = _device->_graphics_queue;
   _graphics_queue_family = _device->_graphics_index.value();
+  _compute_queue = _device->_compute_queue;
+  _compute_queue_family = _device->_compute_index.value();
+  _present_id_enabled = _device->_present_wait;
+  _frame_overlap = std::clamp(frame_overlap, 1u, MAX_FRAME_OVERLAP);
+
+  _pipeline_barrier2 = (PFN_vkCmdPipelineBarrier2KHR) vkGetDeviceProcAddr(_logical, "vkCmdPipelineBarrier2KHR");
+
+  if (_device->_extended_dynamic_state) {
+    _set_cull_mode = (PFN_vkCmdSetCullModeEXT) vkGetDeviceProcAddr(_logical, "vkCmdSetCullModeEXT");
+    _set_front_face = (PFN_vkCmdSetFrontFaceEXT) vkGetDeviceProcAddr(_logical, "vkCmdSetFrontFaceEXT");
+    _set_primitive_topology = (PFN_vkCmdSetPrimitiveTopologyEXT) vkGetDeviceProcAddr(_logical, "vkCmdSetPrimitiveTopologyEXT");
+    _set_depth_test_enable = (PFN_vkCmdSetDepthTestEnableEXT) vkGetDeviceProcAddr(_logical, "vkCmdSetDepthTestEnableEXT");
+    _set_depth_write_enable = (PFN_vkCmdSetDepthWriteEnableEXT) vkGetDeviceProcAddr(_logical, "vkCmdSetDepthWriteEnableEXT");
+    _set_depth_compare_op = (PFN_vkCmdSetDepthCompareOpEXT) vkGetDeviceProcAddr(_logical, "vkCmdSetDepthCompareOpEXT");
+  }
+#ifdef VK_EXT_extended_dynamic_state3
+  if (_device->_dynamic_polygon_mode) {
+    _set_polygon_mode = (PFN_vkCmdSetPolygonModeEXT) vkGetDeviceProcAddr(_logical, "vkCmdSetPolygonModeEXT");
+  }
+#endif
+
+  _timestamps = new Timestamps(_device, MAX_FRAME_OVERLAP, QUERY_COUNT);
+  _graphics_timestamps = _device->_graphics_timestamps;
+  _compute_timestamps = _device->_compute_timestamps;
 }
 
 Cmd::~Cmd() {
-  for (int i = 0; i < FRAME_OVERLAP; i++) {
+  // the device is idle by now, so all deferred work can be executed
+  for (auto& deferred : _deferred) {
+    deferred.work();
+  }
+  _deferred.clear();
+
+  // normally drained by the engine before its subsystems shut down, 
+  // anything left still runs while the semaphores exist
+  finish_uploads();
+
+  for (int i = 0; i < MAX_FRAME_OVERLAP; i++) {
     vkDestroyCommandPool(_logical, _frames[i]._command_pool, nullptr);
+    vkDestroyCommandPool(_logical, _frames[i]._compute_command_pool, nullptr);
 
-    vkDestroyFence(_logical, _frames[i]._render_fence, nullptr);
     vkDestroySemaphore(_logical, _frames[i]._render_semaphore, nullptr);
     vkDestroySemaphore(_logical, _frames[i]._swapchain_semaphore, nullptr);
   }
+  vkDestroySemaphore(_logical, _frame_timeline, nullptr);
+  vkDestroySemaphore(_logical, _compute_timeline, nullptr);
+  delete _timestamps;
 
   vkDestroyCommandPool(_logical, _imm_command_pool, nullptr);
-  vkDestroyFence(_logical, _imm_fence, nullptr);
+  vkDestroySemaphore(_logical, _upload_timeline, nullptr);
 }
 
 void Cmd::init_commands() {
@@ -27,8 +65,9 @@ void Cmd::init_commands() {
 	command_pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 	command_pool_info.queueFamilyIndex = _graphics_queue_family;
 
-  // double buffer system so each buffer requires a pool
-  for (int i = 0; i < FRAME_OVERLAP; i++) {
+  // every frame in flight requires its own pool, all possible frames are 
+  // created up front so the overlap can be changed at runtime
+  for (int i = 0; i < MAX_FRAME_OVERLAP; i++) {
     VK_CHECK(vkCreateCommandPool(
       _logical, 
       &command_pool_info, 
@@ -46,24 +85,107 @@ void Cmd::init_commands() {
     VK_CHECK(vkAllocateCommandBuffers(_logical, &cmd_alloc_info, &_frames[i]._main_command_buffer));
   }
 
-  //--- INIT IMMEDIATE COMMANDS---//
-  VK_CHECK(vkCreateCommandPool(_logical, &command_pool_info, nullptr, &_imm_command_pool));
+  //--- INIT COMPUTE COMMANDS ---//
+  VkCommandPoolCreateInfo compute_pool_info = command_pool_info;
+  compute_pool_info.queueFamilyIndex = _compute_queue_family;
 
-  VkCommandBufferAllocateInfo imm_alloc_info{};
-  imm_alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-  imm_alloc_info.pNext = nullptr;
-  imm_alloc_info.commandPool = _imm_command_pool;
-  imm_alloc_info.commandBufferCount = 1;
-  imm_alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  for (int i = 0; i < MAX_FRAME_OVERLAP; i++) {
+    VK_CHECK(vkCreateCommandPool(
+      _logical, 
+      &compute_pool_info, 
+      nullptr,
+      &_frames[i]._compute_command_pool
+    ));
+  
+    VkCommandBufferAllocateInfo cmd_alloc_info{};
+    cmd_alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    cmd_alloc_info.pNext = nullptr;
+    cmd_alloc_info.commandPool = _frames[i]._compute_command_pool;
+    cmd_alloc_info.commandBufferCount = 1;
+    cmd_alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
 
-  VK_CHECK(vkAllocateCommandBuffers(_logical, &imm_alloc_info, &_imm_command_buffer));
+    VK_CHECK(vkAllocateCommandBuffers(_logical, &cmd_alloc_info, &_frames[i]._compute_command_buffer));
+  }
+
+  //--- INIT IMMEDIATE COMMANDS---//
+  // immediate command buffers are allocated on demand and recycled
+  VK_CHECK(vkCreateCommandPool(_logical, &command_pool_info, nullptr, &_imm_command_pool));
 
   init_sync_structures();
 }
 
+/**
+ * @brief blocks until the frame that last used the current frame's
+ *        resources has finished, then runs any completed deferred work
+ */
 void Cmd::wait_for_render() {
-  VK_CHECK(vkWaitForFences(_logical, 1, &get_current_frame()._render_fence, true, 100000000));
-  VK_CHECK(vkResetFences(_logical, 1, &get_current_frame()._render_fence));
+  wait_for_value(get_current_frame()._timeline_value);
+  read_frame_times();
+  collect_deferred();
+}
+
+/**
+ * @brief changes the number of frames that may be in flight at once,
+ *        all submitted frames are finished before the change is applied
+ * @param frame_overlap number of frames in flight, clamped to [1, MAX_FRAME_OVERLAP]
+ */
+void Cmd::set_frame_overlap(uint32_t frame_overlap) {
+  frame_overlap = std::clamp(frame_overlap, 1u, MAX_FRAME_OVERLAP);
+  if (frame_overlap == _frame_overlap) {
+    return;
+  }
+
+  wait_for_value(_timeline_value);
+  collect_deferred();
+  _frame_overlap = frame_overlap;
+}
+
+uint64_t Cmd::completed_value() {
+  uint64_t value;
+  VK_CHECK(vkGetSemaphoreCounterValue(_logical, _frame_timeline, &value));
+  return value;
+}
+
+void Cmd::wait_for_value(uint64_t value) {
+  VkSemaphoreWaitInfo wait_info{};
+  wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+  wait_info.pNext = nullptr;
+  wait_info.flags = 0;
+  wait_info.semaphoreCount = 1;
+  wait_info.pSemaphores = &_frame_timeline;
+  wait_info.pValues = &value;
+
+  VK_CHECK(vkWaitSemaphores(_logical, &wait_info, 1000000000));
+}
+
+/**
+ * @brief queues work to run once the frame currently being recorded completes
+ */
+void Cmd::defer(std::function<void()>&& work) {
+  defer_until(pending_value(), std::move(work));
+}
+
+/**
+ * @brief queues work to run once the frame timeline reaches a value
+ */
+void Cmd::defer_until(uint64_t value, std::function<void()>&& work) {
+  _deferred.push_back({ value, std::move(work) });
+}
+
+/**
+ * @brief runs all deferred work and destroys all retired handles 
+ *        whose timeline value has been reached
+ */
+void Cmd::collect_deferred() {
+  uint64_t completed = completed_value();
+  _deletion_queue->collect(completed);
+  collect_continuations();
+
+  // work is queued in submission order, so the values only increase
+  while (!_deferred.empty() && _deferred.front().value <= completed) {
+    _deferred.front().work();
+    _deferred.pop_front();
+  }
 }
 
 void Cmd::begin_recording(VkCommandBufferUsageFlags flags) {
@@ -77,6 +199,17 @@ void Cmd::begin_recording(VkCommandBufferUsageFlags flags) {
   cmd_info.flags = flags;
 
   VK_CHECK(vkBeginCommandBuffer(current_cmd, &cmd_info));
+
+  // dynamic state does not carry over between command buffers
+  _bound_state_valid = false;
+  _bound_dynamic_states = 0;
+  _dynamic_stats = _recording_stats;
+  _recording_stats = {};
+
+  if (_graphics_timestamps) {
+    _timestamps->reset(current_cmd, get_frame_index(), QUERY_GRAPHICS_BEGIN, 2);
+    _timestamps->write(current_cmd, get_frame_index(), QUERY_GRAPHICS_BEGIN, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+  }
 }
 
 
@@ -89,6 +222,8 @@ void Cmd::bind_pipeline(VkPipeline pipeline, VkPipelineBindPoint bind_point) {
 }
 
 void Cmd::set_window(const VkExtent2D _window_extent) {
+  _viewport_extent = _window_extent;
+
   // set viewport
   VkViewport viewport;
   viewport.x = 0.0f;
@@ -106,33 +241,161 @@ void Cmd::set_window(const VkExtent2D _window_extent) {
   vkCmdSetScissor(current_cmd, 0, 1, &scissor);
 }
 
+/**
+ * @brief Records the dynamic parts of a render state, values already set
+ *        since the last pipeline with different dynamic states are skipped
+ * @param dynamic_states states the bound pipeline left dynamic
+ */
+void Cmd::set_render_state(const Render_State& state, uint32_t dynamic_states) {
+  // binding a pipeline with other dynamic states overwrites what was set
+  if (dynamic_states != _bound_dynamic_states) {
+    _bound_dynamic_states = dynamic_states;
+    _bound_state_valid = false;
+  }
+  if (dynamic_states == 0) {
+    return;
+  }
+
+  bool all = !_bound_state_valid;
+  uint32_t commands = 0;
+  uint32_t tracked = 0;
+
+  if (dynamic_states & DYNAMIC_CULL_MODE) {
+    tracked += 2;
+    if (all || state.cull_mode != _bound_state.cull_mode) {
+      _set_cull_mode(current_cmd, state.cull_mode);
+      commands++;
+    }
+    if (all || state.front_face != _bound_state.front_face) {
+      _set_front_face(current_cmd, state.front_face);
+      commands++;
+    }
+  }
+  if (dynamic_states & (DYNAMIC_TOPOLOGY | DYNAMIC_TOPOLOGY_ANY)) {
+    tracked++;
+    if (all || state.topology != _bound_state.topology) {
+      _set_primitive_topology(current_cmd, state.topology);
+      commands++;
+    }
+  }
+  if (dynamic_states & DYNAMIC_DEPTH) {
+    tracked += 3;
+    if (all || state.depth_test != _bound_state.depth_test) {
+      _set_depth_test_enable(current_cmd, state.depth_test ? VK_TRUE : VK_FALSE);
+      commands++;
+    }
+    if (all || state.depth_write != _bound_state.depth_write) {
+      _set_depth_write_enable(current_cmd, state.depth_write ? VK_TRUE : VK_FALSE);
+      commands++;
+    }
+    if (all || state.depth_compare != _bound_state.depth_compare) {
+      _set_depth_compare_op(current_cmd, state.depth_compare);
+      commands++;
+    }
+  }
+#ifdef VK_EXT_extended_dynamic_state3
+  if (dynamic_states & DYNAMIC_POLYGON_MODE) {
+    tracked++;
+    if (all || state.polygon_mode != _bound_state.polygon_mode) {
+      _set_polygon_mode(current_cmd, state.polygon_mode);
+      commands++;
+    }
+  }
+#endif
+
+  _bound_state = state;
+  _bound_state_valid = true;
+  _recording_stats.commands += commands;
+  _recording_stats.redundant += tracked - commands;
+}
+
 void Cmd::set_push_constants(VkPipelineLayout layout, VkShaderStageFlags flags, uint32_t offset, uint32_t size, const void* push_values) {
   vkCmdPushConstants(current_cmd, layout, flags, offset, size, push_values);
 };
 
-void Cmd::draw_objects(glm::vec3 cam_pos, Object** first, size_t count) {
-  // calculate camera view and projection
-  glm::mat4 view = glm::translate(glm::mat4(1.f), cam_pos);
-  glm::mat4 projection = glm::perspective(glm::radians(70.f), 1700.f / 900.f, 0.1f, 200.0f);
-  projection[1][1] *= -1;
-
+/**
+ * @brief Draws objects with the pipelines their materials reference,
+ *        objects whose pipeline is still compiling use its fallback or are skipped
+ */
+void Cmd::draw_objects(const Frame_Uniforms& uniforms, Object** first, size_t count, Pipeline_Queue* pipelines) {
   Mesh* last_mesh = nullptr;
-  Material* last_material = nullptr;
+  VkPipeline last_pipeline = VK_NULL_HANDLE;
+  VkPipelineLayout last_layout = VK_NULL_HANDLE;
+  // per draw block of the previous draw, reused while the transform is unchanged
+  glm::mat4 last_model;
+  uint32_t object_offset = UINT32_MAX;
+  uint32_t bound_object_offset = UINT32_MAX;
+  VkDescriptorSet last_texture_set = VK_NULL_HANDLE;
   for (int i = 0; i < count; i++) {
     Object* object  = first[i];
 
-    // no need to bind new pipeline if it is the same one as the last
-    if (&object->material != last_material) {
-      bind_pipeline(object->material._pipeline, VK_PIPELINE_BIND_POINT_GRAPHICS);
-      last_material = &object->material;
+    Pipeline_Binding binding;
+    if (!pipelines->resolve(object->material._pipeline, object->material._fallback, &binding)) {
+      continue;
+    }
+
+    // the object's resources must outlive the frame being recorded
+    object->last_used_value = pending_value();
+
+    // no need to bind new pipeline if it is the same one as the last,
+    // materials sharing a state share a deduplicated pipeline
+    if (binding.pipeline != last_pipeline) {
+      bind_pipeline(binding.pipeline, VK_PIPELINE_BIND_POINT_GRAPHICS);
+      last_pipeline = binding.pipeline;
+    }
+    set_render_state(object->material._state, binding.dynamic_states);
+
+    // the camera set is only rebound for a new layout, the variants of a 
+    // pipeline share theirs so it stays bound across pipeline changes
+    if (binding.layout != last_layout) {
+      vkCmdBindDescriptorSets(
+        current_cmd, 
+        VK_PIPELINE_BIND_POINT_GRAPHICS, 
+        binding.layout, 
+        0, 
+        1, 
+        &uniforms.camera_set, 
+        1, 
+        &uniforms.camera_offset
+      );
+      last_layout = binding.layout;
+      bound_object_offset = UINT32_MAX;
+      last_texture_set = VK_NULL_HANDLE;
     }
 
-    // final render mtx
-    glm::mat4 model = object->transform_mtx;
-    glm::mat4 mesh_mtx = projection * view * model;
-    MeshPushConstants constants;
-    constants.render_matrix = mesh_mtx;
-    set_push_constants(object->material._pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(MeshPushConstants), &constants);
+    if (object->material._texture_set != last_texture_set) {
+      vkCmdBindDescriptorSets(
+        current_cmd, 
+        VK_PIPELINE_BIND_POINT_GRAPHICS, 
+        binding.layout, 
+        2, 
+        1, 
+        &object->material._texture_set, 
+        0, 
+        nullptr
+      );
+      last_texture_set = object->material._texture_set;
+    }
+
+    if (object_offset == UINT32_MAX || object->transform_mtx != last_model) {
+      Object_Uniforms object_data;
+      object_data.model = object->transform_mtx;
+      object_offset = uniforms.ring->write(object_data);
+      last_model = object->transform_mtx;
+    }
+    if (object_offset != bound_object_offset) {
+      vkCmdBindDescriptorSets(
+        current_cmd, 
+        VK_PIPELINE_BIND_POINT_GRAPHICS, 
+        binding.layout, 
+        1, 
+        1, 
+        &uniforms.object_set, 
+        1, 
+        &object_offset
+      );
+      bound_object_offset = object_offset;
+    }
     
     if (&object->mesh != last_mesh) {
       VkDeviceSize offset = 0;
@@ -151,19 +414,152 @@ void Cmd::draw_geometry(Mesh* mesh, uint32_t instance_count, uint32_t first_vert
 }
 
 void Cmd::end_recording() {
+  if (_graphics_timestamps) {
+    _timestamps->write(current_cmd, get_frame_index(), QUERY_GRAPHICS_END, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+  }
   VK_CHECK(vkEndCommandBuffer(current_cmd));
 }
 
+/**
+ * @brief Starts recording the current frame's work for the compute queue
+ */
+void Cmd::begin_compute() {
+  Frame_Data& frame = get_current_frame();
+
+  // a skipped frame may have submitted compute work without graphics work
+  VkSemaphoreWaitInfo wait_info{};
+  wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+  wait_info.pNext = nullptr;
+  wait_info.flags = 0;
+  wait_info.semaphoreCount = 1;
+  wait_info.pSemaphores = &_compute_timeline;
+  wait_info.pValues = &frame._compute_value;
+  VK_CHECK(vkWaitSemaphores(_logical, &wait_info, 1000000000));
+
+  current_compute_cmd = frame._compute_command_buffer;
+  VK_CHECK(vkResetCommandBuffer(current_compute_cmd, 0));
+
+  VkCommandBufferBeginInfo cmd_info{};
+  cmd_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  cmd_info.pNext = nullptr;
+  cmd_info.pInheritanceInfo = nullptr;
+  cmd_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+  VK_CHECK(vkBeginCommandBuffer(current_compute_cmd, &cmd_info));
+
+  if (_compute_timestamps) {
+    _timestamps->reset(current_compute_cmd, get_frame_index(), QUERY_COMPUTE_BEGIN, 2);
+    _timestamps->write(current_compute_cmd, get_frame_index(), QUERY_COMPUTE_BEGIN, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+  }
+}
+
+void Cmd::bind_compute_pipeline(VkPipeline pipeline, VkPipelineLayout layout, VkDescriptorSet set) {
+  vkCmdBindPipeline(current_compute_cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+  vkCmdBindDescriptorSets(current_compute_cmd, VK_PIPELINE_BIND_POINT_COMPUTE, layout, 0, 1, &set, 0, nullptr);
+}
+
+void Cmd::dispatch(uint32_t group_count_x, uint32_t group_count_y, uint32_t group_count_z) {
+  vkCmdDispatch(current_compute_cmd, group_count_x, group_count_y, group_count_z);
+}
+
+void Cmd::transition_compute_image(VkImage image, VkImageLayout current_layout, VkImageLayout new_layout) {
+  record_image_barrier(current_compute_cmd, image, current_layout, new_layout);
+}
+
+void Cmd::end_compute() {
+  if (_compute_timestamps) {
+    _timestamps->write(current_compute_cmd, get_frame_index(), QUERY_COMPUTE_END, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+  }
+  VK_CHECK(vkEndCommandBuffer(current_compute_cmd));
+}
+
+/**
+ * @brief Submits the recorded compute work, the next graphics 
+ *        submission waits on its completion
+ */
+void Cmd::submit_compute() {
+  _compute_value++;
+  get_current_frame()._compute_value = _compute_value;
+  _compute_pending = true;
+
+  VkSemaphoreSubmitInfo signal_info{};
+	signal_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+	signal_info.pNext = nullptr;
+	signal_info.semaphore = _compute_timeline;
+	signal_info.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+	signal_info.deviceIndex = 0;
+	signal_info.value = _compute_value;
+
+  VkCommandBufferSubmitInfo cmd_info{};
+  cmd_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+	cmd_info.pNext = nullptr;
+	cmd_info.commandBuffer = current_compute_cmd;
+	cmd_info.deviceMask = 0;
+
+  VkSubmitInfo2 submit_info{};
+  submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+  submit_info.pNext = nullptr;
+  submit_info.waitSemaphoreInfoCount = 0;
+  submit_info.pWaitSemaphoreInfos = nullptr;
+  submit_info.signalSemaphoreInfoCount = 1;
+  submit_info.pSignalSemaphoreInfos = &signal_info;
+  submit_info.commandBufferInfoCount = 1;
+  submit_info.pCommandBufferInfos = &cmd_info;
+
+  std::lock_guard<std::mutex> lock(_queue_mutex);
+  VK_CHECK(queue_submit(_logical, _compute_queue, 1, &submit_info, VK_NULL_HANDLE));
+}
+
+/**
+ * @brief Reads the timestamps of the frame that last used the current 
+ *        frame data, the compute work of a frame is compared against
+ *        the graphics work of the frame before it to measure overlap
+ */
+void Cmd::read_frame_times() {
+  double times[QUERY_COUNT];
+  if (!_graphics_timestamps 
+  || !_timestamps->read(get_frame_index(), QUERY_GRAPHICS_BEGIN, 2, &times[QUERY_GRAPHICS_BEGIN])) {
+    return;
+  }
+  _gpu_times.graphics_ms = times[QUERY_GRAPHICS_END] - times[QUERY_GRAPHICS_BEGIN];
+  _gpu_times.samples++;
+
+  // timestamps of both queues share one time domain on the devices we target
+  if (_compute_timestamps 
+  && _timestamps->read(get_frame_index(), QUERY_COMPUTE_BEGIN, 2, &times[QUERY_COMPUTE_BEGIN])) {
+    _gpu_times.compute_ms = times[QUERY_COMPUTE_END] - times[QUERY_COMPUTE_BEGIN];
+
+    double overlap_begin = std::max(times[QUERY_COMPUTE_BEGIN], _prev_graphics_begin);
+    double overlap_end = std::min(times[QUERY_COMPUTE_END], _prev_graphics_end);
+    _gpu_times.overlap_ms = std::max(overlap_end - overlap_begin, 0.0);
+  }
+
+  _prev_graphics_begin = times[QUERY_GRAPHICS_BEGIN];
+  _prev_graphics_end = times[QUERY_GRAPHICS_END];
+}
+
 void Cmd::end_renderpass() {
   vkCmdEndRenderPass(current_cmd);
 }
 
+/**
+ * @brief Records and submits commands, then blocks until they have finished
+ */
 void Cmd::immediate_submit(std::function<void(VkCommandBuffer cmd)>&& function) {
-  // wait for previous immediate submit to finish
-  VK_CHECK(vkResetFences(_logical, 1, &_imm_fence));
-	VK_CHECK(vkResetCommandBuffer(_imm_command_buffer, 0));
+  wait(immediate_submit_async(std::move(function)));
+}
+
+/**
+ * @brief Records commands into a pooled command buffer and submits them 
+ *        without waiting, frames submitted afterwards wait on the result
+ * @param function records the commands, it is called before this returns
+ * @param wait_token submission that must complete on the GPU before this one starts
+ * @return token that can be polled, waited on or chained
+ */
+Submit_Token Cmd::immediate_submit_async(std::function<void(VkCommandBuffer cmd)>&& function, Submit_Token wait_token) {
+  std::lock_guard<std::mutex> lock(_imm_mutex);
 
-	VkCommandBuffer cmd = _imm_command_buffer;
+	VkCommandBuffer cmd = acquire_upload_buffer();
 
 	VkCommandBufferBeginInfo cmd_info{};
   cmd_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
@@ -177,28 +573,153 @@ void Cmd::immediate_submit(std::function<void(VkCommandBuffer cmd)>&& function)
 
 	VK_CHECK(vkEndCommandBuffer(cmd));
 
+  uint64_t value = _upload_value.load() + 1;
+  _upload_buffers.push_back({ cmd, value });
+
 	VkCommandBufferSubmitInfo cmd_submit_info{};
   cmd_submit_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
 	cmd_submit_info.pNext = nullptr;
 	cmd_submit_info.commandBuffer = cmd;
 	cmd_submit_info.deviceMask = 0;
 
+  VkSemaphoreSubmitInfo wait_info{};
+	wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+	wait_info.pNext = nullptr;
+	wait_info.semaphore = _upload_timeline;
+	wait_info.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+	wait_info.deviceIndex = 0;
+	wait_info.value = wait_token.value;
+
+  VkSemaphoreSubmitInfo signal_info{};
+	signal_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+	signal_info.pNext = nullptr;
+	signal_info.semaphore = _upload_timeline;
+	signal_info.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+	signal_info.deviceIndex = 0;
+	signal_info.value = value;
+
 	VkSubmitInfo2 submit_info{};
   submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
   submit_info.pNext = nullptr;
-  submit_info.waitSemaphoreInfoCount = 0;
-  submit_info.pWaitSemaphoreInfos = nullptr;
-  submit_info.signalSemaphoreInfoCount = 0;
-  submit_info.pSignalSemaphoreInfos = nullptr;
+  submit_info.waitSemaphoreInfoCount = wait_token.value == 0 ? 0 : 1;
+  submit_info.pWaitSemaphoreInfos = &wait_info;
+  submit_info.signalSemaphoreInfoCount = 1;
+  submit_info.pSignalSemaphoreInfos = &signal_info;
   submit_info.commandBufferInfoCount = 1;
   submit_info.pCommandBufferInfos = &cmd_submit_info;
 
-	// submit command buffer to the queue and execute it.
-	//  _renderFence will now block until the graphic commands finish execution
-	VK_CHECK(queue_submit(_logical, _graphics_queue, 1, &submit_info, _imm_fence));
+  {
+    std::lock_guard<std::mutex> queue_lock(_queue_mutex);
+    VK_CHECK(queue_submit(_logical, _graphics_queue, 1, &submit_info, VK_NULL_HANDLE));
+  }
+  _upload_value.store(value);
 
-	VK_CHECK(vkWaitForFences(_logical, 1, &_imm_fence, true, 9999999999));
-};
+  return Submit_Token{ value };
+}
+
+bool Cmd::is_complete(Submit_Token token) {
+  return token.value <= upload_completed_value();
+}
+
+/**
+ * @brief Blocks until an asynchronous submission has finished executing
+ */
+void Cmd::wait(Submit_Token token) {
+  VkSemaphoreWaitInfo wait_info{};
+  wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+  wait_info.pNext = nullptr;
+  wait_info.flags = 0;
+  wait_info.semaphoreCount = 1;
+  wait_info.pSemaphores = &_upload_timeline;
+  wait_info.pValues = &token.value;
+
+  VK_CHECK(vkWaitSemaphores(_logical, &wait_info, 9999999999));
+}
+
+/**
+ * @brief Runs work on the render thread once a submission has completed,
+ *        e.g. to free staging memory
+ */
+void Cmd::then(Submit_Token token, std::function<void()>&& work) {
+  std::lock_guard<std::mutex> lock(_imm_mutex);
+  _upload_continuations.push_back({ token.value, std::move(work) });
+}
+
+/**
+ * @brief Waits for every immediate submit and runs all continuations, called 
+ *        at shutdown before the objects they release are torn down
+ */
+void Cmd::finish_uploads() {
+  wait(Submit_Token{ _upload_value.load() });
+  std::vector<Deferred_Work> remaining;
+  {
+    std::lock_guard<std::mutex> lock(_imm_mutex);
+    remaining.swap(_upload_continuations);
+  }
+  for (auto& continuation : remaining) {
+    continuation.work();
+  }
+}
+
+uint64_t Cmd::upload_completed_value() {
+  uint64_t value;
+  VK_CHECK(vkGetSemaphoreCounterValue(_logical, _upload_timeline, &value));
+  return value;
+}
+
+/**
+ * @brief Reuses a finished immediate command buffer or allocates a new one,
+ *        _imm_mutex must be held
+ */
+VkCommandBuffer Cmd::acquire_upload_buffer() {
+  uint64_t completed = upload_completed_value();
+  for (size_t i = 0; i < _upload_buffers.size(); i++) {
+    if (_upload_buffers[i].value <= completed) {
+      VkCommandBuffer cmd = _upload_buffers[i].cmd;
+      _upload_buffers[i] = _upload_buffers.back();
+      _upload_buffers.pop_back();
+	    VK_CHECK(vkResetCommandBuffer(cmd, 0));
+      return cmd;
+    }
+  }
+
+  VkCommandBufferAllocateInfo imm_alloc_info{};
+  imm_alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  imm_alloc_info.pNext = nullptr;
+  imm_alloc_info.commandPool = _imm_command_pool;
+  imm_alloc_info.commandBufferCount = 1;
+  imm_alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+
+  VkCommandBuffer cmd;
+  VK_CHECK(vkAllocateCommandBuffers(_logical, &imm_alloc_info, &cmd));
+  return cmd;
+}
+
+/**
+ * @brief Runs the continuations of every completed immediate submit
+ */
+void Cmd::collect_continuations() {
+  std::vector<Deferred_Work> ready;
+  {
+    std::lock_guard<std::mutex> lock(_imm_mutex);
+    uint64_t completed = upload_completed_value();
+    size_t kept = 0;
+    for (size_t i = 0; i < _upload_continuations.size(); i++) {
+      if (_upload_continuations[i].value <= completed) {
+        ready.push_back(std::move(_upload_continuations[i]));
+      }
+      else {
+        _upload_continuations[kept++] = std::move(_upload_continuations[i]);
+      }
+    }
+    _upload_continuations.resize(kept);
+  }
+
+  // continuations may submit more work, so they run without the lock
+  for (auto& continuation : ready) {
+    continuation.work();
+  }
+}
 
 void Cmd::submit_graphics(VkPipelineStageFlags2 wait_mask, VkPipelineStageFlags2 signal_mask) {
   VkSemaphoreSubmitInfo wait_info{};
@@ -209,13 +730,41 @@ void Cmd::submit_graphics(VkPipelineStageFlags2 wait_mask, VkPipelineStageFlags2
 	wait_info.deviceIndex = 0;
 	wait_info.value = 1;
 
-  VkSemaphoreSubmitInfo signal_info{};
-	signal_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
-	signal_info.pNext = nullptr;
-	signal_info.semaphore = get_current_frame()._render_semaphore;
-	signal_info.stageMask = signal_mask;
-	signal_info.deviceIndex = 0;
-	signal_info.value = 1;
+  // the binary semaphore is waited on by presentation, the timeline 
+  // semaphore marks the completion of this frame
+  VkSemaphoreSubmitInfo signal_infos[2]{};
+	signal_infos[0].sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+	signal_infos[0].pNext = nullptr;
+	signal_infos[0].semaphore = get_current_frame()._render_semaphore;
+	signal_infos[0].stageMask = signal_mask;
+	signal_infos[0].deviceIndex = 0;
+	signal_infos[0].value = 1;
+
+  _timeline_value++;
+  get_current_frame()._timeline_value = _timeline_value;
+
+	signal_infos[1].sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+	signal_infos[1].pNext = nullptr;
+	signal_infos[1].semaphore = _frame_timeline;
+	signal_infos[1].stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+	signal_infos[1].deviceIndex = 0;
+	signal_infos[1].value = _timeline_value;
+
+  // uploads submitted before this frame must be finished before it reads them
+  VkSemaphoreSubmitInfo wait_infos[3] = { wait_info, wait_info, wait_info };
+	wait_infos[1].semaphore = _upload_timeline;
+	wait_infos[1].stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+	wait_infos[1].value = _upload_value.load();
+
+  // as does the compute work submitted for this frame
+  uint32_t wait_count = 2;
+  if (_compute_pending) {
+	  wait_infos[2].semaphore = _compute_timeline;
+	  wait_infos[2].stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+	  wait_infos[2].value = _compute_value;
+    wait_count = 3;
+    _compute_pending = false;
+  }
 
   VkCommandBufferSubmitInfo cmd_info{};
   cmd_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
@@ -226,17 +775,22 @@ void Cmd::submit_graphics(VkPipelineStageFlags2 wait_mask, VkPipelineStageFlags2
   VkSubmitInfo2 submit_info{};
   submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
   submit_info.pNext = nullptr;
-  submit_info.waitSemaphoreInfoCount = &wait_info == nullptr ? 0 : 1;
-  submit_info.pWaitSemaphoreInfos = &wait_info;
-  submit_info.signalSemaphoreInfoCount = &signal_info == nullptr ? 0 : 1;
-  submit_info.pSignalSemaphoreInfos = &signal_info;
+  submit_info.waitSemaphoreInfoCount = wait_count;
+  submit_info.pWaitSemaphoreInfos = &wait_infos[0];
+  submit_info.signalSemaphoreInfoCount = 2;
+  submit_info.pSignalSemaphoreInfos = &signal_infos[0];
   submit_info.commandBufferInfoCount = 1;
   submit_info.pCommandBufferInfos = &cmd_info;
 
-  VK_CHECK(queue_submit(_logical, _graphics_queue, 1, &submit_info, get_current_frame()._render_fence));
+  std::lock_guard<std::mutex> lock(_queue_mutex);
+  VK_CHECK(queue_submit(_logical, _graphics_queue, 1, &submit_info, VK_NULL_HANDLE));
 }
 
-void Cmd::present_graphics(VkSwapchainKHR _swapchain, uint32_t* swapchain_image_index) {
+/**
+ * @brief Queues the rendered image for presentation
+ * @return false if the swapchain is out of date or suboptimal and should be recreated
+ */
+bool Cmd::present_graphics(VkSwapchainKHR _swapchain, uint32_t* swapchain_image_index) {
   VkPresentInfoKHR present_info{};
   present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 	present_info.pNext = nullptr;
@@ -248,16 +802,137 @@ void Cmd::present_graphics(VkSwapchainKHR _swapchain, uint32_t* swapchain_image_
 
 	present_info.pImageIndices = swapchain_image_index;
 
-  VK_CHECK(vkQueuePresentKHR(_graphics_queue, &present_info));
+  // tag the present so its completion can be waited on
+  _present_id++;
+  VkPresentIdKHR present_id_info{};
+  present_id_info.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+  present_id_info.pNext = nullptr;
+  present_id_info.swapchainCount = 1;
+  present_id_info.pPresentIds = &_present_id;
+  if (_present_id_enabled) {
+    present_info.pNext = &present_id_info;
+  }
+
+  VkResult result;
+  {
+    std::lock_guard<std::mutex> lock(_queue_mutex);
+    result = vkQueuePresentKHR(_graphics_queue, &present_info);
+  }
 
   _frame_number++;
+
+  if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
+    return false;
+  }
+  VK_CHECK(result);
+  return true;
+}
+
+void Cmd::transition_image(VkImage image, VkImageLayout current_layout, VkImageLayout new_layout) {
+  record_image_barrier(current_cmd, image, current_layout, new_layout);
+}
+
+/**
+ * @brief Records a barrier scoped to a range of mip levels of a color 
+ *        image, used by uploads that move levels through layouts one by one
+ */
+void Cmd::record_mip_barrier(
+  VkCommandBuffer cmd, 
+  VkImage image, 
+  uint32_t base_mip, 
+  uint32_t mip_count, 
+  VkImageLayout current_layout, 
+  VkImageLayout new_layout,
+  VkPipelineStageFlags2 src_stage,
+  VkAccessFlags2 src_access,
+  VkPipelineStageFlags2 dst_stage,
+  VkAccessFlags2 dst_access
+) {
+  VkImageMemoryBarrier2 image_barrier{};
+  image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+  image_barrier.pNext = nullptr;
+
+  image_barrier.srcStageMask = src_stage;
+  image_barrier.srcAccessMask = src_access;
+  image_barrier.dstStageMask = dst_stage;
+  image_barrier.dstAccessMask = dst_access;
+
+  image_barrier.oldLayout = current_layout;
+  image_barrier.newLayout = new_layout;
+  image_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  image_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+
+  image_barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  image_barrier.subresourceRange.baseMipLevel = base_mip;
+  image_barrier.subresourceRange.levelCount = mip_count;
+  image_barrier.subresourceRange.baseArrayLayer = 0;
+  image_barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+  image_barrier.image = image;
+
+  VkDependencyInfo dep_info{};
+  dep_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+  dep_info.pNext = nullptr;
+  dep_info.imageMemoryBarrierCount = 1;
+  dep_info.pImageMemoryBarriers = &image_barrier;
+
+  _pipeline_barrier2(cmd, &dep_info);
+}
+
+/**
+ * @brief Records a full pipeline barrier that moves an image to a new layout
+ */
+void Cmd::record_image_barrier(VkCommandBuffer cmd, VkImage image, VkImageLayout current_layout, VkImageLayout new_layout) {
+  VkImageMemoryBarrier2 image_barrier{};
+  image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+  image_barrier.pNext = nullptr;
+
+  image_barrier.srcStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+  image_barrier.srcAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT;
+  image_barrier.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+  image_barrier.dstAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT | VK_ACCESS_2_MEMORY_READ_BIT;
+
+  image_barrier.oldLayout = current_layout;
+  image_barrier.newLayout = new_layout;
+  image_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  image_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+
+  VkImageAspectFlags aspect_mask = (new_layout == VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL) 
+    ? VK_IMAGE_ASPECT_DEPTH_BIT 
+    : VK_IMAGE_ASPECT_COLOR_BIT;
+  image_barrier.subresourceRange.aspectMask = aspect_mask;
+  image_barrier.subresourceRange.baseMipLevel = 0;
+  image_barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+  image_barrier.subresourceRange.baseArrayLayer = 0;
+  image_barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+  image_barrier.image = image;
+
+  VkDependencyInfo dep_info{};
+  dep_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+  dep_info.pNext = nullptr;
+  dep_info.imageMemoryBarrierCount = 1;
+  dep_info.pImageMemoryBarriers = &image_barrier;
+
+  _pipeline_barrier2(cmd, &dep_info);
+}
+
+/**
+ * @brief Records a batch of image barriers as one dependency
+ */
+void Cmd::record_barriers(VkCommandBuffer cmd, const VkImageMemoryBarrier2* barriers, uint32_t count) {
+  VkDependencyInfo dep_info{};
+  dep_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+  dep_info.pNext = nullptr;
+  dep_info.imageMemoryBarrierCount = count;
+  dep_info.pImageMemoryBarriers = barriers;
+
+  _pipeline_barrier2(cmd, &dep_info);
 }
 
 void Cmd::copy_image_to_image(VkImage src, VkImage destination, VkExtent2D src_size, VkExtent2D dst_size) {
   VkImageBlit blit_region{};
   
   blit_region.srcOffsets[1].x = src_size.width;
-  blit_region.srcOffsets[1].x = src_size.height;
+  blit_region.srcOffsets[1].y = src_size.height;
   blit_region.srcOffsets[1].z = 1;
 
   blit_region.dstOffsets[1].x = dst_size.width;
@@ -286,45 +961,30 @@ void Cmd::copy_image_to_image(VkImage src, VkImage destination, VkExtent2D src_s
   );
 }
 
-void Cmd::draw_background(Swapchain* swapchain, VkExtent2D _window_extent, uint32_t image_index) {
-  VkClearValue clear_value;
-  float flash = static_cast<float>(abs(sin(_frame_number / 120.f)));
-  clear_value.color = { { 0.0f, 0.0f, flash, 1.0f } };
-
-  VkRenderPassBeginInfo renderpass_info{};
-  renderpass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-  renderpass_info.pNext = nullptr;
-
-  renderpass_info.renderPass = swapchain->_renderpass;
-	renderpass_info.renderArea.offset.x = 0;
-	renderpass_info.renderArea.offset.y = 0;
-	renderpass_info.renderArea.extent = _window_extent;
-	renderpass_info.framebuffer = swapchain->_framebuffers[image_index];
-
-  renderpass_info.clearValueCount = 1;
-  renderpass_info.pClearValues = &clear_value;
-  current_renderpass_info = renderpass_info;
-}
-
 void Cmd::init_sync_structures() {
   //--- SYNC STRUCTURES FOR BUFFERS ---//
-  VkFenceCreateInfo fence_info{};
-  fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-  fence_info.pNext = nullptr;
-  fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-
   VkSemaphoreCreateInfo semaphore_info{};
   semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
   semaphore_info.pNext = nullptr;
   semaphore_info.flags = 0;
 
-  for (int i = 0; i < FRAME_OVERLAP; i++) {
-    VK_CHECK(vkCreateFence(_logical, &fence_info, nullptr, &_frames[i]._render_fence));
-
+  for (int i = 0; i < MAX_FRAME_OVERLAP; i++) {
     VK_CHECK(vkCreateSemaphore(_logical, &semaphore_info, nullptr, &_frames[i]._swapchain_semaphore));
     VK_CHECK(vkCreateSemaphore(_logical, &semaphore_info, nullptr, &_frames[i]._render_semaphore));
   }
 
+  //--- FRAME TIMELINE ---//
+  VkSemaphoreTypeCreateInfo timeline_info{};
+  timeline_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+  timeline_info.pNext = nullptr;
+  timeline_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+  timeline_info.initialValue = 0;
+
+  VkSemaphoreCreateInfo timeline_semaphore_info = semaphore_info;
+  timeline_semaphore_info.pNext = &timeline_info;
+  VK_CHECK(vkCreateSemaphore(_logical, &timeline_semaphore_info, nullptr, &_frame_timeline));
+  VK_CHECK(vkCreateSemaphore(_logical, &timeline_semaphore_info, nullptr, &_compute_timeline));
+
   //--- SYNC STRUCTURES FOR IMMEDIATE SUBMIT---//
-  VK_CHECK(vkCreateFence(_logical, &fence_info, nullptr, &_imm_fence));
+  VK_CHECK(vkCreateSemaphore(_logical, &timeline_semaphore_info, nullptr, &_upload_timeline));
 }
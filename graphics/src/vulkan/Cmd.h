@@ -4,6 +4,9 @@
 
 #include "device.h"
 #include "swapchain.h"
+#include "Deletion_Queue.h"
+#include "Timestamps.h"
+#include "Uniform_Ring.h"
 #include "../engine/object.h"
 
 
@@ -19,50 +22,105 @@ const VkSubmitInfo2* pSubmits, VkFence fence) {
   }
 }
 
-struct MeshPushConstants {
-  glm::vec4 data;
-  glm::mat4 render_matrix;
+// set 0 of the mesh shaders, written once per frame
+struct Camera_Uniforms {
+  glm::mat4 viewproj;
+};
+
+// set 1 of the mesh shaders, written per draw when it changes
+struct Object_Uniforms {
+  glm::mat4 model;
 };
 
 /**
- * @brief queue for holding memory objects that need to 
- *        be released when they are no longer needed
+ * @brief Uniform data of a frame, both sets point at the whole ring and 
+ *        are bound at the dynamic offset of the block a draw reads
  */
-struct DeletionQueue {
-  std::vector<Mesh*> meshes;
+struct Frame_Uniforms {
+  Uniform_Ring*   ring;
+  VkDescriptorSet camera_set;
+  uint32_t        camera_offset;
+  VkDescriptorSet object_set;
+};
 
-  void flush_meshes(VmaAllocator _allocator) {
-    for (auto mesh : meshes) {
-      vmaDestroyBuffer(_allocator, mesh->_vertexBuffer._buffer, mesh->_vertexBuffer._allocation);
-    }
-  }
+/**
+ * @brief work that must wait until the frame timeline 
+ *        reaches a given value before it can be executed
+ */
+struct Deferred_Work {
+  uint64_t              value;
+  std::function<void()> work;
 };
 
 struct Frame_Data {
   VkCommandPool   _command_pool;
   VkCommandBuffer _main_command_buffer;
   VkSemaphore     _swapchain_semaphore, _render_semaphore;
-  VkFence         _render_fence;
-  DeletionQueue   _deletion_queue;
+  // value the frame timeline reaches once this frame's work has completed
+  uint64_t        _timeline_value = 0;
+
+  // compute work recorded for the async compute queue
+  VkCommandPool   _compute_command_pool;
+  VkCommandBuffer _compute_command_buffer;
+  uint64_t        _compute_value = 0;
 };
 
-constexpr unsigned int FRAME_OVERLAP = 2;
+// timestamps written for every frame
+enum Frame_Query : uint32_t {
+  QUERY_COMPUTE_BEGIN = 0,
+  QUERY_COMPUTE_END,
+  QUERY_GRAPHICS_BEGIN,
+  QUERY_GRAPHICS_END,
+  QUERY_COUNT
+};
+
+struct Gpu_Frame_Times {
+  double graphics_ms = 0.0;
+  double compute_ms  = 0.0;
+  // time the compute work of a frame ran alongside the previous frame's graphics
+  double overlap_ms  = 0.0;
+  // frames whose timestamps have been read, the times above are the last one's
+  uint64_t samples   = 0;
+};
+
+// dynamic render state commands recorded in the last frame
+struct Dynamic_State_Stats {
+  uint32_t commands  = 0;
+  // state changes skipped because the value was already set
+  uint32_t redundant = 0;
+};
+
+// upper bound on the number of frames that can be in flight at runtime
+constexpr unsigned int MAX_FRAME_OVERLAP = 4;
 
 class Cmd
 {
 public:
-  Cmd(Device* _device);
+  Cmd(Device* _device, Deletion_Queue* deletion_queue, uint32_t frame_overlap = 2);
   ~Cmd();
 
   VkCommandBuffer current_cmd;
 
   Frame_Data& get_current_frame() { 
-    return _frames[_frame_number % FRAME_OVERLAP];
+    return _frames[get_frame_index()];
   }
+  uint32_t get_frame_index() const { return _frame_number % _frame_overlap; }
+
+  uint32_t get_frame_overlap() const { return _frame_overlap; }
+  uint64_t last_present_id() const { return _present_id; }
+  void set_frame_overlap(uint32_t frame_overlap);
+
+  // frame timeline queries
+  uint64_t completed_value();
+  uint64_t submitted_value() const { return _timeline_value; }
+  uint64_t pending_value() const { return _timeline_value + 1; }
+  void wait_for_value(uint64_t value);
+
+  void defer(std::function<void()>&& work);
+  void defer_until(uint64_t value, std::function<void()>&& work);
+  void collect_deferred();
 
   // handles for immediate submit commands
-  VkFence         _imm_fence;
-  VkCommandBuffer _imm_command_buffer;
   VkCommandPool   _imm_command_pool;
 
   void init_commands();
@@ -72,31 +130,126 @@ public:
   void bind_pipeline(VkPipeline pipeline, VkPipelineBindPoint bind_point);
   void set_window(const VkExtent2D _window_extent);
 
+  void set_render_state(const Render_State& state, uint32_t dynamic_states);
   void set_push_constants(VkPipelineLayout layout, VkShaderStageFlags flags, uint32_t offset, uint32_t size, const void* push_values);
-  void draw_objects(glm::vec3 cam_pos, Object** first, size_t count);
+  void draw_objects(const Frame_Uniforms& uniforms, Object** first, size_t count, Pipeline_Queue* pipelines);
   void draw_geometry(Mesh* mesh, uint32_t instance_count, uint32_t first_vertex, uint32_t first_instance);
 
   void end_recording();
   void end_renderpass();
 
   void immediate_submit(std::function<void(VkCommandBuffer cmd)>&& function);
+  Submit_Token immediate_submit_async(std::function<void(VkCommandBuffer cmd)>&& function, Submit_Token wait_token = {});
+  bool is_complete(Submit_Token token);
+  void wait(Submit_Token token);
+  void then(Submit_Token token, std::function<void()>&& work);
+  void finish_uploads();
   void submit_graphics(VkPipelineStageFlags2 wait_mask, VkPipelineStageFlags2 signal_mask);
-  void present_graphics(VkSwapchainKHR _swapchain, uint32_t* swapchain_image_index);
+  bool present_graphics(VkSwapchainKHR _swapchain, uint32_t* swapchain_image_index);
+
+  // async compute commands
+  VkCommandBuffer current_compute_cmd;
+
+  void begin_compute();
+  void bind_compute_pipeline(VkPipeline pipeline, VkPipelineLayout layout, VkDescriptorSet set);
+  void dispatch(uint32_t group_count_x, uint32_t group_count_y, uint32_t group_count_z);
+  void transition_compute_image(VkImage image, VkImageLayout current_layout, VkImageLayout new_layout);
+  void end_compute();
+  void submit_compute();
+
+  const Gpu_Frame_Times& gpu_frame_times() const { return _gpu_times; }
+  const Dynamic_State_Stats& dynamic_state_stats() const { return _dynamic_stats; }
 
   void transition_image(VkImage image, VkImageLayout current_layout, VkImageLayout new_layout);
+  void record_mip_barrier(
+    VkCommandBuffer cmd, 
+    VkImage image, 
+    uint32_t base_mip, 
+    uint32_t mip_count, 
+    VkImageLayout current_layout, 
+    VkImageLayout new_layout,
+    VkPipelineStageFlags2 src_stage,
+    VkAccessFlags2 src_access,
+    VkPipelineStageFlags2 dst_stage,
+    VkAccessFlags2 dst_access
+  );
+  void record_barriers(VkCommandBuffer cmd, const VkImageMemoryBarrier2* barriers, uint32_t count);
   void copy_image_to_image(VkImage src, VkImage destination, VkExtent2D src_size, VkExtent2D dst_size);
-  void draw_background(Swapchain* swapchain, VkExtent2D _window_extent, uint32_t image_index);
 private:
   VkDevice  _logical;
   VkQueue   _graphics_queue;
   uint32_t  _graphics_queue_family;
+  VkQueue   _compute_queue;
+  uint32_t  _compute_queue_family;
+  bool      _present_id_enabled;
+
+  PFN_vkCmdPipelineBarrier2KHR _pipeline_barrier2;
+
+  // extended dynamic state commands, loaded when the device supports them
+  PFN_vkCmdSetCullModeEXT          _set_cull_mode = nullptr;
+  PFN_vkCmdSetFrontFaceEXT         _set_front_face = nullptr;
+  PFN_vkCmdSetPrimitiveTopologyEXT _set_primitive_topology = nullptr;
+  PFN_vkCmdSetDepthTestEnableEXT   _set_depth_test_enable = nullptr;
+  PFN_vkCmdSetDepthWriteEnableEXT  _set_depth_write_enable = nullptr;
+  PFN_vkCmdSetDepthCompareOpEXT    _set_depth_compare_op = nullptr;
+#ifdef VK_EXT_extended_dynamic_state3
+  PFN_vkCmdSetPolygonModeEXT       _set_polygon_mode = nullptr;
+#endif
+
+  // dynamic state last recorded into the current command buffer
+  Render_State        _bound_state;
+  uint32_t            _bound_dynamic_states = 0;
+  bool                _bound_state_valid = false;
+  Dynamic_State_Stats _dynamic_stats;
+  Dynamic_State_Stats _recording_stats;
+
+  // compute submissions signal their own timeline that graphics waits on
+  VkSemaphore _compute_timeline;
+  uint64_t    _compute_value{0};
+  bool        _compute_pending{false};
+
+  Timestamps*     _timestamps;
+  bool            _graphics_timestamps;
+  bool            _compute_timestamps;
+  Gpu_Frame_Times _gpu_times;
+  double          _prev_graphics_begin{0.0};
+  double          _prev_graphics_end{0.0};
+
+  void read_frame_times();
+  void record_image_barrier(VkCommandBuffer cmd, VkImage image, VkImageLayout current_layout, VkImageLayout new_layout);
+
+  // incremented on every present, also passed to VK_KHR_present_id when enabled
+  uint64_t _present_id{0};
+
+  Deletion_Queue* _deletion_queue;
 
   int         _frame_number{0};
-  Frame_Data  _frames[FRAME_OVERLAP];
+  uint32_t    _frame_overlap;
+  Frame_Data  _frames[MAX_FRAME_OVERLAP];
+
+  // one timeline semaphore tracks the completion of every frame
+  VkSemaphore               _frame_timeline;
+  uint64_t                  _timeline_value{0};
+  std::deque<Deferred_Work> _deferred;
+
+  // immediate submits are recorded into pooled command buffers and 
+  // signal their own timeline, so callers never wait on each other
+  struct Upload_Buffer {
+    VkCommandBuffer cmd;
+    uint64_t        value;
+  };
+  std::mutex                 _queue_mutex;
+  std::mutex                 _imm_mutex;
+  VkSemaphore                _upload_timeline;
+  std::atomic<uint64_t>      _upload_value{0};
+  std::vector<Upload_Buffer> _upload_buffers;
+  std::vector<Deferred_Work> _upload_continuations;
+
+  uint64_t upload_completed_value();
+  VkCommandBuffer acquire_upload_buffer();
+  void collect_continuations();
 
-  VkRenderPass               _renderpass;
-  VkRenderPassBeginInfo      current_renderpass_info;
-  std::vector<VkFramebuffer> _framebuffers;
+  VkExtent2D                 _viewport_extent{ 1, 1 };
 
   void init_sync_structures();
 };
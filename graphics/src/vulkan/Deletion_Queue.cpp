@@ -0,0 +1,137 @@
+#include "Deletion_Queue.h"
+
+Deletion_Queue::Deletion_Queue(VkDevice device, VmaAllocator allocator) 
+: _device(device), _allocator(allocator) {}
+
+Deletion_Queue::~Deletion_Queue() {
+  flush();
+}
+
+void Deletion_Queue::retire_buffer(VkBuffer buffer, VmaAllocation allocation, uint64_t value) {
+  if (buffer != VK_NULL_HANDLE) {
+    push(Handle_Type::Buffer, (uint64_t)buffer, allocation, value);
+  }
+}
+
+void Deletion_Queue::retire_image(VkImage image, VmaAllocation allocation, uint64_t value) {
+  if (image != VK_NULL_HANDLE) {
+    push(Handle_Type::Image, (uint64_t)image, allocation, value);
+  }
+}
+
+void Deletion_Queue::retire_allocation(VmaAllocation allocation, uint64_t value) {
+  if (allocation != nullptr) {
+    push(Handle_Type::Allocation, 0, allocation, value);
+  }
+}
+
+/**
+ * @brief Destroys every retired handle whose timeline value has completed
+ * @param completed_value current value of the frame timeline
+ */
+void Deletion_Queue::collect(uint64_t completed_value) {
+  take_incoming();
+
+  size_t kept = 0;
+  for (size_t i = 0; i < _pending.size(); i++) {
+    if (_pending[i]->value <= completed_value) {
+      destroy(_pending[i]);
+    }
+    else {
+      _pending[kept++] = _pending[i];
+    }
+  }
+  _pending.resize(kept);
+}
+
+/**
+ * @brief Destroys every retired handle, the device must be idle
+ */
+void Deletion_Queue::flush() {
+  take_incoming();
+
+  for (auto retired : _pending) {
+    destroy(retired);
+  }
+  _pending.clear();
+}
+
+void Deletion_Queue::push(Handle_Type type, uint64_t handle, VmaAllocation allocation, uint64_t value) {
+  Retired_Handle* retired = new Retired_Handle{ type, handle, allocation, value, nullptr };
+
+  retired->next = _incoming.load(std::memory_order_relaxed);
+  while (!_incoming.compare_exchange_weak(
+    retired->next, 
+    retired, 
+    std::memory_order_release, 
+    std::memory_order_relaxed
+  ));
+}
+
+void Deletion_Queue::take_incoming() {
+  Retired_Handle* retired = _incoming.exchange(nullptr, std::memory_order_acquire);
+  size_t first = _pending.size();
+  while (retired != nullptr) {
+    _pending.push_back(retired);
+    retired = retired->next;
+  }
+  // the stack pops newest first, keep handles in the order they were retired
+  std::reverse(_pending.begin() + first, _pending.end());
+}
+
+void Deletion_Queue::destroy(Retired_Handle* retired) {
+  switch (retired->type) {
+    case Handle_Type::Buffer:
+      vmaDestroyBuffer(_allocator, (VkBuffer)retired->handle, retired->allocation);
+      break;
+    case Handle_Type::Image:
+      vmaDestroyImage(_allocator, (VkImage)retired->handle, retired->allocation);
+      break;
+    case Handle_Type::Image_View:
+      vkDestroyImageView(_device, (VkImageView)retired->handle, nullptr);
+      break;
+    case Handle_Type::Sampler:
+      vkDestroySampler(_device, (VkSampler)retired->handle, nullptr);
+      break;
+    case Handle_Type::Framebuffer:
+      vkDestroyFramebuffer(_device, (VkFramebuffer)retired->handle, nullptr);
+      break;
+    case Handle_Type::Render_Pass:
+      vkDestroyRenderPass(_device, (VkRenderPass)retired->handle, nullptr);
+      break;
+    case Handle_Type::Pipeline:
+      vkDestroyPipeline(_device, (VkPipeline)retired->handle, nullptr);
+      break;
+    case Handle_Type::Pipeline_Layout:
+      vkDestroyPipelineLayout(_device, (VkPipelineLayout)retired->handle, nullptr);
+      break;
+    case Handle_Type::Descriptor_Set_Layout:
+      vkDestroyDescriptorSetLayout(_device, (VkDescriptorSetLayout)retired->handle, nullptr);
+      break;
+    case Handle_Type::Descriptor_Pool:
+      vkDestroyDescriptorPool(_device, (VkDescriptorPool)retired->handle, nullptr);
+      break;
+    case Handle_Type::Shader_Module:
+      vkDestroyShaderModule(_device, (VkShaderModule)retired->handle, nullptr);
+      break;
+    case Handle_Type::Semaphore:
+      vkDestroySemaphore(_device, (VkSemaphore)retired->handle, nullptr);
+      break;
+    case Handle_Type::Fence:
+      vkDestroyFence(_device, (VkFence)retired->handle, nullptr);
+      break;
+    case Handle_Type::Command_Pool:
+      vkDestroyCommandPool(_device, (VkCommandPool)retired->handle, nullptr);
+      break;
+    case Handle_Type::Query_Pool:
+      vkDestroyQueryPool(_device, (VkQueryPool)retired->handle, nullptr);
+      break;
+    case Handle_Type::Swapchain:
+      vkDestroySwapchainKHR(_device, (VkSwapchainKHR)retired->handle, nullptr);
+      break;
+    case Handle_Type::Allocation:
+      vmaFreeMemory(_allocator, retired->allocation);
+      break;
+  }
+  delete retired;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "../vulkan_util/vk_types.h"
+
+#include <atomic>
+
+enum class Handle_Type : uint8_t {
+  Buffer,
+  Image,
+  Image_View,
+  Sampler,
+  Framebuffer,
+  Render_Pass,
+  Pipeline,
+  Pipeline_Layout,
+  Descriptor_Set_Layout,
+  Descriptor_Pool,
+  Shader_Module,
+  Semaphore,
+  Fence,
+  Command_Pool,
+  Query_Pool,
+  Swapchain,
+  Allocation,
+};
+
+struct Retired_Handle {
+  Handle_Type     type;
+  uint64_t        handle;
+  VmaAllocation   allocation;
+  // frame timeline value of the last submission that used the handle
+  uint64_t        value;
+  Retired_Handle* next;
+};
+
+/**
+ * @brief Destroys Vulkan handles and VMA allocations once the frame timeline 
+ *        has reached the value that last used them. Any thread may retire 
+ *        handles without locking, only the render thread collects them.
+ */
+class Deletion_Queue
+{
+public:
+  Deletion_Queue(VkDevice device, VmaAllocator allocator);
+  ~Deletion_Queue();
+
+  Deletion_Queue (const Deletion_Queue&) = delete;
+  Deletion_Queue& operator= (const Deletion_Queue&) = delete;
+
+  // handles are stored as 64 bit integers so 32 bit builds work as well
+  template<typename T>
+  void retire(Handle_Type type, T handle, uint64_t value) {
+    if (handle != VK_NULL_HANDLE) {
+      push(type, (uint64_t)handle, nullptr, value);
+    }
+  }
+
+  void retire_buffer(VkBuffer buffer, VmaAllocation allocation, uint64_t value);
+  void retire_image(VkImage image, VmaAllocation allocation, uint64_t value);
+  void retire_allocation(VmaAllocation allocation, uint64_t value);
+
+  void collect(uint64_t completed_value);
+  void flush();
+
+  size_t pending_count() const { return _pending.size(); }
+
+private:
+  VkDevice     _device;
+  VmaAllocator _allocator;
+
+  // lock free stack that producers push onto
+  std::atomic<Retired_Handle*> _incoming{ nullptr };
+  // handles waiting on the timeline, only touched by the render thread
+  std::vector<Retired_Handle*> _pending;
+
+  void push(Handle_Type type, uint64_t handle, VmaAllocation allocation, uint64_t value);
+  void take_incoming();
+  void destroy(Retired_Handle* retired);
+};
@@ -6,6 +6,7 @@ Device::Device(VkInstance instance, VkSurfaceKHR surface)
 : _instance(instance), _surface(surface) {
   pick_physical_device();
   find_queue_indices();
+  query_optional_extensions();
   create_logical_device();
 }
 
@@ -81,6 +82,162 @@ void Device::find_queue_indices() {
       break;
     }
   }
+
+  // a compute only family is usually backed by dedicated async compute hardware
+  for (uint32_t i = 0; i < property_count; i++) {
+    if ((properties[i].queueFlags & VK_QUEUE_COMPUTE_BIT) != 0
+    && (properties[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) == 0) {
+      _compute_index = i;
+      break;
+    }
+  }
+  // otherwise any other compute family, or a second queue of the graphics family
+  if (!_compute_index.has_value()) {
+    for (uint32_t i = 0; i < property_count; i++) {
+      if ((properties[i].queueFlags & VK_QUEUE_COMPUTE_BIT) != 0 && i != _graphics_index.value()) {
+        _compute_index = i;
+        break;
+      }
+    }
+  }
+  if (!_compute_index.has_value()) {
+    _compute_index = _graphics_index;
+    if (properties[_graphics_index.value()].queueCount > 1) {
+      _compute_queue_slot = 1;
+    }
+  }
+  _async_compute = _compute_index.value() != _graphics_index.value() || _compute_queue_slot != 0;
+
+  VkPhysicalDeviceProperties device_properties;
+  vkGetPhysicalDeviceProperties(_physical, &device_properties);
+  _timestamp_period = device_properties.limits.timestampPeriod;
+  _min_uniform_alignment = device_properties.limits.minUniformBufferOffsetAlignment;
+  _max_anisotropy = device_properties.limits.maxSamplerAnisotropy;
+  _graphics_timestamps = properties[_graphics_index.value()].timestampValidBits > 0;
+  _compute_timestamps = properties[_compute_index.value()].timestampValidBits > 0;
+}
+
+/**
+ * @brief Checks if an extension has been enabled on the logical device
+ */
+bool Device::has_extension(const char* name) const {
+  for (auto extension : _enabled_extensions) {
+    if (strcmp(extension, name) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief Collects the required extensions along with every optional
+ *        extension the physical device supports
+ */
+void Device::query_optional_extensions() {
+  uint32_t extension_count = 0;
+  vkEnumerateDeviceExtensionProperties(_physical, nullptr, &extension_count, nullptr);
+  std::vector<VkExtensionProperties> available_extensions(extension_count);
+  vkEnumerateDeviceExtensionProperties(_physical, nullptr, &extension_count, available_extensions.data());
+
+  _enabled_extensions = device_extensions;
+  for (auto extension_name : optional_device_extensions) {
+    for (auto available_extension : available_extensions) {
+      if (strcmp(extension_name, available_extension.extensionName) == 0) {
+        _enabled_extensions.push_back(extension_name);
+        break;
+      }
+    }
+  }
+
+  // present wait also requires the matching features to be supported
+  if (has_extension(VK_KHR_PRESENT_ID_EXTENSION_NAME) 
+  && has_extension(VK_KHR_PRESENT_WAIT_EXTENSION_NAME)) {
+    VkPhysicalDevicePresentWaitFeaturesKHR present_wait_features{};
+    present_wait_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+    present_wait_features.pNext = nullptr;
+
+    VkPhysicalDevicePresentIdFeaturesKHR present_id_features{};
+    present_id_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+    present_id_features.pNext = &present_wait_features;
+
+    VkPhysicalDeviceFeatures2 features{};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &present_id_features;
+    vkGetPhysicalDeviceFeatures2(_physical, &features);
+
+    _present_wait = present_id_features.presentId && present_wait_features.presentWait;
+  }
+
+#ifdef VK_EXT_graphics_pipeline_library
+  if (has_extension(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME)
+  && has_extension(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME)) {
+    VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT library_features{};
+    library_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+    library_features.pNext = nullptr;
+
+    VkPhysicalDeviceFeatures2 features{};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &library_features;
+    vkGetPhysicalDeviceFeatures2(_physical, &features);
+
+    VkPhysicalDeviceGraphicsPipelineLibraryPropertiesEXT library_properties{};
+    library_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_PROPERTIES_EXT;
+    library_properties.pNext = nullptr;
+
+    VkPhysicalDeviceProperties2 properties{};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties.pNext = &library_properties;
+    vkGetPhysicalDeviceProperties2(_physical, &properties);
+
+    _pipeline_library = library_features.graphicsPipelineLibrary;
+    _fast_linking = library_properties.graphicsPipelineLibraryFastLinking;
+  }
+#endif
+
+  VkPhysicalDeviceFeatures core_features;
+  vkGetPhysicalDeviceFeatures(_physical, &core_features);
+  _fill_mode_non_solid = core_features.fillModeNonSolid;
+  _texture_compression_bc = core_features.textureCompressionBC;
+  _sampler_anisotropy = core_features.samplerAnisotropy;
+
+  if (has_extension(VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME)) {
+    VkPhysicalDeviceExtendedDynamicStateFeaturesEXT dynamic_state_features{};
+    dynamic_state_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_FEATURES_EXT;
+    dynamic_state_features.pNext = nullptr;
+
+    VkPhysicalDeviceFeatures2 features{};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &dynamic_state_features;
+    vkGetPhysicalDeviceFeatures2(_physical, &features);
+
+    _extended_dynamic_state = dynamic_state_features.extendedDynamicState;
+  }
+
+#ifdef VK_EXT_extended_dynamic_state3
+  // extended dynamic state 3 only adds to the states of the first extension
+  if (_extended_dynamic_state && has_extension(VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME)) {
+    VkPhysicalDeviceExtendedDynamicState3FeaturesEXT dynamic_state3_features{};
+    dynamic_state3_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT;
+    dynamic_state3_features.pNext = nullptr;
+
+    VkPhysicalDeviceFeatures2 features{};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &dynamic_state3_features;
+    vkGetPhysicalDeviceFeatures2(_physical, &features);
+
+    VkPhysicalDeviceExtendedDynamicState3PropertiesEXT dynamic_state3_properties{};
+    dynamic_state3_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_PROPERTIES_EXT;
+    dynamic_state3_properties.pNext = nullptr;
+
+    VkPhysicalDeviceProperties2 properties{};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties.pNext = &dynamic_state3_properties;
+    vkGetPhysicalDeviceProperties2(_physical, &properties);
+
+    _dynamic_polygon_mode = dynamic_state3_features.extendedDynamicState3PolygonMode;
+    _dynamic_topology_unrestricted = dynamic_state3_properties.dynamicPrimitiveTopologyUnrestricted;
+  }
+#endif
 }
 
 void Device::create_logical_device() {
@@ -88,17 +245,17 @@ void Device::create_logical_device() {
 
   std::vector<VkDeviceQueueCreateInfo> queue_create_infos;
   std::set<uint32_t> unique_queue_families = {
-    _graphics_index.value(), _present_index.value()
+    _graphics_index.value(), _present_index.value(), _compute_index.value()
   };
 
-  float queue_priority = 1.0f;
+  float queue_priorities[] = { 1.0f, 1.0f };
   for (uint32_t queue_family : unique_queue_families) {
     VkDeviceQueueCreateInfo queue_info{};
     queue_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
     queue_info.pNext = NULL;
     queue_info.queueFamilyIndex = queue_family;
-    queue_info.queueCount = 1;
-    queue_info.pQueuePriorities = &queue_priority;
+    queue_info.queueCount = queue_family == _compute_index.value() ? _compute_queue_slot + 1 : 1;
+    queue_info.pQueuePriorities = queue_priorities;
     queue_create_infos.push_back(queue_info);
   }
 
@@ -112,13 +269,69 @@ void Device::create_logical_device() {
   buffer_features.pNext = nullptr;
   buffer_features.bufferDeviceAddress = VK_TRUE;
 
+  // enable timeline semaphores for frame pacing
+  VkPhysicalDeviceTimelineSemaphoreFeatures timeline_features{};
+  timeline_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+  timeline_features.pNext = &buffer_features;
+  timeline_features.timelineSemaphore = VK_TRUE;
+
+  // enable present id and present wait when available
+  VkPhysicalDevicePresentWaitFeaturesKHR present_wait_features{};
+  present_wait_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+  present_wait_features.pNext = nullptr;
+  present_wait_features.presentWait = VK_TRUE;
+
+  VkPhysicalDevicePresentIdFeaturesKHR present_id_features{};
+  present_id_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+  present_id_features.pNext = &present_wait_features;
+  present_id_features.presentId = VK_TRUE;
+
+  if (_present_wait) {
+    buffer_features.pNext = &present_id_features;
+  }
+
   // enable synchronization 2 features for the device
   VkPhysicalDeviceSynchronization2FeaturesKHR sync_features{};
   sync_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES;
-  sync_features.pNext = &buffer_features;
+  sync_features.pNext = &timeline_features;
   sync_features.synchronization2 = VK_TRUE;
   device_features2.pNext = &sync_features;
 
+#ifdef VK_EXT_graphics_pipeline_library
+  VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT library_features{};
+  library_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+  library_features.pNext = &sync_features;
+  library_features.graphicsPipelineLibrary = VK_TRUE;
+
+  if (_pipeline_library) {
+    device_features2.pNext = &library_features;
+  }
+#endif
+
+  VkPhysicalDeviceExtendedDynamicStateFeaturesEXT dynamic_state_features{};
+  dynamic_state_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_FEATURES_EXT;
+  dynamic_state_features.pNext = device_features2.pNext;
+  dynamic_state_features.extendedDynamicState = VK_TRUE;
+
+  if (_extended_dynamic_state) {
+    device_features2.pNext = &dynamic_state_features;
+  }
+
+#ifdef VK_EXT_extended_dynamic_state3
+  VkPhysicalDeviceExtendedDynamicState3FeaturesEXT dynamic_state3_features{};
+  dynamic_state3_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT;
+  dynamic_state3_features.pNext = device_features2.pNext;
+  dynamic_state3_features.extendedDynamicState3PolygonMode = VK_TRUE;
+
+  if (_dynamic_polygon_mode) {
+    device_features2.pNext = &dynamic_state3_features;
+  }
+#endif
+
+  device_features2.features.fillModeNonSolid = _fill_mode_non_solid ? VK_TRUE : VK_FALSE;
+  device_features2.features.textureCompressionBC = _texture_compression_bc ? VK_TRUE : VK_FALSE;
+  device_features2.features.samplerAnisotropy = _sampler_anisotropy ? VK_TRUE : VK_FALSE;
+
   VkDeviceCreateInfo device_info{};
   device_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
   device_info.pNext = &device_features2;
@@ -127,8 +340,8 @@ void Device::create_logical_device() {
     static_cast<uint32_t>(queue_create_infos.size());
   device_info.pEnabledFeatures = nullptr;
   device_info.enabledExtensionCount 
-    = static_cast<uint32_t>(device_extensions.size());
-  device_info.ppEnabledExtensionNames = device_extensions.data();
+    = static_cast<uint32_t>(_enabled_extensions.size());
+  device_info.ppEnabledExtensionNames = _enabled_extensions.data();
 
   if (vkCreateDevice(_physical, &device_info, nullptr, &_logical) != VK_SUCCESS) {
     throw std::runtime_error("failed to create logical device!");
@@ -136,4 +349,5 @@ void Device::create_logical_device() {
 
   vkGetDeviceQueue(_logical, _graphics_index.value(), 0, &_graphics_queue);
   vkGetDeviceQueue(_logical, _present_index.value(), 0, &_present_queue);
+  vkGetDeviceQueue(_logical, _compute_index.value(), _compute_queue_slot, &_compute_queue);
 }
\ No newline at end of file
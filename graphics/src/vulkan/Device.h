@@ -9,6 +9,20 @@ const std::vector<const char*> device_extensions = {
   "VK_KHR_synchronization2",
 };
 
+// extensions that are enabled only when the device supports them
+const std::vector<const char*> optional_device_extensions = {
+  VK_KHR_PRESENT_ID_EXTENSION_NAME,
+  VK_KHR_PRESENT_WAIT_EXTENSION_NAME,
+  VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME,
+#ifdef VK_EXT_extended_dynamic_state3
+  VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME,
+#endif
+#ifdef VK_EXT_graphics_pipeline_library
+  VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME,
+  VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME,
+#endif
+};
+
 class Device
 {
   public:
@@ -25,12 +39,45 @@ class Device
     VkQueue                 _graphics_queue;
     std::optional<uint32_t> _present_index;
     VkQueue                 _present_queue;
+    // compute queue, a dedicated family is preferred so work runs asynchronously
+    std::optional<uint32_t> _compute_index;
+    uint32_t                _compute_queue_slot = 0;
+    VkQueue                 _compute_queue;
+    bool                    _async_compute = false;
+
+    // nanoseconds per timestamp tick, and timestamp support per queue
+    float _timestamp_period = 1.f;
+    // dynamic uniform offsets must be multiples of this
+    VkDeviceSize _min_uniform_alignment = 256;
+    bool  _graphics_timestamps = false;
+    bool  _compute_timestamps = false;
+
+    // optional features enabled on the logical device
+    bool _present_wait = false;
+    // pipelines can be linked from separately compiled parts
+    bool _pipeline_library = false;
+    bool _fast_linking = false;
+    // render state that can be set per draw instead of baked into pipelines
+    bool _extended_dynamic_state = false;
+    bool _dynamic_polygon_mode = false;
+    bool _dynamic_topology_unrestricted = false;
+    // line and point polygon modes
+    bool _fill_mode_non_solid = false;
+    // BC1-7 block compressed textures
+    bool _texture_compression_bc = false;
+    bool  _sampler_anisotropy = false;
+    float _max_anisotropy = 1.f;
+
+    bool has_extension(const char* name) const;
   private:
     VkInstance _instance; 
     VkSurfaceKHR _surface;
 
+    std::vector<const char*> _enabled_extensions;
+
     void pick_physical_device();
     bool is_device_suitable(VkPhysicalDevice gpu);
     void find_queue_indices();
+    void query_optional_extensions();
     void create_logical_device();
 };
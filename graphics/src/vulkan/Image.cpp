@@ -13,6 +13,77 @@ Image::~Image() {
   }
 }
   
+/**
+ * @brief Hands the image over to the deletion queue, it is destroyed 
+ *        once the frame timeline reaches the given value
+ */
+void Image::retire(Deletion_Queue* deletion_queue, uint64_t last_used_value) {
+  deletion_queue->retire(Handle_Type::Image_View, _image_view, last_used_value);
+  deletion_queue->retire_image(_image, _allocation, last_used_value);
+  _image_view = VK_NULL_HANDLE;
+  _image = VK_NULL_HANDLE;
+}
+
+/**
+ * @brief Takes over the handles of another image and retires the current
+ *        ones, frames in flight keep the old view until the frame timeline
+ *        reaches the given value. The replacement is left empty
+ */
+void Image::replace(Image* replacement, Deletion_Queue* deletion_queue, uint64_t last_used_value) {
+  retire(deletion_queue, last_used_value);
+
+  _image = replacement->_image;
+  _image_view = replacement->_image_view;
+  _allocation = replacement->_allocation;
+  _format = replacement->_format;
+  _extent = replacement->_extent;
+  _mip_levels = replacement->_mip_levels;
+  _array_layers = replacement->_array_layers;
+
+  replacement->_image = VK_NULL_HANDLE;
+  replacement->_image_view = VK_NULL_HANDLE;
+  replacement->_allocation = nullptr;
+}
+  
+/**
+ * @brief Allocates the image in GPU local memory along with a view of it
+ * @param queue_families families that access the image, more than one 
+ *        makes the image shared concurrently between them
+ * @param mip_levels levels allocated, the view covers all of them
+ * @param array_layers more than one makes the view a 2D array
+ */
+void Image::create_image(
+  VkExtent3D extent, 
+  VkFormat format, 
+  VkImageUsageFlags usage, 
+  VkImageAspectFlags aspect,
+  const std::vector<uint32_t>& queue_families,
+  uint32_t mip_levels,
+  uint32_t array_layers
+) {
+  _format = format;
+  _extent = extent;
+  _mip_levels = mip_levels;
+  _array_layers = array_layers;
+
+  VkImageCreateInfo img_info = image_create_info(_format, usage, _extent, _mip_levels, _array_layers);
+  if (queue_families.size() > 1) {
+    img_info.sharingMode = VK_SHARING_MODE_CONCURRENT;
+    img_info.queueFamilyIndexCount = static_cast<uint32_t>(queue_families.size());
+    img_info.pQueueFamilyIndices = queue_families.data();
+  }
+
+  // allocate image on GPU local memory
+  VmaAllocationCreateInfo img_alloc_info {};
+  img_alloc_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+  img_alloc_info.requiredFlags = VkMemoryPropertyFlags(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+  VK_CHECK(vmaCreateImage(_allocator, &img_info, &img_alloc_info, &_image, &_allocation, nullptr));
+
+  VkImageViewCreateInfo view_info = imageview_create_info(_format, _image, aspect, _mip_levels, _array_layers);
+  VK_CHECK(vkCreateImageView(_device, &view_info, nullptr, &_image_view));
+}
+
 void Image::create_depth_image(VkExtent2D _window_extent) {
   VkExtent3D depth_image_extent = {
     _window_extent.width,      
@@ -20,23 +91,16 @@ void Image::create_depth_image(VkExtent2D _window_extent) {
     1
   };
 
-  _format = VK_FORMAT_D32_SFLOAT;
-
-  VkImageCreateInfo depth_img_info = image_create_info(_format, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, depth_image_extent);
-
-  // allocate depth image on GPU local memory
-  VmaAllocationCreateInfo depth_img_alloc_info {};
-  depth_img_alloc_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
-  depth_img_alloc_info.requiredFlags = VkMemoryPropertyFlags(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-  vmaCreateImage(_allocator, &depth_img_info, &depth_img_alloc_info, &_image, &_allocation, nullptr);
-
   // image view is used for rendering
-  VkImageViewCreateInfo depth_view_info = imageview_create_info(_format, _image, VK_IMAGE_ASPECT_DEPTH_BIT);
-  VK_CHECK(vkCreateImageView(_device, &depth_view_info, nullptr, &_image_view));
+  create_image(
+    depth_image_extent, 
+    VK_FORMAT_D32_SFLOAT, 
+    VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, 
+    VK_IMAGE_ASPECT_DEPTH_BIT
+  );
 }
   
-VkImageCreateInfo Image::image_create_info(VkFormat format, VkImageUsageFlags usage_flags, VkExtent3D extent) {
+VkImageCreateInfo Image::image_create_info(VkFormat format, VkImageUsageFlags usage_flags, VkExtent3D extent, uint32_t mip_levels, uint32_t array_layers) {
   VkImageCreateInfo info = { };
   info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
   info.pNext = nullptr;
@@ -46,8 +110,8 @@ VkImageCreateInfo Image::image_create_info(VkFormat format, VkImageUsageFlags us
   info.format = format;
   info.extent = extent;
 
-  info.mipLevels = 1;
-  info.arrayLayers = 1;
+  info.mipLevels = mip_levels;
+  info.arrayLayers = array_layers;
   info.samples = VK_SAMPLE_COUNT_1_BIT;
   info.tiling = VK_IMAGE_TILING_OPTIMAL;
   info.usage = usage_flags;
@@ -55,19 +119,19 @@ VkImageCreateInfo Image::image_create_info(VkFormat format, VkImageUsageFlags us
   return info;
 }
   
-VkImageViewCreateInfo Image::imageview_create_info(VkFormat format, VkImage image, VkImageAspectFlags aspect_flags) {
+VkImageViewCreateInfo Image::imageview_create_info(VkFormat format, VkImage image, VkImageAspectFlags aspect_flags, uint32_t mip_levels, uint32_t array_layers) {
   //build a image-view for the depth image to use for rendering
 	VkImageViewCreateInfo info = {};
 	info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
 	info.pNext = nullptr;
 
-	info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	info.viewType = array_layers > 1 ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D;
 	info.image = image;
 	info.format = format;
 	info.subresourceRange.baseMipLevel = 0;
-	info.subresourceRange.levelCount = 1;
+	info.subresourceRange.levelCount = mip_levels;
 	info.subresourceRange.baseArrayLayer = 0;
-	info.subresourceRange.layerCount = 1;
+	info.subresourceRange.layerCount = array_layers;
 	info.subresourceRange.aspectMask = aspect_flags;
 
 	return info;
@@ -4,6 +4,7 @@
 
 #include "../../external_src/vk_mem_alloc.h"
 #include "../vulkan_util/vk_types.h"
+#include "Deletion_Queue.h"
 
 class Image
 {
@@ -11,10 +12,24 @@ public:
   Image(VmaAllocator allocator, VkDevice device);
   ~Image();
 
+  void create_image(
+    VkExtent3D extent, 
+    VkFormat format, 
+    VkImageUsageFlags usage, 
+    VkImageAspectFlags aspect,
+    const std::vector<uint32_t>& queue_families = {},
+    uint32_t mip_levels = 1,
+    uint32_t array_layers = 1
+  );
   void create_depth_image(VkExtent2D _window_extent);
+  void retire(Deletion_Queue* deletion_queue, uint64_t last_used_value);
+  void replace(Image* replacement, Deletion_Queue* deletion_queue, uint64_t last_used_value);
 
   VkImage       _image = VK_NULL_HANDLE;
   VkFormat      _format;
+  VkExtent3D    _extent;
+  uint32_t      _mip_levels = 1;
+  uint32_t      _array_layers = 1;
   VkImageView   _image_view = VK_NULL_HANDLE;
   VmaAllocation _allocation;
 
@@ -22,7 +37,7 @@ private:
   VkDevice      _device;
   VmaAllocator  _allocator;
 
-  static VkImageCreateInfo image_create_info(VkFormat format, VkImageUsageFlags usage_flags, VkExtent3D extent);
-  static VkImageViewCreateInfo imageview_create_info(VkFormat format, VkImage image, VkImageAspectFlags aspect_flags);
+  static VkImageCreateInfo image_create_info(VkFormat format, VkImageUsageFlags usage_flags, VkExtent3D extent, uint32_t mip_levels, uint32_t array_layers);
+  static VkImageViewCreateInfo imageview_create_info(VkFormat format, VkImage image, VkImageAspectFlags aspect_flags, uint32_t mip_levels, uint32_t array_layers);
 };
 
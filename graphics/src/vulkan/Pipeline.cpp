@@ -1,6 +1,318 @@
 #include "Pipeline.h"
 
 #include <fstream>
+#include <cstring>
+
+uint32_t supported_dynamic_states(const Device* device) {
+  uint32_t dynamic_states = 0;
+  if (device->_extended_dynamic_state) {
+    dynamic_states |= DYNAMIC_CULL_MODE | DYNAMIC_DEPTH | DYNAMIC_TOPOLOGY;
+  }
+  if (device->_dynamic_topology_unrestricted) {
+    dynamic_states |= DYNAMIC_TOPOLOGY_ANY;
+  }
+  if (device->_dynamic_polygon_mode) {
+    dynamic_states |= DYNAMIC_POLYGON_MODE;
+  }
+  return dynamic_states;
+}
+
+// pipelines with a dynamic topology still bake its class
+static uint32_t topology_class(VkPrimitiveTopology topology) {
+  switch (topology) {
+    case VK_PRIMITIVE_TOPOLOGY_POINT_LIST:
+      return 0;
+    case VK_PRIMITIVE_TOPOLOGY_LINE_LIST:
+    case VK_PRIMITIVE_TOPOLOGY_LINE_STRIP:
+    case VK_PRIMITIVE_TOPOLOGY_LINE_LIST_WITH_ADJACENCY:
+    case VK_PRIMITIVE_TOPOLOGY_LINE_STRIP_WITH_ADJACENCY:
+      return 1;
+    case VK_PRIMITIVE_TOPOLOGY_PATCH_LIST:
+      return 3;
+    default:
+      return 2;
+  }
+}
+
+void Render_State::hash_input_assembly(uint64_t& seed, uint32_t dynamic_states) const {
+  if (dynamic_states & DYNAMIC_TOPOLOGY_ANY) {
+    return;
+  }
+  hash_combine(seed, (dynamic_states & DYNAMIC_TOPOLOGY) ? topology_class(topology) : topology);
+}
+
+void Render_State::hash_rasterization(uint64_t& seed, uint32_t dynamic_states) const {
+  if (!(dynamic_states & DYNAMIC_POLYGON_MODE)) {
+    hash_combine(seed, polygon_mode);
+  }
+  if (!(dynamic_states & DYNAMIC_CULL_MODE)) {
+    hash_combine(seed, cull_mode);
+    hash_combine(seed, front_face);
+  }
+}
+
+void Render_State::hash_depth(uint64_t& seed, uint32_t dynamic_states) const {
+  if (!(dynamic_states & DYNAMIC_DEPTH)) {
+    hash_combine(seed, depth_test);
+    hash_combine(seed, depth_write);
+    hash_combine(seed, depth_compare);
+  }
+}
+
+bool Render_State::same_input_assembly(const Render_State& other, uint32_t dynamic_states) const {
+  if (dynamic_states & DYNAMIC_TOPOLOGY_ANY) {
+    return true;
+  }
+  if (dynamic_states & DYNAMIC_TOPOLOGY) {
+    return topology_class(topology) == topology_class(other.topology);
+  }
+  return topology == other.topology;
+}
+
+bool Render_State::same_rasterization(const Render_State& other, uint32_t dynamic_states) const {
+  if (!(dynamic_states & DYNAMIC_POLYGON_MODE) && polygon_mode != other.polygon_mode) {
+    return false;
+  }
+  return (dynamic_states & DYNAMIC_CULL_MODE) || (cull_mode == other.cull_mode && front_face == other.front_face);
+}
+
+bool Render_State::same_depth(const Render_State& other, uint32_t dynamic_states) const {
+  return (dynamic_states & DYNAMIC_DEPTH) || (
+    depth_test == other.depth_test &&
+    depth_write == other.depth_write &&
+    depth_compare == other.depth_compare
+  );
+}
+
+void Blend_State::hash(uint64_t& seed) const {
+  hash_combine(seed, enable);
+  hash_combine(seed, write_mask);
+  // factors are ignored while blending is off
+  if (enable) {
+    hash_combine(seed, src_color);
+    hash_combine(seed, dst_color);
+    hash_combine(seed, color_op);
+    hash_combine(seed, src_alpha);
+    hash_combine(seed, dst_alpha);
+    hash_combine(seed, alpha_op);
+  }
+}
+
+bool Blend_State::same(const Blend_State& other) const {
+  if (enable != other.enable || write_mask != other.write_mask) {
+    return false;
+  }
+  return !enable || (
+    src_color == other.src_color &&
+    dst_color == other.dst_color &&
+    color_op == other.color_op &&
+    src_alpha == other.src_alpha &&
+    dst_alpha == other.dst_alpha &&
+    alpha_op == other.alpha_op
+  );
+}
+
+VkPipelineColorBlendAttachmentState Blend_State::attachment() const {
+  VkPipelineColorBlendAttachmentState attachment{};
+  attachment.blendEnable = enable ? VK_TRUE : VK_FALSE;
+  attachment.srcColorBlendFactor = src_color;
+  attachment.dstColorBlendFactor = dst_color;
+  attachment.colorBlendOp = color_op;
+  attachment.srcAlphaBlendFactor = src_alpha;
+  attachment.dstAlphaBlendFactor = dst_alpha;
+  attachment.alphaBlendOp = alpha_op;
+  attachment.colorWriteMask = write_mask;
+  return attachment;
+}
+
+/**
+ * @brief Sets a constant, setting the same id again replaces its value
+ */
+Shader_Variant& Shader_Variant::set(uint32_t constant_id, uint32_t value) {
+  for (const auto& entry : entries) {
+    if (entry.constantID == constant_id) {
+      data[entry.offset / sizeof(uint32_t)] = value;
+      return *this;
+    }
+  }
+
+  VkSpecializationMapEntry entry{};
+  entry.constantID = constant_id;
+  entry.offset = static_cast<uint32_t>(data.size() * sizeof(uint32_t));
+  entry.size = sizeof(uint32_t);
+  entries.push_back(entry);
+  data.push_back(value);
+  return *this;
+}
+
+Shader_Variant& Shader_Variant::set(uint32_t constant_id, float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return set(constant_id, bits);
+}
+
+Shader_Variant& Shader_Variant::set(uint32_t constant_id, bool value) {
+  // SPIR-V boolean constants are specialized from 32 bit values
+  return set(constant_id, static_cast<uint32_t>(value ? VK_TRUE : VK_FALSE));
+}
+
+// constant values paired with their ids, sorted so the order they were set in does not matter
+static std::vector<std::pair<uint32_t, uint32_t>> sorted_constants(const Shader_Variant& variant) {
+  std::vector<std::pair<uint32_t, uint32_t>> constants;
+  for (const auto& entry : variant.entries) {
+    constants.push_back({ entry.constantID, variant.data[entry.offset / sizeof(uint32_t)] });
+  }
+  std::sort(constants.begin(), constants.end());
+  return constants;
+}
+
+/**
+ * @brief Key of the constant values, independent of the order they were set in
+ */
+uint64_t Shader_Variant::key() const {
+  std::vector<std::pair<uint32_t, uint32_t>> constants = sorted_constants(*this);
+
+  uint64_t seed = constants.size();
+  for (const auto& constant : constants) {
+    hash_combine(seed, constant.first);
+    hash_combine(seed, constant.second);
+  }
+  return seed;
+}
+
+bool Shader_Variant::same(const Shader_Variant& other) const {
+  return entries.size() == other.entries.size() && sorted_constants(*this) == sorted_constants(other);
+}
+
+/**
+ * @brief Canonical key of the pipeline state, the name is left out so
+ *        identical states submitted under different names share a pipeline
+ */
+uint64_t Pipeline_Description::key() const {
+  std::hash<std::string> hash_string;
+
+  uint64_t seed = 0;
+  hash_combine(seed, hash_string(vert_filepath));
+  hash_combine(seed, hash_string(frag_filepath));
+  hash_combine(seed, hash_string(comp_filepath));
+  hash_combine(seed, Shader_Compiler::defines_key(defines));
+  hash_combine(seed, variant.key());
+
+  for (const auto& binding : vertex_bindings) {
+    hash_combine(seed, binding.binding);
+    hash_combine(seed, binding.stride);
+    hash_combine(seed, binding.inputRate);
+  }
+  for (const auto& attribute : vertex_attributes) {
+    hash_combine(seed, attribute.location);
+    hash_combine(seed, attribute.binding);
+    hash_combine(seed, attribute.format);
+    hash_combine(seed, attribute.offset);
+  }
+
+  // pipelines differing only in dynamic state collapse into one
+  hash_combine(seed, dynamic_states);
+  state.hash_input_assembly(seed, dynamic_states);
+  state.hash_rasterization(seed, dynamic_states);
+  state.hash_depth(seed, dynamic_states);
+  blend.hash(seed);
+
+  vkreflect::Dynamic_Bindings sorted_buffers = dynamic_buffers;
+  std::sort(sorted_buffers.begin(), sorted_buffers.end());
+  for (const auto& buffer : sorted_buffers) {
+    hash_combine(seed, buffer.first);
+    hash_combine(seed, buffer.second);
+  }
+  hash_combine(seed, (uint64_t)layout);
+  hash_combine(seed, (uint64_t)render_pass);
+  return seed;
+}
+
+bool Pipeline_Description::same(const Pipeline_Description& other) const {
+  return 
+    vert_filepath == other.vert_filepath &&
+    frag_filepath == other.frag_filepath &&
+    comp_filepath == other.comp_filepath &&
+    same_shader_inputs(other) &&
+    same_vertex_input(other) &&
+    dynamic_states == other.dynamic_states &&
+    state.same_input_assembly(other.state, dynamic_states) &&
+    state.same_rasterization(other.state, dynamic_states) &&
+    state.same_depth(other.state, dynamic_states) &&
+    blend.same(other.blend) &&
+    same_dynamic_buffers(other) &&
+    layout == other.layout &&
+    render_pass == other.render_pass;
+}
+
+bool Pipeline_Description::same_vertex_input(const Pipeline_Description& other) const {
+  auto same_binding = [](const VkVertexInputBindingDescription& a, const VkVertexInputBindingDescription& b) {
+    return a.binding == b.binding && a.stride == b.stride && a.inputRate == b.inputRate;
+  };
+  auto same_attribute = [](const VkVertexInputAttributeDescription& a, const VkVertexInputAttributeDescription& b) {
+    return a.location == b.location && a.binding == b.binding && a.format == b.format && a.offset == b.offset;
+  };
+  return 
+    std::equal(vertex_bindings.begin(), vertex_bindings.end(), other.vertex_bindings.begin(), other.vertex_bindings.end(), same_binding) &&
+    std::equal(vertex_attributes.begin(), vertex_attributes.end(), other.vertex_attributes.begin(), other.vertex_attributes.end(), same_attribute);
+}
+
+bool Pipeline_Description::same_dynamic_buffers(const Pipeline_Description& other) const {
+  vkreflect::Dynamic_Bindings sorted = dynamic_buffers;
+  vkreflect::Dynamic_Bindings other_sorted = other.dynamic_buffers;
+  std::sort(sorted.begin(), sorted.end());
+  std::sort(other_sorted.begin(), other_sorted.end());
+  return sorted == other_sorted;
+}
+
+/**
+ * @brief Defines and specialization constants, both independent of order
+ */
+bool Pipeline_Description::same_shader_inputs(const Pipeline_Description& other) const {
+  Shader_Defines sorted = defines;
+  Shader_Defines other_sorted = other.defines;
+  std::sort(sorted.begin(), sorted.end());
+  std::sort(other_sorted.begin(), other_sorted.end());
+  return sorted == other_sorted && variant.same(other.variant);
+}
+
+/**
+ * @brief Picks the pipeline to draw with this frame, the fallback is used
+ *        while the requested pipeline compiles. Called on the render thread
+ * @return false when nothing is ready and the draw should be skipped
+ */
+bool Pipeline_Queue::resolve(Pipeline_Handle handle, Pipeline_Handle fallback, Pipeline_Binding* binding) {
+  Entry& entry = entries[handle];
+  binding->pipeline = entry.pipeline.load(std::memory_order_acquire);
+  if (binding->pipeline != VK_NULL_HANDLE) {
+    binding->layout = entry.layout.load(std::memory_order_relaxed);
+    binding->dynamic_states = entry.dynamic_states;
+    if (entry.waited_on) {
+      auto elapsed = std::chrono::steady_clock::now() - entry.requested;
+      double ms = std::chrono::duration<double, std::milli>(elapsed).count();
+      swap_stats.swap_ins++;
+      swap_stats.last_swap_in_ms = ms;
+      swap_stats.max_swap_in_ms = std::max(swap_stats.max_swap_in_ms, ms);
+      fmt::println("pipeline {} swapped in after {:.2f} ms", entry.name, ms);
+      entry.waited_on = false;
+    }
+    return true;
+  }
+
+  entry.waited_on = true;
+  if (!skip_pending && fallback != NULL_PIPELINE_HANDLE) {
+    binding->pipeline = entries[fallback].pipeline.load(std::memory_order_acquire);
+    if (binding->pipeline != VK_NULL_HANDLE) {
+      binding->layout = entries[fallback].layout.load(std::memory_order_relaxed);
+      binding->dynamic_states = entries[fallback].dynamic_states;
+      swap_stats.fallback_draws++;
+      return true;
+    }
+  }
+
+  swap_stats.skipped_draws++;
+  return false;
+}
 
 Pipeline::~Pipeline() {
   if (vert_shader != VK_NULL_HANDLE) {
@@ -9,6 +321,10 @@ Pipeline::~Pipeline() {
     frag_shader = VK_NULL_HANDLE;
     vert_shader = VK_NULL_HANDLE;
   }
+  if (comp_shader != VK_NULL_HANDLE) {
+    vkDestroyShaderModule(_logical, comp_shader, nullptr);
+    comp_shader = VK_NULL_HANDLE;
+  }
 }
 
 void Pipeline::clear() {
@@ -21,6 +337,7 @@ void Pipeline::clear() {
 	_pipeline_layout = {};
   _depth_stencil = { .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO };
 	_shader_stages.clear();
+  _dynamic_states = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
 
   if (vert_shader != VK_NULL_HANDLE) {
     vkDestroyShaderModule(_logical, frag_shader, nullptr);
@@ -71,20 +388,20 @@ VkPipeline Pipeline::build_pipeline(VkRenderPass pass) {
   pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
 
   // setup our dynamic states
-  VkDynamicState state[] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
-
   VkPipelineDynamicStateCreateInfo dynamic_info = {
     .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO
   };
-  dynamic_info.pDynamicStates = &state[0];
-  dynamic_info.dynamicStateCount = 2;
+  dynamic_info.pDynamicStates = _dynamic_states.data();
+  dynamic_info.dynamicStateCount = static_cast<uint32_t>(_dynamic_states.size());
 
   pipeline_info.pDynamicState = &dynamic_info;
 
+  auto start = std::chrono::steady_clock::now();
+
   VkPipeline new_pipeline;
   if (vkCreateGraphicsPipelines(
     _logical, 
-    VK_NULL_HANDLE, 
+    _cache != nullptr ? _cache->handle() : VK_NULL_HANDLE, 
     1, 
     &pipeline_info, 
     nullptr,
@@ -93,6 +410,7 @@ VkPipeline Pipeline::build_pipeline(VkRenderPass pass) {
     fmt::println("failed to create pipeline");
   }
   else {
+    record_creation_time(start);
     vkDestroyShaderModule(_logical, frag_shader, nullptr);
     vkDestroyShaderModule(_logical, vert_shader, nullptr);
     frag_shader = VK_NULL_HANDLE;
@@ -103,15 +421,162 @@ VkPipeline Pipeline::build_pipeline(VkRenderPass pass) {
   return VK_NULL_HANDLE;
 }
 
-void Pipeline::set_shaders(std::string vert_filepath, std::string frag_filepath) {
+/**
+ * @brief Builds a compute pipeline from the loaded compute shader
+ *        with the stored pipeline layout
+ */
+VkPipeline Pipeline::build_compute_pipeline() {
+  VkComputePipelineCreateInfo pipeline_info = {
+    .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO
+  };
+  pipeline_info.pNext = nullptr;
+  pipeline_info.stage = _shader_stages[0];
+  pipeline_info.layout = _pipeline_layout;
+
+  auto start = std::chrono::steady_clock::now();
+
+  VkPipeline new_pipeline = VK_NULL_HANDLE;
+  if (vkCreateComputePipelines(
+    _logical, 
+    _cache != nullptr ? _cache->handle() : VK_NULL_HANDLE, 
+    1, 
+    &pipeline_info, 
+    nullptr,
+    &new_pipeline)
+  != VK_SUCCESS) {
+    fmt::println("failed to create compute pipeline");
+    new_pipeline = VK_NULL_HANDLE;
+  }
+  else {
+    record_creation_time(start);
+  }
+
+  vkDestroyShaderModule(_logical, comp_shader, nullptr);
+  comp_shader = VK_NULL_HANDLE;
+  return new_pipeline;
+}
+
+#ifdef VK_EXT_graphics_pipeline_library
+/**
+ * @brief Builds one part of a graphics pipeline as a library, only the 
+ *        state belonging to that part is read from the builder
+ * @param part a single VkGraphicsPipelineLibraryFlagBitsEXT
+ */
+VkPipeline Pipeline::build_library(VkRenderPass pass, VkGraphicsPipelineLibraryFlagsEXT part) {
+  VkPipelineViewportStateCreateInfo viewport_state{};
+  viewport_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+  viewport_state.pNext = nullptr;
+  viewport_state.viewportCount = 1;
+  viewport_state.scissorCount = 1;
+
+  VkPipelineColorBlendStateCreateInfo color_blending{};
+  color_blending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+  color_blending.pNext = nullptr;
+  color_blending.logicOpEnable = VK_FALSE;
+  color_blending.logicOp = VK_LOGIC_OP_COPY;
+  color_blending.attachmentCount = 1;
+  color_blending.pAttachments = &_color_blend_attachment;
+
+  // states a part does not contain are ignored by it
+  VkPipelineDynamicStateCreateInfo dynamic_info = {
+    .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO
+  };
+  dynamic_info.pDynamicStates = _dynamic_states.data();
+  dynamic_info.dynamicStateCount = static_cast<uint32_t>(_dynamic_states.size());
+
+  VkGraphicsPipelineLibraryCreateInfoEXT library_info = {
+    .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT
+  };
+  library_info.pNext = nullptr;
+  library_info.flags = part;
+
+  VkGraphicsPipelineCreateInfo pipeline_info = {
+    .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO
+  };
+  pipeline_info.pNext = &library_info;
+  // link time optimization info is kept so the parts can be relinked optimized
+  pipeline_info.flags = VK_PIPELINE_CREATE_LIBRARY_BIT_KHR | VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT;
+  pipeline_info.subpass = 0;
+  pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
+
+  VkShaderStageFlagBits stage = VK_SHADER_STAGE_ALL;
+  switch (part) {
+    case VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT:
+      pipeline_info.pVertexInputState = &_vertex_input_info;
+      pipeline_info.pInputAssemblyState = &_input_assembly;
+      pipeline_info.pDynamicState = &dynamic_info;
+      break;
+    case VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT:
+      stage = VK_SHADER_STAGE_VERTEX_BIT;
+      pipeline_info.pViewportState = &viewport_state;
+      pipeline_info.pRasterizationState = &_rasterizer;
+      pipeline_info.pDynamicState = &dynamic_info;
+      pipeline_info.layout = _pipeline_layout;
+      pipeline_info.renderPass = pass;
+      break;
+    case VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT:
+      stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+      pipeline_info.pDepthStencilState = &_depth_stencil;
+      pipeline_info.pDynamicState = &dynamic_info;
+      pipeline_info.pMultisampleState = &_multisampling;
+      pipeline_info.layout = _pipeline_layout;
+      pipeline_info.renderPass = pass;
+      break;
+    case VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT:
+      pipeline_info.pColorBlendState = &color_blending;
+      pipeline_info.pMultisampleState = &_multisampling;
+      pipeline_info.renderPass = pass;
+      break;
+    default:
+      return VK_NULL_HANDLE;
+  }
+
+  for (const auto& shader_stage : _shader_stages) {
+    if (shader_stage.stage == stage) {
+      pipeline_info.stageCount = 1;
+      pipeline_info.pStages = &shader_stage;
+    }
+  }
+
+  auto start = std::chrono::steady_clock::now();
+
+  VkPipeline new_pipeline = VK_NULL_HANDLE;
+  if (vkCreateGraphicsPipelines(
+    _logical, 
+    _cache != nullptr ? _cache->handle() : VK_NULL_HANDLE, 
+    1, 
+    &pipeline_info, 
+    nullptr,
+    &new_pipeline)
+  != VK_SUCCESS) {
+    fmt::println("failed to create pipeline library part {}", part);
+    return VK_NULL_HANDLE;
+  }
+
+  record_creation_time(start);
+  return new_pipeline;
+}
+#endif
+
+void Pipeline::record_creation_time(std::chrono::steady_clock::time_point start) {
+  if (_cache != nullptr) {
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    _cache->record_creation(std::chrono::duration<double, std::milli>(elapsed).count());
+  }
+}
+
+void Pipeline::set_shaders(std::string vert_filepath, std::string frag_filepath, const Shader_Defines& defines) {
   _shader_stages.clear();
   
   // load in shader stage code
-  auto vert_shader_code = read_file(vert_filepath);
-  auto frag_shader_code = read_file(frag_filepath);
+  auto vert_shader_code = load_shader(vert_filepath, defines);
+  auto frag_shader_code = load_shader(frag_filepath, defines);
   vert_shader = create_shader_module(vert_shader_code);
   frag_shader = create_shader_module(frag_shader_code);
 
+  _interface = vkreflect::reflect(vert_shader_code);
+  _interface.merge(vkreflect::reflect(frag_shader_code));
+
   VkPipelineShaderStageCreateInfo vert_shader_info{};
   vert_shader_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
   vert_shader_info.stage = VK_SHADER_STAGE_VERTEX_BIT;
@@ -127,6 +592,90 @@ void Pipeline::set_shaders(std::string vert_filepath, std::string frag_filepath)
   _shader_stages.push_back(frag_shader_info);
 }
 
+void Pipeline::set_compute_shader(std::string comp_filepath, const Shader_Defines& defines) {
+  _shader_stages.clear();
+
+  auto comp_shader_code = load_shader(comp_filepath, defines);
+  comp_shader = create_shader_module(comp_shader_code);
+  _interface = vkreflect::reflect(comp_shader_code);
+
+  VkPipelineShaderStageCreateInfo comp_shader_info{};
+  comp_shader_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  comp_shader_info.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+  comp_shader_info.module = comp_shader;
+  comp_shader_info.pName = "main";
+  _shader_stages.push_back(comp_shader_info);
+}
+
+/**
+ * @brief Specializes the loaded shader stages, the variant must outlive
+ *        the builder. An empty variant leaves the shaders unspecialized
+ */
+void Pipeline::set_variant(const Shader_Variant& variant) {
+  _specialization.mapEntryCount = static_cast<uint32_t>(variant.entries.size());
+  _specialization.pMapEntries = variant.entries.data();
+  _specialization.dataSize = variant.data.size() * sizeof(uint32_t);
+  _specialization.pData = variant.data.data();
+
+  for (auto& stage : _shader_stages) {
+    stage.pSpecializationInfo = variant.empty() ? nullptr : &_specialization;
+  }
+}
+
+/**
+ * @brief Uses the layout matching the reflected interface of the loaded
+ *        shaders, pipelines with the same interface share a layout
+ * @param dynamic_buffers buffer bindings promoted to dynamic offsets
+ */
+void Pipeline::reflect_layout(vklayout::Layout_Cache* layouts, const vkreflect::Dynamic_Bindings& dynamic_buffers) {
+  _interface.make_dynamic(dynamic_buffers);
+  _pipeline_layout = layouts->get_pipeline_layout(_interface);
+}
+
+/**
+ * @brief Applies the fixed function state of a description, the
+ *        description must outlive the builder
+ */
+void Pipeline::set_fixed_function(const Pipeline_Description& description) {
+  _vertex_input_info.pVertexAttributeDescriptions = description.vertex_attributes.data();
+  _vertex_input_info.vertexAttributeDescriptionCount = static_cast<uint32_t>(description.vertex_attributes.size());
+  _vertex_input_info.pVertexBindingDescriptions = description.vertex_bindings.data();
+  _vertex_input_info.vertexBindingDescriptionCount = static_cast<uint32_t>(description.vertex_bindings.size());
+
+  set_input_topology(description.state.topology);
+  set_polygon_mode(description.state.polygon_mode);
+  set_cull_mode(description.state.cull_mode, description.state.front_face);
+  set_multisampling_none();
+  default_depth_stencil(description.state.depth_test, description.state.depth_write, description.state.depth_compare);
+  set_blending(description.blend);
+  set_dynamic_states(description.dynamic_states);
+}
+
+/**
+ * @brief Leaves the given render states to be set per draw, viewport and
+ *        scissor are always dynamic
+ */
+void Pipeline::set_dynamic_states(uint32_t dynamic_states) {
+  _dynamic_states = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+  if (dynamic_states & DYNAMIC_CULL_MODE) {
+    _dynamic_states.push_back(VK_DYNAMIC_STATE_CULL_MODE_EXT);
+    _dynamic_states.push_back(VK_DYNAMIC_STATE_FRONT_FACE_EXT);
+  }
+  if (dynamic_states & DYNAMIC_DEPTH) {
+    _dynamic_states.push_back(VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE_EXT);
+    _dynamic_states.push_back(VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE_EXT);
+    _dynamic_states.push_back(VK_DYNAMIC_STATE_DEPTH_COMPARE_OP_EXT);
+  }
+  if (dynamic_states & (DYNAMIC_TOPOLOGY | DYNAMIC_TOPOLOGY_ANY)) {
+    _dynamic_states.push_back(VK_DYNAMIC_STATE_PRIMITIVE_TOPOLOGY_EXT);
+  }
+#ifdef VK_EXT_extended_dynamic_state3
+  if (dynamic_states & DYNAMIC_POLYGON_MODE) {
+    _dynamic_states.push_back(VK_DYNAMIC_STATE_POLYGON_MODE_EXT);
+  }
+#endif
+}
+
 void Pipeline::set_vertex_input_info() {
   _vertex_input_info.vertexAttributeDescriptionCount = 0;
   _vertex_input_info.vertexBindingDescriptionCount = 0;
@@ -179,6 +728,10 @@ void Pipeline::disable_blending() {
   _color_blend_attachment.blendEnable = VK_FALSE;
 }
 
+void Pipeline::set_blending(const Blend_State& blend) {
+  _color_blend_attachment = blend.attachment();
+}
+
 std::vector<char> Pipeline::read_file(const std::string& filepath) {
   // read the file starting at the end in binary mode
   std::ifstream file(filepath, std::ios::ate | std::ios::binary);
@@ -199,6 +752,21 @@ std::vector<char> Pipeline::read_file(const std::string& filepath) {
   return buffer;
 }
 
+/**
+ * @brief Precompiled .spv files are read directly, anything else is
+ *        GLSL handed to the shader compiler
+ */
+std::vector<char> Pipeline::load_shader(const std::string& filepath, const Shader_Defines& defines) {
+  bool precompiled = filepath.size() >= 4 && filepath.compare(filepath.size() - 4, 4, ".spv") == 0;
+  if (precompiled) {
+    return read_file(filepath);
+  }
+  if (_shaders == nullptr) {
+    throw std::runtime_error("no shader compiler to compile: [" + filepath + "]!");
+  }
+  return _shaders->compile(filepath, defines);
+}
+
 VkShaderModule Pipeline::create_shader_module(const std::vector<char>& code) {
   VkShaderModuleCreateInfo shader_module_info{};
   shader_module_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
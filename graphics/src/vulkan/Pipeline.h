@@ -1,19 +1,234 @@
 #pragma once
 
 #include "../vulkan_util/vk_types.h"
+#include "../vulkan_util/vk_descriptors.h"
+#include "../vulkan_util/vk_reflect.h"
+#include "Pipeline_Cache.h"
+#include "Shader_Compiler.h"
+
+#include <chrono>
 
 #include "Device.h"
 
+// render state a pipeline leaves to be set per draw
+enum Dynamic_Render_State : uint32_t {
+  // cull mode and front face
+  DYNAMIC_CULL_MODE    = 1 << 0,
+  // depth test, write and compare op
+  DYNAMIC_DEPTH        = 1 << 1,
+  // topology within the class the pipeline was built with
+  DYNAMIC_TOPOLOGY     = 1 << 2,
+  // any topology, the class is not baked either
+  DYNAMIC_TOPOLOGY_ANY = 1 << 3,
+  DYNAMIC_POLYGON_MODE = 1 << 4,
+};
+
+// dynamic render states the device supports
+uint32_t supported_dynamic_states(const Device* device);
+
+/**
+ * @brief Fixed function state that can either be baked into a pipeline
+ *        or set per draw, states that are dynamic are left out of the key
+ */
+struct Render_State {
+  VkPrimitiveTopology topology      = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+  VkPolygonMode       polygon_mode  = VK_POLYGON_MODE_FILL;
+  VkCullModeFlags     cull_mode     = VK_CULL_MODE_NONE;
+  VkFrontFace         front_face    = VK_FRONT_FACE_CLOCKWISE;
+  bool                depth_test    = false;
+  bool                depth_write   = false;
+  VkCompareOp         depth_compare = VK_COMPARE_OP_ALWAYS;
+
+  // grouped by the pipeline library part that bakes them
+  void hash_input_assembly(uint64_t& seed, uint32_t dynamic_states) const;
+  void hash_rasterization(uint64_t& seed, uint32_t dynamic_states) const;
+  void hash_depth(uint64_t& seed, uint32_t dynamic_states) const;
+  bool same_input_assembly(const Render_State& other, uint32_t dynamic_states) const;
+  bool same_rasterization(const Render_State& other, uint32_t dynamic_states) const;
+  bool same_depth(const Render_State& other, uint32_t dynamic_states) const;
+};
+
+/**
+ * @brief Blending of the color attachment, disabled unless enabled here
+ */
+struct Blend_State {
+  bool                  enable     = false;
+  VkBlendFactor         src_color  = VK_BLEND_FACTOR_ONE;
+  VkBlendFactor         dst_color  = VK_BLEND_FACTOR_ZERO;
+  VkBlendOp             color_op   = VK_BLEND_OP_ADD;
+  VkBlendFactor         src_alpha  = VK_BLEND_FACTOR_ONE;
+  VkBlendFactor         dst_alpha  = VK_BLEND_FACTOR_ZERO;
+  VkBlendOp             alpha_op   = VK_BLEND_OP_ADD;
+  VkColorComponentFlags write_mask = 
+    VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+  void hash(uint64_t& seed) const;
+  bool same(const Blend_State& other) const;
+  VkPipelineColorBlendAttachmentState attachment() const;
+};
+
+/**
+ * @brief Specialization constant values selecting a permutation of a
+ *        shader module, the same values are given to every stage and
+ *        constant ids a stage does not declare are ignored
+ */
+struct Shader_Variant {
+  std::vector<VkSpecializationMapEntry> entries;
+  // every constant is stored in 32 bits
+  std::vector<uint32_t>                 data;
+
+  Shader_Variant& set(uint32_t constant_id, uint32_t value);
+  Shader_Variant& set(uint32_t constant_id, float value);
+  Shader_Variant& set(uint32_t constant_id, bool value);
+
+  bool empty() const { return entries.empty(); }
+  uint64_t key() const;
+  bool same(const Shader_Variant& other) const;
+};
+
+/**
+ * @brief Everything needed to build a pipeline, descriptions are not 
+ *        modified once submitted so workers can read them without locking
+ */
+struct Pipeline_Description {
+  std::string name;
+
+  // a compute pipeline is built when comp_filepath is set, GLSL sources
+  // are compiled at runtime and .spv files are loaded as they are
+  std::string vert_filepath;
+  std::string frag_filepath;
+  std::string comp_filepath;
+
+  // permutation of the shaders above, variants are keyed like any other state
+  Shader_Defines defines;
+  Shader_Variant variant;
+
+  std::vector<VkVertexInputBindingDescription>   vertex_bindings;
+  std::vector<VkVertexInputAttributeDescription> vertex_attributes;
+
+  // values of dynamic states only serve as defaults, draws set their own
+  Render_State state;
+  uint32_t     dynamic_states = 0;
+  Blend_State  blend;
+
+  // reflected from the shaders when left empty, the listed buffers are
+  // bound at dynamic offsets in the reflected layout
+  vkreflect::Dynamic_Bindings dynamic_buffers;
+  VkPipelineLayout layout      = VK_NULL_HANDLE;
+  VkRenderPass     render_pass = VK_NULL_HANDLE;
+
+  uint64_t key() const;
+  // compares everything key() covers, so colliding keys are told apart
+  bool same(const Pipeline_Description& other) const;
+  bool same_vertex_input(const Pipeline_Description& other) const;
+  bool same_shader_inputs(const Pipeline_Description& other) const;
+  bool same_dynamic_buffers(const Pipeline_Description& other) const;
+};
+
+// index of a pipeline in the Pipeline_Queue
+using Pipeline_Handle = uint32_t;
+constexpr Pipeline_Handle NULL_PIPELINE_HANDLE = UINT32_MAX;
+
+// what a draw binds for a resolved pipeline handle
+struct Pipeline_Binding {
+  VkPipeline       pipeline       = VK_NULL_HANDLE;
+  VkPipelineLayout layout         = VK_NULL_HANDLE;
+  uint32_t         dynamic_states = 0;
+};
+
+struct Pipeline_Swap_Stats {
+  // draws made while the requested pipeline was still compiling
+  uint32_t fallback_draws = 0;
+  uint32_t skipped_draws  = 0;
+  // pipelines that became ready after something waited on them
+  uint32_t swap_ins       = 0;
+  // time from the request to the first draw with the real pipeline
+  double   last_swap_in_ms = 0.0;
+  double   max_swap_in_ms  = 0.0;
+};
+
+/**
+ * @brief Owns every pipeline and layout, pipelines are deduplicated by
+ *        their description and looked up by handle. Keys only narrow the
+ *        search, entries sharing a key are compared in full
+ */
 struct Pipeline_Queue {
-  std::unordered_map<std::string, VkPipeline> pipelines;
-  std::unordered_map<std::string, VkPipelineLayout> pipeline_layouts;
+  struct Entry {
+    // written by compilation workers once the pipeline has been built
+    std::atomic<VkPipeline>       pipeline{ VK_NULL_HANDLE };
+    std::atomic<VkPipelineLayout> layout{ VK_NULL_HANDLE };
+    std::string                   name;
+    uint32_t                      dynamic_states = 0;
+    std::shared_ptr<const Pipeline_Description> description;
 
-  void flush(VkDevice _logical) {
-    for (auto pipeline : pipelines) {
-      vkDestroyPipeline(_logical, pipeline.second, nullptr);
+    // only touched by the render thread
+    std::chrono::steady_clock::time_point requested;
+    bool                                  waited_on = false;
+  };
+
+  // a deque keeps entries in place while new ones are reserved
+  std::deque<Entry> entries;
+  std::unordered_map<uint64_t, std::vector<Pipeline_Handle>> handles;
+
+  std::mutex mutex;
+  uint32_t   deduplicated_count = 0;
+
+  // draws skip materials without a ready pipeline instead of using their fallback
+  bool                skip_pending = false;
+  Pipeline_Swap_Stats swap_stats;
+
+  Pipeline_Handle reserve(std::shared_ptr<const Pipeline_Description> description, bool* is_new) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<Pipeline_Handle>& candidates = handles[description->key()];
+
+    for (auto candidate : candidates) {
+      if (entries[candidate].description->same(*description)) {
+        deduplicated_count++;
+        *is_new = false;
+        return candidate;
+      }
     }
-    for (auto layout : pipeline_layouts) {
-      vkDestroyPipelineLayout(_logical, layout.second, nullptr);
+
+    Pipeline_Handle handle = static_cast<Pipeline_Handle>(entries.size());
+    Entry& entry = entries.emplace_back();
+    entry.layout = description->layout;
+    entry.name = description->name;
+    entry.dynamic_states = description->dynamic_states;
+    entry.description = description;
+    entry.requested = std::chrono::steady_clock::now();
+    candidates.push_back(handle);
+    *is_new = true;
+    return handle;
+  }
+
+  void publish(Pipeline_Handle handle, VkPipeline pipeline, VkPipelineLayout layout) {
+    std::lock_guard<std::mutex> lock(mutex);
+    entries[handle].layout.store(layout, std::memory_order_relaxed);
+    entries[handle].pipeline.store(pipeline, std::memory_order_release);
+  }
+
+  // swaps in an improved pipeline, the previous one is returned to be retired
+  VkPipeline replace(Pipeline_Handle handle, VkPipeline pipeline) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return entries[handle].pipeline.exchange(pipeline, std::memory_order_acq_rel);
+  }
+
+  // lookups happen on the thread that reserves handles
+  VkPipeline pipeline(Pipeline_Handle handle) const {
+    return entries[handle].pipeline.load(std::memory_order_acquire);
+  }
+
+  VkPipelineLayout layout(Pipeline_Handle handle) const {
+    return entries[handle].layout.load(std::memory_order_acquire);
+  }
+
+  bool resolve(Pipeline_Handle handle, Pipeline_Handle fallback, Pipeline_Binding* binding);
+
+  void flush(VkDevice _logical) {
+    for (auto& entry : entries) {
+      if (entry.pipeline != VK_NULL_HANDLE) {
+        vkDestroyPipeline(_logical, entry.pipeline, nullptr);
+      }
     }
   }
 };
@@ -29,10 +244,13 @@ public:
   VkPipelineMultisampleStateCreateInfo          _multisampling;
   VkPipelineLayout                              _pipeline_layout;
   VkPipelineDepthStencilStateCreateInfo         _depth_stencil;
+  std::vector<VkDynamicState>                   _dynamic_states;
 
-  Pipeline(VkDevice device){ 
+  Pipeline(VkDevice device, Pipeline_Cache* cache = nullptr, Shader_Compiler* shaders = nullptr){ 
     clear();
     _logical = device;
+    _cache = cache;
+    _shaders = shaders;
   }
 
   ~Pipeline();
@@ -40,8 +258,17 @@ public:
   void clear();
 
   VkPipeline build_pipeline(VkRenderPass pass);
+  VkPipeline build_compute_pipeline();
+#ifdef VK_EXT_graphics_pipeline_library
+  VkPipeline build_library(VkRenderPass pass, VkGraphicsPipelineLibraryFlagsEXT part);
+#endif
 
-  void set_shaders(std::string vert_filepath, std::string frag_filepath);
+  void set_shaders(std::string vert_filepath, std::string frag_filepath, const Shader_Defines& defines = {});
+  void set_compute_shader(std::string comp_filepath, const Shader_Defines& defines = {});
+  void set_variant(const Shader_Variant& variant);
+  void set_fixed_function(const Pipeline_Description& description);
+  void set_dynamic_states(uint32_t dynamic_states);
+  void reflect_layout(vklayout::Layout_Cache* layouts, const vkreflect::Dynamic_Bindings& dynamic_buffers = {});
   void set_vertex_input_info();
   void set_input_topology(VkPrimitiveTopology topology);
   void set_polygon_mode(VkPolygonMode mode);
@@ -50,13 +277,26 @@ public:
   void set_pipeline_layout(VkPipelineLayout layout);
   void default_depth_stencil(bool depth_test, bool depth_write, VkCompareOp compareOp);
   void disable_blending();
+  void set_blending(const Blend_State& blend);
 
 private:
   VkDevice _logical;
+  Pipeline_Cache* _cache;
+  Shader_Compiler* _shaders;
+
+  void record_creation_time(std::chrono::steady_clock::time_point start);
   VkShaderModule vert_shader = VK_NULL_HANDLE;
   VkShaderModule frag_shader = VK_NULL_HANDLE;
+  VkShaderModule comp_shader = VK_NULL_HANDLE;
+
+  // resources used by the loaded shader stages
+  vkreflect::Shader_Interface _interface;
+
+  // specialization of the loaded stages, points into the variant given to set_variant
+  VkSpecializationInfo _specialization{};
 
   static std::vector<char> read_file(const std::string& filepath);
+  std::vector<char> load_shader(const std::string& filepath, const Shader_Defines& defines);
   VkShaderModule create_shader_module(const std::vector<char>& code);
   
 };
@@ -0,0 +1,174 @@
+#include "Pipeline_Cache.h"
+#include "../vulkan_util/vk_util.h"
+
+#include <cstring>
+#include <fstream>
+
+// "MBPC" in little endian
+constexpr uint32_t CACHE_MAGIC = 0x4350424D;
+constexpr uint32_t CACHE_VERSION = 2;
+
+Pipeline_Cache::Pipeline_Cache(Device* device, std::string filepath)
+: _logical(device->_logical), _filepath(filepath) {
+  vkGetPhysicalDeviceProperties(device->_physical, &_properties);
+
+  File_Header header{};
+  std::vector<char> data = load(&header);
+  _stats.warm = !data.empty();
+  _stats.loaded_bytes = data.size();
+  if (_stats.warm) {
+    _stats.cold_pipelines = header.cold_pipelines;
+    _stats.cold_ms = header.cold_ms;
+  }
+
+  VkPipelineCacheCreateInfo cache_info{};
+  cache_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+  cache_info.pNext = nullptr;
+  cache_info.flags = 0;
+  cache_info.initialDataSize = data.size();
+  cache_info.pInitialData = data.empty() ? nullptr : data.data();
+
+  VK_CHECK(vkCreatePipelineCache(_logical, &cache_info, nullptr, &_cache));
+}
+
+Pipeline_Cache::~Pipeline_Cache() {
+  vkDestroyPipelineCache(_logical, _cache, nullptr);
+}
+
+/**
+ * @brief Adds the time spent creating a pipeline against this cache, to the
+ *        cold or warm total depending on how the cache started
+ */
+void Pipeline_Cache::record_creation(double ms) {
+  std::lock_guard<std::mutex> lock(_stats_mutex);
+  if (_stats.warm) {
+    _stats.warm_pipelines++;
+    _stats.warm_ms += ms;
+  }
+  else {
+    _stats.cold_pipelines++;
+    _stats.cold_ms += ms;
+  }
+}
+
+Pipeline_Cache_Stats Pipeline_Cache::stats() {
+  std::lock_guard<std::mutex> lock(_stats_mutex);
+  return _stats;
+}
+
+void Pipeline_Cache::report() {
+  Pipeline_Cache_Stats current = stats();
+  fmt::println(
+    "pipeline cache cold: {} pipelines in {:.2f} ms{}",
+    current.cold_pipelines,
+    current.cold_ms,
+    current.warm ? " (first run)" : ""
+  );
+  if (!current.warm) {
+    return;
+  }
+  double cold_average = current.cold_pipelines > 0 ? current.cold_ms / current.cold_pipelines : 0.0;
+  double warm_average = current.warm_pipelines > 0 ? current.warm_ms / current.warm_pipelines : 0.0;
+  fmt::println(
+    "pipeline cache warm: {} pipelines in {:.2f} ms, {:.3f} ms per pipeline against {:.3f} cold",
+    current.warm_pipelines,
+    current.warm_ms,
+    warm_average,
+    cold_average
+  );
+}
+
+/**
+ * @brief Reads the cache file, the data is discarded if it was
+ *        written by a different device, driver or is corrupted
+ */
+std::vector<char> Pipeline_Cache::load(File_Header* header_out) {
+  std::ifstream file(_filepath, std::ios::binary | std::ios::ate);
+  if (!file.is_open()) {
+    return {};
+  }
+
+  size_t file_size = static_cast<size_t>(file.tellg());
+  if (file_size < sizeof(File_Header)) {
+    return {};
+  }
+
+  File_Header header;
+  file.seekg(0);
+  file.read(reinterpret_cast<char*>(&header), sizeof(File_Header));
+  if (header.data_size != file_size - sizeof(File_Header)) {
+    fmt::println("pipeline cache {} is truncated, starting cold", _filepath);
+    return {};
+  }
+
+  std::vector<char> data(header.data_size);
+  file.read(data.data(), data.size());
+
+  if (!validate(header, data)) {
+    return {};
+  }
+  *header_out = header;
+  return data;
+}
+
+bool Pipeline_Cache::validate(const File_Header& header, const std::vector<char>& data) const {
+  if (header.magic != CACHE_MAGIC || header.version != CACHE_VERSION) {
+    fmt::println("pipeline cache {} has an unknown format, starting cold", _filepath);
+    return false;
+  }
+  if (
+    header.vendor_id != _properties.vendorID ||
+    header.device_id != _properties.deviceID ||
+    header.driver_version != _properties.driverVersion ||
+    memcmp(header.cache_uuid, _properties.pipelineCacheUUID, VK_UUID_SIZE) != 0
+  ) {
+    fmt::println("pipeline cache {} was written by another device or driver, starting cold", _filepath);
+    return false;
+  }
+  if (header.data_hash != hash_bytes(data.data(), data.size())) {
+    fmt::println("pipeline cache {} is corrupted, starting cold", _filepath);
+    return false;
+  }
+
+  // the driver prefixes its data with a header of its own
+  VkPipelineCacheHeaderVersionOne driver_header;
+  if (data.size() < sizeof(driver_header)) {
+    return false;
+  }
+  memcpy(&driver_header, data.data(), sizeof(driver_header));
+  return driver_header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+    driver_header.vendorID == _properties.vendorID &&
+    driver_header.deviceID == _properties.deviceID &&
+    memcmp(driver_header.pipelineCacheUUID, _properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+/**
+ * @brief Writes the cache through vkutil::write_file_atomic, a crash never
+ *        leaves a partially written cache. The cold creation time is kept
+ *        so later warm runs can be compared against it
+ */
+void Pipeline_Cache::save() {
+  size_t data_size = 0;
+  VK_CHECK(vkGetPipelineCacheData(_logical, _cache, &data_size, nullptr));
+  std::vector<char> data(data_size);
+  VK_CHECK(vkGetPipelineCacheData(_logical, _cache, &data_size, data.data()));
+  data.resize(data_size);
+
+  File_Header header{};
+  header.magic = CACHE_MAGIC;
+  header.version = CACHE_VERSION;
+  header.vendor_id = _properties.vendorID;
+  header.device_id = _properties.deviceID;
+  header.driver_version = _properties.driverVersion;
+  memcpy(header.cache_uuid, _properties.pipelineCacheUUID, VK_UUID_SIZE);
+  Pipeline_Cache_Stats current = stats();
+  header.cold_pipelines = current.cold_pipelines;
+  header.cold_ms = current.cold_ms;
+  header.data_size = data.size();
+  header.data_hash = hash_bytes(data.data(), data.size());
+
+  std::vector<char> contents(sizeof(File_Header) + data.size());
+  memcpy(contents.data(), &header, sizeof(File_Header));
+  memcpy(contents.data() + sizeof(File_Header), data.data(), data.size());
+  vkutil::write_file_atomic(_filepath, contents);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "../vulkan_util/vk_types.h"
+#include "device.h"
+
+struct Pipeline_Cache_Stats {
+  // the cache was seeded with data saved by a previous run
+  bool     warm = false;
+  size_t   loaded_bytes = 0;
+  // creation against an empty cache, from this run or the run that first
+  // wrote the cache file
+  uint32_t cold_pipelines = 0;
+  double   cold_ms = 0.0;
+  // creation against a loaded cache, only measured in warm runs
+  uint32_t warm_pipelines = 0;
+  double   warm_ms = 0.0;
+};
+
+/**
+ * @brief Pipeline cache persisted to disk between runs, the saved data is
+ *        only reused on the same device and driver that produced it
+ */
+class Pipeline_Cache
+{
+public:
+  Pipeline_Cache(Device* device, std::string filepath);
+  ~Pipeline_Cache();
+
+  Pipeline_Cache (const Pipeline_Cache&) = delete;
+  Pipeline_Cache& operator= (const Pipeline_Cache&) = delete;
+
+  VkPipelineCache handle() const { return _cache; }
+
+  void record_creation(double ms);
+  Pipeline_Cache_Stats stats();
+  void report();
+  void save();
+
+private:
+  // written in front of the driver's cache data
+  struct File_Header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vendor_id;
+    uint32_t device_id;
+    uint32_t driver_version;
+    uint8_t  cache_uuid[VK_UUID_SIZE];
+    // creation time of the cold run that first wrote the cache
+    uint32_t cold_pipelines;
+    double   cold_ms;
+    uint64_t data_size;
+    uint64_t data_hash;
+  };
+
+  VkDevice                   _logical;
+  VkPhysicalDeviceProperties _properties;
+  std::string                _filepath;
+  VkPipelineCache            _cache = VK_NULL_HANDLE;
+
+  std::mutex           _stats_mutex;
+  Pipeline_Cache_Stats _stats;
+
+  std::vector<char> load(File_Header* header);
+  bool validate(const File_Header& header, const std::vector<char>& data) const;
+};
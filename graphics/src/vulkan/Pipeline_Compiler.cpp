@@ -0,0 +1,154 @@
+#include "Pipeline_Compiler.h"
+
+Pipeline_Compiler::Pipeline_Compiler(
+  VkDevice device, 
+  Pipeline_Cache* cache, 
+  vklayout::Layout_Cache* layouts, 
+  Shader_Compiler* shaders, 
+  Pipeline_Library* library, 
+  Thread_Pool* workers
+) : _logical(device), _cache(cache), _layouts(layouts), _shaders(shaders), _library(library), _workers(workers) {}
+
+Pipeline_Compiler::~Pipeline_Compiler() {
+  wait();
+  // nothing is in flight once the compiler is destroyed
+  for (auto pipeline : _replaced) {
+    vkDestroyPipeline(_logical, pipeline, nullptr);
+  }
+}
+
+/**
+ * @brief Queues a description for compilation, the pipeline is published
+ *        to the returned handle once it has been built. A description 
+ *        matching an earlier one returns the existing handle instead
+ */
+Pipeline_Handle Pipeline_Compiler::compile(std::shared_ptr<const Pipeline_Description> description, Pipeline_Queue* queue) {
+  bool is_new = false;
+  Pipeline_Handle handle = queue->reserve(description, &is_new);
+  if (!is_new) {
+    return handle;
+  }
+
+  bool use_library = _library != nullptr && _library->supported() && description->comp_filepath.empty();
+
+  enqueue([this, description, queue, handle, use_library]() {
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    VkPipelineLayout layout = VK_NULL_HANDLE;
+    try {
+      pipeline = use_library ? _library->fast_link(*description, &layout) : build(*description, &layout);
+    }
+    catch (const std::exception& e) {
+      fmt::println("failed to compile pipeline {}: {}", description->name, e.what());
+    }
+
+    if (pipeline != VK_NULL_HANDLE) {
+      queue->publish(handle, pipeline, layout);
+      _compiled++;
+      if (use_library) {
+        link_optimized(description, queue, handle, layout);
+      }
+    }
+    else {
+      _failed++;
+    }
+  });
+
+  return handle;
+}
+
+/**
+ * @brief Blocks until every submitted description has been compiled,
+ *        including the optimized links that replace fast linked pipelines
+ */
+void Pipeline_Compiler::wait() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  _done.wait(lock, [&]() { return _pending == 0; });
+}
+
+/**
+ * @brief Hands replaced pipelines to the deletion queue, frames up to
+ *        the given value may still have them bound
+ */
+void Pipeline_Compiler::retire_replaced(Deletion_Queue* deletion_queue, uint64_t last_used_value) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  for (auto pipeline : _replaced) {
+    deletion_queue->retire(Handle_Type::Pipeline, pipeline, last_used_value);
+  }
+  _replaced.clear();
+}
+
+void Pipeline_Compiler::enqueue(std::function<void()>&& job) {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _pending++;
+  }
+
+  _workers->enqueue([this, job = std::move(job)]() {
+    job();
+    finish_job();
+  });
+}
+
+void Pipeline_Compiler::finish_job() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  _pending--;
+  if (_pending == 0) {
+    _done.notify_all();
+  }
+}
+
+/**
+ * @brief Queues an optimized link of a fast linked pipeline, it is
+ *        swapped in once built and the fast linked one is retired
+ */
+void Pipeline_Compiler::link_optimized(
+  std::shared_ptr<const Pipeline_Description> description, 
+  Pipeline_Queue* queue, 
+  Pipeline_Handle handle, 
+  VkPipelineLayout layout
+) {
+  enqueue([this, description, queue, handle, layout]() {
+    VkPipeline optimized = VK_NULL_HANDLE;
+    try {
+      optimized = _library->optimized_link(*description, layout);
+    }
+    catch (const std::exception& e) {
+      fmt::println("failed to link optimized pipeline {}: {}", description->name, e.what());
+    }
+    if (optimized == VK_NULL_HANDLE) {
+      // the fast linked pipeline stays in use
+      return;
+    }
+
+    VkPipeline replaced = queue->replace(handle, optimized);
+    std::lock_guard<std::mutex> lock(_mutex);
+    _replaced.push_back(replaced);
+  });
+}
+
+VkPipeline Pipeline_Compiler::build(const Pipeline_Description& description, VkPipelineLayout* layout) {
+  Pipeline pipeline_builder(_logical, _cache, _shaders);
+
+  if (!description.comp_filepath.empty()) {
+    pipeline_builder.set_compute_shader(description.comp_filepath, description.defines);
+  }
+  else {
+    pipeline_builder.set_shaders(description.vert_filepath, description.frag_filepath, description.defines);
+  }
+  pipeline_builder.set_variant(description.variant);
+
+  if (description.layout != VK_NULL_HANDLE) {
+    pipeline_builder.set_pipeline_layout(description.layout);
+  }
+  else {
+    pipeline_builder.reflect_layout(_layouts, description.dynamic_buffers);
+  }
+  *layout = pipeline_builder._pipeline_layout;
+
+  if (!description.comp_filepath.empty()) {
+    return pipeline_builder.build_compute_pipeline();
+  }
+
+  pipeline_builder.set_fixed_function(description);
+  return pipeline_builder.build_pipeline(description.render_pass);
+}
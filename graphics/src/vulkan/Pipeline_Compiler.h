@@ -0,0 +1,62 @@
+#pragma once
+
+#include "../vulkan_util/vk_types.h"
+#include "../engine/Thread_Pool.h"
+#include "pipeline.h"
+#include "Pipeline_Cache.h"
+#include "Pipeline_Library.h"
+#include "Deletion_Queue.h"
+
+/**
+ * @brief Compiles pipeline descriptions on worker threads against the
+ *        shared pipeline cache and publishes them into a Pipeline_Queue.
+ *        Graphics pipelines are fast linked from a pipeline library when
+ *        the device supports it and replaced by an optimized link later
+ */
+class Pipeline_Compiler
+{
+public:
+  Pipeline_Compiler(
+    VkDevice device, 
+    Pipeline_Cache* cache, 
+    vklayout::Layout_Cache* layouts, 
+    Shader_Compiler* shaders, 
+    Pipeline_Library* library, 
+    Thread_Pool* workers
+  );
+  ~Pipeline_Compiler();
+
+  Pipeline_Compiler (const Pipeline_Compiler&) = delete;
+  Pipeline_Compiler& operator= (const Pipeline_Compiler&) = delete;
+
+  Pipeline_Handle compile(std::shared_ptr<const Pipeline_Description> description, Pipeline_Queue* queue);
+  void wait();
+  void retire_replaced(Deletion_Queue* deletion_queue, uint64_t last_used_value);
+
+  uint32_t compiled_count() const { return _compiled.load(); }
+  uint32_t failed_count() const { return _failed.load(); }
+
+private:
+  VkDevice        _logical;
+  Pipeline_Cache*         _cache;
+  vklayout::Layout_Cache* _layouts;
+  Shader_Compiler*        _shaders;
+  Pipeline_Library*       _library;
+  Thread_Pool*            _workers;
+
+  // fast linked pipelines that an optimized link has replaced
+  std::vector<VkPipeline> _replaced;
+
+  // compiles submitted to the pool that have not finished yet
+  std::mutex              _mutex;
+  std::condition_variable _done;
+  uint32_t                _pending{0};
+
+  std::atomic<uint32_t> _compiled{0};
+  std::atomic<uint32_t> _failed{0};
+
+  VkPipeline build(const Pipeline_Description& description, VkPipelineLayout* layout);
+  void enqueue(std::function<void()>&& job);
+  void finish_job();
+  void link_optimized(std::shared_ptr<const Pipeline_Description> description, Pipeline_Queue* queue, Pipeline_Handle handle, VkPipelineLayout layout);
+};
@@ -0,0 +1,348 @@
+#include "Pipeline_Library.h"
+
+#include <chrono>
+
+static double elapsed_ms(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+Pipeline_Library::Pipeline_Library(Device* device, Pipeline_Cache* cache, vklayout::Layout_Cache* layouts, Shader_Compiler* shaders)
+: _logical(device->_logical), _cache(cache), _layouts(layouts), _shaders(shaders), _supported(device->_pipeline_library) {
+  if (_supported && !device->_fast_linking) {
+    fmt::println("pipeline libraries are supported but linking them is not fast on this device");
+  }
+}
+
+Pipeline_Library::~Pipeline_Library() {
+  for (auto& parts : _parts) {
+    for (auto& candidates : parts) {
+      for (auto& part : candidates.second) {
+        vkDestroyPipeline(_logical, part.pipeline, nullptr);
+      }
+    }
+  }
+}
+
+/**
+ * @brief Links the parts of a description without link time optimization,
+ *        parts that have not been used before are compiled first
+ * @param layout receives the layout the pipeline was linked with
+ */
+VkPipeline Pipeline_Library::fast_link(const Pipeline_Description& description, VkPipelineLayout* layout) {
+  *layout = VK_NULL_HANDLE;
+  VkPipeline parts[PART_COUNT];
+  if (!get_parts(description, layout, parts)) {
+    return VK_NULL_HANDLE;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  VkPipeline pipeline = link(parts, *layout, false);
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  _stats.fast_links++;
+  _stats.fast_link_ms += elapsed_ms(start);
+  return pipeline;
+}
+
+/**
+ * @brief Relinks the cached parts of a description with link time
+ *        optimization, meant to run in the background after a fast link
+ */
+VkPipeline Pipeline_Library::optimized_link(const Pipeline_Description& description, VkPipelineLayout layout) {
+  VkPipeline parts[PART_COUNT];
+  if (!get_parts(description, &layout, parts)) {
+    return VK_NULL_HANDLE;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  VkPipeline pipeline = link(parts, layout, true);
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  _stats.optimized_links++;
+  _stats.optimized_link_ms += elapsed_ms(start);
+  return pipeline;
+}
+
+Pipeline_Library_Stats Pipeline_Library::stats() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _stats;
+}
+
+void Pipeline_Library::report() {
+  if (!_supported) {
+    fmt::println("pipeline libraries unavailable, pipelines are compiled whole");
+    return;
+  }
+
+  Pipeline_Library_Stats current = stats();
+  fmt::println(
+    "pipeline library: {} parts compiled, {} reused, {} fast links ({:.2f} ms), {} optimized links ({:.2f} ms)",
+    current.parts_compiled,
+    current.parts_reused,
+    current.fast_links,
+    current.fast_link_ms,
+    current.optimized_links,
+    current.optimized_link_ms
+  );
+}
+
+/**
+ * @brief Key of the state a part depends on, descriptions that only
+ *        differ in other parts share this part
+ */
+uint64_t Pipeline_Library::part_key(Part part, const Pipeline_Description& description, VkPipelineLayout layout) {
+  std::hash<std::string> hash_string;
+  uint64_t seed = part;
+
+  switch (part) {
+    case PART_VERTEX_INPUT:
+      for (const auto& binding : description.vertex_bindings) {
+        hash_combine(seed, binding.binding);
+        hash_combine(seed, binding.stride);
+        hash_combine(seed, binding.inputRate);
+      }
+      for (const auto& attribute : description.vertex_attributes) {
+        hash_combine(seed, attribute.location);
+        hash_combine(seed, attribute.binding);
+        hash_combine(seed, attribute.format);
+        hash_combine(seed, attribute.offset);
+      }
+      hash_combine(seed, description.dynamic_states);
+      description.state.hash_input_assembly(seed, description.dynamic_states);
+      break;
+    case PART_PRE_RASTERIZATION:
+      hash_combine(seed, hash_string(description.vert_filepath));
+      hash_combine(seed, Shader_Compiler::defines_key(description.defines));
+      hash_combine(seed, description.variant.key());
+      hash_combine(seed, description.dynamic_states);
+      description.state.hash_rasterization(seed, description.dynamic_states);
+      hash_combine(seed, (uint64_t)layout);
+      hash_combine(seed, (uint64_t)description.render_pass);
+      break;
+    case PART_FRAGMENT_SHADER:
+      hash_combine(seed, hash_string(description.frag_filepath));
+      hash_combine(seed, Shader_Compiler::defines_key(description.defines));
+      hash_combine(seed, description.variant.key());
+      hash_combine(seed, description.dynamic_states);
+      description.state.hash_depth(seed, description.dynamic_states);
+      hash_combine(seed, (uint64_t)layout);
+      hash_combine(seed, (uint64_t)description.render_pass);
+      break;
+    case PART_FRAGMENT_OUTPUT:
+      description.blend.hash(seed);
+      hash_combine(seed, (uint64_t)description.render_pass);
+      break;
+    default:
+      break;
+  }
+  return seed;
+}
+
+/**
+ * @brief Compares the state a part depends on, the same state part_key hashes
+ */
+bool Pipeline_Library::same_part(Part part, const Cached_Part& cached, const Pipeline_Description& description, VkPipelineLayout layout) {
+  const Pipeline_Description& other = cached.description;
+  switch (part) {
+    case PART_VERTEX_INPUT:
+      return 
+        description.same_vertex_input(other) &&
+        description.dynamic_states == other.dynamic_states &&
+        description.state.same_input_assembly(other.state, description.dynamic_states);
+    case PART_PRE_RASTERIZATION:
+      return 
+        description.vert_filepath == other.vert_filepath &&
+        description.same_shader_inputs(other) &&
+        description.dynamic_states == other.dynamic_states &&
+        description.state.same_rasterization(other.state, description.dynamic_states) &&
+        layout == cached.layout &&
+        description.render_pass == other.render_pass;
+    case PART_FRAGMENT_SHADER:
+      return 
+        description.frag_filepath == other.frag_filepath &&
+        description.same_shader_inputs(other) &&
+        description.dynamic_states == other.dynamic_states &&
+        description.state.same_depth(other.state, description.dynamic_states) &&
+        layout == cached.layout &&
+        description.render_pass == other.render_pass;
+    case PART_FRAGMENT_OUTPUT:
+      return description.blend.same(other.blend) && description.render_pass == other.render_pass;
+    default:
+      return false;
+  }
+}
+
+/**
+ * @brief Cached part matching the description, the caller holds the mutex
+ * @return VK_NULL_HANDLE when the part has not been compiled yet
+ */
+VkPipeline Pipeline_Library::find_part(Part part, uint64_t key, const Pipeline_Description& description, VkPipelineLayout layout) {
+  auto found = _parts[part].find(key);
+  if (found == _parts[part].end()) {
+    return VK_NULL_HANDLE;
+  }
+  for (const auto& cached : found->second) {
+    if (same_part(part, cached, description, layout)) {
+      return cached.pipeline;
+    }
+  }
+  return VK_NULL_HANDLE;
+}
+
+/**
+ * @brief Key of everything a reflected layout depends on
+ */
+uint64_t Pipeline_Library::shader_key(const Pipeline_Description& description) {
+  std::hash<std::string> hash_string;
+  uint64_t seed = 0;
+  hash_combine(seed, hash_string(description.vert_filepath));
+  hash_combine(seed, hash_string(description.frag_filepath));
+  hash_combine(seed, Shader_Compiler::defines_key(description.defines));
+  hash_combine(seed, description.variant.key());
+  return seed;
+}
+
+/**
+ * @brief Layout reflected earlier from the same shaders, the caller holds the mutex
+ * @return VK_NULL_HANDLE when the shaders have not been reflected yet
+ */
+VkPipelineLayout Pipeline_Library::find_reflected(const Pipeline_Description& description) {
+  auto found = _reflected.find(shader_key(description));
+  if (found == _reflected.end()) {
+    return VK_NULL_HANDLE;
+  }
+  for (const auto& reflected : found->second) {
+    const Pipeline_Description& other = reflected.description;
+    if (
+      description.vert_filepath == other.vert_filepath &&
+      description.frag_filepath == other.frag_filepath &&
+      description.same_shader_inputs(other) &&
+      description.same_dynamic_buffers(other)
+    ) {
+      return reflected.layout;
+    }
+  }
+  return VK_NULL_HANDLE;
+}
+
+#ifdef VK_EXT_graphics_pipeline_library
+
+/**
+ * @brief Looks up the parts of a description, the shaders are only loaded
+ *        when a part has to be compiled or the layout reflected, so
+ *        linking parts that are all cached costs nothing but the link
+ * @param layout the layout to link with, found and returned when null
+ */
+bool Pipeline_Library::get_parts(const Pipeline_Description& description, VkPipelineLayout* layout, VkPipeline* parts) {
+  const VkGraphicsPipelineLibraryFlagsEXT part_flags[PART_COUNT] = {
+    VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT,
+    VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT,
+    VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT,
+    VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT,
+  };
+
+  std::optional<Pipeline> pipeline_builder;
+  auto load_shaders = [&]() {
+    if (!pipeline_builder) {
+      pipeline_builder.emplace(_logical, _cache, _shaders);
+      pipeline_builder->set_shaders(description.vert_filepath, description.frag_filepath, description.defines);
+      pipeline_builder->set_variant(description.variant);
+      pipeline_builder->set_fixed_function(description);
+    }
+  };
+
+  if (*layout == VK_NULL_HANDLE) {
+    *layout = description.layout;
+  }
+  if (*layout == VK_NULL_HANDLE) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    *layout = find_reflected(description);
+  }
+  if (*layout == VK_NULL_HANDLE) {
+    load_shaders();
+    pipeline_builder->reflect_layout(_layouts, description.dynamic_buffers);
+    *layout = pipeline_builder->_pipeline_layout;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (find_reflected(description) == VK_NULL_HANDLE) {
+      _reflected[shader_key(description)].push_back({ description, *layout });
+    }
+  }
+
+  for (uint32_t part = 0; part < PART_COUNT; part++) {
+    uint64_t key = part_key(static_cast<Part>(part), description, *layout);
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      VkPipeline found = find_part(static_cast<Part>(part), key, description, *layout);
+      if (found != VK_NULL_HANDLE) {
+        parts[part] = found;
+        _stats.parts_reused++;
+        continue;
+      }
+    }
+
+    load_shaders();
+    pipeline_builder->set_pipeline_layout(*layout);
+    VkPipeline built = pipeline_builder->build_library(description.render_pass, part_flags[part]);
+    if (built == VK_NULL_HANDLE) {
+      return false;
+    }
+
+    // another worker may have compiled the same part in the meantime
+    std::lock_guard<std::mutex> lock(_mutex);
+    VkPipeline existing = find_part(static_cast<Part>(part), key, description, *layout);
+    if (existing != VK_NULL_HANDLE) {
+      vkDestroyPipeline(_logical, built, nullptr);
+      parts[part] = existing;
+      continue;
+    }
+    _parts[part][key].push_back({ description, *layout, built });
+    _stats.parts_compiled++;
+    parts[part] = built;
+  }
+  return true;
+}
+
+VkPipeline Pipeline_Library::link(const VkPipeline* parts, VkPipelineLayout layout, bool optimize) {
+  VkPipelineLibraryCreateInfoKHR library_info = {
+    .sType = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR
+  };
+  library_info.pNext = nullptr;
+  library_info.libraryCount = PART_COUNT;
+  library_info.pLibraries = parts;
+
+  VkGraphicsPipelineCreateInfo pipeline_info = {
+    .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO
+  };
+  pipeline_info.pNext = &library_info;
+  pipeline_info.flags = optimize ? VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT : 0;
+  pipeline_info.layout = layout;
+  pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
+
+  VkPipeline pipeline = VK_NULL_HANDLE;
+  if (vkCreateGraphicsPipelines(
+    _logical,
+    _cache->handle(),
+    1,
+    &pipeline_info,
+    nullptr,
+    &pipeline)
+  != VK_SUCCESS) {
+    fmt::println("failed to link pipeline library");
+    return VK_NULL_HANDLE;
+  }
+  return pipeline;
+}
+
+#else
+
+// headers without the extension always take the monolithic path
+bool Pipeline_Library::get_parts(const Pipeline_Description&, VkPipelineLayout*, VkPipeline*) {
+  return false;
+}
+
+VkPipeline Pipeline_Library::link(const VkPipeline*, VkPipelineLayout, bool) {
+  return VK_NULL_HANDLE;
+}
+
+#endif
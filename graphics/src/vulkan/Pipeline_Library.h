@@ -0,0 +1,86 @@
+#pragma once
+
+#include "../vulkan_util/vk_types.h"
+#include "../vulkan_util/vk_descriptors.h"
+#include "device.h"
+#include "pipeline.h"
+#include "Pipeline_Cache.h"
+
+struct Pipeline_Library_Stats {
+  uint32_t parts_compiled  = 0;
+  uint32_t parts_reused    = 0;
+  uint32_t fast_links      = 0;
+  uint32_t optimized_links = 0;
+  double   fast_link_ms      = 0.0;
+  double   optimized_link_ms = 0.0;
+};
+
+/**
+ * @brief Builds graphics pipelines from separately compiled parts through
+ *        VK_EXT_graphics_pipeline_library. Parts are cached by the state
+ *        they depend on, so a new combination only compiles what is missing
+ *        and is then linked without optimization. An optimized link of the
+ *        same parts can be made later to replace it.
+ */
+class Pipeline_Library
+{
+public:
+  Pipeline_Library(Device* device, Pipeline_Cache* cache, vklayout::Layout_Cache* layouts, Shader_Compiler* shaders);
+  ~Pipeline_Library();
+
+  Pipeline_Library (const Pipeline_Library&) = delete;
+  Pipeline_Library& operator= (const Pipeline_Library&) = delete;
+
+  // false when the device lacks the extension, monolithic pipelines are used instead
+  bool supported() const { return _supported; }
+
+  VkPipeline fast_link(const Pipeline_Description& description, VkPipelineLayout* layout);
+  VkPipeline optimized_link(const Pipeline_Description& description, VkPipelineLayout layout);
+
+  Pipeline_Library_Stats stats();
+  void report();
+
+private:
+  enum Part : uint32_t {
+    PART_VERTEX_INPUT = 0,
+    PART_PRE_RASTERIZATION,
+    PART_FRAGMENT_SHADER,
+    PART_FRAGMENT_OUTPUT,
+    PART_COUNT
+  };
+
+  // a compiled part and the inputs it was built from, parts sharing a key
+  // are told apart by comparing the inputs
+  struct Cached_Part {
+    Pipeline_Description description;
+    VkPipelineLayout     layout;
+    VkPipeline           pipeline;
+  };
+
+  // layout reflected from a set of shaders, so linking cached parts
+  // does not have to load the shaders again to find it
+  struct Reflected_Layout {
+    Pipeline_Description description;
+    VkPipelineLayout     layout;
+  };
+
+  VkDevice                _logical;
+  Pipeline_Cache*         _cache;
+  vklayout::Layout_Cache* _layouts;
+  Shader_Compiler*        _shaders;
+  bool                    _supported;
+
+  std::mutex                                             _mutex;
+  std::unordered_map<uint64_t, std::vector<Cached_Part>> _parts[PART_COUNT];
+  std::unordered_map<uint64_t, std::vector<Reflected_Layout>> _reflected;
+  Pipeline_Library_Stats                                 _stats;
+
+  static uint64_t part_key(Part part, const Pipeline_Description& description, VkPipelineLayout layout);
+  static bool same_part(Part part, const Cached_Part& cached, const Pipeline_Description& description, VkPipelineLayout layout);
+  VkPipeline find_part(Part part, uint64_t key, const Pipeline_Description& description, VkPipelineLayout layout);
+  static uint64_t shader_key(const Pipeline_Description& description);
+  VkPipelineLayout find_reflected(const Pipeline_Description& description);
+
+  bool get_parts(const Pipeline_Description& description, VkPipelineLayout* layout, VkPipeline* parts);
+  VkPipeline link(const VkPipeline* parts, VkPipelineLayout layout, bool optimize);
+};
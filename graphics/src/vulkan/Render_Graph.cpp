@@ -0,0 +1,880 @@
+#include "Render_Graph.h"
+
+// frames a framebuffer may go unused before it is destroyed
+constexpr uint64_t FRAMEBUFFER_KEEP_FRAMES = 8;
+
+struct Usage_Info {
+  VkImageLayout         layout;
+  VkPipelineStageFlags2 stages;
+  VkAccessFlags2        read_access;
+  VkAccessFlags2        write_access;
+  VkImageUsageFlags     image_usage;
+  bool                  attachment;
+};
+
+static Usage_Info usage_info(Resource_Usage usage) {
+  switch (usage) {
+    case Resource_Usage::Transfer_Src:
+      return {
+        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT_KHR,
+        VK_ACCESS_2_TRANSFER_READ_BIT_KHR,
+        0,
+        VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+        false
+      };
+    case Resource_Usage::Transfer_Dst:
+      return {
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT_KHR,
+        0,
+        VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR,
+        VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+        false
+      };
+    case Resource_Usage::Color_Attachment:
+      return {
+        VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+        VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR,
+        VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT_KHR,
+        VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT_KHR,
+        VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+        true
+      };
+    case Resource_Usage::Depth_Attachment:
+      return {
+        VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+        VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT_KHR | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT_KHR,
+        VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT_KHR,
+        VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT_KHR,
+        VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+        true
+      };
+    case Resource_Usage::Sampled:
+      return {
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT_KHR | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR,
+        VK_ACCESS_2_SHADER_SAMPLED_READ_BIT_KHR,
+        0,
+        VK_IMAGE_USAGE_SAMPLED_BIT,
+        false
+      };
+    case Resource_Usage::Storage_Read:
+      return {
+        VK_IMAGE_LAYOUT_GENERAL,
+        VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR,
+        VK_ACCESS_2_SHADER_STORAGE_READ_BIT_KHR,
+        0,
+        VK_IMAGE_USAGE_STORAGE_BIT,
+        false
+      };
+    case Resource_Usage::Storage_Write:
+    default:
+      return {
+        VK_IMAGE_LAYOUT_GENERAL,
+        VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR,
+        VK_ACCESS_2_SHADER_STORAGE_READ_BIT_KHR,
+        VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT_KHR,
+        VK_IMAGE_USAGE_STORAGE_BIT,
+        false
+      };
+  }
+}
+
+static VkImageMemoryBarrier2 image_barrier(
+  VkImage image,
+  VkImageAspectFlags aspect,
+  VkImageLayout current_layout,
+  VkImageLayout new_layout,
+  VkPipelineStageFlags2 src_stages,
+  VkAccessFlags2 src_access,
+  VkPipelineStageFlags2 dst_stages,
+  VkAccessFlags2 dst_access
+) {
+  VkImageMemoryBarrier2 barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+  barrier.pNext = nullptr;
+
+  barrier.srcStageMask = src_stages;
+  barrier.srcAccessMask = src_access;
+  barrier.dstStageMask = dst_stages;
+  barrier.dstAccessMask = dst_access;
+
+  barrier.oldLayout = current_layout;
+  barrier.newLayout = new_layout;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+
+  barrier.subresourceRange.aspectMask = aspect;
+  barrier.subresourceRange.baseMipLevel = 0;
+  barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+  barrier.subresourceRange.baseArrayLayer = 0;
+  barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+  barrier.image = image;
+  return barrier;
+}
+
+Render_Graph::Render_Graph(
+  Device* device,
+  VmaAllocator allocator,
+  Cmd* cmd,
+  Deletion_Queue* deletion_queue
+) : _device(device), _allocator(allocator), _cmd(cmd), _deletion_queue(deletion_queue) {}
+
+/**
+ * @brief Transient images and framebuffers are handed to the deletion
+ *        queue, which is flushed after the graph is destroyed
+ */
+Render_Graph::~Render_Graph() {
+  release_transients(_cmd->submitted_value());
+}
+
+/**
+ * @brief Clears the passes and resources of the last frame, the transient
+ *        memory and framebuffers are kept for the next compile to reuse
+ */
+void Render_Graph::begin_frame() {
+  _frame++;
+  _passes.clear();
+  _resources.clear();
+  _order.clear();
+  _final_barriers.clear();
+
+  for (auto it = _framebuffers.begin(); it != _framebuffers.end();) {
+    std::vector<Framebuffer_Entry>& entries = it->second;
+    for (auto entry = entries.begin(); entry != entries.end();) {
+      if (_frame - entry->last_frame > FRAMEBUFFER_KEEP_FRAMES) {
+        _deletion_queue->retire(Handle_Type::Framebuffer, entry->framebuffer, entry->last_used_value);
+        entry = entries.erase(entry);
+      }
+      else {
+        ++entry;
+      }
+    }
+    it = entries.empty() ? _framebuffers.erase(it) : std::next(it);
+  }
+}
+
+Graph_Resource Render_Graph::import_image(const std::string& name, const Graph_Import& import) {
+  Resource resource;
+  resource.name = name;
+  resource.imported = true;
+  resource.image = import;
+  _resources.push_back(resource);
+  return static_cast<Graph_Resource>(_resources.size() - 1);
+}
+
+/**
+ * @brief Declares an image that only lives within the frame, it is given
+ *        memory when the graph is compiled and may share it with other
+ *        transients that are never used at the same time
+ */
+Graph_Resource Render_Graph::create_image(const std::string& name, const Graph_Image_Desc& desc) {
+  Resource resource;
+  resource.name = name;
+  resource.image.format = desc.format;
+  resource.image.extent = desc.extent;
+  resource.image.aspect = desc.aspect;
+  _resources.push_back(resource);
+  return static_cast<Graph_Resource>(_resources.size() - 1);
+}
+
+Graph_Pass Render_Graph::add_pass(const std::string& name, std::function<void(VkCommandBuffer cmd)>&& execute) {
+  Pass pass;
+  pass.name = name;
+  pass.execute = std::move(execute);
+  _passes.push_back(std::move(pass));
+  return static_cast<Graph_Pass>(_passes.size() - 1);
+}
+
+void Render_Graph::read(Graph_Pass pass, Graph_Resource resource, Resource_Usage usage) {
+  access(pass, resource, usage).reads = true;
+}
+
+/**
+ * @brief Declares a write, attachments whose previous contents are loaded
+ *        are read by the pass as well
+ */
+void Render_Graph::write(Graph_Pass pass, Graph_Resource resource, Resource_Usage usage) {
+  access(pass, resource, usage).writes = true;
+}
+
+/**
+ * @brief Records the pass inside a render pass instance, the attachments
+ *        are the pass's color attachments in the order they were declared
+ *        followed by its depth attachment
+ */
+void Render_Graph::set_render_pass(Graph_Pass pass, VkRenderPass render_pass, const std::vector<VkClearValue>& clear_values) {
+  _passes[pass].render_pass = render_pass;
+  _passes[pass].clear_values = clear_values;
+}
+
+/**
+ * @brief Limits the render pass to the top left of its attachments, so a
+ *        frame can be drawn smaller without reallocating them
+ */
+void Render_Graph::set_render_area(Graph_Pass pass, VkExtent2D extent) {
+  _passes[pass].area = extent;
+}
+
+Render_Graph::Access& Render_Graph::access(Graph_Pass pass, Graph_Resource resource, Resource_Usage usage) {
+  for (auto& existing : _passes[pass].accesses) {
+    if (existing.resource == resource) {
+      if (existing.usage != usage) {
+        throw std::runtime_error("render graph pass " + _passes[pass].name + " uses " + _resources[resource].name + " in two ways");
+      }
+      return existing;
+    }
+  }
+  Access added;
+  added.resource = resource;
+  added.usage = usage;
+  _passes[pass].accesses.push_back(added);
+  return _passes[pass].accesses.back();
+}
+
+/**
+ * @brief Culls passes, gives the transients memory and works out the
+ *        barriers and render pass instances of the passes left
+ */
+void Render_Graph::compile() {
+  cull();
+
+  for (uint32_t i = 0; i < _passes.size(); i++) {
+    if (_passes[i].culled) {
+      continue;
+    }
+    int32_t index = static_cast<int32_t>(_order.size());
+    _order.push_back(i);
+    for (const auto& access : _passes[i].accesses) {
+      Resource& resource = _resources[access.resource];
+      if (resource.first_pass < 0) {
+        resource.first_pass = index;
+      }
+      resource.last_pass = index;
+      resource.usage |= usage_info(access.usage).image_usage;
+    }
+  }
+
+  allocate_transients();
+  record_barriers();
+
+  for (uint32_t index : _order) {
+    Pass& pass = _passes[index];
+    if (pass.begins_render_pass) {
+      pass.framebuffer = framebuffer(pass, &pass.render_area);
+      if (pass.area.width != 0 && pass.area.height != 0) {
+        pass.render_area.width = std::min(pass.area.width, pass.render_area.width);
+        pass.render_area.height = std::min(pass.area.height, pass.render_area.height);
+      }
+    }
+  }
+
+  update_schedule();
+}
+
+/**
+ * @brief Records the compiled passes, each pass's barriers are recorded
+ *        as one batch before it
+ */
+void Render_Graph::execute(VkCommandBuffer cmd) {
+  for (uint32_t index : _order) {
+    Pass& pass = _passes[index];
+    if (!pass.barriers.empty()) {
+      _cmd->record_barriers(cmd, pass.barriers.data(), static_cast<uint32_t>(pass.barriers.size()));
+    }
+
+    if (pass.begins_render_pass) {
+      VkRenderPassBeginInfo renderpass_info{};
+      renderpass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+      renderpass_info.pNext = nullptr;
+      renderpass_info.renderPass = pass.render_pass;
+      renderpass_info.framebuffer = pass.framebuffer;
+      renderpass_info.renderArea.offset = { 0, 0 };
+      renderpass_info.renderArea.extent = pass.render_area;
+      renderpass_info.clearValueCount = static_cast<uint32_t>(pass.clear_values.size());
+      renderpass_info.pClearValues = pass.clear_values.data();
+      vkCmdBeginRenderPass(cmd, &renderpass_info, VK_SUBPASS_CONTENTS_INLINE);
+    }
+
+    pass.execute(cmd);
+
+    if (pass.ends_render_pass) {
+      vkCmdEndRenderPass(cmd);
+    }
+  }
+
+  if (!_final_barriers.empty()) {
+    _cmd->record_barriers(cmd, _final_barriers.data(), static_cast<uint32_t>(_final_barriers.size()));
+  }
+}
+
+/**
+ * @brief Framebuffers of the old swapchain views are dropped, a new view
+ *        may be given the handle of a destroyed one
+ */
+void Render_Graph::on_swapchain_recreated() {
+  release_framebuffers(_cmd->submitted_value());
+}
+
+void Render_Graph::report() {
+  fmt::println(
+    "render graph: {} passes, {} culled, {} render passes, {} barriers in {} batches",
+    _schedule.passes.size(),
+    _schedule.culled,
+    _schedule.render_passes,
+    _schedule.barriers,
+    _schedule.barrier_batches
+  );
+  for (const auto& pass : _schedule.passes) {
+    if (pass.culled) {
+      fmt::println("  {} (culled)", pass.name);
+    }
+    else {
+      fmt::println("  {}: {} barriers{}", pass.name, pass.barriers, pass.merged ? ", shares the render pass before it" : "");
+    }
+  }
+  for (const auto& transient : _schedule.transients) {
+    fmt::println(
+      "  transient {}: {:.2f} MiB in slot {}, passes {} to {}",
+      transient.name,
+      transient.size / (1024.0 * 1024.0),
+      transient.slot,
+      transient.first_pass,
+      transient.last_pass
+    );
+  }
+  fmt::println(
+    "  transient memory: {:.2f} MiB aliased into {:.2f} MiB",
+    _schedule.transient_bytes / (1024.0 * 1024.0),
+    _schedule.allocated_bytes / (1024.0 * 1024.0)
+  );
+}
+
+/**
+ * @brief Walks the passes backwards from the outputs, a pass is kept when
+ *        it writes an image whose contents a kept pass or output uses
+ */
+void Render_Graph::cull() {
+  std::vector<bool> needed(_resources.size(), false);
+  for (size_t i = 0; i < _resources.size(); i++) {
+    needed[i] = _resources[i].imported && _resources[i].image.output;
+  }
+
+  for (size_t i = _passes.size(); i-- > 0;) {
+    Pass& pass = _passes[i];
+    pass.culled = true;
+    for (const auto& access : pass.accesses) {
+      if (access.writes && needed[access.resource]) {
+        pass.culled = false;
+      }
+    }
+    if (pass.culled) {
+      continue;
+    }
+    // earlier contents of an image this pass overwrites are not needed
+    for (const auto& access : pass.accesses) {
+      if (access.writes && !access.reads) {
+        needed[access.resource] = false;
+      }
+    }
+    for (const auto& access : pass.accesses) {
+      if (access.reads) {
+        needed[access.resource] = true;
+      }
+    }
+  }
+}
+
+/**
+ * @brief Creates the transient images and places them in memory slots,
+ *        largest first, each in the first slot whose images are never
+ *        alive at the same time as it. The images are only recreated
+ *        when the transients or their lifetimes change
+ */
+void Render_Graph::allocate_transients() {
+  std::vector<uint32_t> transients;
+  std::vector<Transient_Desc> descs;
+  uint64_t key = 0;
+  for (uint32_t i = 0; i < _resources.size(); i++) {
+    const Resource& resource = _resources[i];
+    if (resource.imported || resource.first_pass < 0) {
+      continue;
+    }
+    transients.push_back(i);
+    descs.push_back({
+      resource.image.format,
+      resource.image.extent,
+      resource.image.aspect,
+      resource.usage,
+      resource.first_pass,
+      resource.last_pass
+    });
+    hash_combine(key, resource.image.format);
+    hash_combine(key, resource.image.extent.width);
+    hash_combine(key, resource.image.extent.height);
+    hash_combine(key, resource.image.aspect);
+    hash_combine(key, resource.usage);
+    hash_combine(key, static_cast<uint64_t>(resource.first_pass));
+    hash_combine(key, static_cast<uint64_t>(resource.last_pass));
+  }
+
+  auto same_desc = [](const Transient_Desc& a, const Transient_Desc& b) {
+    return 
+      a.format == b.format &&
+      a.extent.width == b.extent.width &&
+      a.extent.height == b.extent.height &&
+      a.aspect == b.aspect &&
+      a.usage == b.usage &&
+      a.first_pass == b.first_pass &&
+      a.last_pass == b.last_pass;
+  };
+  bool reuse = 
+    key == _transient_key && 
+    std::equal(descs.begin(), descs.end(), _transient_descs.begin(), _transient_descs.end(), same_desc);
+
+  if (!reuse) {
+    release_transients(_cmd->submitted_value());
+    _transient_key = key;
+    _transient_descs = std::move(descs);
+    _physical.resize(transients.size());
+
+    std::vector<VkMemoryRequirements> requirements(transients.size());
+    for (size_t i = 0; i < transients.size(); i++) {
+      const Resource& resource = _resources[transients[i]];
+
+      VkImageCreateInfo image_info{};
+      image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+      image_info.pNext = nullptr;
+      image_info.imageType = VK_IMAGE_TYPE_2D;
+      image_info.format = resource.image.format;
+      image_info.extent = { resource.image.extent.width, resource.image.extent.height, 1 };
+      image_info.mipLevels = 1;
+      image_info.arrayLayers = 1;
+      image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+      image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+      image_info.usage = resource.usage;
+      image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+      image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+      VK_CHECK(vkCreateImage(_device->_logical, &image_info, nullptr, &_physical[i].image));
+
+      vkGetImageMemoryRequirements(_device->_logical, _physical[i].image, &requirements[i]);
+      _physical[i].size = requirements[i].size;
+    }
+
+    std::vector<uint32_t> by_size(transients.size());
+    for (uint32_t i = 0; i < by_size.size(); i++) {
+      by_size[i] = i;
+    }
+    std::sort(by_size.begin(), by_size.end(), [&](uint32_t a, uint32_t b) {
+      return requirements[a].size > requirements[b].size;
+    });
+
+    std::vector<std::vector<uint32_t>> occupants;
+    for (uint32_t i : by_size) {
+      const Resource& resource = _resources[transients[i]];
+      uint32_t slot = 0;
+      for (; slot < _slots.size(); slot++) {
+        if ((_slots[slot].requirements.memoryTypeBits & requirements[i].memoryTypeBits) == 0) {
+          continue;
+        }
+        bool overlaps = false;
+        for (uint32_t other : occupants[slot]) {
+          const Resource& occupant = _resources[transients[other]];
+          if (resource.first_pass <= occupant.last_pass && occupant.first_pass <= resource.last_pass) {
+            overlaps = true;
+          }
+        }
+        if (!overlaps) {
+          break;
+        }
+      }
+
+      if (slot == _slots.size()) {
+        Memory_Slot added;
+        added.requirements = requirements[i];
+        _slots.push_back(added);
+        occupants.emplace_back();
+      }
+      else {
+        VkMemoryRequirements& merged = _slots[slot].requirements;
+        merged.size = std::max(merged.size, requirements[i].size);
+        merged.alignment = std::max(merged.alignment, requirements[i].alignment);
+        merged.memoryTypeBits &= requirements[i].memoryTypeBits;
+      }
+      occupants[slot].push_back(i);
+      _physical[i].slot = slot;
+    }
+
+    VmaAllocationCreateInfo alloc_info{};
+    alloc_info.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+    alloc_info.requiredFlags = VkMemoryPropertyFlags(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    _schedule.transient_bytes = 0;
+    _schedule.allocated_bytes = 0;
+    for (auto& slot : _slots) {
+      VK_CHECK(vmaAllocateMemory(_allocator, &slot.requirements, &alloc_info, &slot.allocation, nullptr));
+      _schedule.allocated_bytes += slot.requirements.size;
+    }
+
+    for (size_t i = 0; i < transients.size(); i++) {
+      const Resource& resource = _resources[transients[i]];
+      Physical_Image& physical = _physical[i];
+      VK_CHECK(vmaBindImageMemory2(_allocator, _slots[physical.slot].allocation, 0, physical.image, nullptr));
+
+      VkImageViewCreateInfo view_info{};
+      view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+      view_info.pNext = nullptr;
+      view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+      view_info.image = physical.image;
+      view_info.format = resource.image.format;
+      view_info.subresourceRange.aspectMask = resource.image.aspect;
+      view_info.subresourceRange.baseMipLevel = 0;
+      view_info.subresourceRange.levelCount = 1;
+      view_info.subresourceRange.baseArrayLayer = 0;
+      view_info.subresourceRange.layerCount = 1;
+      VK_CHECK(vkCreateImageView(_device->_logical, &view_info, nullptr, &physical.view));
+
+      _schedule.transient_bytes += physical.size;
+    }
+    _schedule.rebuilds++;
+  }
+
+  for (uint32_t i = 0; i < transients.size(); i++) {
+    Resource& resource = _resources[transients[i]];
+    resource.physical = i;
+    resource.image.image = _physical[i].image;
+    resource.image.view = _physical[i].view;
+  }
+}
+
+void Render_Graph::release_transients(uint64_t last_used_value) {
+  // the framebuffers reference the views
+  release_framebuffers(last_used_value);
+
+  for (auto& physical : _physical) {
+    _deletion_queue->retire(Handle_Type::Image_View, physical.view, last_used_value);
+    _deletion_queue->retire(Handle_Type::Image, physical.image, last_used_value);
+  }
+  for (auto& slot : _slots) {
+    _deletion_queue->retire_allocation(slot.allocation, last_used_value);
+  }
+  _physical.clear();
+  _slots.clear();
+  _transient_key = 0;
+  _transient_descs.clear();
+}
+
+void Render_Graph::release_framebuffers(uint64_t last_used_value) {
+  for (auto& entries : _framebuffers) {
+    for (auto& entry : entries.second) {
+      _deletion_queue->retire(Handle_Type::Framebuffer, entry.framebuffer, std::max(last_used_value, entry.last_used_value));
+    }
+  }
+  _framebuffers.clear();
+}
+
+/**
+ * @brief Follows every image through the live passes and records a
+ *        barrier only where a pass has to wait on an earlier use, or the
+ *        image has to change layout. A pass continuing the render pass of
+ *        the pass before it needs no barriers between their attachment
+ *        writes, the writes of one subpass are ordered already
+ */
+void Render_Graph::record_barriers() {
+  for (auto& resource : _resources) {
+    resource.state = {};
+    if (resource.imported) {
+      resource.state.layout = resource.image.initial_layout;
+      resource.state.write_stages = resource.image.initial_stages;
+      resource.state.write_access = resource.image.initial_access;
+    }
+  }
+
+  Pass* previous = nullptr;
+  for (uint32_t index : _order) {
+    Pass& pass = _passes[index];
+    pass.barriers.clear();
+    pass.begins_render_pass = false;
+    pass.ends_render_pass = false;
+
+    bool merge = previous != nullptr && previous->render_pass != VK_NULL_HANDLE && can_merge(*previous, pass);
+    std::vector<Image_State> saved;
+    if (merge) {
+      for (const auto& access : pass.accesses) {
+        saved.push_back(_resources[access.resource].state);
+      }
+    }
+
+    for (const auto& access : pass.accesses) {
+      sync(_resources[access.resource], access, merge, &pass.barriers);
+    }
+
+    // barriers cannot be recorded inside the render pass, it is ended instead
+    if (merge && !pass.barriers.empty()) {
+      for (size_t i = 0; i < pass.accesses.size(); i++) {
+        _resources[pass.accesses[i].resource].state = saved[i];
+      }
+      pass.barriers.clear();
+      for (const auto& access : pass.accesses) {
+        sync(_resources[access.resource], access, false, &pass.barriers);
+      }
+      merge = false;
+    }
+
+    if (previous != nullptr && previous->render_pass != VK_NULL_HANDLE && !merge) {
+      previous->ends_render_pass = true;
+    }
+    pass.begins_render_pass = pass.render_pass != VK_NULL_HANDLE && !merge;
+    previous = &pass;
+  }
+  if (previous != nullptr && previous->render_pass != VK_NULL_HANDLE) {
+    previous->ends_render_pass = true;
+  }
+
+  patch_first_barriers();
+
+  for (auto& resource : _resources) {
+    const Graph_Import& image = resource.image;
+    if (!resource.imported || image.final_layout == VK_IMAGE_LAYOUT_UNDEFINED || image.final_layout == resource.state.layout) {
+      continue;
+    }
+    _final_barriers.push_back(image_barrier(
+      image.image,
+      image.aspect,
+      resource.state.layout,
+      image.final_layout,
+      resource.state.write_stages | resource.state.read_stages,
+      resource.state.write_access,
+      image.final_stages,
+      0
+    ));
+  }
+}
+
+/**
+ * @brief Adds the barrier a pass needs before using an image and moves
+ *        the image's state past the use
+ * @param in_render_pass the pass continues the render pass before it
+ */
+void Render_Graph::sync(Resource& resource, const Access& access, bool in_render_pass, std::vector<VkImageMemoryBarrier2>* barriers) {
+  Usage_Info info = usage_info(access.usage);
+  Image_State& state = resource.state;
+  VkAccessFlags2 dst_access = (access.reads ? info.read_access : 0) | (access.writes ? info.write_access : 0);
+
+  bool transition = state.layout != info.layout;
+  bool barrier = false;
+  VkPipelineStageFlags2 src_stages = state.write_stages | state.read_stages;
+  if (transition) {
+    barrier = true;
+  }
+  else if (access.writes) {
+    barrier = src_stages != 0 && !(in_render_pass && info.attachment);
+  }
+  else {
+    // reads only wait on the last write, once per stage
+    barrier = state.write_stages != 0 && (info.stages & ~state.visible_stages) != 0;
+    src_stages = state.write_stages;
+  }
+
+  if (barrier) {
+    barriers->push_back(image_barrier(
+      resource.image.image,
+      resource.image.aspect,
+      state.layout,
+      info.layout,
+      src_stages,
+      state.write_access,
+      info.stages,
+      dst_access
+    ));
+  }
+
+  state.layout = info.layout;
+  if (access.writes || transition) {
+    // a layout change is a write that later uses wait on like any other
+    state.write_stages = info.stages;
+    state.write_access = access.writes ? info.write_access : 0;
+    state.read_stages = access.writes ? 0 : info.stages;
+    state.visible_stages = info.stages;
+  }
+  else {
+    state.read_stages |= info.stages;
+    if (barrier) {
+      state.visible_stages |= info.stages;
+    }
+  }
+}
+
+/**
+ * @brief The first barrier of a transient discards its contents, it waits
+ *        on the last use of the image that had the memory before it. The
+ *        first image in a slot waits on the last one of the previous frame
+ */
+void Render_Graph::patch_first_barriers() {
+  std::vector<std::vector<Resource*>> occupants(_slots.size());
+  for (auto& resource : _resources) {
+    if (!resource.imported && resource.first_pass >= 0) {
+      occupants[_physical[resource.physical].slot].push_back(&resource);
+    }
+  }
+
+  for (auto& slot : occupants) {
+    std::sort(slot.begin(), slot.end(), [](const Resource* a, const Resource* b) {
+      return a->first_pass < b->first_pass;
+    });
+    for (size_t i = 0; i < slot.size(); i++) {
+      Resource* resource = slot[i];
+      const Resource* before = slot[(i + slot.size() - 1) % slot.size()];
+      Pass& pass = _passes[_order[resource->first_pass]];
+      for (auto& barrier : pass.barriers) {
+        if (barrier.image == resource->image.image && barrier.oldLayout == VK_IMAGE_LAYOUT_UNDEFINED) {
+          barrier.srcStageMask = before->state.write_stages | before->state.read_stages;
+          barrier.srcAccessMask = before->state.write_access;
+        }
+      }
+    }
+  }
+}
+
+/**
+ * @brief A pass continues the render pass of the pass before it when they
+ *        use the same render pass, attachments and render area
+ */
+bool Render_Graph::can_merge(const Pass& previous, const Pass& pass) const {
+  if (previous.render_pass != pass.render_pass ||
+      previous.area.width != pass.area.width || previous.area.height != pass.area.height) {
+    return false;
+  }
+  std::vector<Graph_Resource> previous_attachments;
+  std::vector<Graph_Resource> pass_attachments;
+  attachments(previous, &previous_attachments);
+  attachments(pass, &pass_attachments);
+  return previous_attachments == pass_attachments;
+}
+
+void Render_Graph::attachments(const Pass& pass, std::vector<Graph_Resource>* resources) const {
+  for (const auto& access : pass.accesses) {
+    if (access.usage == Resource_Usage::Color_Attachment) {
+      resources->push_back(access.resource);
+    }
+  }
+  for (const auto& access : pass.accesses) {
+    if (access.usage == Resource_Usage::Depth_Attachment) {
+      resources->push_back(access.resource);
+    }
+  }
+}
+
+/**
+ * @brief Framebuffers are cached by render pass and views, the render
+ *        area is the extent of the first attachment
+ */
+VkFramebuffer Render_Graph::framebuffer(const Pass& pass, VkExtent2D* extent) {
+  std::vector<Graph_Resource> resources;
+  attachments(pass, &resources);
+  if (resources.empty()) {
+    throw std::runtime_error("render graph pass " + pass.name + " has a render pass but no attachments");
+  }
+
+  *extent = _resources[resources[0]].image.extent;
+  std::vector<VkImageView> views;
+  uint64_t key = (uint64_t)pass.render_pass;
+  hash_combine(key, extent->width);
+  hash_combine(key, extent->height);
+  for (auto resource : resources) {
+    views.push_back(_resources[resource].image.view);
+    hash_combine(key, (uint64_t)_resources[resource].image.view);
+  }
+
+  std::vector<Framebuffer_Entry>& candidates = _framebuffers[key];
+  for (auto& candidate : candidates) {
+    if (
+      candidate.render_pass == pass.render_pass &&
+      candidate.extent.width == extent->width &&
+      candidate.extent.height == extent->height &&
+      candidate.views == views
+    ) {
+      candidate.last_frame = _frame;
+      candidate.last_used_value = _cmd->pending_value();
+      return candidate.framebuffer;
+    }
+  }
+
+  VkFramebufferCreateInfo fb_info = {};
+  fb_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+  fb_info.pNext = nullptr;
+  fb_info.renderPass = pass.render_pass;
+  fb_info.attachmentCount = static_cast<uint32_t>(views.size());
+  fb_info.pAttachments = views.data();
+  fb_info.width = extent->width;
+  fb_info.height = extent->height;
+  fb_info.layers = 1;
+
+  Framebuffer_Entry entry;
+  VK_CHECK(vkCreateFramebuffer(_device->_logical, &fb_info, nullptr, &entry.framebuffer));
+  entry.render_pass = pass.render_pass;
+  entry.views = views;
+  entry.extent = *extent;
+  entry.last_frame = _frame;
+  entry.last_used_value = _cmd->pending_value();
+  candidates.push_back(entry);
+  return entry.framebuffer;
+}
+
+/**
+ * @brief Rebuilds the schedule shown in the GUI, it is printed whenever
+ *        the shape of the graph changes
+ */
+void Render_Graph::update_schedule() {
+  _schedule.passes.clear();
+  _schedule.transients.clear();
+  _schedule.culled = 0;
+  _schedule.barriers = 0;
+  _schedule.barrier_batches = 0;
+  _schedule.render_passes = 0;
+
+  uint64_t key = 0;
+  for (const auto& pass : _passes) {
+    Graph_Pass_Info info;
+    info.name = pass.name;
+    info.culled = pass.culled;
+    info.barriers = static_cast<uint32_t>(pass.barriers.size());
+    info.begins_render_pass = !pass.culled && pass.begins_render_pass;
+    info.merged = !pass.culled && pass.render_pass != VK_NULL_HANDLE && !pass.begins_render_pass;
+    _schedule.passes.push_back(info);
+
+    _schedule.culled += info.culled ? 1 : 0;
+    if (!info.culled) {
+      _schedule.barriers += info.barriers;
+      _schedule.barrier_batches += info.barriers > 0 ? 1 : 0;
+      _schedule.render_passes += info.begins_render_pass ? 1 : 0;
+    }
+
+    hash_combine(key, hash_bytes(pass.name.data(), pass.name.size()));
+    hash_combine(key, info.culled);
+    hash_combine(key, info.barriers);
+    hash_combine(key, info.merged);
+  }
+  _schedule.barriers += static_cast<uint32_t>(_final_barriers.size());
+  _schedule.barrier_batches += _final_barriers.empty() ? 0 : 1;
+
+  for (const auto& resource : _resources) {
+    if (resource.imported || resource.first_pass < 0) {
+      continue;
+    }
+    Graph_Transient_Info info;
+    info.name = resource.name;
+    info.size = _physical[resource.physical].size;
+    info.slot = _physical[resource.physical].slot;
+    info.first_pass = static_cast<uint32_t>(resource.first_pass);
+    info.last_pass = static_cast<uint32_t>(resource.last_pass);
+    _schedule.transients.push_back(info);
+  }
+  hash_combine(key, _transient_key);
+
+  if (key != _schedule_key) {
+    _schedule_key = key;
+    report();
+  }
+}
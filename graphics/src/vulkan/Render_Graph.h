@@ -0,0 +1,245 @@
+#pragma once
+
+#include "../vulkan_util/vk_types.h"
+#include "Device.h"
+#include "Cmd.h"
+#include "Deletion_Queue.h"
+
+#include <unordered_map>
+
+// how a pass uses an image, each usage implies a layout, stages and access
+enum class Resource_Usage : uint8_t {
+  Transfer_Src,
+  Transfer_Dst,
+  Color_Attachment,
+  Depth_Attachment,
+  Sampled,
+  Storage_Read,
+  Storage_Write,
+};
+
+using Graph_Resource = uint32_t;
+using Graph_Pass = uint32_t;
+
+/**
+ * @brief An image owned outside the graph, with the state it is in when
+ *        the graph's commands start and the layout it is left in
+ */
+struct Graph_Import {
+  VkImage               image = VK_NULL_HANDLE;
+  VkImageView           view = VK_NULL_HANDLE;
+  VkFormat              format = VK_FORMAT_UNDEFINED;
+  VkExtent2D            extent{ 0, 0 };
+  VkImageAspectFlags    aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+  VkImageLayout         initial_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+  // stages the previous use finishes in, the wait stages of a semaphore
+  VkPipelineStageFlags2 initial_stages = VK_PIPELINE_STAGE_2_NONE_KHR;
+  VkAccessFlags2        initial_access = 0;
+  // undefined leaves the image in the layout of its last use
+  VkImageLayout         final_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+  // stages that use the image after the graph, the signal stages of a semaphore
+  VkPipelineStageFlags2 final_stages = VK_PIPELINE_STAGE_2_NONE_KHR;
+  // passes are kept only when their writes reach an output
+  bool                  output = false;
+};
+
+/**
+ * @brief An image that only lives within a frame, its usage flags come
+ *        from the passes using it
+ */
+struct Graph_Image_Desc {
+  VkFormat           format;
+  VkExtent2D         extent;
+  VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+};
+
+struct Graph_Pass_Info {
+  std::string name;
+  bool        culled = false;
+  uint32_t    barriers = 0;
+  // the pass begins a render pass, or continues the one of the pass before it
+  bool        begins_render_pass = false;
+  bool        merged = false;
+};
+
+struct Graph_Transient_Info {
+  std::string  name;
+  VkDeviceSize size = 0;
+  uint32_t     slot = 0;
+  // first and last pass of the compiled schedule using the image
+  uint32_t     first_pass = 0;
+  uint32_t     last_pass = 0;
+};
+
+struct Graph_Schedule {
+  std::vector<Graph_Pass_Info>      passes;
+  std::vector<Graph_Transient_Info> transients;
+  uint32_t     culled = 0;
+  uint32_t     barriers = 0;
+  uint32_t     barrier_batches = 0;
+  uint32_t     render_passes = 0;
+  // memory the transients would take on their own, and after aliasing
+  VkDeviceSize transient_bytes = 0;
+  VkDeviceSize allocated_bytes = 0;
+  // times the transient images were recreated
+  uint32_t     rebuilds = 0;
+};
+
+/**
+ * @brief Frame graph rebuilt every frame. Passes declare the images they
+ *        read and write, compiling culls passes whose writes never reach
+ *        an output, places transient images with disjoint lifetimes in
+ *        the same memory and works out the fewest barriers between passes.
+ *        Consecutive passes drawing to the same attachments share one
+ *        render pass instance
+ */
+class Render_Graph
+{
+public:
+  Render_Graph(Device* device, VmaAllocator allocator, Cmd* cmd, Deletion_Queue* deletion_queue);
+  ~Render_Graph();
+
+  Render_Graph (const Render_Graph&) = delete;
+  Render_Graph& operator= (const Render_Graph&) = delete;
+
+  void begin_frame();
+  Graph_Resource import_image(const std::string& name, const Graph_Import& import);
+  Graph_Resource create_image(const std::string& name, const Graph_Image_Desc& desc);
+
+  Graph_Pass add_pass(const std::string& name, std::function<void(VkCommandBuffer cmd)>&& execute);
+  void read(Graph_Pass pass, Graph_Resource resource, Resource_Usage usage);
+  void write(Graph_Pass pass, Graph_Resource resource, Resource_Usage usage);
+  void set_render_pass(Graph_Pass pass, VkRenderPass render_pass, const std::vector<VkClearValue>& clear_values = {});
+  void set_render_area(Graph_Pass pass, VkExtent2D extent);
+
+  void compile();
+  void execute(VkCommandBuffer cmd);
+
+  // handles of a resource, transients only have them once compiled
+  VkImage image(Graph_Resource resource) const { return _resources[resource].image.image; }
+  VkImageView view(Graph_Resource resource) const { return _resources[resource].image.view; }
+
+  void on_swapchain_recreated();
+  const Graph_Schedule& schedule() const { return _schedule; }
+  void report();
+
+private:
+  struct Access {
+    Graph_Resource resource;
+    Resource_Usage usage;
+    bool           reads = false;
+    bool           writes = false;
+  };
+
+  struct Pass {
+    std::string                          name;
+    std::function<void(VkCommandBuffer)> execute;
+    std::vector<Access>                  accesses;
+    VkRenderPass                         render_pass = VK_NULL_HANDLE;
+    std::vector<VkClearValue>            clear_values;
+    // part of the attachments drawn to, all of them when zero
+    VkExtent2D                           area{ 0, 0 };
+
+    // filled by compile
+    bool                               culled = false;
+    std::vector<VkImageMemoryBarrier2> barriers;
+    bool                               begins_render_pass = false;
+    bool                               ends_render_pass = false;
+    VkFramebuffer                      framebuffer = VK_NULL_HANDLE;
+    VkExtent2D                         render_area{ 0, 0 };
+  };
+
+  // state of an image between the passes of a frame while compiling
+  struct Image_State {
+    VkImageLayout         layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    // stages of the last write or layout change, and of the reads since
+    VkPipelineStageFlags2 write_stages = 0;
+    VkPipelineStageFlags2 read_stages = 0;
+    // writes not yet made available
+    VkAccessFlags2        write_access = 0;
+    // stages the last write is already visible to
+    VkPipelineStageFlags2 visible_stages = 0;
+  };
+
+  struct Resource {
+    std::string       name;
+    bool              imported = false;
+    Graph_Import      image;
+    VkImageUsageFlags usage = 0;
+    // live passes using the image, -1 when none do
+    int32_t           first_pass = -1;
+    int32_t           last_pass = -1;
+    // index into the physical images of a transient
+    uint32_t          physical = 0;
+    Image_State       state;
+  };
+
+  // memory shared by transient images that are never alive together
+  struct Memory_Slot {
+    VmaAllocation        allocation = VK_NULL_HANDLE;
+    VkMemoryRequirements requirements{};
+  };
+
+  // transient images, kept between frames while the graph has the same shape
+  struct Physical_Image {
+    VkImage      image = VK_NULL_HANDLE;
+    VkImageView  view = VK_NULL_HANDLE;
+    uint32_t     slot = 0;
+    VkDeviceSize size = 0;
+  };
+
+  // what a transient image was created from, compared when its key matches
+  struct Transient_Desc {
+    VkFormat           format;
+    VkExtent2D         extent;
+    VkImageAspectFlags aspect;
+    VkImageUsageFlags  usage;
+    int32_t            first_pass;
+    int32_t            last_pass;
+  };
+
+  struct Framebuffer_Entry {
+    VkFramebuffer            framebuffer;
+    VkRenderPass             render_pass;
+    std::vector<VkImageView> views;
+    VkExtent2D               extent;
+    uint64_t                 last_used_value;
+    uint64_t                 last_frame;
+  };
+
+  Device*         _device;
+  VmaAllocator    _allocator;
+  Cmd*            _cmd;
+  Deletion_Queue* _deletion_queue;
+
+  std::vector<Pass>     _passes;
+  std::vector<Resource> _resources;
+  std::vector<uint32_t> _order;
+
+  uint64_t                    _transient_key = 0;
+  std::vector<Transient_Desc> _transient_descs;
+  std::vector<Physical_Image> _physical;
+  std::vector<Memory_Slot>    _slots;
+
+  // keys are hashes of the render pass, extent and views, entries sharing
+  // a key are told apart by comparing them
+  std::unordered_map<uint64_t, std::vector<Framebuffer_Entry>> _framebuffers;
+  uint64_t                                                     _frame = 0;
+
+  std::vector<VkImageMemoryBarrier2> _final_barriers;
+  Graph_Schedule                     _schedule;
+  uint64_t                           _schedule_key = 0;
+
+  Access& access(Graph_Pass pass, Graph_Resource resource, Resource_Usage usage);
+  void cull();
+  void allocate_transients();
+  void release_transients(uint64_t last_used_value);
+  void release_framebuffers(uint64_t last_used_value);
+  void record_barriers();
+  void sync(Resource& resource, const Access& access, bool in_render_pass, std::vector<VkImageMemoryBarrier2>* barriers);
+  void patch_first_barriers();
+  bool can_merge(const Pass& previous, const Pass& pass) const;
+  void attachments(const Pass& pass, std::vector<Graph_Resource>* resources) const;
+  VkFramebuffer framebuffer(const Pass& pass, VkExtent2D* extent);
+  void update_schedule();
+};
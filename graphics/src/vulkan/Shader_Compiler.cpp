@@ -0,0 +1,360 @@
+#include "Shader_Compiler.h"
+#include "../vulkan_util/vk_util.h"
+
+#include <shaderc/shaderc.hpp>
+
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+// bump when the compile options below change
+constexpr uint32_t SHADER_CACHE_VERSION = 2;
+constexpr uint32_t SHADER_CACHE_MAGIC = 0x4D425348; // "HSBM"
+constexpr uint32_t SPIRV_MAGIC = 0x07230203;
+
+// written in front of every cached module, a file is only used when all of it matches
+struct Shader_Cache_Header {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t compiler_version;
+  // hash of the stage, defines and preprocessed source the module was compiled from
+  uint64_t source_hash;
+  uint64_t code_size;
+  uint64_t code_hash;
+};
+
+// compiled once to identify the compiler, its output changes with the shaderc build
+static const char* PROBE_SHADER = "#version 450\nlayout(location = 0) out vec4 color;\nvoid main() { color = vec4(1.0); }\n";
+
+static bool read_text(const std::string& filepath, std::string* text) {
+  std::ifstream file(filepath, std::ios::binary);
+  if (!file.is_open()) {
+    return false;
+  }
+  text->assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  return true;
+}
+
+static shaderc_shader_kind shader_stage(const std::string& filepath) {
+  std::string extension = std::filesystem::path(filepath).extension().string();
+  if (extension == ".vert") return shaderc_glsl_vertex_shader;
+  if (extension == ".frag") return shaderc_glsl_fragment_shader;
+  if (extension == ".comp") return shaderc_glsl_compute_shader;
+  if (extension == ".geom") return shaderc_glsl_geometry_shader;
+  if (extension == ".tesc") return shaderc_glsl_tess_control_shader;
+  if (extension == ".tese") return shaderc_glsl_tess_evaluation_shader;
+  throw std::runtime_error("unknown shader stage for file: [" + filepath + "]!");
+}
+
+/**
+ * @brief Resolves #include "file" against the including file and
+ *        #include <file> against the shader source directory
+ */
+class Shader_Includer : public shaderc::CompileOptions::IncluderInterface
+{
+public:
+  Shader_Includer(const std::string& source_dir) : _source_dir(source_dir) {}
+
+  shaderc_include_result* GetInclude(
+    const char* requested_source, 
+    shaderc_include_type type, 
+    const char* requesting_source, 
+    size_t include_depth
+  ) override {
+    std::filesystem::path path = type == shaderc_include_type_relative
+      ? std::filesystem::path(requesting_source).parent_path() / requested_source
+      : std::filesystem::path(_source_dir) / requested_source;
+
+    Include* include = new Include();
+    if (read_text(path.string(), &include->content)) {
+      include->name = path.string();
+    }
+    else {
+      // an empty name reports the content as the error
+      include->content = "failed to open include: [" + path.string() + "]";
+    }
+
+    include->result.source_name = include->name.c_str();
+    include->result.source_name_length = include->name.size();
+    include->result.content = include->content.c_str();
+    include->result.content_length = include->content.size();
+    include->result.user_data = include;
+    return &include->result;
+  }
+
+  void ReleaseInclude(shaderc_include_result* data) override {
+    delete static_cast<Include*>(data->user_data);
+  }
+
+private:
+  struct Include {
+    shaderc_include_result result;
+    std::string            name;
+    std::string            content;
+  };
+
+  std::string _source_dir;
+};
+
+static shaderc::CompileOptions compile_options(const std::string& source_dir, const Shader_Defines& defines) {
+  shaderc::CompileOptions options;
+  options.SetTargetEnvironment(shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_2);
+  options.SetOptimizationLevel(shaderc_optimization_level_performance);
+  options.SetIncluder(std::make_unique<Shader_Includer>(source_dir));
+  for (const auto& define : defines) {
+    options.AddMacroDefinition(define.first, define.second);
+  }
+  return options;
+}
+
+Shader_Compiler::Shader_Compiler(std::string source_dir, std::string cache_dir)
+: _source_dir(source_dir), _cache_dir(cache_dir), _compiler(std::make_unique<shaderc::Compiler>()) {
+  _compiler_version = probe_compiler_version();
+
+  std::error_code error;
+  std::filesystem::create_directories(_cache_dir, error);
+  if (error) {
+    fmt::println("failed to create shader cache {}: {}", _cache_dir, error.message());
+  }
+}
+
+Shader_Compiler::~Shader_Compiler() {}
+
+/**
+ * @brief Returns the SPIR-V of a GLSL shader with the given defines,
+ *        compiling it only when no cached module matches
+ */
+std::vector<char> Shader_Compiler::compile(const std::string& filepath, const Shader_Defines& defines) {
+  std::string source;
+  if (!read_text(filepath, &source)) {
+    throw std::runtime_error("failed to open file: [" + filepath + "]!");
+  }
+
+  // includes and macros are expanded first so the key covers everything the shader sees
+  shaderc_shader_kind stage = shader_stage(filepath);
+  std::string preprocessed = preprocess(filepath, source, defines, stage);
+
+  uint64_t source_hash = stage;
+  hash_combine(source_hash, defines_key(defines));
+  hash_combine(source_hash, hash_bytes(preprocessed.data(), preprocessed.size()));
+
+  uint64_t key = _compiler_version;
+  hash_combine(key, source_hash);
+
+  std::promise<std::vector<char>> promise;
+  std::shared_future<std::vector<char>> existing;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto found = _modules.find(key);
+    if (found != _modules.end()) {
+      _stats.memory_hits++;
+      existing = found->second;
+    }
+    else {
+      _modules[key] = promise.get_future().share();
+    }
+  }
+
+  if (existing.valid()) {
+    // another worker may still be compiling it
+    return existing.get();
+  }
+
+  try {
+    std::vector<char> code = build(filepath, preprocessed, defines, stage, key, source_hash);
+    promise.set_value(code);
+    return code;
+  }
+  catch (...) {
+    promise.set_exception(std::current_exception());
+    // a failed permutation is retried on the next request
+    std::lock_guard<std::mutex> lock(_mutex);
+    _modules.erase(key);
+    _stats.failed++;
+    throw;
+  }
+}
+
+Shader_Compiler_Stats Shader_Compiler::stats() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _stats;
+}
+
+void Shader_Compiler::report() {
+  Shader_Compiler_Stats current = stats();
+  fmt::println(
+    "shaders: {} compiled in {:.2f} ms, {} from disk cache, {} reused, {} failed",
+    current.compiled,
+    current.compile_ms,
+    current.disk_hits,
+    current.memory_hits,
+    current.failed
+  );
+}
+
+/**
+ * @brief Order independent key of a set of defines
+ */
+uint64_t Shader_Compiler::defines_key(const Shader_Defines& defines) {
+  Shader_Defines sorted = defines;
+  std::sort(sorted.begin(), sorted.end());
+
+  std::hash<std::string> hash_string;
+  uint64_t seed = sorted.size();
+  for (const auto& define : sorted) {
+    hash_combine(seed, hash_string(define.first));
+    hash_combine(seed, hash_string(define.second));
+  }
+  return seed;
+}
+
+std::string Shader_Compiler::preprocess(const std::string& filepath, const std::string& source, const Shader_Defines& defines, int stage) {
+  shaderc::CompileOptions options = compile_options(_source_dir, defines);
+  shaderc::PreprocessedSourceCompilationResult result = _compiler->PreprocessGlsl(
+    source, 
+    static_cast<shaderc_shader_kind>(stage), 
+    filepath.c_str(), 
+    options
+  );
+
+  if (result.GetCompilationStatus() != shaderc_compilation_status_success) {
+    throw std::runtime_error("failed to preprocess shader: " + result.GetErrorMessage());
+  }
+  return std::string(result.cbegin(), result.cend());
+}
+
+std::vector<char> Shader_Compiler::build(
+  const std::string& filepath, 
+  const std::string& preprocessed, 
+  const Shader_Defines& defines, 
+  int stage, 
+  uint64_t key, 
+  uint64_t source_hash
+) {
+  std::vector<char> code = load_cached(key, source_hash);
+  if (!code.empty()) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stats.disk_hits++;
+    return code;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+
+  shaderc::CompileOptions options = compile_options(_source_dir, defines);
+  shaderc::SpvCompilationResult result = _compiler->CompileGlslToSpv(
+    preprocessed, 
+    static_cast<shaderc_shader_kind>(stage), 
+    filepath.c_str(), 
+    options
+  );
+
+  if (result.GetCompilationStatus() != shaderc_compilation_status_success) {
+    throw std::runtime_error("failed to compile shader: " + result.GetErrorMessage());
+  }
+
+  size_t size = (result.cend() - result.cbegin()) * sizeof(uint32_t);
+  code.resize(size);
+  memcpy(code.data(), result.cbegin(), size);
+  save_cached(key, source_hash, code);
+
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  std::lock_guard<std::mutex> lock(_mutex);
+  _stats.compiled++;
+  _stats.compile_ms += std::chrono::duration<double, std::milli>(elapsed).count();
+  return code;
+}
+
+/**
+ * @brief Hashes the module compiled from a fixed probe shader, the SPIR-V
+ *        header carries the generator version and the code changes with
+ *        the compiler build, so the cache is invalidated when either does
+ */
+uint64_t Shader_Compiler::probe_compiler_version() {
+  uint64_t version = SHADER_CACHE_VERSION;
+
+  shaderc::CompileOptions options = compile_options(_source_dir, {});
+  shaderc::SpvCompilationResult result = _compiler->CompileGlslToSpv(
+    PROBE_SHADER, 
+    shaderc_glsl_fragment_shader, 
+    "probe.frag", 
+    options
+  );
+  if (result.GetCompilationStatus() != shaderc_compilation_status_success || result.cend() - result.cbegin() < 5) {
+    fmt::println("failed to identify the shader compiler, the disk cache is disabled: {}", result.GetErrorMessage());
+    // no file will ever match a key salted with the time
+    hash_combine(version, std::chrono::steady_clock::now().time_since_epoch().count());
+    return version;
+  }
+
+  // word 2 of the header is the generator magic, the tool and its version
+  const uint32_t* words = result.cbegin();
+  hash_combine(version, words[1]);
+  hash_combine(version, words[2]);
+  hash_combine(version, hash_bytes(words, (result.cend() - result.cbegin()) * sizeof(uint32_t)));
+  return version;
+}
+
+/**
+ * @brief Reads a cached module, files from another compiler or source,
+ *        and files that are truncated or corrupted, are ignored
+ */
+std::vector<char> Shader_Compiler::load_cached(uint64_t key, uint64_t source_hash) {
+  std::ifstream file(cache_path(key), std::ios::binary | std::ios::ate);
+  if (!file.is_open()) {
+    return {};
+  }
+
+  size_t file_size = static_cast<size_t>(file.tellg());
+  if (file_size < sizeof(Shader_Cache_Header) + sizeof(uint32_t)) {
+    return {};
+  }
+
+  Shader_Cache_Header header;
+  file.seekg(0);
+  file.read(reinterpret_cast<char*>(&header), sizeof(header));
+  if (
+    !file.good() ||
+    header.magic != SHADER_CACHE_MAGIC ||
+    header.version != SHADER_CACHE_VERSION ||
+    header.compiler_version != _compiler_version ||
+    header.source_hash != source_hash ||
+    header.code_size != file_size - sizeof(header) ||
+    header.code_size % sizeof(uint32_t) != 0
+  ) {
+    return {};
+  }
+
+  std::vector<char> code(header.code_size);
+  file.read(code.data(), code.size());
+
+  uint32_t magic;
+  memcpy(&magic, code.data(), sizeof(magic));
+  if (!file.good() || magic != SPIRV_MAGIC || hash_bytes(code.data(), code.size()) != header.code_hash) {
+    return {};
+  }
+  return code;
+}
+
+/**
+ * @brief Written through vkutil::write_file_atomic, readers never see a
+ *        partially written module
+ */
+void Shader_Compiler::save_cached(uint64_t key, uint64_t source_hash, const std::vector<char>& code) {
+  Shader_Cache_Header header{};
+  header.magic = SHADER_CACHE_MAGIC;
+  header.version = SHADER_CACHE_VERSION;
+  header.compiler_version = _compiler_version;
+  header.source_hash = source_hash;
+  header.code_size = code.size();
+  header.code_hash = hash_bytes(code.data(), code.size());
+
+  std::vector<char> data(sizeof(header) + code.size());
+  memcpy(data.data(), &header, sizeof(header));
+  memcpy(data.data() + sizeof(header), code.data(), code.size());
+  vkutil::write_file_atomic(cache_path(key), data);
+}
+
+std::string Shader_Compiler::cache_path(uint64_t key) const {
+  return fmt::format("{}/{:016x}.spv", _cache_dir, key);
+}
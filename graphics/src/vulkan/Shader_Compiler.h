@@ -0,0 +1,66 @@
+#pragma once
+
+#include "../vulkan_util/vk_types.h"
+
+#include <future>
+#include <unordered_map>
+
+namespace shaderc { class Compiler; }
+
+// macros defined before a shader is compiled, as (name, value) pairs
+using Shader_Defines = std::vector<std::pair<std::string, std::string>>;
+
+struct Shader_Compiler_Stats {
+  // permutations already compiled during this run
+  uint32_t memory_hits = 0;
+  // permutations loaded from the disk cache
+  uint32_t disk_hits   = 0;
+  uint32_t compiled    = 0;
+  uint32_t failed      = 0;
+  double   compile_ms  = 0.0;
+};
+
+/**
+ * @brief Compiles GLSL to SPIR-V at runtime with shaderc. Results are cached
+ *        on disk under a hash of the preprocessed source, the defines and
+ *        the compiler version, so a shader only recompiles when something
+ *        it includes changes. Safe to call from several worker threads,
+ *        concurrent requests for the same permutation compile it once
+ */
+class Shader_Compiler
+{
+public:
+  // system includes are resolved against source_dir
+  Shader_Compiler(std::string source_dir, std::string cache_dir);
+  ~Shader_Compiler();
+
+  Shader_Compiler (const Shader_Compiler&) = delete;
+  Shader_Compiler& operator= (const Shader_Compiler&) = delete;
+
+  std::vector<char> compile(const std::string& filepath, const Shader_Defines& defines = {});
+
+  Shader_Compiler_Stats stats();
+  void report();
+
+  static uint64_t defines_key(const Shader_Defines& defines);
+
+private:
+  std::string _source_dir;
+  std::string _cache_dir;
+  // identity of the shaderc build, taken from a probe module it compiled
+  uint64_t    _compiler_version;
+
+  std::unique_ptr<shaderc::Compiler> _compiler;
+
+  // every permutation requested this run, pending ones are waited on
+  std::mutex _mutex;
+  std::unordered_map<uint64_t, std::shared_future<std::vector<char>>> _modules;
+  Shader_Compiler_Stats _stats;
+
+  std::string preprocess(const std::string& filepath, const std::string& source, const Shader_Defines& defines, int stage);
+  std::vector<char> build(const std::string& filepath, const std::string& preprocessed, const Shader_Defines& defines, int stage, uint64_t key, uint64_t source_hash);
+  std::vector<char> load_cached(uint64_t key, uint64_t source_hash);
+  void save_cached(uint64_t key, uint64_t source_hash, const std::vector<char>& code);
+  uint64_t probe_compiler_version();
+  std::string cache_path(uint64_t key) const;
+};
@@ -6,17 +6,12 @@ Swapchain::Swapchain(VkInstance instance, Device* device,VkSurfaceKHR surface,
 
 Swapchain::~Swapchain() {
   vkDestroyRenderPass(_device->_logical, _renderpass, nullptr);
-
-  for (auto framebuffer : _framebuffers) {
-    vkDestroyFramebuffer(_device->_logical, framebuffer, nullptr);
-  }
+  vkDestroyRenderPass(_device->_logical, _scene_renderpass, nullptr);
 
   for (auto image_view : swapchain_image_views) {
     vkDestroyImageView(_device->_logical, image_view, nullptr);
   }
 
-  delete _depth_image;
-
   vkDestroySwapchainKHR(_device->_logical, _handle, nullptr);
 }
 
@@ -24,7 +19,7 @@ void Swapchain::create_default() {
   query_swapchain_details();
 
   VkSurfaceFormatKHR format = choose_surface_format();
-  VkPresentModeKHR present_mode = choose_present_mode();
+  present_mode = choose_present_mode();
   VkExtent2D extent = choose_extent();
 
   // store details
@@ -46,7 +41,8 @@ void Swapchain::create_default() {
   swapchain_info.imageColorSpace = format.colorSpace;
   swapchain_info.imageExtent = extent;
   swapchain_info.imageArrayLayers = 1;
-  swapchain_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+  // the compute background is blitted into the swapchain images
+  swapchain_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
 
   uint32_t queue_family_indices[] = {
     _device->_graphics_index.value(),
@@ -68,7 +64,8 @@ void Swapchain::create_default() {
   swapchain_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
   swapchain_info.presentMode = present_mode;
   swapchain_info.clipped = VK_TRUE;
-  swapchain_info.oldSwapchain = VK_NULL_HANDLE;
+  // images of the old swapchain stay valid until it is destroyed
+  swapchain_info.oldSwapchain = _old_swapchain;
 
   VK_CHECK(vkCreateSwapchainKHR(_device->_logical, &swapchain_info, nullptr, &_handle));
 
@@ -80,23 +77,105 @@ void Swapchain::create_default() {
   create_image_views();
 }
 
+/**
+ * @brief Replaces the swapchain for the current surface size, size dependent
+ *        attachments belong to the render graph. The default render pass is
+ *        rebuilt when the surface format changed, the scene pass does not
+ *        use the swapchain format and is kept
+ * @param deletion_queue receives the replaced handles
+ * @param last_used_value timeline value of the last frame using the old swapchain
+ * @return true when the default render pass was replaced, pipelines built
+ *         against it must be recreated
+ */
+bool Swapchain::recreate(Deletion_Queue* deletion_queue, uint64_t last_used_value) {
+  for (auto image_view : swapchain_image_views) {
+    deletion_queue->retire(Handle_Type::Image_View, image_view, last_used_value);
+  }
+
+  VkFormat previous_format = swapchain_image_format;
+
+  _old_swapchain = _handle;
+  create_default();
+  deletion_queue->retire(Handle_Type::Swapchain, _old_swapchain, last_used_value);
+  _old_swapchain = VK_NULL_HANDLE;
+
+  if (swapchain_image_format == previous_format) {
+    return false;
+  }
+  fmt::println(
+    "swapchain format changed from {} to {}, rebuilding the default render pass",
+    string_VkFormat(previous_format),
+    string_VkFormat(swapchain_image_format)
+  );
+  deletion_queue->retire(Handle_Type::Render_Pass, _renderpass, last_used_value);
+  init_default_renderpass();
+  return true;
+}
+
+/**
+ * @brief Color only pass over the swapchain image, the upscaled scene is
+ *        already in it when the pass begins
+ */
 void Swapchain::init_default_renderpass() {
   VkAttachmentDescription color_attachment = {};
 	//the attachment will have the format needed by the swapchain
 	color_attachment.format = swapchain_image_format;
 	//1 sample, we won't be doing MSAA
 	color_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
-	// we Clear when this attachment is loaded
-	color_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	color_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+	// we keep the attachment stored when the renderpass ends
+	color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	//we don't care about stencil
+	color_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	color_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	// the render graph moves the image in and out of the attachment layout
+	color_attachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	color_attachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+  VkAttachmentReference color_attachment_ref = {};
+	//attachment number will index into the pAttachments array in the parent renderpass itself
+	color_attachment_ref.attachment = 0;
+	color_attachment_ref.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+	//we are going to create 1 subpass, which is the minimum you can do
+	VkSubpassDescription subpass = {};
+	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subpass.colorAttachmentCount = 1;
+	subpass.pColorAttachments = &color_attachment_ref;
+
+  // the render graph records the barriers before and after the pass, 
+  // so it has no external dependencies of its own
+  VkRenderPassCreateInfo render_pass_info = {};
+	render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	render_pass_info.attachmentCount = 1;
+	render_pass_info.pAttachments = &color_attachment;
+	render_pass_info.subpassCount = 1;
+	render_pass_info.pSubpasses = &subpass;
+  render_pass_info.dependencyCount = 0;
+  render_pass_info.pDependencies = nullptr;
+
+	VK_CHECK(vkCreateRenderPass(_device->_logical, &render_pass_info, nullptr, &_renderpass));
+}
+
+/**
+ * @brief Pass the meshes are drawn in, into the offscreen scene color 
+ *        target at the render scale
+ */
+void Swapchain::init_scene_renderpass() {
+  VkAttachmentDescription color_attachment = {};
+	color_attachment.format = SCENE_COLOR_FORMAT;
+	//1 sample, we won't be doing MSAA
+	color_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	// the background is already in the attachment when the pass begins
+	color_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
 	// we keep the attachment stored when the renderpass ends
 	color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 	//we don't care about stencil
 	color_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	color_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	//we don't know or care about the starting layout of the attachment
-	color_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	//after the renderpass ends, the image has to be on a layout ready for display
-	color_attachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	// the render graph moves the image in and out of the attachment layout
+	color_attachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	color_attachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
   VkAttachmentReference color_attachment_ref = {};
 	//attachment number will index into the pAttachments array in the parent renderpass itself
@@ -105,13 +184,14 @@ void Swapchain::init_default_renderpass() {
 
   VkAttachmentDescription depth_attachment = {};
   depth_attachment.flags = 0;
-  depth_attachment.format = _depth_image->_format;
+  depth_attachment.format = DEPTH_FORMAT;
   depth_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
   depth_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-  depth_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+  // depth is a transient of the render graph, nothing reads it after the pass
+  depth_attachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
   depth_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
   depth_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-  depth_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  depth_attachment.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
   depth_attachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
   VkAttachmentReference depth_attachment_ref = {};
@@ -127,24 +207,8 @@ void Swapchain::init_default_renderpass() {
 
   VkAttachmentDescription attachments[2] = { color_attachment,depth_attachment };
 
-  VkSubpassDependency dependency = {};
-  dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-  dependency.dstSubpass = 0;
-  dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-  dependency.srcAccessMask = 0;
-  dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-  dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-
-  VkSubpassDependency depth_dependency = {};
-  depth_dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-  depth_dependency.dstSubpass = 0;
-  depth_dependency.srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
-  depth_dependency.srcAccessMask = 0;
-  depth_dependency.dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
-  depth_dependency.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-
-  VkSubpassDependency dependencies[2] = { dependency, depth_dependency };
-
+  // the render graph records the barriers before and after the pass, 
+  // so it has no external dependencies of its own
   VkRenderPassCreateInfo render_pass_info = {};
 	render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
 	//connect the color attachment to the info
@@ -153,48 +217,10 @@ void Swapchain::init_default_renderpass() {
 	//connect the subpass to the info
 	render_pass_info.subpassCount = 1;
 	render_pass_info.pSubpasses = &subpass;
-  render_pass_info.dependencyCount = 2;
-  render_pass_info.pDependencies = &dependencies[0];
+  render_pass_info.dependencyCount = 0;
+  render_pass_info.pDependencies = nullptr;
 
-	VK_CHECK(vkCreateRenderPass(_device->_logical, &render_pass_info, nullptr, &_renderpass));
-}
-
-void Swapchain::init_framebuffers() {
-  //create the framebuffers for the swapchain images. This will connect the render-pass to the images for rendering
-	VkFramebufferCreateInfo fb_info = {};
-	fb_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-	fb_info.pNext = nullptr;
-
-	fb_info.renderPass = _renderpass;
-	fb_info.attachmentCount = 1;
-	fb_info.width = swapchain_extent.width;
-	fb_info.height = swapchain_extent.height;
-	fb_info.layers = 1;
-
-	//grab how many images we have in the swapchain
-	const uint32_t swapchain_imagecount = static_cast<uint32_t>(swapchain_images.size());
-	_framebuffers = std::vector<VkFramebuffer>(swapchain_imagecount);
-
-	//create framebuffers for each of the swapchain image views
-	for (uint32_t i = 0; i < swapchain_imagecount; i++) {
-
-    VkImageView attachments[2];
-		attachments[0] = swapchain_image_views[i];
-    attachments[1] = _depth_image->_image_view;
-
-    fb_info.pAttachments = attachments;
-    fb_info.attachmentCount = 2;
-
-		if (vkCreateFramebuffer(_device->_logical, &fb_info, nullptr, &_framebuffers[i]) != VK_SUCCESS) {
-      throw std::runtime_error("failed to create framebuffer");
-    }
-	}
-}
-
-void Swapchain::init_depth_image(VkExtent2D _window_extent) {
-  //depth image size will match window
-  _depth_image = new Image(_allocator, _device->_logical);
-  _depth_image->create_depth_image(_window_extent);
+	VK_CHECK(vkCreateRenderPass(_device->_logical, &render_pass_info, nullptr, &_scene_renderpass));
 }
 
 void Swapchain::query_swapchain_details() {
@@ -230,12 +256,13 @@ VkSurfaceFormatKHR Swapchain::choose_surface_format() {
 }
 
 VkPresentModeKHR Swapchain::choose_present_mode() {
-  for (const auto& present_mode : details.present_modes) {
-    if (present_mode == VK_PRESENT_MODE_FIFO_KHR) {
-      return present_mode;
+  for (const auto& available_mode : details.present_modes) {
+    if (available_mode == preferred_present_mode) {
+      return available_mode;
     }
   }
 
+  // FIFO is the only present mode guaranteed to be available
   return VK_PRESENT_MODE_FIFO_KHR;
 }
 
@@ -292,14 +319,3 @@ void Swapchain::create_image_views() {
     VK_CHECK(vkCreateImageView(_device->_logical, &image_info, nullptr, &swapchain_image_views[i]));
   }
 }
-
-void Swapchain::renderpass_begin_info(VkRenderPassBeginInfo* renderpass_info, VkExtent2D _window_extent, uint32_t swapchain_image_index) {
-  renderpass_info->sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-  renderpass_info->pNext = nullptr;
-
-  renderpass_info->renderPass = _renderpass;
-	renderpass_info->renderArea.offset.x = 0;
-	renderpass_info->renderArea.offset.y = 0;
-	renderpass_info->renderArea.extent = _window_extent;
-	renderpass_info->framebuffer = _framebuffers[swapchain_image_index];
-}
\ No newline at end of file
@@ -3,10 +3,16 @@
 #include "../vulkan_util/vk_types.h"
 #include "device.h"
 #include "image.h"
+#include "Deletion_Queue.h"
 
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_vulkan.h>
 
+// attachments of the scene render pass, the scene is drawn offscreen in
+// linear color and upscaled into the swapchain
+constexpr VkFormat SCENE_COLOR_FORMAT = VK_FORMAT_R16G16B16A16_SFLOAT;
+constexpr VkFormat DEPTH_FORMAT = VK_FORMAT_D32_SFLOAT;
+
 struct Swapchain_details {
   VkSurfaceCapabilitiesKHR capabilities;
   std::vector<VkSurfaceFormatKHR> formats;
@@ -27,29 +33,32 @@ class Swapchain {
     Swapchain (const Swapchain&) = delete;
     Swapchain& operator= (const Swapchain&) = delete;
 
-    void init(VkExtent2D _window_extent) {
+    void init() {
       create_default();
-      init_depth_image(_window_extent);
       init_default_renderpass();
-      init_framebuffers();
+      init_scene_renderpass();
     }
 
+    bool recreate(Deletion_Queue* deletion_queue, uint64_t last_used_value);
+
     // Swapchain handles
     VkSwapchainKHR _handle;
     VkSwapchainCreateInfoKHR old_create_info{};
     Swapchain_details details;
     VkFormat swapchain_image_format;
-    Image* _depth_image;
+    VkPresentModeKHR present_mode;
+    // present mode used when the surface supports it, FIFO otherwise
+    VkPresentModeKHR preferred_present_mode = VK_PRESENT_MODE_FIFO_KHR;
     uint32_t image_count;
     VkExtent2D swapchain_extent;
     std::vector<VkImage> swapchain_images;
     std::vector<VkImageView> swapchain_image_views;
 
-    // Secondary handles
-    VkRenderPass               _renderpass;
-	  std::vector<VkFramebuffer> _framebuffers;
-
-    void renderpass_begin_info(VkRenderPassBeginInfo* renderpass_info, VkExtent2D _window_extent, uint32_t swapchain_image_index);
+    // Secondary handles, the render graph records the layout changes
+    // around the render passes and owns their framebuffers.
+    // The default pass draws over the swapchain image at native resolution
+    VkRenderPass _renderpass;
+    VkRenderPass _scene_renderpass;
 
   private:
     VkInstance    _instance;
@@ -62,8 +71,7 @@ class Swapchain {
 
     void create_default();
     void init_default_renderpass();
-    void init_framebuffers();
-    void init_depth_image(VkExtent2D _window_extent);
+    void init_scene_renderpass();
 
     void query_swapchain_details();
     VkSurfaceFormatKHR choose_surface_format();
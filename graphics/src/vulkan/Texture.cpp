@@ -0,0 +1,468 @@
+#include "Texture.h"
+#include "Cmd.h"
+
+#include <cstring>
+#include <filesystem>
+
+// features needed to build a mip chain with linear blits
+constexpr VkFormatFeatureFlags MIP_BLIT_FEATURES =
+  VK_FORMAT_FEATURE_BLIT_SRC_BIT |
+  VK_FORMAT_FEATURE_BLIT_DST_BIT |
+  VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+
+Texture_Cache::Texture_Cache(
+  Device* device,
+  VmaAllocator allocator,
+  Cmd* cmd,
+  vklayout::Sampler_Cache* samplers
+) : _device(device), _allocator(allocator), _cmd(cmd), _samplers(samplers) {
+  // magenta and grey checkerboard stands in for missing textures
+  vktexture::Texture_Data checker;
+  checker.format = VK_FORMAT_R8G8B8A8_SRGB;
+  checker.extent = { 64, 64, 1 };
+  checker.bytes.resize(vktexture::level_size(checker.format, checker.extent));
+  for (uint32_t y = 0; y < checker.extent.height; y++) {
+    for (uint32_t x = 0; x < checker.extent.width; x++) {
+      bool odd = ((x / 8) + (y / 8)) % 2 == 1;
+      uint8_t* texel = &checker.bytes[(y * checker.extent.width + x) * 4];
+      texel[0] = odd ? 255 : 64;
+      texel[1] = odd ? 0 : 64;
+      texel[2] = odd ? 255 : 64;
+      texel[3] = 255;
+    }
+  }
+  vktexture::Texture_Level level;
+  level.offset = 0;
+  level.size = checker.bytes.size();
+  level.extent = checker.extent;
+  checker.levels.push_back(level);
+
+  _default = create(checker, true, "default");
+}
+
+Texture_Cache::~Texture_Cache() {
+  // the device is idle by the time the cache is destroyed
+  for (auto& texture : _textures) {
+    if (texture.second != _default) {
+      delete texture.second->image;
+      delete texture.second;
+    }
+  }
+  delete _default->image;
+  delete _default;
+}
+
+/**
+ * @brief Returns the texture loaded from a path, loading and uploading it
+ *        on first use. The upload is asynchronous, see Texture::ready
+ */
+Texture* Texture_Cache::load(const std::string& path, const Texture_Options& options) {
+  return get_or_create(path, [&]() { return load_uncached(path, options); });
+}
+
+/**
+ * @brief Uploads texel data built in memory under a name, such as the
+ *        layers of an atlas. A name already in use returns its texture
+ */
+Texture* Texture_Cache::add(const std::string& name, const vktexture::Texture_Data& data) {
+  return get_or_create(name, [&]() { return create(data, false, name); });
+}
+
+/**
+ * @brief Returns the texture under a key or makes it without holding the
+ *        lock, requests for a key being made wait for it instead
+ */
+Texture* Texture_Cache::get_or_create(const std::string& key, const std::function<Texture*()>& make) {
+  std::promise<Texture*> promise;
+  std::shared_future<Texture*> pending;
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto found = _textures.find(key);
+    if (found != _textures.end()) {
+      return found->second;
+    }
+    auto loading = _loading.find(key);
+    if (loading != _loading.end()) {
+      pending = loading->second;
+    }
+    else {
+      _loading[key] = promise.get_future().share();
+    }
+  }
+
+  if (pending.valid()) {
+    return pending.get();
+  }
+
+  Texture* texture = nullptr;
+  try {
+    texture = make();
+  }
+  catch (const std::exception& e) {
+    fmt::println("failed to load texture {}: {}", key, e.what());
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (texture == nullptr) {
+      _stats.failed++;
+      texture = _default;
+    }
+    _textures[key] = texture;
+    _loading.erase(key);
+  }
+  promise.set_value(texture);
+  return texture;
+}
+
+/**
+ * @brief Reads, decodes and uploads a texture, called without the lock
+ * @return nullptr when the file cannot be used
+ */
+Texture* Texture_Cache::load_uncached(const std::string& path, const Texture_Options& options) {
+  std::string source = resolve(path, options);
+  vktexture::Texture_Data data;
+  Texture* texture = nullptr;
+  if (!vktexture::load(source, options.srgb, &data)) {
+    fmt::println("failed to load texture {}", source);
+  }
+  else if (data.compressed() && !_device->_texture_compression_bc) {
+    fmt::println("{} is block compressed but the device cannot sample BCn", source);
+  }
+  else if (!format_supported(data.format, VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_TRANSFER_DST_BIT)) {
+    fmt::println("{} uses {} which the device cannot sample", source, string_VkFormat(data.format));
+  }
+  else if (options.stream && (data.levels.size() > 1 || vktexture::build_mips(&data))) {
+    // the small levels are uploaded now, the streamer brings in the rest
+    uint32_t resident_mip = 0;
+    while (
+      resident_mip + 1 < data.levels.size() &&
+      std::max(data.levels[resident_mip].extent.width, data.levels[resident_mip].extent.height) > STREAM_RESIDENT_SIZE
+    ) {
+      resident_mip++;
+    }
+    texture = create(vktexture::tail(data, resident_mip), false, source);
+    texture->streamed = true;
+    texture->srgb = options.srgb;
+    texture->format = data.format;
+    texture->extent = data.extent;
+    texture->mip_levels = static_cast<uint32_t>(data.levels.size());
+    texture->resident_mip = resident_mip;
+    // the sampler reaches every level the image may grow to
+    texture->sampler = create_sampler(texture->mip_levels);
+  }
+  else {
+    texture = create(data, options.generate_mips, source);
+  }
+  return texture;
+}
+
+/**
+ * @brief Image info for a combined image sampler descriptor of a texture
+ */
+VkDescriptorImageInfo Texture_Cache::descriptor(const Texture* texture) const {
+  VkDescriptorImageInfo info{};
+  info.sampler = texture->sampler;
+  info.imageView = texture->image->_image_view;
+  info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  return info;
+}
+
+Texture_Stats Texture_Cache::stats() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _stats;
+}
+
+void Texture_Cache::report() {
+  Texture_Stats current = stats();
+  fmt::println(
+    "textures: {} loaded ({} block compressed, {} with generated mips, {} failed), {:.2f} MiB",
+    current.loaded,
+    current.compressed,
+    current.mips_generated,
+    current.failed,
+    current.bytes / (1024.0 * 1024.0)
+  );
+}
+
+/**
+ * @brief Picks a block compressed sibling of a source image when there is
+ *        one the device can sample, it takes 4-8x less memory and bandwidth
+ */
+std::string Texture_Cache::resolve(const std::string& path, const Texture_Options& options) {
+  if (!options.prefer_compressed || !_device->_texture_compression_bc) {
+    return path;
+  }
+
+  std::filesystem::path source(path);
+  for (const char* extension : { ".ktx2", ".dds" }) {
+    std::filesystem::path candidate = source;
+    candidate.replace_extension(extension);
+    if (candidate != source && std::filesystem::exists(candidate)) {
+      return candidate.string();
+    }
+  }
+  return path;
+}
+
+bool Texture_Cache::format_supported(VkFormat format, VkFormatFeatureFlags features) const {
+  VkFormatProperties properties;
+  vkGetPhysicalDeviceFormatProperties(_device->_physical, format, &properties);
+  return (properties.optimalTilingFeatures & features) == features;
+}
+
+/**
+ * @brief Uploads texel data into a new image, levels missing from the
+ *        data are blitted from the ones above when the format allows it.
+ *        Safe to call from any thread, the cache itself is not touched
+ * @param ready receives the token the upload completes with
+ */
+Image* Texture_Cache::upload(const vktexture::Texture_Data& data, bool generate_mips, Submit_Token* ready) {
+  uint32_t provided_levels = static_cast<uint32_t>(data.levels.size()) / data.layers;
+  bool blit_mips =
+    generate_mips &&
+    provided_levels == 1 &&
+    data.layers == 1 &&
+    !data.compressed() &&
+    format_supported(data.format, MIP_BLIT_FEATURES);
+  uint32_t mip_levels = blit_mips ? vktexture::mip_count(data.extent) : provided_levels;
+
+  // stage every provided level in host visible memory
+  VkBufferCreateInfo staging_info {};
+  staging_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  staging_info.size = data.bytes.size();
+  staging_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+
+  VmaAllocationCreateInfo staging_alloc_info {};
+  staging_alloc_info.usage = VMA_MEMORY_USAGE_CPU_ONLY;
+
+  AllocatedBuffer staging;
+  VK_CHECK(vmaCreateBuffer(_allocator, &staging_info, &staging_alloc_info,
+    &staging._buffer,
+    &staging._allocation,
+    nullptr
+  ));
+
+  void* mapped;
+  vmaMapMemory(_allocator, staging._allocation, &mapped);
+  memcpy(mapped, data.bytes.data(), data.bytes.size());
+  vmaUnmapMemory(_allocator, staging._allocation);
+
+  Image* texture_image = new Image(_allocator, _device->_logical);
+
+  // a source for mip blits, and for the copies of streamed images dropping levels
+  VkImageUsageFlags usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+  texture_image->create_image(data.extent, data.format, usage, VK_IMAGE_ASPECT_COLOR_BIT, {}, mip_levels, data.layers);
+  VkImage image = texture_image->_image;
+
+  *ready = _cmd->immediate_submit_async([&](VkCommandBuffer upload_cmd) {
+    _cmd->record_mip_barrier(
+      upload_cmd, image, 0, mip_levels,
+      VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+      VK_PIPELINE_STAGE_2_NONE_KHR, 0,
+      VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR, VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR
+    );
+
+    std::vector<VkBufferImageCopy> copies;
+    for (uint32_t level = 0; level < data.levels.size(); level++) {
+      VkBufferImageCopy copy{};
+      copy.bufferOffset = data.levels[level].offset;
+      copy.bufferRowLength = 0;
+      copy.bufferImageHeight = 0;
+      copy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+      copy.imageSubresource.mipLevel = level % provided_levels;
+      copy.imageSubresource.baseArrayLayer = level / provided_levels;
+      copy.imageSubresource.layerCount = 1;
+      copy.imageExtent = data.levels[level].extent;
+      copies.push_back(copy);
+    }
+    vkCmdCopyBufferToImage(
+      upload_cmd,
+      staging._buffer,
+      image,
+      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+      static_cast<uint32_t>(copies.size()),
+      copies.data()
+    );
+
+    if (!blit_mips) {
+      _cmd->record_mip_barrier(
+        upload_cmd, image, 0, mip_levels,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR, VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR,
+        VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_READ_BIT_KHR
+      );
+      return;
+    }
+
+    // each level is read from the one above once it has been written
+    for (uint32_t level = 1; level < mip_levels; level++) {
+      _cmd->record_mip_barrier(
+        upload_cmd, image, level - 1, 1,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR, VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR,
+        VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR, VK_ACCESS_2_TRANSFER_READ_BIT_KHR
+      );
+
+      VkImageBlit blit{};
+      blit.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level - 1, 0, 1 };
+      blit.srcOffsets[1].x = std::max(1, static_cast<int32_t>(data.extent.width >> (level - 1)));
+      blit.srcOffsets[1].y = std::max(1, static_cast<int32_t>(data.extent.height >> (level - 1)));
+      blit.srcOffsets[1].z = 1;
+      blit.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1 };
+      blit.dstOffsets[1].x = std::max(1, static_cast<int32_t>(data.extent.width >> level));
+      blit.dstOffsets[1].y = std::max(1, static_cast<int32_t>(data.extent.height >> level));
+      blit.dstOffsets[1].z = 1;
+
+      vkCmdBlitImage(
+        upload_cmd,
+        image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        1, &blit,
+        VK_FILTER_LINEAR
+      );
+    }
+
+    _cmd->record_mip_barrier(
+      upload_cmd, image, 0, mip_levels - 1,
+      VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+      VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR, VK_ACCESS_2_TRANSFER_READ_BIT_KHR,
+      VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_READ_BIT_KHR
+    );
+    _cmd->record_mip_barrier(
+      upload_cmd, image, mip_levels - 1, 1,
+      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+      VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR, VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR,
+      VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_READ_BIT_KHR
+    );
+  });
+
+  // release the staging buffer once the copy is done
+  VmaAllocator allocator = _allocator;
+  _cmd->then(*ready, [allocator, staging]() {
+    vmaDestroyBuffer(allocator, staging._buffer, staging._allocation);
+  });
+  return texture_image;
+}
+
+/**
+ * @brief Copies the levels of an image from first_level down into a new,
+ *        smaller image on the GPU, without reading the source file again
+ * @param ready receives the token the copy completes with, the source
+ *        must stay alive until then
+ */
+Image* Texture_Cache::shrink(const Image* source, uint32_t first_level, Submit_Token* ready) {
+  uint32_t mip_levels = source->_mip_levels - first_level;
+  VkExtent3D extent = {
+    std::max(1u, source->_extent.width >> first_level),
+    std::max(1u, source->_extent.height >> first_level),
+    1
+  };
+
+  Image* texture_image = new Image(_allocator, _device->_logical);
+  VkImageUsageFlags usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+  texture_image->create_image(extent, source->_format, usage, VK_IMAGE_ASPECT_COLOR_BIT, {}, mip_levels);
+  VkImage src = source->_image;
+  VkImage image = texture_image->_image;
+
+  *ready = _cmd->immediate_submit_async([&](VkCommandBuffer copy_cmd) {
+    // frames submitted before on the same queue may still be sampling the source
+    _cmd->record_mip_barrier(
+      copy_cmd, src, first_level, mip_levels,
+      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+      VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT_KHR, 0,
+      VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR, VK_ACCESS_2_TRANSFER_READ_BIT_KHR
+    );
+    _cmd->record_mip_barrier(
+      copy_cmd, image, 0, mip_levels,
+      VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+      VK_PIPELINE_STAGE_2_NONE_KHR, 0,
+      VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR, VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR
+    );
+
+    std::vector<VkImageCopy> copies;
+    for (uint32_t level = 0; level < mip_levels; level++) {
+      VkImageCopy copy{};
+      copy.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, first_level + level, 0, 1 };
+      copy.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1 };
+      copy.extent = { std::max(1u, extent.width >> level), std::max(1u, extent.height >> level), 1 };
+      copies.push_back(copy);
+    }
+    vkCmdCopyImage(
+      copy_cmd,
+      src, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+      image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+      static_cast<uint32_t>(copies.size()),
+      copies.data()
+    );
+
+    // the source is sampled until the new image is swapped in
+    _cmd->record_mip_barrier(
+      copy_cmd, src, first_level, mip_levels,
+      VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+      VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR, 0,
+      VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_READ_BIT_KHR
+    );
+    _cmd->record_mip_barrier(
+      copy_cmd, image, 0, mip_levels,
+      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+      VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR, VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR,
+      VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT_KHR, VK_ACCESS_2_SHADER_READ_BIT_KHR
+    );
+  });
+  return texture_image;
+}
+
+/**
+ * @brief Uploads the data of a texture and counts it in the stats, the
+ *        lock is only taken for the stats
+ */
+Texture* Texture_Cache::create(const vktexture::Texture_Data& data, bool generate_mips, const std::string& path) {
+  Texture* texture = new Texture();
+  texture->path = path;
+  texture->compressed = data.compressed();
+  texture->format = data.format;
+  texture->extent = data.extent;
+  texture->image = upload(data, generate_mips, &texture->ready);
+  texture->mip_levels = texture->image->_mip_levels;
+  texture->sampler = create_sampler(texture->mip_levels);
+
+  bool blit_mips = texture->mip_levels * data.layers > data.levels.size();
+  for (uint32_t level = 0; level < texture->mip_levels; level++) {
+    VkExtent3D extent = { std::max(1u, data.extent.width >> level), std::max(1u, data.extent.height >> level), 1 };
+    texture->bytes += vktexture::level_size(data.format, extent) * data.layers;
+  }
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  _stats.loaded++;
+  _stats.compressed += texture->compressed ? 1 : 0;
+  _stats.mips_generated += blit_mips ? 1 : 0;
+  _stats.bytes += texture->bytes;
+  return texture;
+}
+
+/**
+ * @brief Trilinear repeating sampler, anisotropic where the device allows,
+ *        shared through the sampler cache
+ */
+VkSampler Texture_Cache::create_sampler(uint32_t mip_levels) {
+  VkSamplerCreateInfo info{};
+  info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+  info.pNext = nullptr;
+  info.magFilter = VK_FILTER_LINEAR;
+  info.minFilter = VK_FILTER_LINEAR;
+  info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+  info.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+  info.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+  info.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+  info.mipLodBias = 0.f;
+  info.anisotropyEnable = _device->_sampler_anisotropy ? VK_TRUE : VK_FALSE;
+  info.maxAnisotropy = _device->_sampler_anisotropy ? std::min(8.f, _device->_max_anisotropy) : 1.f;
+  info.compareEnable = VK_FALSE;
+  info.compareOp = VK_COMPARE_OP_ALWAYS;
+  info.minLod = 0.f;
+  info.maxLod = static_cast<float>(mip_levels);
+  info.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+  info.unnormalizedCoordinates = VK_FALSE;
+  return _samplers->get_sampler(info);
+}
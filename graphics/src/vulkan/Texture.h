@@ -0,0 +1,108 @@
+#pragma once
+
+#include "../vulkan_util/vk_types.h"
+#include "../vulkan_util/vk_descriptors.h"
+#include "../vulkan_util/vk_textures.h"
+#include "device.h"
+#include "Image.h"
+
+#include <future>
+#include <unordered_map>
+
+class Cmd;
+
+struct Texture_Options {
+  // color data, false for normal maps and masks
+  bool srgb = true;
+  // sources without a mip chain get one generated on the GPU
+  bool generate_mips = true;
+  // a .ktx2 or .dds next to the source is loaded instead when the device samples BCn
+  bool prefer_compressed = true;
+  // only the levels up to STREAM_RESIDENT_SIZE are uploaded, see Texture_Streamer
+  bool stream = false;
+};
+
+// largest side of the levels a streamed texture keeps resident at all times
+constexpr uint32_t STREAM_RESIDENT_SIZE = 64;
+
+struct Texture {
+  Image*       image = nullptr;
+  VkSampler    sampler = VK_NULL_HANDLE;
+  std::string  path;
+  bool         compressed = false;
+  VkDeviceSize bytes = 0;
+  // completes once the texels are uploaded, frames submitted later wait on it
+  Submit_Token ready;
+
+  // the full chain of a streamed texture, image holds the levels from
+  // resident_mip down and is replaced as levels stream in and out
+  bool         streamed = false;
+  bool         srgb = true;
+  VkFormat     format = VK_FORMAT_UNDEFINED;
+  VkExtent3D   extent = { 0, 0, 1 };
+  uint32_t     mip_levels = 1;
+  uint32_t     resident_mip = 0;
+};
+
+struct Texture_Stats {
+  uint32_t     loaded = 0;
+  uint32_t     compressed = 0;
+  uint32_t     mips_generated = 0;
+  uint32_t     failed = 0;
+  VkDeviceSize bytes = 0;
+};
+
+/**
+ * @brief Loads textures once per path and uploads them through a staging
+ *        buffer into optimally tiled images. Block compressed files are
+ *        copied as they are with their own mips, other sources get their
+ *        mips blitted on the GPU. Textures that fail to load are replaced
+ *        by a checkerboard so a missing file never stops a scene
+ */
+class Texture_Cache
+{
+public:
+  Texture_Cache(
+    Device* device,
+    VmaAllocator allocator,
+    Cmd* cmd,
+    vklayout::Sampler_Cache* samplers
+  );
+  ~Texture_Cache();
+
+  Texture_Cache (const Texture_Cache&) = delete;
+  Texture_Cache& operator= (const Texture_Cache&) = delete;
+
+  Texture* load(const std::string& path, const Texture_Options& options = {});
+  Texture* add(const std::string& name, const vktexture::Texture_Data& data);
+  Texture* default_texture() const { return _default; }
+  VkDescriptorImageInfo descriptor(const Texture* texture) const;
+  Image* upload(const vktexture::Texture_Data& data, bool generate_mips, Submit_Token* ready);
+  Image* shrink(const Image* source, uint32_t first_level, Submit_Token* ready);
+
+  Texture_Stats stats();
+  void report();
+
+private:
+  Device*                  _device;
+  VmaAllocator             _allocator;
+  Cmd*                     _cmd;
+  vklayout::Sampler_Cache* _samplers;
+
+  // textures may be requested from worker threads, the lock is only held
+  // to look them up, loads run outside it and concurrent requests for the
+  // same path wait on the one in flight
+  std::mutex                                                    _mutex;
+  std::unordered_map<std::string, Texture*>                     _textures;
+  std::unordered_map<std::string, std::shared_future<Texture*>> _loading;
+  Texture*                                                      _default = nullptr;
+  Texture_Stats                                                 _stats;
+
+  Texture* get_or_create(const std::string& key, const std::function<Texture*()>& make);
+  Texture* load_uncached(const std::string& path, const Texture_Options& options);
+
+  std::string resolve(const std::string& path, const Texture_Options& options);
+  bool format_supported(VkFormat format, VkFormatFeatureFlags features) const;
+  Texture* create(const vktexture::Texture_Data& data, bool generate_mips, const std::string& path);
+  VkSampler create_sampler(uint32_t mip_levels);
+};
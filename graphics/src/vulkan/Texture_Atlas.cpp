@@ -0,0 +1,48 @@
+#include "Texture_Atlas.h"
+
+/**
+ * @brief Loads an atlas packed offline with vkatlas::pack_directory
+ */
+bool Texture_Atlas::load(const std::string& path) {
+  vkatlas::Atlas_Data atlas;
+  if (!vkatlas::read_atlas(path, &atlas)) {
+    return false;
+  }
+  upload(atlas, path);
+  return true;
+}
+
+/**
+ * @brief Packs the images queued on a builder at runtime
+ * @param name the atlas is registered in the texture cache under
+ */
+bool Texture_Atlas::build(vkatlas::Atlas_Builder& builder, const std::string& name) {
+  vkatlas::Atlas_Data atlas;
+  if (!builder.build(&atlas)) {
+    return false;
+  }
+  upload(atlas, name);
+  return true;
+}
+
+/**
+ * @brief Rect of a packed image, invalid when no image has the name
+ */
+Atlas_Region Texture_Atlas::region(const std::string& name) const {
+  Atlas_Region region;
+  auto found = _rects.find(name);
+  if (found != _rects.end()) {
+    region.texture = _texture;
+    region.rect = found->second;
+  }
+  return region;
+}
+
+void Texture_Atlas::upload(const vkatlas::Atlas_Data& atlas, const std::string& name) {
+  _texture = _textures->add(name, atlas.texture);
+  _layers = atlas.texture.layers;
+  _rects.clear();
+  for (size_t i = 0; i < atlas.names.size(); i++) {
+    _rects[atlas.names[i]] = atlas.rects[i];
+  }
+}
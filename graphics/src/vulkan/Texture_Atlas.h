@@ -0,0 +1,46 @@
+#pragma once
+
+#include "../vulkan_util/vk_types.h"
+#include "../vulkan_util/vk_atlas.h"
+#include "Texture.h"
+
+#include <unordered_map>
+
+/**
+ * @brief Handle to an image packed into an atlas, draws bind the atlas
+ *        texture and move their UVs into the image's rect
+ */
+struct Atlas_Region {
+  Texture*            texture = nullptr;
+  vkatlas::Atlas_Rect rect;
+
+  bool valid() const { return texture != nullptr; }
+};
+
+/**
+ * @brief Many small images uploaded as one texture, a 2D texture when
+ *        they fit in one layer and a 2D array otherwise. The texture is
+ *        owned by the texture cache
+ */
+class Texture_Atlas
+{
+public:
+  Texture_Atlas(Texture_Cache* textures) : _textures(textures) {}
+
+  bool load(const std::string& path);
+  bool build(vkatlas::Atlas_Builder& builder, const std::string& name);
+
+  Atlas_Region region(const std::string& name) const;
+  Texture* texture() const { return _texture; }
+  size_t image_count() const { return _rects.size(); }
+  uint32_t layer_count() const { return _layers; }
+  const std::unordered_map<std::string, vkatlas::Atlas_Rect>& rects() const { return _rects; }
+
+private:
+  Texture_Cache*                                       _textures;
+  Texture*                                             _texture = nullptr;
+  uint32_t                                             _layers = 0;
+  std::unordered_map<std::string, vkatlas::Atlas_Rect> _rects;
+
+  void upload(const vkatlas::Atlas_Data& atlas, const std::string& name);
+};
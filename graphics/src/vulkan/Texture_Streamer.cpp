@@ -0,0 +1,295 @@
+#include "Texture_Streamer.h"
+#include "Cmd.h"
+
+#include <cmath>
+
+// loads allowed in flight at once, each one reads a whole file. Dropped
+// levels are copied on the GPU and do not count against it
+constexpr uint32_t MAX_PENDING_LOADS = 4;
+
+Texture_Streamer::Texture_Streamer(
+  Texture_Cache* textures,
+  Cmd* cmd,
+  Deletion_Queue* deletion_queue,
+  Thread_Pool* workers,
+  VkDeviceSize budget
+) : _textures(textures), _cmd(cmd), _deletion_queue(deletion_queue), _workers(workers) {
+  _stats.budget = budget;
+}
+
+/**
+ * @brief Waits for the loads still running, their images were never
+ *        swapped in and are destroyed here
+ */
+Texture_Streamer::~Texture_Streamer() {
+  _workers->wait_idle();
+  for (auto& result : _results) {
+    if (result.image != nullptr) {
+      _cmd->wait(result.ready);
+      delete result.image;
+    }
+  }
+}
+
+/**
+ * @brief Starts streaming a texture, textures that were not loaded for
+ *        streaming are fully resident and ignored
+ */
+void Texture_Streamer::add(Texture* texture) {
+  if (!texture->streamed || _states.count(texture) != 0) {
+    return;
+  }
+
+  Stream_State state;
+  state.texture = texture;
+  state.target_mip = texture->resident_mip;
+  state.floor_mip = texture->resident_mip;
+  state.wanted_mip = texture->resident_mip;
+  state.last_needed.resize(texture->mip_levels, 0);
+  _states[texture] = state;
+
+  _stats.textures++;
+  _stats.committed_bytes += chain_bytes(texture, state.target_mip);
+}
+
+/**
+ * @brief Records the level a texture is sampled at on screen, the finest
+ *        level requested within a frame wins
+ * @param mip level of the full chain, fractions are rounded down
+ */
+void Texture_Streamer::request(Texture* texture, float mip, uint64_t frame) {
+  auto found = _states.find(texture);
+  if (found == _states.end()) {
+    return;
+  }
+  Stream_State& state = found->second;
+
+  uint32_t level = static_cast<uint32_t>(std::clamp(std::floor(mip), 0.f, float(texture->mip_levels - 1)));
+  if (state.wanted_frame != frame || level < state.wanted_mip) {
+    state.wanted_mip = level;
+    state.wanted_frame = frame;
+  }
+  for (uint32_t i = level; i < texture->mip_levels; i++) {
+    state.last_needed[i] = frame;
+  }
+}
+
+/**
+ * @brief Swaps in the images that finished uploading, then starts loading
+ *        the next level of the textures furthest from what they are drawn
+ *        at and drops levels that are no longer needed to make room
+ * @param last_used_value frame timeline value of the last submitted frame,
+ *        replaced images are kept until it completes
+ */
+void Texture_Streamer::update(uint64_t frame, uint64_t last_used_value) {
+  apply_results(last_used_value);
+
+  // textures missing the most levels go first
+  std::vector<Stream_State*> wanting;
+  for (auto& entry : _states) {
+    Stream_State& state = entry.second;
+    if (state.wanted_frame == frame && state.wanted_mip < state.target_mip && !state.loading && !state.failed) {
+      wanting.push_back(&state);
+    }
+  }
+  std::sort(wanting.begin(), wanting.end(), [](const Stream_State* a, const Stream_State* b) {
+    return a->target_mip - a->wanted_mip > b->target_mip - b->wanted_mip;
+  });
+
+  for (auto state : wanting) {
+    if (_stats.pending >= MAX_PENDING_LOADS) {
+      break;
+    }
+    // one level at a time, the texture sharpens as each arrives
+    uint32_t target = state->target_mip - 1;
+    VkDeviceSize extra = chain_bytes(state->texture, target) - chain_bytes(state->texture, state->target_mip);
+    if (!make_room(extra, frame, state)) {
+      _stats.over_budget++;
+      continue;
+    }
+    _stats.committed_bytes += extra;
+    schedule(state, target);
+    _stats.streamed_in++;
+  }
+
+  // a lowered budget is met by dropping levels as well
+  while (budgeted_bytes() > _stats.budget) {
+    if (!evict_one(frame, nullptr)) {
+      break;
+    }
+  }
+}
+
+void Texture_Streamer::report() {
+  fmt::println(
+    "texture streaming: {} textures, {} levels streamed in, {} evicted, {} over budget, {} failed, {:.2f} of {:.2f} MiB",
+    _stats.textures,
+    _stats.streamed_in,
+    _stats.evicted,
+    _stats.over_budget,
+    _stats.failed,
+    _stats.committed_bytes / (1024.0 * 1024.0),
+    _stats.budget / (1024.0 * 1024.0)
+  );
+}
+
+/**
+ * @brief Replaces the images of textures whose new levels have finished
+ *        uploading, frames recorded from now on sample the new image
+ */
+void Texture_Streamer::apply_results(uint64_t last_used_value) {
+  std::vector<Stream_Result> finished;
+  {
+    std::lock_guard<std::mutex> lock(_results_mutex);
+    size_t kept = 0;
+    for (size_t i = 0; i < _results.size(); i++) {
+      if (_results[i].image == nullptr || _cmd->is_complete(_results[i].ready)) {
+        finished.push_back(_results[i]);
+      }
+      else {
+        _results[kept++] = _results[i];
+      }
+    }
+    _results.resize(kept);
+  }
+
+  for (auto& result : finished) {
+    Stream_State& state = _states[result.texture];
+    Texture* texture = result.texture;
+    state.loading = false;
+    if (result.released > 0) {
+      // the old image is destroyed once the last frame sampling it completes
+      _stats.releasing_bytes -= result.released;
+      _stats.committed_bytes -= result.released;
+    }
+    else {
+      _stats.pending--;
+    }
+
+    if (result.image == nullptr) {
+      // the source could not be read again, it keeps the levels it has
+      _stats.committed_bytes -= chain_bytes(texture, state.target_mip);
+      _stats.committed_bytes += chain_bytes(texture, texture->resident_mip);
+      state.target_mip = texture->resident_mip;
+      state.failed = true;
+      _stats.failed++;
+      continue;
+    }
+
+    texture->image->replace(result.image, _deletion_queue, last_used_value);
+    delete result.image;
+    texture->resident_mip = result.resident_mip;
+    texture->bytes = chain_bytes(texture, result.resident_mip);
+  }
+}
+
+/**
+ * @brief Evicts least recently needed levels of other textures until the
+ *        given number of bytes fits in the budget
+ * @param keep texture the room is made for, never evicted from
+ */
+bool Texture_Streamer::make_room(VkDeviceSize bytes, uint64_t frame, const Stream_State* keep) {
+  while (budgeted_bytes() + bytes > _stats.budget) {
+    if (!evict_one(frame, keep)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Drops the finest level of the texture whose finest level has gone
+ *        the longest without being needed, levels needed this frame stay
+ */
+bool Texture_Streamer::evict_one(uint64_t frame, const Stream_State* keep) {
+  Stream_State* oldest = nullptr;
+  for (auto& entry : _states) {
+    Stream_State& state = entry.second;
+    if (&state == keep || state.loading || state.target_mip >= state.floor_mip) {
+      continue;
+    }
+    uint64_t needed = state.last_needed[state.target_mip];
+    if (needed == frame) {
+      continue;
+    }
+    if (oldest == nullptr || needed < oldest->last_needed[oldest->target_mip]) {
+      oldest = &state;
+    }
+  }
+  if (oldest == nullptr) {
+    return false;
+  }
+
+  drop_levels(oldest, oldest->target_mip + 1);
+  _stats.evicted++;
+  return true;
+}
+
+/**
+ * @brief Copies the levels from target_mip down out of the current image
+ *        into a smaller one. The dropped bytes stay committed until the
+ *        copy is swapped in, the old image is resident until then
+ */
+void Texture_Streamer::drop_levels(Stream_State* state, uint32_t target_mip) {
+  Texture* texture = state->texture;
+  VkDeviceSize released = chain_bytes(texture, state->target_mip) - chain_bytes(texture, target_mip);
+  state->target_mip = target_mip;
+  state->loading = true;
+  _stats.releasing_bytes += released;
+
+  Stream_Result result = { texture, nullptr, target_mip, {}, released };
+  result.image = _textures->shrink(texture->image, target_mip - texture->resident_mip, &result.ready);
+
+  std::lock_guard<std::mutex> lock(_results_mutex);
+  _results.push_back(result);
+}
+
+/**
+ * @brief Reads the source of a texture on a worker and uploads the levels
+ *        from target_mip down into a new image
+ */
+void Texture_Streamer::schedule(Stream_State* state, uint32_t target_mip) {
+  state->target_mip = target_mip;
+  state->loading = true;
+  _stats.pending++;
+
+  Texture* texture = state->texture;
+  std::string path = texture->path;
+  bool srgb = texture->srgb;
+  uint32_t mip_levels = texture->mip_levels;
+
+  _workers->enqueue([this, texture, path, srgb, mip_levels, target_mip]() {
+    Stream_Result result = { texture, nullptr, target_mip, {} };
+
+    vktexture::Texture_Data data;
+    if (!vktexture::load(path, srgb, &data)) {
+      fmt::println("failed to stream {}", path);
+    }
+    else if (data.levels.size() == 1) {
+      vktexture::build_mips(&data);
+    }
+
+    if (data.levels.size() == mip_levels) {
+      result.image = _textures->upload(vktexture::tail(data, target_mip), false, &result.ready);
+    }
+    else if (!data.levels.empty()) {
+      fmt::println("{} changed on disk while streaming", path);
+    }
+
+    std::lock_guard<std::mutex> lock(_results_mutex);
+    _results.push_back(result);
+  });
+}
+
+VkDeviceSize Texture_Streamer::chain_bytes(const Texture* texture, uint32_t first_mip) {
+  VkDeviceSize bytes = 0;
+  for (uint32_t level = first_mip; level < texture->mip_levels; level++) {
+    VkExtent3D extent = {
+      std::max(1u, texture->extent.width >> level),
+      std::max(1u, texture->extent.height >> level),
+      1
+    };
+    bytes += vktexture::level_size(texture->format, extent);
+  }
+  return bytes;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "../vulkan_util/vk_types.h"
+#include "../engine/Thread_Pool.h"
+#include "Texture.h"
+#include "Deletion_Queue.h"
+
+#include <unordered_map>
+
+struct Streaming_Stats {
+  uint32_t     textures = 0;
+  uint32_t     pending = 0;
+  // levels brought in and dropped since the start
+  uint32_t     streamed_in = 0;
+  uint32_t     evicted = 0;
+  // requests left waiting because the budget had no room for them
+  uint32_t     over_budget = 0;
+  uint32_t     failed = 0;
+  // bytes of every streamed texture at the levels it has or is loading
+  VkDeviceSize committed_bytes = 0;
+  // part of committed_bytes held by dropped levels until their image is swapped
+  VkDeviceSize releasing_bytes = 0;
+  VkDeviceSize budget = 0;
+};
+
+/**
+ * @brief Streams the mips of textures loaded with Texture_Options::stream.
+ *        Culling requests the finest level each texture is seen at, the
+ *        levels are read and uploaded on worker threads one at a time and
+ *        the least recently needed levels are dropped to stay in budget,
+ *        by copying the levels kept into a smaller image on the GPU.
+ *        A texture changing its levels gets a new image, the old one is
+ *        retired once the frames drawing with it have finished
+ */
+class Texture_Streamer
+{
+public:
+  Texture_Streamer(
+    Texture_Cache* textures,
+    Cmd* cmd,
+    Deletion_Queue* deletion_queue,
+    Thread_Pool* workers,
+    VkDeviceSize budget
+  );
+  ~Texture_Streamer();
+
+  Texture_Streamer (const Texture_Streamer&) = delete;
+  Texture_Streamer& operator= (const Texture_Streamer&) = delete;
+
+  void add(Texture* texture);
+  void request(Texture* texture, float mip, uint64_t frame);
+  void update(uint64_t frame, uint64_t last_used_value);
+
+  void set_budget(VkDeviceSize budget) { _stats.budget = budget; }
+  const Streaming_Stats& stats() const { return _stats; }
+  void report();
+
+private:
+  // levels requested by culling, only touched by the render thread
+  struct Stream_State {
+    Texture*              texture;
+    // first level that is resident or being loaded
+    uint32_t              target_mip;
+    // levels from STREAM_RESIDENT_SIZE down are never evicted
+    uint32_t              floor_mip;
+    uint32_t              wanted_mip;
+    uint64_t              wanted_frame = 0;
+    // frame each level was last needed in
+    std::vector<uint64_t> last_needed;
+    bool                  loading = false;
+    bool                  failed = false;
+  };
+
+  // an image finished on a worker or copied on the GPU, swapped in once
+  // its upload or copy completes
+  struct Stream_Result {
+    Texture*     texture;
+    Image*       image;
+    uint32_t     resident_mip;
+    Submit_Token ready;
+    // bytes of the levels dropped, freed from the budget at the swap
+    VkDeviceSize released = 0;
+  };
+
+  Texture_Cache*  _textures;
+  Cmd*            _cmd;
+  Deletion_Queue* _deletion_queue;
+  Thread_Pool*    _workers;
+
+  std::unordered_map<Texture*, Stream_State> _states;
+  Streaming_Stats                            _stats;
+
+  std::mutex                 _results_mutex;
+  std::vector<Stream_Result> _results;
+
+  void apply_results(uint64_t last_used_value);
+  bool make_room(VkDeviceSize bytes, uint64_t frame, const Stream_State* keep);
+  bool evict_one(uint64_t frame, const Stream_State* keep);
+  void schedule(Stream_State* state, uint32_t target_mip);
+  void drop_levels(Stream_State* state, uint32_t target_mip);
+  VkDeviceSize budgeted_bytes() const { return _stats.committed_bytes - _stats.releasing_bytes; }
+  static VkDeviceSize chain_bytes(const Texture* texture, uint32_t first_mip);
+};
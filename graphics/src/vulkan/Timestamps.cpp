@@ -0,0 +1,61 @@
+#include "Timestamps.h"
+
+Timestamps::Timestamps(Device* device, uint32_t frame_count, uint32_t queries_per_frame) 
+: _logical(device->_logical), _period(device->_timestamp_period), _queries_per_frame(queries_per_frame) {
+  VkQueryPoolCreateInfo pool_info{};
+  pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+  pool_info.pNext = nullptr;
+  pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+  pool_info.queryCount = frame_count * queries_per_frame;
+
+  VK_CHECK(vkCreateQueryPool(_logical, &pool_info, nullptr, &_pool));
+  _written.resize(pool_info.queryCount, false);
+}
+
+Timestamps::~Timestamps() {
+  vkDestroyQueryPool(_logical, _pool, nullptr);
+}
+
+void Timestamps::reset(VkCommandBuffer cmd, uint32_t frame, uint32_t first, uint32_t count) {
+  vkCmdResetQueryPool(cmd, _pool, frame * _queries_per_frame + first, count);
+}
+
+void Timestamps::write(VkCommandBuffer cmd, uint32_t frame, uint32_t query, VkPipelineStageFlagBits stage) {
+  uint32_t index = frame * _queries_per_frame + query;
+  vkCmdWriteTimestamp(cmd, stage, _pool, index);
+  _written[index] = true;
+}
+
+/**
+ * @brief Reads timestamps of a completed frame without waiting
+ * @param ms_values receives the timestamps converted to milliseconds
+ * @return false if any of the queries is not available
+ */
+bool Timestamps::read(uint32_t frame, uint32_t first, uint32_t count, double* ms_values) {
+  uint32_t index = frame * _queries_per_frame + first;
+  for (uint32_t i = 0; i < count; i++) {
+    if (!_written[index + i]) {
+      return false;
+    }
+  }
+
+  std::vector<uint64_t> ticks(count);
+  VkResult result = vkGetQueryPoolResults(
+    _logical,
+    _pool,
+    index,
+    count,
+    count * sizeof(uint64_t),
+    ticks.data(),
+    sizeof(uint64_t),
+    VK_QUERY_RESULT_64_BIT
+  );
+  if (result != VK_SUCCESS) {
+    return false;
+  }
+
+  for (uint32_t i = 0; i < count; i++) {
+    ms_values[i] = static_cast<double>(ticks[i]) * _period / 1000000.0;
+  }
+  return true;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "../vulkan_util/vk_types.h"
+#include "device.h"
+
+/**
+ * @brief Timestamp query pool split into one range of queries per frame 
+ *        in flight, results are read back once the frame has completed
+ */
+class Timestamps
+{
+public:
+  Timestamps(Device* device, uint32_t frame_count, uint32_t queries_per_frame);
+  ~Timestamps();
+
+  Timestamps (const Timestamps&) = delete;
+  Timestamps& operator= (const Timestamps&) = delete;
+
+  void reset(VkCommandBuffer cmd, uint32_t frame, uint32_t first, uint32_t count);
+  void write(VkCommandBuffer cmd, uint32_t frame, uint32_t query, VkPipelineStageFlagBits stage);
+  bool read(uint32_t frame, uint32_t first, uint32_t count, double* ms_values);
+
+private:
+  VkDevice    _logical;
+  VkQueryPool _pool;
+  float       _period;
+  uint32_t    _queries_per_frame;
+
+  // queries are only read after they have been written at least once
+  std::vector<bool> _written;
+};
@@ -0,0 +1,105 @@
+#include "Uniform_Ring.h"
+
+#include <cstring>
+
+Uniform_Ring::Uniform_Ring(Device* device, VmaAllocator allocator, VkDeviceSize frame_size, uint32_t frame_count) 
+: _allocator(allocator), _frame_count(frame_count), _alignment(std::max<VkDeviceSize>(device->_min_uniform_alignment, 1)) {
+  create_buffer(frame_size);
+}
+
+Uniform_Ring::~Uniform_Ring() {
+  vmaDestroyBuffer(_allocator, _buffer, _allocation);
+}
+
+void Uniform_Ring::create_buffer(VkDeviceSize frame_size) {
+  // every region starts at an offset the device can bind
+  _frame_size = block_size(frame_size);
+
+  VkBufferCreateInfo buffer_info {};
+  buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  buffer_info.size = _frame_size * _frame_count;
+  buffer_info.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+
+  // written by the CPU every frame and read once by the GPU
+  VmaAllocationCreateInfo alloc_info {};
+  alloc_info.usage = VMA_MEMORY_USAGE_CPU_TO_GPU;
+  alloc_info.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+  VmaAllocationInfo allocation_info;
+  VK_CHECK(vmaCreateBuffer(_allocator, &buffer_info, &alloc_info, &_buffer, &_allocation, &allocation_info));
+  _mapped = static_cast<uint8_t*>(allocation_info.pMappedData);
+}
+
+/**
+ * @brief Grows the regions before a frame that could write more than they
+ *        hold, called before begin_frame. The old buffer is retired since
+ *        frames in flight still read it
+ * @param frame_bytes most the coming frame may write, blocks counted with block_size
+ * @return true when the buffer was replaced, descriptors must point at the new one
+ */
+bool Uniform_Ring::reserve(VkDeviceSize frame_bytes, Deletion_Queue* deletion_queue, uint64_t last_used_value) {
+  if (frame_bytes <= _frame_size) {
+    return false;
+  }
+
+  deletion_queue->retire_buffer(_buffer, _allocation, last_used_value);
+  // doubling keeps the count of replaced buffers low while the scene grows
+  create_buffer(std::max(frame_bytes, _frame_size * 2));
+  _stats.grows++;
+  fmt::println("uniform ring grown to {} KiB per frame", _frame_size / 1024);
+  return true;
+}
+
+/**
+ * @brief Starts writing into the region of a frame, the frame that used
+ *        it before must have completed on the GPU
+ */
+void Uniform_Ring::begin_frame(uint32_t frame_index) {
+  VkDeviceSize used = _head.load(std::memory_order_relaxed);
+  _stats.writes = _writes.exchange(0, std::memory_order_relaxed);
+  _stats.bytes = used;
+  _stats.peak_bytes = std::max(_stats.peak_bytes, used);
+
+  _frame_begin = frame_index * _frame_size;
+  _head.store(0, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Copies a block into the current frame's region without taking
+ *        a lock, any thread recording the frame may write
+ * @return offset of the block in the buffer, used as its dynamic offset
+ */
+uint32_t Uniform_Ring::write(const void* data, VkDeviceSize size) {
+  VkDeviceSize aligned = (size + _alignment - 1) & ~(_alignment - 1);
+  VkDeviceSize offset = _head.fetch_add(aligned, std::memory_order_relaxed);
+  if (offset + aligned > _frame_size) {
+    throw std::runtime_error("uniform ring is full, reserve was not called with the frame's writes");
+  }
+
+  memcpy(_mapped + _frame_begin + offset, data, size);
+  _writes.fetch_add(1, std::memory_order_relaxed);
+  return static_cast<uint32_t>(_frame_begin + offset);
+}
+
+/**
+ * @brief Makes the writes of the current frame visible to the device, 
+ *        does nothing on host coherent memory
+ */
+void Uniform_Ring::flush() {
+  VkDeviceSize used = std::min(_head.load(std::memory_order_relaxed), _frame_size);
+  if (used > 0) {
+    VK_CHECK(vmaFlushAllocation(_allocator, _allocation, _frame_begin, used));
+  }
+}
+
+/**
+ * @brief Buffer info for a dynamic uniform descriptor, the range is the
+ *        size of the block bound at each dynamic offset
+ */
+VkDescriptorBufferInfo Uniform_Ring::descriptor(VkDeviceSize range) const {
+  VkDescriptorBufferInfo info{};
+  info.buffer = _buffer;
+  info.offset = 0;
+  info.range = range;
+  return info;
+}
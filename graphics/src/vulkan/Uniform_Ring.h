@@ -0,0 +1,61 @@
+#pragma once
+
+#include "../vulkan_util/vk_types.h"
+#include "device.h"
+#include "Deletion_Queue.h"
+
+// uniform data written during the last recorded frame
+struct Uniform_Ring_Stats {
+  uint32_t     writes     = 0;
+  VkDeviceSize bytes      = 0;
+  VkDeviceSize peak_bytes = 0;
+  uint32_t     grows      = 0;
+};
+
+/**
+ * @brief Persistently mapped uniform buffer split into one region per frame
+ *        in flight. Writes bump an atomic head within the current frame's
+ *        region and return the offset to bind it at as a dynamic offset,
+ *        so the buffer and the descriptor sets pointing at it only change
+ *        when a frame needs more room than the regions have
+ */
+class Uniform_Ring
+{
+public:
+  Uniform_Ring(Device* device, VmaAllocator allocator, VkDeviceSize frame_size, uint32_t frame_count);
+  ~Uniform_Ring();
+
+  Uniform_Ring (const Uniform_Ring&) = delete;
+  Uniform_Ring& operator= (const Uniform_Ring&) = delete;
+
+  bool reserve(VkDeviceSize frame_bytes, Deletion_Queue* deletion_queue, uint64_t last_used_value);
+  void begin_frame(uint32_t frame_index);
+  uint32_t write(const void* data, VkDeviceSize size);
+  template<typename T>
+  uint32_t write(const T& value) { return write(&value, sizeof(T)); }
+  void flush();
+
+  // bytes a block of the given size takes in the ring
+  VkDeviceSize block_size(VkDeviceSize size) const { return (size + _alignment - 1) & ~(_alignment - 1); }
+
+  VkDescriptorBufferInfo descriptor(VkDeviceSize range) const;
+  const Uniform_Ring_Stats& stats() const { return _stats; }
+
+private:
+  VmaAllocator  _allocator;
+  VkBuffer      _buffer;
+  VmaAllocation _allocation;
+  uint8_t*      _mapped;
+
+  VkDeviceSize _frame_size;
+  uint32_t     _frame_count;
+  VkDeviceSize _alignment;
+  VkDeviceSize _frame_begin = 0;
+
+  // bytes used in the current frame's region
+  std::atomic<VkDeviceSize> _head{0};
+  std::atomic<uint32_t>     _writes{0};
+  Uniform_Ring_Stats        _stats;
+
+  void create_buffer(VkDeviceSize frame_size);
+};
@@ -7,6 +7,12 @@ vk_interface::~vk_interface() {
     }
     delete _cmd;
     delete _swapchain;
+    // the device is idle, so everything still retired can be destroyed
+    delete _deletion_queue;
+    _pipeline_cache->save();
+    delete _pipeline_cache;
+    delete _layout_cache;
+    delete _sampler_cache;
     vmaDestroyAllocator(_allocator);
     delete _device;
     vkDestroySurfaceKHR(_instance, _surface, nullptr);
@@ -68,34 +74,39 @@ void vk_interface::create_surface() {
   }
 }
 
-uint32_t vk_interface::get_next_image() {
-  uint32_t swapchain_image_index;
-  VK_CHECK(vkAcquireNextImageKHR(
+/**
+ * @brief Acquires the next image from the swapchain
+ * @param swapchain_image_index receives the index of the acquired image
+ * @return false if the swapchain is out of date and must be recreated
+ */
+bool vk_interface::get_next_image(uint32_t* swapchain_image_index) {
+  VkResult result = vkAcquireNextImageKHR(
     _device->_logical, 
     _swapchain->_handle,
     1000000000,
     _cmd->get_current_frame()._swapchain_semaphore,
     nullptr, 
-    &swapchain_image_index
-  ));
-  return swapchain_image_index;
+    swapchain_image_index
+  );
+
+  // a suboptimal image is still signaled and can be rendered to
+  if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+    return false;
+  }
+  if (result != VK_SUBOPTIMAL_KHR) {
+    VK_CHECK(result);
+  }
+  return true;
 }
 
-void vk_interface::draw_background(
-  VkRenderPassBeginInfo* renderpass_info, 
-  VkExtent2D _window_extent,
-  uint32_t swapchain_image_index
-) {
-  VkClearValue clear_value;
-  clear_value.color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
-  VkClearValue depth_clear;
-  depth_clear.depthStencil.depth = 1.f;
-
-  _swapchain->renderpass_begin_info(renderpass_info, _window_extent, swapchain_image_index);
-  renderpass_info->clearValueCount = 2;
-  clear_values[0] = clear_value;
-  clear_values[1] = depth_clear;
-  renderpass_info->pClearValues = &clear_values[0];
+/**
+ * @brief Recreates the swapchain without waiting on the device, the old
+ *        handles are destroyed once the last submitted frame completes
+ * @return true when the surface format changed and the default render 
+ *         pass was replaced
+ */
+bool vk_interface::recreate_swapchain() {
+  return _swapchain->recreate(_deletion_queue, _cmd->submitted_value());
 }
 
 /**
@@ -5,7 +5,9 @@
 #include "device.h"
 #include "swapchain.h"
 #include "pipeline.h"
+#include "Pipeline_Cache.h"
 #include "cmd.h"
+#include "Deletion_Queue.h"
 
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_vulkan.h>
@@ -63,6 +65,14 @@ class vk_interface {
     Swapchain*   _swapchain;
     Cmd*         _cmd;
     VmaAllocator _allocator;
+    // retired handles are freed here once the frames using them complete
+    Deletion_Queue* _deletion_queue;
+    // persisted between runs so pipelines are not recompiled on every launch
+    Pipeline_Cache* _pipeline_cache;
+    // pipeline and descriptor set layouts shared between pipelines
+    vklayout::Layout_Cache* _layout_cache;
+    // samplers shared by every texture using the same state
+    vklayout::Sampler_Cache* _sampler_cache;
     
     vk_interface(SDL_Window* window) : _window(window) {};
     ~vk_interface();
@@ -70,7 +80,7 @@ class vk_interface {
     vk_interface (const vk_interface&) = delete;
     vk_interface& operator= (const vk_interface&) = delete;
 
-    void init(VkExtent2D _window_extent) {
+    void init(uint32_t frame_overlap, VkPresentModeKHR present_mode) {
       init_instance();
 
       if (ENABLE_VALIDATION_LAYERS) {
@@ -82,23 +92,23 @@ class vk_interface {
       _device = new Device(_instance, _surface);
 
       init_allocator();
+      _pipeline_cache = new Pipeline_Cache(_device, "pipeline_cache.bin");
+      _layout_cache = new vklayout::Layout_Cache(_device->_logical);
+      _sampler_cache = new vklayout::Sampler_Cache(_device->_logical);
+      _deletion_queue = new Deletion_Queue(_device->_logical, _allocator);
 
       _swapchain = new Swapchain(_instance, _device, _surface, _window, _allocator);
-      _swapchain->init(_window_extent);
+      _swapchain->preferred_present_mode = present_mode;
+      _swapchain->init();
 
-      _cmd = new Cmd(_device);
+      _cmd = new Cmd(_device, _deletion_queue, frame_overlap);
       _cmd->init_commands();
 
       _initialized = true;
     }
 
-    uint32_t get_next_image();
-
-    void draw_background(
-      VkRenderPassBeginInfo* renderpass_info, 
-      VkExtent2D _window_extent,
-      uint32_t swapchain_image_index
-    );
+    bool get_next_image(uint32_t* swapchain_image_index);
+    bool recreate_swapchain();
 
   private:
     bool _initialized = false;
@@ -108,8 +118,6 @@ class vk_interface {
     SDL_Window*   _window;
     VkSurfaceKHR  _surface;
 
-    VkClearValue clear_values[2];
-
     static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
       VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
       VkDebugUtilsMessageTypeFlagsEXT messageType,
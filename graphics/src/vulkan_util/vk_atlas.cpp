@@ -0,0 +1,379 @@
+#include "vk_atlas.h"
+
+#include <cctype>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+// ImGui compiles its copy of the packer statically, this one is private to the atlas builder
+#define STBRP_STATIC
+#define STB_RECT_PACK_IMPLEMENTATION
+#include "../imgui/imstb_rectpack.h"
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+namespace vkatlas
+{
+
+static uint32_t next_power_of_two(uint32_t value) {
+  uint32_t result = 1;
+  while (result < value) {
+    result <<= 1;
+  }
+  return result;
+}
+
+static uint32_t log2_floor(uint32_t value) {
+  uint32_t result = 0;
+  while (value > 1) {
+    value >>= 1;
+    result++;
+  }
+  return result;
+}
+
+static Atlas_Rect make_rect(uint32_t layer, uint32_t x, uint32_t y, uint32_t width, uint32_t height, VkExtent3D extent) {
+  Atlas_Rect rect;
+  rect.layer = layer;
+  rect.x = x;
+  rect.y = y;
+  rect.width = width;
+  rect.height = height;
+  rect.uv_offset = { float(x) / extent.width, float(y) / extent.height };
+  rect.uv_scale = { float(width) / extent.width, float(height) / extent.height };
+  return rect;
+}
+
+/**
+ * @brief Appends a layer to an array texture, keeping the given number
+ *        of its mips, the layer's mips are built when it has none
+ */
+static void append_layer(vktexture::Texture_Data* texture, vktexture::Texture_Data& layer, uint32_t mips) {
+  if (mips > 1) {
+    vktexture::build_mips(&layer);
+  }
+  for (uint32_t level = 0; level < mips; level++) {
+    vktexture::Texture_Level mip = layer.levels[level];
+    const uint8_t* src = layer.bytes.data() + mip.offset;
+    mip.offset = texture->bytes.size();
+    texture->bytes.insert(texture->bytes.end(), src, src + mip.size);
+    texture->levels.push_back(mip);
+  }
+}
+
+/**
+ * @brief Moves a UV of the packed image into the atlas, UVs outside
+ *        [0, 1] would sample the neighbours and are clamped
+ */
+glm::vec2 Atlas_Rect::remap(glm::vec2 uv) const {
+  return uv_offset + glm::clamp(uv, glm::vec2(0.f), glm::vec2(1.f)) * uv_scale;
+}
+
+Atlas_Builder::Atlas_Builder(const Atlas_Options& options) : _options(options) {}
+
+/**
+ * @brief Queues an image for packing, only the largest level is used
+ * @return false for images that are not RGBA8 or do not fit in a layer
+ */
+bool Atlas_Builder::add(const std::string& name, const vktexture::Texture_Data& image) {
+  if (image.format != VK_FORMAT_R8G8B8A8_SRGB && image.format != VK_FORMAT_R8G8B8A8_UNORM) {
+    fmt::println("{} cannot be packed, atlases hold RGBA8 images", name);
+    return false;
+  }
+  uint32_t padded_width = image.extent.width + _options.padding * 2;
+  uint32_t padded_height = image.extent.height + _options.padding * 2;
+  if (padded_width > _options.size || padded_height > _options.size) {
+    fmt::println("{} is too large for a {}x{} atlas", name, _options.size, _options.size);
+    return false;
+  }
+
+  Pending_Image pending;
+  pending.name = name;
+  pending.extent = image.extent;
+  const vktexture::Texture_Level& level = image.levels[0];
+  pending.texels.assign(image.bytes.begin() + level.offset, image.bytes.begin() + level.offset + level.size);
+  _images.push_back(std::move(pending));
+  return true;
+}
+
+bool Atlas_Builder::add_file(const std::string& name, const std::string& path) {
+  vktexture::Texture_Data image;
+  if (!vktexture::load_image(path, _options.srgb, &image)) {
+    return false;
+  }
+  return add(name, image);
+}
+
+/**
+ * @brief Packs every queued image, layers are added until all of them fit.
+ *        Images are placed on a grid of the largest power of two within the
+ *        padding, so the mips that stay inside the padding never mix two
+ *        images in one texel. A single layer shrinks to the power of two
+ *        around what was packed
+ */
+bool Atlas_Builder::build(Atlas_Data* atlas) {
+  if (_images.empty()) {
+    return false;
+  }
+
+  uint32_t padding = _options.padding;
+  uint32_t align = padding > 0 ? 1u << log2_floor(padding) : 1u;
+  int cells = static_cast<int>(_options.size / align);
+
+  std::vector<stbrp_rect> remaining(_images.size());
+  for (size_t i = 0; i < _images.size(); i++) {
+    remaining[i].id = static_cast<int>(i);
+    remaining[i].w = static_cast<stbrp_coord>((_images[i].extent.width + padding * 2 + align - 1) / align);
+    remaining[i].h = static_cast<stbrp_coord>((_images[i].extent.height + padding * 2 + align - 1) / align);
+  }
+
+  std::vector<stbrp_rect> placed(_images.size());
+  std::vector<uint32_t> layer_of(_images.size(), 0);
+  std::vector<stbrp_node> nodes(cells);
+  uint32_t layers = 0;
+  while (!remaining.empty()) {
+    if (layers == _options.max_layers) {
+      fmt::println("{} images did not fit in {} atlas layers", remaining.size(), _options.max_layers);
+      return false;
+    }
+
+    stbrp_context context;
+    stbrp_init_target(&context, cells, cells, nodes.data(), cells);
+    stbrp_pack_rects(&context, remaining.data(), static_cast<int>(remaining.size()));
+
+    std::vector<stbrp_rect> left;
+    for (const auto& rect : remaining) {
+      if (rect.was_packed) {
+        placed[rect.id] = rect;
+        layer_of[rect.id] = layers;
+      }
+      else {
+        left.push_back(rect);
+      }
+    }
+    remaining.swap(left);
+    layers++;
+  }
+
+  VkExtent3D extent = { _options.size, _options.size, 1 };
+  if (layers == 1) {
+    uint32_t used_width = 0;
+    uint32_t used_height = 0;
+    for (const auto& rect : placed) {
+      used_width = std::max(used_width, uint32_t(rect.x + rect.w) * align);
+      used_height = std::max(used_height, uint32_t(rect.y + rect.h) * align);
+    }
+    extent.width = next_power_of_two(used_width);
+    extent.height = next_power_of_two(used_height);
+  }
+  uint32_t mips = std::min(vktexture::mip_count(extent), log2_floor(align) + 1);
+
+  VkFormat format = _options.srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+  std::vector<vktexture::Texture_Data> pages(layers);
+  for (auto& page : pages) {
+    page.format = format;
+    page.extent = extent;
+    page.bytes.assign(vktexture::level_size(format, extent), 0);
+    vktexture::Texture_Level level;
+    level.offset = 0;
+    level.size = page.bytes.size();
+    level.extent = extent;
+    page.levels.push_back(level);
+  }
+
+  atlas->names.clear();
+  atlas->rects.clear();
+  for (size_t i = 0; i < _images.size(); i++) {
+    const Pending_Image& image = _images[i];
+    uint32_t x = placed[i].x * align + padding;
+    uint32_t y = placed[i].y * align + padding;
+    uint8_t* page = pages[layer_of[i]].bytes.data();
+
+    // the padding repeats the nearest edge texel of the image
+    int width = static_cast<int>(image.extent.width);
+    int height = static_cast<int>(image.extent.height);
+    int pad = static_cast<int>(padding);
+    for (int py = -pad; py < height + pad; py++) {
+      int sy = std::clamp(py, 0, height - 1);
+      for (int px = -pad; px < width + pad; px++) {
+        int sx = std::clamp(px, 0, width - 1);
+        size_t dst = (size_t(y + py) * extent.width + (x + px)) * 4;
+        size_t src = (size_t(sy) * width + sx) * 4;
+        memcpy(page + dst, image.texels.data() + src, 4);
+      }
+    }
+
+    atlas->names.push_back(image.name);
+    atlas->rects.push_back(make_rect(layer_of[i], x, y, image.extent.width, image.extent.height, extent));
+  }
+
+  atlas->texture = {};
+  atlas->texture.format = format;
+  atlas->texture.extent = extent;
+  atlas->texture.layers = layers;
+  for (auto& page : pages) {
+    append_layer(&atlas->texture, page, mips);
+  }
+  return true;
+}
+
+/**
+ * @brief Writes an atlas as a manifest and one PNG per layer next to it,
+ *        mips are rebuilt when the atlas is read
+ */
+bool write_atlas(const std::string& path, const Atlas_Data& atlas) {
+  const vktexture::Texture_Data& texture = atlas.texture;
+  uint32_t mips = static_cast<uint32_t>(texture.levels.size()) / texture.layers;
+  bool srgb = texture.format == VK_FORMAT_R8G8B8A8_SRGB;
+
+  std::ofstream manifest(path);
+  if (!manifest.is_open()) {
+    fmt::println("failed to write atlas {}", path);
+    return false;
+  }
+  manifest << "atlas " << texture.extent.width << " " << texture.extent.height << " "
+           << texture.layers << " " << mips << " " << (srgb ? 1 : 0) << "\n";
+
+  std::filesystem::path manifest_path(path);
+  for (uint32_t layer = 0; layer < texture.layers; layer++) {
+    std::string file = manifest_path.stem().string() + "_" + std::to_string(layer) + ".png";
+    std::string layer_path = (manifest_path.parent_path() / file).string();
+    const vktexture::Texture_Level& level = texture.levels[layer * mips];
+    if (!stbi_write_png(
+      layer_path.c_str(),
+      static_cast<int>(level.extent.width),
+      static_cast<int>(level.extent.height),
+      4,
+      texture.bytes.data() + level.offset,
+      static_cast<int>(level.extent.width * 4))
+    ) {
+      fmt::println("failed to write atlas layer {}", layer_path);
+      return false;
+    }
+    manifest << "layer " << file << "\n";
+  }
+
+  for (size_t i = 0; i < atlas.names.size(); i++) {
+    const Atlas_Rect& rect = atlas.rects[i];
+    manifest << "image " << rect.layer << " " << rect.x << " " << rect.y << " "
+             << rect.width << " " << rect.height << " " << atlas.names[i] << "\n";
+  }
+  return true;
+}
+
+/**
+ * @brief Reads an atlas written by write_atlas
+ */
+bool read_atlas(const std::string& path, Atlas_Data* atlas) {
+  std::ifstream manifest(path);
+  if (!manifest.is_open()) {
+    fmt::println("failed to open atlas {}", path);
+    return false;
+  }
+
+  std::string line;
+  std::string tag;
+  uint32_t width = 0, height = 0, layers = 0, mips = 1, srgb = 1;
+  std::getline(manifest, line);
+  std::istringstream header(line);
+  header >> tag >> width >> height >> layers >> mips >> srgb;
+  if (header.fail() || tag != "atlas" || layers == 0 || mips == 0) {
+    fmt::println("{} is not an atlas manifest", path);
+    return false;
+  }
+
+  VkExtent3D extent = { width, height, 1 };
+  atlas->texture = {};
+  atlas->texture.format = srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+  atlas->texture.extent = extent;
+  atlas->texture.layers = layers;
+  atlas->names.clear();
+  atlas->rects.clear();
+
+  std::filesystem::path directory = std::filesystem::path(path).parent_path();
+  uint32_t layers_read = 0;
+  while (std::getline(manifest, line)) {
+    std::istringstream fields(line);
+    fields >> tag;
+    if (tag == "layer") {
+      std::string file;
+      fields >> file;
+      vktexture::Texture_Data layer;
+      if (!vktexture::load_image((directory / file).string(), srgb != 0, &layer)) {
+        return false;
+      }
+      if (layer.extent.width != width || layer.extent.height != height) {
+        fmt::println("layer {} of {} does not match the atlas size", file, path);
+        return false;
+      }
+      append_layer(&atlas->texture, layer, mips);
+      layers_read++;
+    }
+    else if (tag == "image") {
+      uint32_t layer, x, y, rect_width, rect_height;
+      std::string name;
+      fields >> layer >> x >> y >> rect_width >> rect_height;
+      std::getline(fields >> std::ws, name);
+      atlas->names.push_back(name);
+      atlas->rects.push_back(make_rect(layer, x, y, rect_width, rect_height, extent));
+    }
+  }
+
+  if (layers_read != layers) {
+    fmt::println("{} lists {} of its {} layers", path, layers_read, layers);
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Offline packer, packs every PNG and JPEG under a directory into
+ *        an atlas named by their path relative to it. Layers written by an
+ *        earlier run into the same directory are skipped
+ */
+bool pack_directory(const std::string& directory, const std::string& output, const Atlas_Options& options) {
+  Atlas_Builder builder(options);
+  std::string layer_prefix = std::filesystem::path(output).stem().string() + "_";
+
+  std::vector<std::filesystem::path> files;
+  for (const auto& entry : std::filesystem::recursive_directory_iterator(directory)) {
+    if (!entry.is_regular_file()) {
+      continue;
+    }
+    std::string ext = entry.path().extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+    if (ext != ".png" && ext != ".jpg" && ext != ".jpeg") {
+      continue;
+    }
+    if (entry.path().filename().string().rfind(layer_prefix, 0) == 0) {
+      continue;
+    }
+    files.push_back(entry.path());
+  }
+  // the same inputs always give the same atlas
+  std::sort(files.begin(), files.end());
+
+  for (const auto& file : files) {
+    std::string name = std::filesystem::relative(file, directory).generic_string();
+    builder.add_file(name, file.string());
+  }
+
+  Atlas_Data atlas;
+  if (!builder.build(&atlas) || !write_atlas(output, atlas)) {
+    return false;
+  }
+  fmt::println(
+    "packed {} of {} images into {} {}x{} layers of {}",
+    atlas.names.size(),
+    files.size(),
+    atlas.texture.layers,
+    atlas.texture.extent.width,
+    atlas.texture.extent.height,
+    output
+  );
+  return true;
+}
+
+} // namespace vkatlas
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <string>
+#include <vector>
+
+#include "vk_types.h"
+#include "vk_textures.h"
+
+namespace vkatlas
+{
+
+/**
+ * @brief Where an image ended up in an atlas, UVs of the image itself
+ *        are moved into the atlas with remap
+ */
+struct Atlas_Rect {
+  uint32_t  layer = 0;
+  // texels of the image in the layer, without the padding around it
+  uint32_t  x = 0;
+  uint32_t  y = 0;
+  uint32_t  width = 0;
+  uint32_t  height = 0;
+  glm::vec2 uv_offset{ 0.f };
+  glm::vec2 uv_scale{ 1.f };
+
+  glm::vec2 remap(glm::vec2 uv) const;
+};
+
+struct Atlas_Options {
+  // largest side of a layer, layers of a multi layer atlas all use it
+  uint32_t size = 2048;
+  // edge texels repeated around every image, each doubling of it keeps
+  // one more mip free of bleeding between neighbours
+  uint32_t padding = 4;
+  uint32_t max_layers = 16;
+  bool     srgb = true;
+};
+
+/**
+ * @brief Packed images and the layers they were packed into, the texture
+ *        holds every layer with the mips that stay inside the padding
+ */
+struct Atlas_Data {
+  vktexture::Texture_Data  texture;
+  std::vector<std::string> names;
+  std::vector<Atlas_Rect>  rects;
+};
+
+/**
+ * @brief Packs small RGBA8 images into as few layers as possible with the
+ *        skyline packer ImGui bundles, used by the offline packer and at
+ *        runtime alike
+ */
+class Atlas_Builder
+{
+public:
+  Atlas_Builder(const Atlas_Options& options = {});
+
+  bool add(const std::string& name, const vktexture::Texture_Data& image);
+  bool add_file(const std::string& name, const std::string& path);
+  bool build(Atlas_Data* atlas);
+
+  size_t image_count() const { return _images.size(); }
+
+private:
+  struct Pending_Image {
+    std::string          name;
+    VkExtent3D           extent;
+    std::vector<uint8_t> texels;
+  };
+
+  Atlas_Options              _options;
+  std::vector<Pending_Image> _images;
+};
+
+bool write_atlas(const std::string& path, const Atlas_Data& atlas);
+bool read_atlas(const std::string& path, Atlas_Data* atlas);
+bool pack_directory(const std::string& directory, const std::string& output, const Atlas_Options& options = {});
+
+} // namespace vkatlas
@@ -1,41 +1,467 @@
 #include "vk_descriptors.h"
 
+#include <cmath>
+
 namespace vklayout
 {
 
-void Layout::triangle_layout(VkDevice _device, VkPipelineLayout* layout) {
+static uint64_t hash_bindings(std::vector<VkDescriptorSetLayoutBinding>& bindings) {
+  // binding order in the shader does not change the layout
+  std::sort(bindings.begin(), bindings.end(), 
+    [](const VkDescriptorSetLayoutBinding& a, const VkDescriptorSetLayoutBinding& b) { 
+      return a.binding < b.binding; 
+    });
+
+  uint64_t seed = bindings.size();
+  for (const auto& binding : bindings) {
+    hash_combine(seed, binding.binding);
+    hash_combine(seed, binding.descriptorType);
+    hash_combine(seed, binding.descriptorCount);
+    hash_combine(seed, binding.stageFlags);
+    if (binding.pImmutableSamplers != nullptr) {
+      for (uint32_t i = 0; i < binding.descriptorCount; i++) {
+        hash_combine(seed, (uint64_t)binding.pImmutableSamplers[i]);
+      }
+    }
+  }
+  return seed;
+}
+
+static bool same_binding(const VkDescriptorSetLayoutBinding& a, const VkDescriptorSetLayoutBinding& b) {
+  if (
+    a.binding != b.binding ||
+    a.descriptorType != b.descriptorType ||
+    a.descriptorCount != b.descriptorCount ||
+    a.stageFlags != b.stageFlags ||
+    (a.pImmutableSamplers == nullptr) != (b.pImmutableSamplers == nullptr)
+  ) {
+    return false;
+  }
+  return a.pImmutableSamplers == nullptr ||
+    std::equal(a.pImmutableSamplers, a.pImmutableSamplers + a.descriptorCount, b.pImmutableSamplers);
+}
+
+static bool same_range(const VkPushConstantRange& a, const VkPushConstantRange& b) {
+  return a.stageFlags == b.stageFlags && a.offset == b.offset && a.size == b.size;
+}
+
+Layout_Cache::~Layout_Cache() {
+  for (auto& layouts : _pipeline_layouts) {
+    for (auto layout : layouts.second) {
+      vkDestroyPipelineLayout(_device, layout, nullptr);
+    }
+  }
+  for (auto& layouts : _set_layouts) {
+    for (auto set_layout : layouts.second) {
+      vkDestroyDescriptorSetLayout(_device, set_layout, nullptr);
+    }
+  }
+}
+
+/**
+ * @brief Returns the pipeline layout matching a shader interface, 
+ *        creating it and any missing set layouts on first use
+ */
+VkPipelineLayout Layout_Cache::get_pipeline_layout(const vkreflect::Shader_Interface& shader) {
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  // unused set numbers below the highest one still need an empty layout
+  std::vector<VkDescriptorSetLayout> set_layouts;
+  for (const auto& bindings : shader.sets) {
+    set_layouts.push_back(create_set_layout(bindings));
+  }
+
+  uint64_t key = set_layouts.size();
+  for (auto set_layout : set_layouts) {
+    hash_combine(key, (uint64_t)set_layout);
+  }
+  for (const auto& range : shader.push_constants) {
+    hash_combine(key, range.stageFlags);
+    hash_combine(key, range.offset);
+    hash_combine(key, range.size);
+  }
+
+  // set layouts are deduplicated, so comparing their handles is structural
+  std::vector<VkPipelineLayout>& candidates = _pipeline_layouts[key];
+  for (auto candidate : candidates) {
+    const auto& ranges = _layout_ranges[candidate];
+    if (
+      _layout_sets[candidate] == set_layouts &&
+      std::equal(ranges.begin(), ranges.end(), shader.push_constants.begin(), shader.push_constants.end(), same_range)
+    ) {
+      _stats.pipeline_layout_hits++;
+      return candidate;
+    }
+  }
+
   VkPipelineLayoutCreateInfo info{};
   info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
   info.pNext = nullptr;
-  // empty defaults
   info.flags = 0;
-  info.setLayoutCount = 0;
-  info.pSetLayouts = nullptr;
-  info.pushConstantRangeCount = 0;
-  info.pPushConstantRanges = nullptr;
+  info.setLayoutCount = static_cast<uint32_t>(set_layouts.size());
+  info.pSetLayouts = set_layouts.data();
+  info.pushConstantRangeCount = static_cast<uint32_t>(shader.push_constants.size());
+  info.pPushConstantRanges = shader.push_constants.data();
+
+  VkPipelineLayout layout;
+  VK_CHECK(vkCreatePipelineLayout(_device, &info, nullptr, &layout));
 
-  VK_CHECK(vkCreatePipelineLayout(_device, &info, nullptr, layout));
+  candidates.push_back(layout);
+  _layout_sets[layout] = set_layouts;
+  _layout_ranges[layout] = shader.push_constants;
+  _stats.pipeline_layouts_created++;
+  return layout;
 }
 
-void Layout::mesh_layout(VkDevice _device, VkPipelineLayout* layout) {
-  VkPipelineLayoutCreateInfo info{};
-  info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+VkDescriptorSetLayout Layout_Cache::get_set_layout(const std::vector<VkDescriptorSetLayoutBinding>& bindings) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return create_set_layout(bindings);
+}
+
+/**
+ * @brief Bindings a set layout was created from, sorted by binding number
+ */
+std::vector<VkDescriptorSetLayoutBinding> Layout_Cache::bindings(VkDescriptorSetLayout set_layout) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _set_bindings[set_layout];
+}
+
+/**
+ * @brief Set layouts of a pipeline layout, indexed by set number
+ */
+std::vector<VkDescriptorSetLayout> Layout_Cache::set_layouts(VkPipelineLayout layout) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _layout_sets[layout];
+}
+
+Layout_Cache_Stats Layout_Cache::stats() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _stats;
+}
+
+void Layout_Cache::report() {
+  Layout_Cache_Stats current = stats();
+  fmt::println(
+    "layout cache: {} set layouts ({} reused), {} pipeline layouts ({} reused)",
+    current.set_layouts_created,
+    current.set_layout_hits,
+    current.pipeline_layouts_created,
+    current.pipeline_layout_hits
+  );
+}
+
+VkDescriptorSetLayout Layout_Cache::create_set_layout(std::vector<VkDescriptorSetLayoutBinding> bindings) {
+  uint64_t key = hash_bindings(bindings);
+
+  std::vector<VkDescriptorSetLayout>& candidates = _set_layouts[key];
+  for (auto candidate : candidates) {
+    const auto& existing = _set_bindings[candidate];
+    if (std::equal(existing.begin(), existing.end(), bindings.begin(), bindings.end(), same_binding)) {
+      _stats.set_layout_hits++;
+      return candidate;
+    }
+  }
+
+  VkDescriptorSetLayoutCreateInfo info{};
+  info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
   info.pNext = nullptr;
-  // empty defaults
   info.flags = 0;
-  info.setLayoutCount = 0;
-  info.pSetLayouts = nullptr;
+  info.bindingCount = static_cast<uint32_t>(bindings.size());
+  info.pBindings = bindings.data();
+
+  VkDescriptorSetLayout set_layout;
+  VK_CHECK(vkCreateDescriptorSetLayout(_device, &info, nullptr, &set_layout));
+
+  candidates.push_back(set_layout);
+  _set_bindings[set_layout] = bindings;
+  _stats.set_layouts_created++;
+  return set_layout;
+}
+
+static uint64_t hash_sampler(const VkSamplerCreateInfo& info) {
+  uint64_t seed = info.flags;
+  hash_combine(seed, info.magFilter);
+  hash_combine(seed, info.minFilter);
+  hash_combine(seed, info.mipmapMode);
+  hash_combine(seed, info.addressModeU);
+  hash_combine(seed, info.addressModeV);
+  hash_combine(seed, info.addressModeW);
+  hash_combine(seed, std::hash<float>{}(info.mipLodBias));
+  hash_combine(seed, info.anisotropyEnable);
+  hash_combine(seed, std::hash<float>{}(info.maxAnisotropy));
+  hash_combine(seed, info.compareEnable);
+  hash_combine(seed, info.compareOp);
+  hash_combine(seed, std::hash<float>{}(info.minLod));
+  hash_combine(seed, std::hash<float>{}(info.maxLod));
+  hash_combine(seed, info.borderColor);
+  hash_combine(seed, info.unnormalizedCoordinates);
+  return seed;
+}
+
+static bool same_sampler(const VkSamplerCreateInfo& a, const VkSamplerCreateInfo& b) {
+  return
+    a.flags == b.flags &&
+    a.magFilter == b.magFilter &&
+    a.minFilter == b.minFilter &&
+    a.mipmapMode == b.mipmapMode &&
+    a.addressModeU == b.addressModeU &&
+    a.addressModeV == b.addressModeV &&
+    a.addressModeW == b.addressModeW &&
+    a.mipLodBias == b.mipLodBias &&
+    a.anisotropyEnable == b.anisotropyEnable &&
+    a.maxAnisotropy == b.maxAnisotropy &&
+    a.compareEnable == b.compareEnable &&
+    a.compareOp == b.compareOp &&
+    a.minLod == b.minLod &&
+    a.maxLod == b.maxLod &&
+    a.borderColor == b.borderColor &&
+    a.unnormalizedCoordinates == b.unnormalizedCoordinates;
+}
+
+Sampler_Cache::~Sampler_Cache() {
+  for (auto& samplers : _samplers) {
+    for (auto& sampler : samplers.second) {
+      vkDestroySampler(_device, sampler.second, nullptr);
+    }
+  }
+}
 
-  VkPushConstantRange push_constant;
-  push_constant.offset = 0;
-  push_constant.size = sizeof(MeshPushConstants);
-  push_constant.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+/**
+ * @brief Returns a sampler created from the same state, creating it on
+ *        first use. Extension structs in pNext are not part of the key
+ */
+VkSampler Sampler_Cache::get_sampler(const VkSamplerCreateInfo& info) {
+  if (info.pNext != nullptr) {
+    throw std::runtime_error("samplers with extension structs cannot be cached");
+  }
 
-  info.pPushConstantRanges = &push_constant;
-  info.pushConstantRangeCount = 1;
+  std::lock_guard<std::mutex> lock(_mutex);
+  auto& candidates = _samplers[hash_sampler(info)];
+  for (const auto& candidate : candidates) {
+    if (same_sampler(candidate.first, info)) {
+      _stats.hits++;
+      return candidate.second;
+    }
+  }
 
-  VK_CHECK(vkCreatePipelineLayout(_device, &info, nullptr, layout));
+  VkSampler sampler;
+  VK_CHECK(vkCreateSampler(_device, &info, nullptr, &sampler));
+  candidates.push_back({ info, sampler });
+  _stats.created++;
+  return sampler;
+}
+
+Sampler_Cache_Stats Sampler_Cache::stats() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _stats;
+}
 
+void Sampler_Cache::report() {
+  Sampler_Cache_Stats current = stats();
+  fmt::println("sampler cache: {} samplers ({} reused)", current.created, current.hits);
 }
 
 } // namespace vklayout
+
+namespace vkdescriptor
+{
+
+// pools stop growing here, most drivers handle larger pools no better
+constexpr uint32_t MAX_SETS_PER_POOL = 4096;
+
+Growable_Allocator::Growable_Allocator(
+  VkDevice device, 
+  vklayout::Layout_Cache* layouts, 
+  uint32_t initial_sets, 
+  const std::vector<Pool_Ratio>& ratios
+) : _device(device), _layouts(layouts), _ratios(ratios), _sets_per_pool(std::max(initial_sets, 1u)) {}
+
+Growable_Allocator::~Growable_Allocator() {
+  if (_current != VK_NULL_HANDLE) {
+    vkDestroyDescriptorPool(_device, _current, nullptr);
+  }
+  for (auto pool : _ready_pools) {
+    vkDestroyDescriptorPool(_device, pool, nullptr);
+  }
+  for (auto pool : _full_pools) {
+    vkDestroyDescriptorPool(_device, pool, nullptr);
+  }
+}
+
+static bool pool_exhausted(VkResult result) {
+  return result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL;
+}
+
+/**
+ * @brief Allocates a set from the current pool, moving on through the 
+ *        chain until a pool has room. Reset pools were sized with older
+ *        ratios, once none of them fits a new pool is created that does
+ */
+VkDescriptorSet Growable_Allocator::allocate(VkDescriptorSetLayout layout) {
+  const std::vector<VkDescriptorPoolSize>& sizes = layout_sizes(layout);
+  for (const auto& size : sizes) {
+    _observed[size.type] += size.descriptorCount;
+  }
+  _observed_sets++;
+
+  if (_current == VK_NULL_HANDLE) {
+    _current = next_pool(sizes);
+  }
+
+  VkDescriptorSet set = VK_NULL_HANDLE;
+  VkResult result = allocate_from_current(layout, &set);
+  while (pool_exhausted(result)) {
+    _stats.pool_overflows++;
+    bool created = _ready_pools.empty();
+    retire_current();
+    _current = next_pool(sizes);
+    result = allocate_from_current(layout, &set);
+    // a new pool always has room for the layout, failing there is an error
+    if (created) {
+      break;
+    }
+  }
+  VK_CHECK(result);
+
+  _current_sets++;
+  _stats.sets_allocated++;
+  _stats.total_sets++;
+  return set;
+}
+
+/**
+ * @brief Frees every set allocated since the last reset, each pool is 
+ *        reset as a whole and reused in the order it was created
+ */
+void Growable_Allocator::reset() {
+  if (_current != VK_NULL_HANDLE) {
+    _full_pools.push_back(_current);
+    _current = VK_NULL_HANDLE;
+    _current_sets = 0;
+  }
+  for (auto pool : _full_pools) {
+    VK_CHECK(vkResetDescriptorPool(_device, pool, 0));
+    _ready_pools.push_back(pool);
+  }
+  _full_pools.clear();
+
+  _stats.sets_allocated = 0;
+  _stats.pools_in_use = 0;
+  _stats.resets++;
+}
+
+void Growable_Allocator::report(const char* name) const {
+  fmt::println(
+    "{} descriptors: {} sets allocated, {} pools created ({} sets per pool), {} overflows, {} resets",
+    name,
+    _stats.total_sets,
+    _stats.pools_created,
+    _sets_per_pool,
+    _stats.pool_overflows,
+    _stats.resets
+  );
+}
+
+const std::vector<VkDescriptorPoolSize>& Growable_Allocator::layout_sizes(VkDescriptorSetLayout layout) {
+  auto found = _layout_sizes.find(layout);
+  if (found != _layout_sizes.end()) {
+    return found->second;
+  }
+
+  std::vector<VkDescriptorPoolSize> sizes;
+  for (const auto& binding : _layouts->bindings(layout)) {
+    sizes.push_back({ binding.descriptorType, binding.descriptorCount });
+  }
+  return _layout_sizes.emplace(layout, std::move(sizes)).first->second;
+}
+
+VkResult Growable_Allocator::allocate_from_current(VkDescriptorSetLayout layout, VkDescriptorSet* set) {
+  VkDescriptorSetAllocateInfo alloc_info{};
+  alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  alloc_info.pNext = nullptr;
+  alloc_info.descriptorPool = _current;
+  alloc_info.descriptorSetCount = 1;
+  alloc_info.pSetLayouts = &layout;
+  return vkAllocateDescriptorSets(_device, &alloc_info, set);
+}
+
+/**
+ * @brief Sets aside an exhausted pool. A pool is kept until the next reset
+ *        while sets in it are in use, a reset pool that could not fit a
+ *        single set is too small for the ratios seen now and is destroyed
+ */
+void Growable_Allocator::retire_current() {
+  if (_current_sets > 0) {
+    _full_pools.push_back(_current);
+  }
+  else {
+    vkDestroyDescriptorPool(_device, _current, nullptr);
+    _stats.pools_in_use--;
+  }
+  _current = VK_NULL_HANDLE;
+  _current_sets = 0;
+}
+
+/**
+ * @brief Reuses a pool that was reset or creates a bigger one, pools 
+ *        double in size every time the chain grows
+ * @param minimum descriptors a new pool holds at least, the layout being allocated
+ */
+VkDescriptorPool Growable_Allocator::next_pool(const std::vector<VkDescriptorPoolSize>& minimum) {
+  _stats.pools_in_use++;
+  if (!_ready_pools.empty()) {
+    VkDescriptorPool pool = _ready_pools.back();
+    _ready_pools.pop_back();
+    return pool;
+  }
+
+  VkDescriptorPool pool = create_pool(_sets_per_pool, minimum);
+  _sets_per_pool = std::min(_sets_per_pool * 2, MAX_SETS_PER_POOL);
+  return pool;
+}
+
+/**
+ * @brief Creates a pool holding the given number of sets, each type gets
+ *        the larger of its configured ratio and the ratio seen so far
+ */
+VkDescriptorPool Growable_Allocator::create_pool(uint32_t set_count, const std::vector<VkDescriptorPoolSize>& minimum) {
+  std::unordered_map<VkDescriptorType, float> ratios;
+  for (const auto& ratio : _ratios) {
+    ratios[ratio.type] = ratio.ratio;
+  }
+  if (_observed_sets > 0) {
+    for (const auto& observed : _observed) {
+      float ratio = static_cast<float>(observed.second) / static_cast<float>(_observed_sets);
+      ratios[observed.first] = std::max(ratios[observed.first], ratio);
+    }
+  }
+
+  std::unordered_map<VkDescriptorType, uint32_t> counts;
+  for (const auto& ratio : ratios) {
+    counts[ratio.first] = std::max(static_cast<uint32_t>(std::ceil(ratio.second * set_count)), 1u);
+  }
+  for (const auto& size : minimum) {
+    counts[size.type] = std::max(counts[size.type], size.descriptorCount);
+  }
+
+  std::vector<VkDescriptorPoolSize> pool_sizes;
+  for (const auto& count : counts) {
+    pool_sizes.push_back({ count.first, count.second });
+  }
+
+  VkDescriptorPoolCreateInfo pool_info{};
+  pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  pool_info.pNext = nullptr;
+  // no FREE_DESCRIPTOR_SET_BIT, sets are only released by resetting the pool
+  pool_info.flags = 0;
+  pool_info.maxSets = set_count;
+  pool_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
+  pool_info.pPoolSizes = pool_sizes.data();
+
+  VkDescriptorPool pool;
+  VK_CHECK(vkCreateDescriptorPool(_device, &pool_info, nullptr, &pool));
+  _stats.pools_created++;
+  return pool;
+}
+
+} // namespace vkdescriptor
@@ -2,22 +2,160 @@
 
 #include <vulkan/vulkan.h>
 #include <vector>
+#include <unordered_map>
 
 #include "vk_types.h"
+#include "vk_reflect.h"
 
 namespace vklayout
 {
 
-class Layout {
+struct Layout_Cache_Stats {
+  uint32_t set_layouts_created      = 0;
+  uint32_t set_layout_hits          = 0;
+  uint32_t pipeline_layouts_created = 0;
+  uint32_t pipeline_layout_hits     = 0;
+};
+
+/**
+ * @brief Pipeline and descriptor set layouts built from reflected shader 
+ *        interfaces, identical interfaces share the same layouts so 
+ *        descriptor sets stay bound across pipelines that use them
+ */
+class Layout_Cache {
 public:
-  static void triangle_layout(VkDevice _device, VkPipelineLayout* layout);
-  static void mesh_layout(VkDevice _device, VkPipelineLayout* layout);
+  Layout_Cache(VkDevice device) : _device(device) {}
+  ~Layout_Cache();
+
+  Layout_Cache (const Layout_Cache&) = delete;
+  Layout_Cache& operator= (const Layout_Cache&) = delete;
+
+  VkPipelineLayout get_pipeline_layout(const vkreflect::Shader_Interface& shader);
+  VkDescriptorSetLayout get_set_layout(const std::vector<VkDescriptorSetLayoutBinding>& bindings);
+  std::vector<VkDescriptorSetLayout> set_layouts(VkPipelineLayout layout);
+  std::vector<VkDescriptorSetLayoutBinding> bindings(VkDescriptorSetLayout set_layout);
+
+  Layout_Cache_Stats stats();
+  void report();
 
 private:
-  struct MeshPushConstants {
-    glm::vec4 data;
-    glm::mat4 render_matrix;
-  };
+  VkDevice   _device;
+  // layouts are requested from pipeline compilation workers
+  std::mutex _mutex;
+
+  // keys are structural hashes, layouts sharing a key are told apart by
+  // comparing what they were created from
+  std::unordered_map<uint64_t, std::vector<VkDescriptorSetLayout>> _set_layouts;
+  std::unordered_map<uint64_t, std::vector<VkPipelineLayout>> _pipeline_layouts;
+  std::unordered_map<VkPipelineLayout, std::vector<VkDescriptorSetLayout>> _layout_sets;
+  std::unordered_map<VkPipelineLayout, std::vector<VkPushConstantRange>> _layout_ranges;
+  std::unordered_map<VkDescriptorSetLayout, std::vector<VkDescriptorSetLayoutBinding>> _set_bindings;
+  Layout_Cache_Stats _stats;
+
+  VkDescriptorSetLayout create_set_layout(std::vector<VkDescriptorSetLayoutBinding> bindings);
+};
+
+struct Sampler_Cache_Stats {
+  uint32_t created = 0;
+  uint32_t hits    = 0;
+};
+
+/**
+ * @brief Samplers shared between every texture and material that asks for
+ *        the same filtering and addressing, most scenes need only a few
+ */
+class Sampler_Cache {
+public:
+  Sampler_Cache(VkDevice device) : _device(device) {}
+  ~Sampler_Cache();
+
+  Sampler_Cache (const Sampler_Cache&) = delete;
+  Sampler_Cache& operator= (const Sampler_Cache&) = delete;
+
+  VkSampler get_sampler(const VkSamplerCreateInfo& info);
+
+  Sampler_Cache_Stats stats();
+  void report();
+
+private:
+  VkDevice   _device;
+  std::mutex _mutex;
+
+  std::unordered_map<uint64_t, std::vector<std::pair<VkSamplerCreateInfo, VkSampler>>> _samplers;
+  Sampler_Cache_Stats _stats;
 };
 
 } // namespace vklayout
+
+namespace vkdescriptor
+{
+
+// descriptors of a type reserved in a pool for every set it can hold
+struct Pool_Ratio {
+  VkDescriptorType type;
+  float            ratio;
+};
+
+struct Allocator_Stats {
+  uint32_t sets_allocated = 0;  // since the last reset
+  uint32_t total_sets     = 0;
+  uint32_t pools_created  = 0;
+  uint32_t pools_in_use   = 0;
+  uint32_t resets         = 0;
+  uint32_t pool_overflows = 0;  // allocations retried in another pool
+};
+
+/**
+ * @brief Allocates descriptor sets from a chain of pools that grows when
+ *        the current pool runs out. New pools are sized from the ratios
+ *        of descriptor types seen so far, sets are never freed one by one,
+ *        every pool is reset at once instead. Not thread safe, each
+ *        recording thread or frame owns its own allocator
+ */
+class Growable_Allocator {
+public:
+  Growable_Allocator(
+    VkDevice device, 
+    vklayout::Layout_Cache* layouts, 
+    uint32_t initial_sets, 
+    const std::vector<Pool_Ratio>& ratios
+  );
+  ~Growable_Allocator();
+
+  Growable_Allocator (const Growable_Allocator&) = delete;
+  Growable_Allocator& operator= (const Growable_Allocator&) = delete;
+
+  VkDescriptorSet allocate(VkDescriptorSetLayout layout);
+  void reset();
+
+  const Allocator_Stats& stats() const { return _stats; }
+  void report(const char* name) const;
+
+private:
+  VkDevice                _device;
+  vklayout::Layout_Cache* _layouts;
+  std::vector<Pool_Ratio> _ratios;
+  uint32_t                _sets_per_pool;
+
+  VkDescriptorPool              _current = VK_NULL_HANDLE;
+  // sets allocated from the current pool since it was taken
+  uint32_t                      _current_sets = 0;
+  std::vector<VkDescriptorPool> _ready_pools;
+  std::vector<VkDescriptorPool> _full_pools;
+
+  // descriptors each layout takes, looked up once per layout
+  std::unordered_map<VkDescriptorSetLayout, std::vector<VkDescriptorPoolSize>> _layout_sizes;
+  // descriptors of each type allocated over the lifetime of the allocator
+  std::unordered_map<VkDescriptorType, uint64_t> _observed;
+  uint64_t                                       _observed_sets = 0;
+
+  Allocator_Stats _stats;
+
+  const std::vector<VkDescriptorPoolSize>& layout_sizes(VkDescriptorSetLayout layout);
+  VkResult allocate_from_current(VkDescriptorSetLayout layout, VkDescriptorSet* set);
+  void retire_current();
+  VkDescriptorPool next_pool(const std::vector<VkDescriptorPoolSize>& minimum);
+  VkDescriptorPool create_pool(uint32_t set_count, const std::vector<VkDescriptorPoolSize>& minimum);
+};
+
+} // namespace vkdescriptor
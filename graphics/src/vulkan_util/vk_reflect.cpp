@@ -0,0 +1,364 @@
+#include "vk_reflect.h"
+
+#include <cstring>
+#include <unordered_map>
+
+namespace vkreflect
+{
+
+// subset of the SPIR-V specification needed to find the shader interface
+constexpr uint32_t SPIRV_MAGIC = 0x07230203;
+
+enum Op : uint32_t {
+  OP_ENTRY_POINT       = 15,
+  OP_TYPE_INT          = 21,
+  OP_TYPE_FLOAT        = 22,
+  OP_TYPE_VECTOR       = 23,
+  OP_TYPE_MATRIX       = 24,
+  OP_TYPE_IMAGE        = 25,
+  OP_TYPE_SAMPLER      = 26,
+  OP_TYPE_SAMPLED_IMAGE= 27,
+  OP_TYPE_ARRAY        = 28,
+  OP_TYPE_RUNTIME_ARRAY= 29,
+  OP_TYPE_STRUCT       = 30,
+  OP_TYPE_POINTER      = 32,
+  OP_CONSTANT          = 43,
+  OP_VARIABLE          = 59,
+  OP_DECORATE          = 71,
+  OP_MEMBER_DECORATE   = 72,
+};
+
+enum Decoration : uint32_t {
+  DECORATION_BLOCK          = 2,
+  DECORATION_BUFFER_BLOCK   = 3,
+  DECORATION_ARRAY_STRIDE   = 6,
+  DECORATION_BINDING        = 33,
+  DECORATION_DESCRIPTOR_SET = 34,
+  DECORATION_OFFSET         = 35,
+};
+
+enum Storage_Class : uint32_t {
+  STORAGE_UNIFORM_CONSTANT = 0,
+  STORAGE_UNIFORM          = 2,
+  STORAGE_PUSH_CONSTANT    = 9,
+  STORAGE_STORAGE_BUFFER   = 12,
+};
+
+constexpr uint32_t DIM_BUFFER       = 5;
+constexpr uint32_t DIM_SUBPASS_DATA = 6;
+
+struct Id_Info {
+  uint32_t              opcode = 0;
+  std::vector<uint32_t> operands;
+
+  // decorations
+  uint32_t set = UINT32_MAX;
+  uint32_t binding = UINT32_MAX;
+  uint32_t array_stride = 0;
+  bool     block = false;
+  bool     buffer_block = false;
+  std::vector<uint32_t> member_offsets;
+};
+
+static VkShaderStageFlags execution_model_stage(uint32_t model) {
+  switch (model) {
+    case 0: return VK_SHADER_STAGE_VERTEX_BIT;
+    case 1: return VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+    case 2: return VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+    case 3: return VK_SHADER_STAGE_GEOMETRY_BIT;
+    case 4: return VK_SHADER_STAGE_FRAGMENT_BIT;
+    case 5: return VK_SHADER_STAGE_COMPUTE_BIT;
+    default: return 0;
+  }
+}
+
+/**
+ * @brief Length of an array type, only lengths given by an OpConstant are
+ *        known. A length set by a specialization constant depends on the
+ *        variant and cannot be reflected from the module alone
+ */
+static uint32_t array_length(std::unordered_map<uint32_t, Id_Info>& ids, const Id_Info& array) {
+  const Id_Info& length = ids[array.operands[1]];
+  if (length.opcode != OP_CONSTANT || length.operands.size() < 3) {
+    throw std::runtime_error("failed to reflect shader, unsupported array length");
+  }
+  return length.operands[2];
+}
+
+/**
+ * @brief Size in bytes of a type as laid out in a push constant block
+ */
+static uint32_t type_size(std::unordered_map<uint32_t, Id_Info>& ids, uint32_t type_id) {
+  Id_Info& type = ids[type_id];
+  switch (type.opcode) {
+    case OP_TYPE_INT:
+    case OP_TYPE_FLOAT:
+      return type.operands[0] / 8;
+    case OP_TYPE_VECTOR:
+    case OP_TYPE_MATRIX:
+      return type_size(ids, type.operands[0]) * type.operands[1];
+    case OP_TYPE_ARRAY: {
+      uint32_t length = array_length(ids, type);
+      uint32_t stride = type.array_stride != 0 ? type.array_stride : type_size(ids, type.operands[0]);
+      return stride * length;
+    }
+    case OP_TYPE_STRUCT: {
+      uint32_t size = 0;
+      for (size_t i = 0; i < type.operands.size(); i++) {
+        uint32_t offset = i < type.member_offsets.size() ? type.member_offsets[i] : size;
+        size = std::max(size, offset + type_size(ids, type.operands[i]));
+      }
+      return size;
+    }
+    default:
+      return 0;
+  }
+}
+
+static bool descriptor_type(Id_Info& type, uint32_t storage, VkDescriptorType* descriptor) {
+  switch (type.opcode) {
+    case OP_TYPE_SAMPLER:
+      *descriptor = VK_DESCRIPTOR_TYPE_SAMPLER;
+      return true;
+    case OP_TYPE_SAMPLED_IMAGE:
+      *descriptor = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+      return true;
+    case OP_TYPE_IMAGE: {
+      // operands: sampled type, dim, depth, arrayed, ms, sampled, format
+      uint32_t dim = type.operands[1];
+      uint32_t sampled = type.operands[5];
+      if (dim == DIM_SUBPASS_DATA) {
+        *descriptor = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+      }
+      else if (dim == DIM_BUFFER) {
+        *descriptor = sampled == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+      }
+      else {
+        *descriptor = sampled == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+      }
+      return true;
+    }
+    case OP_TYPE_STRUCT:
+      if (storage == STORAGE_STORAGE_BUFFER || type.buffer_block) {
+        *descriptor = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        return true;
+      }
+      if (storage == STORAGE_UNIFORM && type.block) {
+        // bindings at a dynamic offset are promoted by the caller
+        *descriptor = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        return true;
+      }
+      return false;
+    default:
+      return false;
+  }
+}
+
+/**
+ * @brief Finds the push constant block and descriptor bindings used by
+ *        a SPIR-V module
+ */
+Shader_Interface reflect(const std::vector<char>& code) {
+  std::vector<uint32_t> words(code.size() / sizeof(uint32_t));
+  memcpy(words.data(), code.data(), words.size() * sizeof(uint32_t));
+
+  if (words.size() < 5 || words[0] != SPIRV_MAGIC) {
+    throw std::runtime_error("failed to reflect shader, not a SPIR-V module");
+  }
+
+  Shader_Interface shader;
+  std::unordered_map<uint32_t, Id_Info> ids;
+  // (pointer type, variable id, storage class)
+  std::vector<std::array<uint32_t, 3>> variables;
+
+  size_t offset = 5;
+  while (offset < words.size()) {
+    uint32_t opcode = words[offset] & 0xFFFF;
+    uint32_t word_count = words[offset] >> 16;
+    if (word_count == 0 || offset + word_count > words.size()) {
+      throw std::runtime_error("failed to reflect shader, malformed instruction");
+    }
+    const uint32_t* operands = &words[offset + 1];
+    uint32_t operand_count = word_count - 1;
+
+    switch (opcode) {
+      case OP_ENTRY_POINT:
+        if (shader.stages == 0) {
+          shader.stages = execution_model_stage(operands[0]);
+        }
+        break;
+      case OP_DECORATE: {
+        Id_Info& target = ids[operands[0]];
+        switch (operands[1]) {
+          case DECORATION_DESCRIPTOR_SET: target.set = operands[2]; break;
+          case DECORATION_BINDING: target.binding = operands[2]; break;
+          case DECORATION_ARRAY_STRIDE: target.array_stride = operands[2]; break;
+          case DECORATION_BLOCK: target.block = true; break;
+          case DECORATION_BUFFER_BLOCK: target.buffer_block = true; break;
+          default: break;
+        }
+        break;
+      }
+      case OP_MEMBER_DECORATE:
+        if (operands[2] == DECORATION_OFFSET) {
+          Id_Info& target = ids[operands[0]];
+          if (target.member_offsets.size() <= operands[1]) {
+            target.member_offsets.resize(operands[1] + 1, 0);
+          }
+          target.member_offsets[operands[1]] = operands[3];
+        }
+        break;
+      case OP_TYPE_INT:
+      case OP_TYPE_FLOAT:
+      case OP_TYPE_VECTOR:
+      case OP_TYPE_MATRIX:
+      case OP_TYPE_IMAGE:
+      case OP_TYPE_SAMPLER:
+      case OP_TYPE_SAMPLED_IMAGE:
+      case OP_TYPE_ARRAY:
+      case OP_TYPE_RUNTIME_ARRAY:
+      case OP_TYPE_STRUCT:
+      case OP_TYPE_POINTER: {
+        // the first operand is the result id, the rest describe the type
+        Id_Info& type = ids[operands[0]];
+        type.opcode = opcode;
+        type.operands.assign(operands + 1, operands + operand_count);
+        break;
+      }
+      case OP_CONSTANT: {
+        // operands: result type, result id, value
+        Id_Info& constant = ids[operands[1]];
+        constant.opcode = opcode;
+        constant.operands.assign(operands, operands + operand_count);
+        break;
+      }
+      case OP_VARIABLE:
+        variables.push_back({ operands[0], operands[1], operands[2] });
+        break;
+      default:
+        break;
+    }
+    offset += word_count;
+  }
+
+  for (const auto& variable : variables) {
+    uint32_t storage = variable[2];
+    // pointer operands: storage class, pointee type
+    uint32_t type_id = ids[variable[0]].operands[1];
+
+    if (storage == STORAGE_PUSH_CONSTANT) {
+      Id_Info& block = ids[type_id];
+      uint32_t first = block.member_offsets.empty() ? 0 : *std::min_element(block.member_offsets.begin(), block.member_offsets.end());
+
+      VkPushConstantRange range{};
+      range.stageFlags = shader.stages;
+      range.offset = first;
+      range.size = type_size(ids, type_id) - first;
+      shader.push_constants.push_back(range);
+      continue;
+    }
+
+    if (
+      storage != STORAGE_UNIFORM_CONSTANT &&
+      storage != STORAGE_UNIFORM &&
+      storage != STORAGE_STORAGE_BUFFER
+    ) {
+      continue;
+    }
+
+    Id_Info& decorations = ids[variable[1]];
+    if (decorations.set == UINT32_MAX || decorations.binding == UINT32_MAX) {
+      continue;
+    }
+
+    // arrays of resources take one descriptor per element
+    uint32_t count = 1;
+    Id_Info* type = &ids[type_id];
+    if (type->opcode == OP_TYPE_ARRAY) {
+      count = array_length(ids, *type);
+      type = &ids[type->operands[0]];
+    }
+    else if (type->opcode == OP_TYPE_RUNTIME_ARRAY) {
+      count = 0;
+      type = &ids[type->operands[0]];
+    }
+
+    VkDescriptorSetLayoutBinding binding{};
+    if (!descriptor_type(*type, storage, &binding.descriptorType)) {
+      continue;
+    }
+    binding.binding = decorations.binding;
+    binding.descriptorCount = count;
+    binding.stageFlags = shader.stages;
+    binding.pImmutableSamplers = nullptr;
+
+    if (shader.sets.size() <= decorations.set) {
+      shader.sets.resize(decorations.set + 1);
+    }
+    shader.sets[decorations.set].push_back(binding);
+  }
+
+  return shader;
+}
+
+/**
+ * @brief Combines the interface of another stage, resources used by both
+ *        stages are made visible to both
+ */
+void Shader_Interface::merge(const Shader_Interface& other) {
+  stages |= other.stages;
+
+  for (const auto& range : other.push_constants) {
+    if (push_constants.empty()) {
+      push_constants.push_back(range);
+      continue;
+    }
+    // stages share a single range covering every block
+    VkPushConstantRange& merged = push_constants[0];
+    uint32_t end = std::max(merged.offset + merged.size, range.offset + range.size);
+    merged.offset = std::min(merged.offset, range.offset);
+    merged.size = end - merged.offset;
+    merged.stageFlags |= range.stageFlags;
+  }
+
+  if (sets.size() < other.sets.size()) {
+    sets.resize(other.sets.size());
+  }
+  for (size_t set = 0; set < other.sets.size(); set++) {
+    for (const auto& binding : other.sets[set]) {
+      auto existing = std::find_if(sets[set].begin(), sets[set].end(),
+        [&](const VkDescriptorSetLayoutBinding& b) { return b.binding == binding.binding; });
+      if (existing != sets[set].end()) {
+        existing->stageFlags |= binding.stageFlags;
+      }
+      else {
+        sets[set].push_back(binding);
+      }
+    }
+  }
+}
+
+/**
+ * @brief Promotes the given buffer bindings to their dynamic descriptor
+ *        types, bindings the shaders do not use are ignored
+ */
+void Shader_Interface::make_dynamic(const Dynamic_Bindings& bindings) {
+  for (const auto& slot : bindings) {
+    if (slot.first >= sets.size()) {
+      continue;
+    }
+    for (auto& binding : sets[slot.first]) {
+      if (binding.binding != slot.second) {
+        continue;
+      }
+      if (binding.descriptorType == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER) {
+        binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+      }
+      else if (binding.descriptorType == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER) {
+        binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+      }
+    }
+  }
+}
+
+} // namespace vkreflect
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <vector>
+
+#include "vk_types.h"
+
+namespace vkreflect
+{
+
+// (set, binding) of buffers bound at a dynamic offset, SPIR-V cannot tell
+// them apart from buffers bound at a fixed one
+using Dynamic_Bindings = std::vector<std::pair<uint32_t, uint32_t>>;
+
+/**
+ * @brief Resources a set of shader stages expects from its pipeline layout
+ */
+struct Shader_Interface {
+  VkShaderStageFlags stages = 0;
+  std::vector<VkPushConstantRange> push_constants;
+  // bindings of every descriptor set, indexed by set number
+  std::vector<std::vector<VkDescriptorSetLayoutBinding>> sets;
+
+  void merge(const Shader_Interface& other);
+  void make_dynamic(const Dynamic_Bindings& bindings);
+};
+
+Shader_Interface reflect(const std::vector<char>& code);
+
+} // namespace vkreflect
@@ -0,0 +1,539 @@
+#include "vk_textures.h"
+
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+#define STB_IMAGE_IMPLEMENTATION
+#define STBI_ONLY_PNG
+#define STBI_ONLY_JPEG
+#include <stb_image.h>
+
+namespace vktexture
+{
+
+// subset of the KTX2 and DDS container headers needed for 2D textures
+const uint8_t KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+struct Ktx2_Header {
+  uint8_t  identifier[12];
+  uint32_t vk_format;
+  uint32_t type_size;
+  uint32_t pixel_width;
+  uint32_t pixel_height;
+  uint32_t pixel_depth;
+  uint32_t layer_count;
+  uint32_t face_count;
+  uint32_t level_count;
+  uint32_t supercompression_scheme;
+  uint32_t dfd_byte_offset;
+  uint32_t dfd_byte_length;
+  uint32_t kvd_byte_offset;
+  uint32_t kvd_byte_length;
+  uint64_t sgd_byte_offset;
+  uint64_t sgd_byte_length;
+};
+
+struct Ktx2_Level {
+  uint64_t byte_offset;
+  uint64_t byte_length;
+  uint64_t uncompressed_byte_length;
+};
+
+constexpr uint32_t DDS_MAGIC = 0x20534444;  // "DDS "
+constexpr uint32_t DDPF_FOURCC = 0x4;
+constexpr uint32_t DDPF_RGB = 0x40;
+constexpr uint32_t DDSCAPS2_CUBEMAP = 0x200;
+constexpr uint32_t DDS_DIMENSION_TEXTURE2D = 3;
+
+struct Dds_Pixel_Format {
+  uint32_t size;
+  uint32_t flags;
+  uint32_t four_cc;
+  uint32_t rgb_bit_count;
+  uint32_t r_mask;
+  uint32_t g_mask;
+  uint32_t b_mask;
+  uint32_t a_mask;
+};
+
+struct Dds_Header {
+  uint32_t         size;
+  uint32_t         flags;
+  uint32_t         height;
+  uint32_t         width;
+  uint32_t         pitch_or_linear_size;
+  uint32_t         depth;
+  uint32_t         mip_map_count;
+  uint32_t         reserved1[11];
+  Dds_Pixel_Format pixel_format;
+  uint32_t         caps;
+  uint32_t         caps2;
+  uint32_t         caps3;
+  uint32_t         caps4;
+  uint32_t         reserved2;
+};
+
+struct Dds_Header_Dx10 {
+  uint32_t dxgi_format;
+  uint32_t resource_dimension;
+  uint32_t misc_flag;
+  uint32_t array_size;
+  uint32_t misc_flags2;
+};
+
+static constexpr uint32_t four_cc(char a, char b, char c, char d) {
+  return uint32_t(uint8_t(a)) | (uint32_t(uint8_t(b)) << 8) | (uint32_t(uint8_t(c)) << 16) | (uint32_t(uint8_t(d)) << 24);
+}
+
+static VkFormat dxgi_format(uint32_t format) {
+  switch (format) {
+    case 28: return VK_FORMAT_R8G8B8A8_UNORM;
+    case 29: return VK_FORMAT_R8G8B8A8_SRGB;
+    case 71: return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+    case 72: return VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
+    case 74: return VK_FORMAT_BC2_UNORM_BLOCK;
+    case 75: return VK_FORMAT_BC2_SRGB_BLOCK;
+    case 77: return VK_FORMAT_BC3_UNORM_BLOCK;
+    case 78: return VK_FORMAT_BC3_SRGB_BLOCK;
+    case 80: return VK_FORMAT_BC4_UNORM_BLOCK;
+    case 81: return VK_FORMAT_BC4_SNORM_BLOCK;
+    case 83: return VK_FORMAT_BC5_UNORM_BLOCK;
+    case 84: return VK_FORMAT_BC5_SNORM_BLOCK;
+    case 87: return VK_FORMAT_B8G8R8A8_UNORM;
+    case 91: return VK_FORMAT_B8G8R8A8_SRGB;
+    case 95: return VK_FORMAT_BC6H_UFLOAT_BLOCK;
+    case 96: return VK_FORMAT_BC6H_SFLOAT_BLOCK;
+    case 98: return VK_FORMAT_BC7_UNORM_BLOCK;
+    case 99: return VK_FORMAT_BC7_SRGB_BLOCK;
+    default: return VK_FORMAT_UNDEFINED;
+  }
+}
+
+static VkFormat legacy_dds_format(const Dds_Pixel_Format& format) {
+  if (format.flags & DDPF_FOURCC) {
+    switch (format.four_cc) {
+      case four_cc('D', 'X', 'T', '1'): return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+      case four_cc('D', 'X', 'T', '3'): return VK_FORMAT_BC2_UNORM_BLOCK;
+      case four_cc('D', 'X', 'T', '5'): return VK_FORMAT_BC3_UNORM_BLOCK;
+      case four_cc('A', 'T', 'I', '1'):
+      case four_cc('B', 'C', '4', 'U'): return VK_FORMAT_BC4_UNORM_BLOCK;
+      case four_cc('A', 'T', 'I', '2'):
+      case four_cc('B', 'C', '5', 'U'): return VK_FORMAT_BC5_UNORM_BLOCK;
+      default: return VK_FORMAT_UNDEFINED;
+    }
+  }
+  if ((format.flags & DDPF_RGB) && format.rgb_bit_count == 32) {
+    if (format.r_mask == 0x000000FF && format.b_mask == 0x00FF0000) {
+      return VK_FORMAT_R8G8B8A8_UNORM;
+    }
+    if (format.r_mask == 0x00FF0000 && format.b_mask == 0x000000FF) {
+      return VK_FORMAT_B8G8R8A8_UNORM;
+    }
+  }
+  return VK_FORMAT_UNDEFINED;
+}
+
+static bool read_file(const std::string& path, std::vector<uint8_t>* bytes) {
+  std::ifstream file(path, std::ios::ate | std::ios::binary);
+  if (!file.is_open()) {
+    return false;
+  }
+
+  size_t file_size = static_cast<size_t>(file.tellg());
+  bytes->resize(file_size);
+  file.seekg(0);
+  file.read(reinterpret_cast<char*>(bytes->data()), file_size);
+  return true;
+}
+
+static std::string extension(const std::string& path) {
+  size_t dot = path.find_last_of('.');
+  if (dot == std::string::npos) {
+    return "";
+  }
+  std::string ext = path.substr(dot + 1);
+  std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+  return ext;
+}
+
+bool Texture_Data::compressed() const {
+  return is_block_compressed(format);
+}
+
+bool is_block_compressed(VkFormat format) {
+  return format >= VK_FORMAT_BC1_RGB_UNORM_BLOCK && format <= VK_FORMAT_BC7_SRGB_BLOCK;
+}
+
+/**
+ * @brief Bytes per 4x4 block of a compressed format, or per texel of
+ *        an uncompressed one. Zero for formats textures cannot use
+ */
+uint32_t block_bytes(VkFormat format) {
+  switch (format) {
+    case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+    case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+    case VK_FORMAT_BC4_UNORM_BLOCK:
+    case VK_FORMAT_BC4_SNORM_BLOCK:
+      return 8;
+    case VK_FORMAT_BC2_UNORM_BLOCK:
+    case VK_FORMAT_BC2_SRGB_BLOCK:
+    case VK_FORMAT_BC3_UNORM_BLOCK:
+    case VK_FORMAT_BC3_SRGB_BLOCK:
+    case VK_FORMAT_BC5_UNORM_BLOCK:
+    case VK_FORMAT_BC5_SNORM_BLOCK:
+    case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+    case VK_FORMAT_BC6H_SFLOAT_BLOCK:
+    case VK_FORMAT_BC7_UNORM_BLOCK:
+    case VK_FORMAT_BC7_SRGB_BLOCK:
+      return 16;
+    case VK_FORMAT_R8_UNORM:
+      return 1;
+    case VK_FORMAT_R8G8_UNORM:
+      return 2;
+    case VK_FORMAT_R8G8B8A8_UNORM:
+    case VK_FORMAT_R8G8B8A8_SRGB:
+    case VK_FORMAT_B8G8R8A8_UNORM:
+    case VK_FORMAT_B8G8R8A8_SRGB:
+      return 4;
+    case VK_FORMAT_R16G16B16A16_SFLOAT:
+      return 8;
+    case VK_FORMAT_R32G32B32A32_SFLOAT:
+      return 16;
+    default:
+      return 0;
+  }
+}
+
+size_t level_size(VkFormat format, VkExtent3D extent) {
+  if (is_block_compressed(format)) {
+    size_t blocks_x = std::max(1u, (extent.width + 3) / 4);
+    size_t blocks_y = std::max(1u, (extent.height + 3) / 4);
+    return blocks_x * blocks_y * block_bytes(format);
+  }
+  return size_t(extent.width) * extent.height * block_bytes(format);
+}
+
+// levels of a full mip chain down to 1x1
+uint32_t mip_count(VkExtent3D extent) {
+  uint32_t size = std::max(extent.width, extent.height);
+  uint32_t levels = 1;
+  while (size > 1) {
+    size >>= 1;
+    levels++;
+  }
+  return levels;
+}
+
+static VkExtent3D mip_extent(VkExtent3D extent, uint32_t level) {
+  return { std::max(1u, extent.width >> level), std::max(1u, extent.height >> level), 1 };
+}
+
+static bool is_srgb(VkFormat format) {
+  return format == VK_FORMAT_R8G8B8A8_SRGB || format == VK_FORMAT_B8G8R8A8_SRGB;
+}
+
+static float srgb_to_linear(uint8_t value) {
+  float c = value / 255.f;
+  return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+static uint8_t linear_to_srgb(float value) {
+  float c = value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.f / 2.4f) - 0.055f;
+  return static_cast<uint8_t>(std::clamp(c, 0.f, 1.f) * 255.f + 0.5f);
+}
+
+/**
+ * @brief Box filters the full mip chain of a single level 8 bit RGBA or
+ *        BGRA texture on the CPU, sRGB color is averaged in linear space.
+ *        Streamed textures need their small levels without the large one
+ *        on the GPU, so they cannot be blitted there
+ * @return false for compressed data, other formats and textures that 
+ *         already have mips
+ */
+bool build_mips(Texture_Data* texture) {
+  if (texture->levels.size() != 1 || block_bytes(texture->format) != 4 || texture->compressed()) {
+    return false;
+  }
+
+  bool srgb = is_srgb(texture->format);
+  float to_linear[256];
+  for (uint32_t i = 0; i < 256; i++) {
+    to_linear[i] = srgb ? srgb_to_linear(static_cast<uint8_t>(i)) : i / 255.f;
+  }
+
+  uint32_t levels = mip_count(texture->extent);
+  for (uint32_t level = 1; level < levels; level++) {
+    const Texture_Level parent = texture->levels[level - 1];
+    Texture_Level mip;
+    mip.extent = mip_extent(texture->extent, level);
+    mip.offset = texture->bytes.size();
+    mip.size = level_size(texture->format, mip.extent);
+    texture->bytes.resize(mip.offset + mip.size);
+
+    const uint8_t* src = texture->bytes.data() + parent.offset;
+    uint8_t* dst = texture->bytes.data() + mip.offset;
+    for (uint32_t y = 0; y < mip.extent.height; y++) {
+      for (uint32_t x = 0; x < mip.extent.width; x++) {
+        // odd sizes repeat the last row or column of the parent
+        uint32_t x0 = std::min(x * 2, parent.extent.width - 1);
+        uint32_t x1 = std::min(x * 2 + 1, parent.extent.width - 1);
+        uint32_t y0 = std::min(y * 2, parent.extent.height - 1);
+        uint32_t y1 = std::min(y * 2 + 1, parent.extent.height - 1);
+        const uint8_t* texels[4] = {
+          src + (y0 * parent.extent.width + x0) * 4,
+          src + (y0 * parent.extent.width + x1) * 4,
+          src + (y1 * parent.extent.width + x0) * 4,
+          src + (y1 * parent.extent.width + x1) * 4,
+        };
+
+        uint8_t* out = dst + (y * mip.extent.width + x) * 4;
+        for (uint32_t c = 0; c < 4; c++) {
+          // alpha is never sRGB encoded
+          bool linear = c == 3 || !srgb;
+          float sum = 0.f;
+          for (const uint8_t* texel : texels) {
+            sum += linear ? texel[c] / 255.f : to_linear[texel[c]];
+          }
+          float average = sum * 0.25f;
+          out[c] = linear ? static_cast<uint8_t>(average * 255.f + 0.5f) : linear_to_srgb(average);
+        }
+      }
+    }
+    texture->levels.push_back(mip);
+  }
+  return true;
+}
+
+/**
+ * @brief Copy of the levels from first_level down, the first of them
+ *        becomes level 0 of the result
+ */
+Texture_Data tail(const Texture_Data& texture, uint32_t first_level) {
+  Texture_Data result;
+  result.format = texture.format;
+  first_level = std::min(first_level, static_cast<uint32_t>(texture.levels.size()) - 1);
+  result.extent = texture.levels[first_level].extent;
+
+  for (uint32_t level = first_level; level < texture.levels.size(); level++) {
+    Texture_Level mip = texture.levels[level];
+    const uint8_t* src = texture.bytes.data() + mip.offset;
+    mip.offset = result.bytes.size();
+    result.bytes.insert(result.bytes.end(), src, src + mip.size);
+    result.levels.push_back(mip);
+  }
+  return result;
+}
+
+/**
+ * @brief Reads a KTX2 texture, supercompressed and Basis Universal payloads
+ *        need a transcoder and are rejected
+ */
+bool load_ktx2(const std::string& path, Texture_Data* texture) {
+  std::vector<uint8_t> file;
+  if (!read_file(path, &file)) {
+    return false;
+  }
+
+  Ktx2_Header header;
+  if (file.size() < sizeof(header)) {
+    fmt::println("{} is not a KTX2 file", path);
+    return false;
+  }
+  memcpy(&header, file.data(), sizeof(header));
+  if (memcmp(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0) {
+    fmt::println("{} is not a KTX2 file", path);
+    return false;
+  }
+  if (header.vk_format == VK_FORMAT_UNDEFINED || header.supercompression_scheme != 0) {
+    fmt::println("{} is supercompressed, only raw KTX2 payloads are supported", path);
+    return false;
+  }
+  if (header.pixel_width == 0) {
+    fmt::println("{} has no pixels", path);
+    return false;
+  }
+  if (header.pixel_depth > 1 || header.layer_count > 1 || header.face_count != 1) {
+    fmt::println("{} is not a 2D texture", path);
+    return false;
+  }
+
+  texture->format = static_cast<VkFormat>(header.vk_format);
+  texture->extent = { header.pixel_width, std::max(header.pixel_height, 1u), 1 };
+  if (level_size(texture->format, texture->extent) == 0) {
+    fmt::println("{} uses an unsupported pixel format", path);
+    return false;
+  }
+
+  // a level count of zero asks for the mips to be generated
+  uint32_t level_count = std::max(header.level_count, 1u);
+  if (level_count > mip_count(texture->extent)) {
+    fmt::println("{} has more mip levels than its size allows", path);
+    return false;
+  }
+  size_t index_end = sizeof(header) + level_count * sizeof(Ktx2_Level);
+  if (file.size() < index_end) {
+    fmt::println("{} has a truncated level index", path);
+    return false;
+  }
+
+  texture->levels.clear();
+  texture->bytes.clear();
+
+  for (uint32_t level = 0; level < level_count; level++) {
+    Ktx2_Level entry;
+    memcpy(&entry, file.data() + sizeof(header) + level * sizeof(Ktx2_Level), sizeof(entry));
+    // compared without sums, offsets near the top of the range would wrap
+    if (entry.byte_offset > file.size() || entry.byte_length > file.size() - entry.byte_offset) {
+      fmt::println("{} has a truncated mip level {}", path, level);
+      return false;
+    }
+
+    Texture_Level mip;
+    mip.offset = texture->bytes.size();
+    mip.extent = mip_extent(texture->extent, level);
+    mip.size = level_size(texture->format, mip.extent);
+    if (entry.byte_length != mip.size) {
+      fmt::println("{} mip level {} is {} bytes, expected {}", path, level, entry.byte_length, mip.size);
+      return false;
+    }
+    texture->levels.push_back(mip);
+    texture->bytes.insert(
+      texture->bytes.end(),
+      file.begin() + entry.byte_offset,
+      file.begin() + entry.byte_offset + entry.byte_length
+    );
+  }
+  return true;
+}
+
+/**
+ * @brief Reads a DDS texture with either a legacy FourCC or a DX10 header,
+ *        cube maps and arrays are rejected
+ */
+bool load_dds(const std::string& path, Texture_Data* texture) {
+  std::vector<uint8_t> file;
+  if (!read_file(path, &file)) {
+    return false;
+  }
+
+  uint32_t magic = 0;
+  Dds_Header header;
+  if (file.size() < sizeof(magic) + sizeof(header)) {
+    fmt::println("{} is not a DDS file", path);
+    return false;
+  }
+  memcpy(&magic, file.data(), sizeof(magic));
+  memcpy(&header, file.data() + sizeof(magic), sizeof(header));
+  if (magic != DDS_MAGIC || header.size != sizeof(Dds_Header)) {
+    fmt::println("{} is not a DDS file", path);
+    return false;
+  }
+  if (header.caps2 & DDSCAPS2_CUBEMAP) {
+    fmt::println("{} is a cube map, only 2D textures are supported", path);
+    return false;
+  }
+
+  size_t offset = sizeof(magic) + sizeof(header);
+  VkFormat format = VK_FORMAT_UNDEFINED;
+  if ((header.pixel_format.flags & DDPF_FOURCC) && header.pixel_format.four_cc == four_cc('D', 'X', '1', '0')) {
+    Dds_Header_Dx10 dx10;
+    if (file.size() < offset + sizeof(dx10)) {
+      fmt::println("{} has a truncated DX10 header", path);
+      return false;
+    }
+    memcpy(&dx10, file.data() + offset, sizeof(dx10));
+    offset += sizeof(dx10);
+
+    if (dx10.resource_dimension != DDS_DIMENSION_TEXTURE2D || dx10.array_size > 1) {
+      fmt::println("{} is not a 2D texture", path);
+      return false;
+    }
+    format = dxgi_format(dx10.dxgi_format);
+  }
+  else {
+    format = legacy_dds_format(header.pixel_format);
+  }
+
+  if (format == VK_FORMAT_UNDEFINED) {
+    fmt::println("{} uses an unsupported pixel format", path);
+    return false;
+  }
+
+  if (header.width == 0 || header.height == 0) {
+    fmt::println("{} has no pixels", path);
+    return false;
+  }
+
+  texture->format = format;
+  texture->extent = { header.width, header.height, 1 };
+  texture->levels.clear();
+  texture->bytes.clear();
+
+  uint32_t level_count = std::max(header.mip_map_count, 1u);
+  if (level_count > mip_count(texture->extent)) {
+    fmt::println("{} has more mip levels than its size allows", path);
+    return false;
+  }
+  for (uint32_t level = 0; level < level_count; level++) {
+    Texture_Level mip;
+    mip.offset = texture->bytes.size();
+    mip.extent = mip_extent(texture->extent, level);
+    mip.size = level_size(format, mip.extent);
+    // compared without sums, sizes near the top of the range would wrap
+    if (offset > file.size() || mip.size > file.size() - offset) {
+      fmt::println("{} has a truncated mip level {}", path, level);
+      return false;
+    }
+
+    texture->levels.push_back(mip);
+    texture->bytes.insert(texture->bytes.end(), file.begin() + offset, file.begin() + offset + mip.size);
+    offset += mip.size;
+  }
+  return true;
+}
+
+/**
+ * @brief Decodes a PNG or JPEG into RGBA8, the mips are left to the GPU
+ * @param srgb false for data textures such as normal maps
+ */
+bool load_image(const std::string& path, bool srgb, Texture_Data* texture) {
+  int width, height, channels;
+  stbi_uc* pixels = stbi_load(path.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+  if (pixels == nullptr) {
+    fmt::println("failed to decode {}: {}", path, stbi_failure_reason());
+    return false;
+  }
+
+  texture->format = srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+  texture->extent = { static_cast<uint32_t>(width), static_cast<uint32_t>(height), 1 };
+
+  Texture_Level mip;
+  mip.offset = 0;
+  mip.size = level_size(texture->format, texture->extent);
+  mip.extent = texture->extent;
+  texture->levels = { mip };
+  texture->bytes.assign(pixels, pixels + mip.size);
+
+  stbi_image_free(pixels);
+  return true;
+}
+
+/**
+ * @brief Loads a texture with the reader matching its extension
+ */
+bool load(const std::string& path, bool srgb, Texture_Data* texture) {
+  std::string ext = extension(path);
+  if (ext == "ktx2") {
+    return load_ktx2(path, texture);
+  }
+  if (ext == "dds") {
+    return load_dds(path, texture);
+  }
+  return load_image(path, srgb, texture);
+}
+
+} // namespace vktexture
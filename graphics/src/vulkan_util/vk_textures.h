@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+#include <string>
+#include <vector>
+
+#include "vk_types.h"
+
+namespace vktexture
+{
+
+// one mip level of a texture, stored from the largest level down
+struct Texture_Level {
+  size_t     offset = 0;
+  size_t     size = 0;
+  VkExtent3D extent;
+};
+
+/**
+ * @brief Texel data of a 2D texture as it is copied into the image,
+ *        block compressed data is kept compressed. Array textures store
+ *        the levels of each layer one layer after another
+ */
+struct Texture_Data {
+  VkFormat                   format = VK_FORMAT_UNDEFINED;
+  VkExtent3D                 extent = { 0, 0, 1 };
+  uint32_t                   layers = 1;
+  std::vector<Texture_Level> levels;
+  std::vector<uint8_t>       bytes;
+
+  bool compressed() const;
+};
+
+bool is_block_compressed(VkFormat format);
+uint32_t block_bytes(VkFormat format);
+size_t level_size(VkFormat format, VkExtent3D extent);
+uint32_t mip_count(VkExtent3D extent);
+
+bool build_mips(Texture_Data* texture);
+Texture_Data tail(const Texture_Data& texture, uint32_t first_level);
+
+bool load_ktx2(const std::string& path, Texture_Data* texture);
+bool load_dds(const std::string& path, Texture_Data* texture);
+bool load_image(const std::string& path, bool srgb, Texture_Data* texture);
+bool load(const std::string& path, bool srgb, Texture_Data* texture);
+
+} // namespace vktexture
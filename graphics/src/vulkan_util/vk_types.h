@@ -10,6 +10,9 @@
 #include <array>
 #include <functional>
 #include <deque>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
 
 #include <vulkan/vulkan.h>
 #include <vulkan/vk_enum_string_helper.h>
@@ -26,6 +29,30 @@ struct AllocatedBuffer {
   VmaAllocation _allocation;
 };
 
+/**
+ * @brief completion token of an asynchronous submission, 
+ *        a value of zero is always complete
+ */
+struct Submit_Token {
+  uint64_t value = 0;
+};
+
+// mixes a value into a hash used as a structural cache key
+inline void hash_combine(uint64_t& seed, uint64_t value) {
+  seed ^= value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2);
+}
+
+// FNV-1a hash of a block of bytes, used for content stored on disk
+inline uint64_t hash_bytes(const void* data, size_t size) {
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  uint64_t hash = 14695981039346656037ull;
+  for (size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
 //< node_types
 //> intro
 #define VK_CHECK(x)                                                     \
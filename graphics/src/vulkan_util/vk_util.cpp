@@ -1,5 +1,17 @@
 #include "vk_util.h"
 
+#include <fmt/core.h>
+
+#include <cstdio>
+#include <filesystem>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 glm::mat4 vkutil::calc_render_matrix(const glm::vec3 camera_position,const int _frame_number) {
   glm::mat4 view = glm::translate(glm::mat4(1.f), camera_position);
 
@@ -11,4 +23,52 @@ glm::mat4 vkutil::calc_render_matrix(const glm::vec3 camera_position,const int _
   glm::mat4 mesh_matrix = projection * view * model;
 
   return mesh_matrix;
-}
\ No newline at end of file
+}
+/**
+ * @brief Writes a file next to its final path, syncs it to disk and renames
+ *        it over the previous file, so after a crash the path holds either
+ *        the old or the new contents in full
+ * @return false when the file could not be written, the old file is kept
+ */
+bool vkutil::write_file_atomic(const std::string& filepath, const std::vector<char>& data) {
+  std::string tmp_filepath = filepath + ".tmp";
+  FILE* file = std::fopen(tmp_filepath.c_str(), "wb");
+  if (file == nullptr) {
+    fmt::println("failed to open {} for writing", tmp_filepath);
+    return false;
+  }
+
+  bool written = std::fwrite(data.data(), 1, data.size(), file) == data.size() && std::fflush(file) == 0;
+  // the data has to reach the disk before the rename does
+#ifdef _WIN32
+  written = written && _commit(_fileno(file)) == 0;
+#else
+  written = written && fsync(fileno(file)) == 0;
+#endif
+  written = std::fclose(file) == 0 && written;
+
+  std::error_code error;
+  if (!written) {
+    fmt::println("failed to write {}", tmp_filepath);
+    std::filesystem::remove(tmp_filepath, error);
+    return false;
+  }
+
+  std::filesystem::rename(tmp_filepath, filepath, error);
+  if (error) {
+    fmt::println("failed to replace {}: {}", filepath, error.message());
+    std::filesystem::remove(tmp_filepath, error);
+    return false;
+  }
+
+#ifndef _WIN32
+  // the rename itself is only durable once the directory is synced
+  std::filesystem::path directory = std::filesystem::path(filepath).parent_path();
+  int directory_fd = open(directory.empty() ? "." : directory.c_str(), O_RDONLY);
+  if (directory_fd >= 0) {
+    fsync(directory_fd);
+    close(directory_fd);
+  }
+#endif
+  return true;
+}
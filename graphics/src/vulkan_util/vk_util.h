@@ -4,8 +4,13 @@
 #include <glm/glm.hpp>
 #include <glm/gtx/transform.hpp>
 
+#include <string>
+#include <vector>
+
 struct vkutil {
 
 static glm::mat4 calc_render_matrix(const glm::vec3 camera_position,const int _frame_number);
 
+static bool write_file_atomic(const std::string& filepath, const std::vector<char>& data);
+
 };